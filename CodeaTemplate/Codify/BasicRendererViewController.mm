@@ -1055,6 +1055,8 @@
     
     //Get the lua state and call draw or setup
     LuaState *scripting = [LuaState sharedInstance];        
+    [scripting pollThreads];
+    [scripting updateTasks:elapsedTime];
     if( renderManager.frameCount == 1 )
     {
         [scripting callSimpleFunction:@"setup"];                        
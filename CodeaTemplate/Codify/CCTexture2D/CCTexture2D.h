@@ -103,6 +103,18 @@ typedef enum {
 	
 } CCTexture2DPixelFormat;
 
+/** @typedef CCTexture2DMipmapMode
+ How mip levels are built for a texture
+ */
+typedef enum {
+	//! No mip levels
+	kCCTexture2DMipmap_None = 0,
+	//! 2x2 box filtered levels
+	kCCTexture2DMipmap_Box,
+	//! 2x2 box filtered levels, averaged in linear light
+	kCCTexture2DMipmap_Gamma,
+} CCTexture2DMipmapMode;
+
 //CLASS INTERFACES:
 
 /** CCTexture2D class.
@@ -123,9 +135,12 @@ typedef enum {
 								maxT_;
 	BOOL						hasPremultipliedAlpha_;
     BOOL                        antialiased_;
+    CCTexture2DMipmapMode       mipmaps_;
 }
 /** Intializes with a texture2d with data */
 - (id) initWithData:(const void*)data pixelFormat:(CCTexture2DPixelFormat)pixelFormat pixelsWide:(NSUInteger)width pixelsHigh:(NSUInteger)height contentSize:(CGSize)size;
+/** Intializes a texture2d from RGBA8888 pixels, packing them (with ordered dithering) to pixelFormat and building any mip levels */
+- (id) initWithRGBA8888Data:(const void*)data pixelFormat:(CCTexture2DPixelFormat)pixelFormat pixelsWide:(NSUInteger)width pixelsHigh:(NSUInteger)height contentSize:(CGSize)size mipmaps:(CCTexture2DMipmapMode)mipmaps premultiplied:(BOOL)premultiplied;
 
 /** These functions are needed to create mutable textures */
 - (void) releaseData:(void*)data;
@@ -153,6 +168,10 @@ typedef enum {
 @property(nonatomic,readwrite) GLfloat maxT;
 /** whether or not the texture has their Alpha premultiplied */
 @property(nonatomic,readonly) BOOL hasPremultipliedAlpha;
+/** how the texture's mip levels were built, kCCTexture2DMipmap_None if it has none */
+@property(nonatomic,readonly) CCTexture2DMipmapMode mipmaps;
+/** bytes of texture memory used by the texture, including its mip levels */
+@property(nonatomic,readonly) NSUInteger textureBytes;
 
 /** returns the content size of the texture in points */
 -(CGSize) contentSize;
@@ -177,6 +196,9 @@ Note that RGBA type textures will have their alpha premultiplied - use the blend
 /** Initializes a texture from a UIImage object */
 #ifdef __IPHONE_OS_VERSION_MAX_ALLOWED
 - (id) initWithImage:(UIImage *)uiImage;
+/** Initializes a texture from a UIImage object in pixelFormat (kCCTexture2DPixelFormat_Automatic for the default),
+ with mip levels built from its pixels if it is POT */
+- (id) initWithImage:(UIImage *)uiImage pixelFormat:(CCTexture2DPixelFormat)pixelFormat mipmaps:(CCTexture2DMipmapMode)mipmaps;
 #elif defined(__MAC_OS_X_VERSION_MAX_ALLOWED)
 - (id) initWithImage:(CGImageRef)cgImage;
 #endif
@@ -279,6 +301,14 @@ typedef struct _ccTexParams {
  */
 -(void) generateMipmap;
 
+/** Builds and uploads mip levels on the CPU from the RGBA8888 pixels the texture was created with,
+ box filtered (in linear light for kCCTexture2DMipmap_Gamma) with straight alpha colours weighted by alpha.
+ Each level is packed to the texture's pixel format after filtering; A8 textures get no levels.
+ Antialiased textures with mip levels use GL_LINEAR_MIPMAP_LINEAR.
+ It only works if the texture size is POT (power of 2) and does nothing otherwise.
+ */
+-(void) setMipmapsFromData:(const void*)data mode:(CCTexture2DMipmapMode)mode premultiplied:(BOOL)premultiplied;
+
 
 @end
 
@@ -305,6 +335,9 @@ typedef struct _ccTexParams {
  @since v0.8
  */
 +(CCTexture2DPixelFormat) defaultAlphaPixelFormat;
+
+/** returns the number of bytes a texel takes in format */
++(NSUInteger) bytesPerPixelForFormat:(CCTexture2DPixelFormat)format;
 @end
 
 
@@ -77,6 +77,7 @@ Copyright (C) 2008 Apple Inc. All Rights Reserved.
 #import "ccMacros.h"
 //#import "CCConfiguration.h"
 #import "ccUtils.h"
+#import "blit.h"
 //#import "CCTexturePVR.h"
 
 #if defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && CC_FONT_LABEL_SUPPORT
@@ -104,10 +105,49 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 #pragma mark -
 #pragma mark CCTexture2D - Main
 
+//Uploads one level of texels in pixelFormat to the bound texture
+static void ccTexImage2D(GLint level, CCTexture2DPixelFormat pixelFormat, NSUInteger width, NSUInteger height, const void* data)
+{
+	switch(pixelFormat)
+	{
+		case kCCTexture2DPixelFormat_RGBA8888:
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, (GLsizei) width, (GLsizei) height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			break;
+		case kCCTexture2DPixelFormat_RGBA4444:
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, (GLsizei) width, (GLsizei) height, 0, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, data);
+			break;
+		case kCCTexture2DPixelFormat_RGB5A1:
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, (GLsizei) width, (GLsizei) height, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, data);
+			break;
+		case kCCTexture2DPixelFormat_RGB565:
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, (GLsizei) width, (GLsizei) height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, data);
+			break;
+		case kCCTexture2DPixelFormat_A8:
+			glTexImage2D(GL_TEXTURE_2D, level, GL_ALPHA, (GLsizei) width, (GLsizei) height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, data);
+			break;
+		default:
+			[NSException raise:NSInternalInconsistencyException format:@""];
+			
+	}
+}
+
+//The packing kernel for a format with fewer bits than RGBA8888
+static blit_format ccBlitFormat(CCTexture2DPixelFormat pixelFormat)
+{
+	switch(pixelFormat)
+	{
+		case kCCTexture2DPixelFormat_RGBA4444:	return BLIT_RGBA4444;
+		case kCCTexture2DPixelFormat_RGB5A1:	return BLIT_RGB5A1;
+		case kCCTexture2DPixelFormat_RGB565:	return BLIT_RGB565;
+		default:								return BLIT_A8;
+	}
+}
+
 @implementation CCTexture2D
 
 @synthesize contentSizeInPixels = size_, scale = scale_, pixelFormat = format_, pixelsWide = width_, pixelsHigh = height_, name = name_, maxS = maxS_, maxT = maxT_;
 @synthesize hasPremultipliedAlpha = hasPremultipliedAlpha_;
+@synthesize mipmaps = mipmaps_;
 
 - (id) initWithData:(const void*)data pixelFormat:(CCTexture2DPixelFormat)pixelFormat pixelsWide:(NSUInteger)width pixelsHigh:(NSUInteger)height contentSize:(CGSize)size
 {
@@ -116,28 +156,7 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 		glBindTexture(GL_TEXTURE_2D, name_);
 
 		// Specify OpenGL texture image
-		
-		switch(pixelFormat)
-		{
-			case kCCTexture2DPixelFormat_RGBA8888:
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei) width, (GLsizei) height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-				break;
-			case kCCTexture2DPixelFormat_RGBA4444:
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei) width, (GLsizei) height, 0, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, data);
-				break;
-			case kCCTexture2DPixelFormat_RGB5A1:
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei) width, (GLsizei) height, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, data);
-				break;
-			case kCCTexture2DPixelFormat_RGB565:
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, (GLsizei) width, (GLsizei) height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, data);
-				break;
-			case kCCTexture2DPixelFormat_A8:
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, (GLsizei) width, (GLsizei) height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, data);
-				break;
-			default:
-				[NSException raise:NSInternalInconsistencyException format:@""];
-				
-		}
+		ccTexImage2D(0, pixelFormat, width, height, data);
 
         scale_ = scale_==0?1.0f:scale_;        
 		size_ = size;
@@ -155,6 +174,35 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 	return self;
 }
 
+- (id) initWithRGBA8888Data:(const void*)data pixelFormat:(CCTexture2DPixelFormat)pixelFormat pixelsWide:(NSUInteger)width pixelsHigh:(NSUInteger)height contentSize:(CGSize)size mipmaps:(CCTexture2DMipmapMode)mipmaps premultiplied:(BOOL)premultiplied
+{
+	void* texels = (void*)data;
+	
+	if( pixelFormat != kCCTexture2DPixelFormat_RGBA8888 )
+	{
+		texels = malloc(width * height * [CCTexture2D bytesPerPixelForFormat:pixelFormat]);
+		blit_pack(texels, data, width, height, ccBlitFormat(pixelFormat), YES);
+	}
+	
+	if((self = [self initWithData:texels pixelFormat:pixelFormat pixelsWide:width pixelsHigh:height contentSize:size])) {
+		[self setMipmapsFromData:data mode:mipmaps premultiplied:premultiplied];
+	}
+	
+	if( texels != data )
+	{
+		free(texels);
+	}
+	return self;
+}
+
+- (NSUInteger) textureBytes
+{
+	NSUInteger bytes = width_ * height_ * [CCTexture2D bytesPerPixelForFormat:format_];
+	
+	//A full chain of levels adds a third
+	return mipmaps_ ? bytes + bytes / 3 : bytes;
+}
+
 - (void) releaseData:(void*)data
 {
 	//Free data
@@ -197,6 +245,11 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 @implementation CCTexture2D (Image)
 #ifdef __IPHONE_OS_VERSION_MAX_ALLOWED
 - (id) initWithImage:(UIImage *)uiImage
+{
+    return [self initWithImage:uiImage pixelFormat:kCCTexture2DPixelFormat_Automatic mipmaps:kCCTexture2DMipmap_None];
+}
+
+- (id) initWithImage:(UIImage *)uiImage pixelFormat:(CCTexture2DPixelFormat)preferredFormat mipmaps:(CCTexture2DMipmapMode)mipmaps
 #elif defined(__MAC_OS_X_VERSION_MAX_ALLOWED)
 - (id) initWithImage:(CGImageRef)CGImage
 #endif
@@ -205,9 +258,6 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 	CGContextRef			context = nil;
 	void*					data = nil;;
 	CGColorSpaceRef			colorSpace;
-	void*					tempData;
-	unsigned int*			inPixel32;
-	unsigned short*			outPixel16;
 	BOOL					hasAlpha;
 	CGImageAlphaInfo		info;
 	CGSize					imageSize;
@@ -218,6 +268,9 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 #ifdef __IPHONE_OS_VERSION_MAX_ALLOWED
 	CGImageRef	CGImage = uiImage.CGImage;
     scale_ = uiImage.scale;
+#else
+	CCTexture2DPixelFormat	preferredFormat = kCCTexture2DPixelFormat_Automatic;
+	CCTexture2DMipmapMode	mipmaps = kCCTexture2DMipmap_None;
 #endif	    
 
 	if(CGImage == NULL) {
@@ -264,7 +317,7 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 
 	if(colorSpace) {
 		if(hasAlpha || bpp >= 8)
-			pixelFormat = defaultAlphaPixelFormat_;
+			pixelFormat = preferredFormat != kCCTexture2DPixelFormat_Automatic ? preferredFormat : defaultAlphaPixelFormat_;
 		else {
 			CCLOG(@"cocos2d: CCTexture2D: Using RGB565 texture since image has no alpha");
 			pixelFormat = kCCTexture2DPixelFormat_RGB565;
@@ -312,53 +365,14 @@ static CCTexture2DPixelFormat defaultAlphaPixelFormat_ = kCCTexture2DPixelFormat
 	CGContextTranslateCTM(context, 0, POTHigh - imageSize.height);
 	CGContextDrawImage(context, CGRectMake(0, 0, CGImageGetWidth(CGImage), CGImageGetHeight(CGImage)), CGImage);
 	
-	// Repack the pixel data into the right format
+	// Repack the pixel data into the right format (with ordered dithering for 16-bit formats), building
+	// any mip levels from the 32-bit pixels
 	
-	if(pixelFormat == kCCTexture2DPixelFormat_RGB565) {
-		//Convert "RRRRRRRRRGGGGGGGGBBBBBBBBAAAAAAAA" to "RRRRRGGGGGGBBBBB"
-		tempData = malloc(POTHigh * POTWide * 2);
-		inPixel32 = (unsigned int*)data;
-		outPixel16 = (unsigned short*)tempData;
-		for(unsigned int i = 0; i < POTWide * POTHigh; ++i, ++inPixel32)
-			*outPixel16++ = ((((*inPixel32 >> 0) & 0xFF) >> 3) << 11) | ((((*inPixel32 >> 8) & 0xFF) >> 2) << 5) | ((((*inPixel32 >> 16) & 0xFF) >> 3) << 0);
-		free(data);
-		data = tempData;
-		
-	}
-	else if (pixelFormat == kCCTexture2DPixelFormat_RGBA4444) {
-		//Convert "RRRRRRRRRGGGGGGGGBBBBBBBBAAAAAAAA" to "RRRRGGGGBBBBAAAA"
-		tempData = malloc(POTHigh * POTWide * 2);
-		inPixel32 = (unsigned int*)data;
-		outPixel16 = (unsigned short*)tempData;
-		for(unsigned int i = 0; i < POTWide * POTHigh; ++i, ++inPixel32)
-			*outPixel16++ = 
-			((((*inPixel32 >> 0) & 0xFF) >> 4) << 12) | // R
-			((((*inPixel32 >> 8) & 0xFF) >> 4) << 8) | // G
-			((((*inPixel32 >> 16) & 0xFF) >> 4) << 4) | // B
-			((((*inPixel32 >> 24) & 0xFF) >> 4) << 0); // A
-		
-		
-		free(data);
-		data = tempData;
-		
-	}
-	else if (pixelFormat == kCCTexture2DPixelFormat_RGB5A1) {
-		//Convert "RRRRRRRRRGGGGGGGGBBBBBBBBAAAAAAAA" to "RRRRRGGGGGBBBBBA"
-		tempData = malloc(POTHigh * POTWide * 2);
-		inPixel32 = (unsigned int*)data;
-		outPixel16 = (unsigned short*)tempData;
-		for(unsigned int i = 0; i < POTWide * POTHigh; ++i, ++inPixel32)
-			*outPixel16++ = 
-			((((*inPixel32 >> 0) & 0xFF) >> 3) << 11) | // R
-			((((*inPixel32 >> 8) & 0xFF) >> 3) << 6) | // G
-			((((*inPixel32 >> 16) & 0xFF) >> 3) << 1) | // B
-			((((*inPixel32 >> 24) & 0xFF) >> 7) << 0); // A
-		
-		
-		free(data);
-		data = tempData;
-	}
-	self = [self initWithData:data pixelFormat:pixelFormat pixelsWide:POTWide pixelsHigh:POTHigh contentSize:imageSize];
+	if(pixelFormat == kCCTexture2DPixelFormat_A8)
+		self = [self initWithData:data pixelFormat:pixelFormat pixelsWide:POTWide pixelsHigh:POTHigh contentSize:imageSize];
+	else
+		//Opaque images skip their alpha byte, so premultiplied averaging suits them too
+		self = [self initWithRGBA8888Data:data pixelFormat:pixelFormat pixelsWide:POTWide pixelsHigh:POTHigh contentSize:imageSize mipmaps:mipmaps premultiplied:YES];
 	
 	// should be after calling super init
 	hasPremultipliedAlpha_ = (info == kCGImageAlphaPremultipliedLast || info == kCGImageAlphaPremultipliedFirst);
@@ -727,6 +741,61 @@ static BOOL PVRHaveAlphaPremultiplied_ = NO;
 	ccglGenerateMipmap(GL_TEXTURE_2D);
 }
 
+-(void) setMipmapsFromData:(const void*)data mode:(CCTexture2DMipmapMode)mode premultiplied:(BOOL)premultiplied
+{
+    if( mode == kCCTexture2DMipmap_None || format_ == kCCTexture2DPixelFormat_A8 ||
+        width_ != ccNextPOT(width_) || height_ != ccNextPOT(height_) )
+    {
+        return;
+    }
+    
+    //Each level only needs the one before, so they alternate between two buffers
+    NSUInteger w = width_, h = height_;
+    size_t first = MAX(w / 2, 1) * MAX(h / 2, 1) * 4;
+    uint8_t *levels = malloc(first + MAX(w / 4, 1) * MAX(h / 4, 1) * 4);
+    const uint8_t *src = data;
+    
+    //Levels are reduced at 32 bits and only packed on the way to GL
+    uint8_t *texels = NULL;
+    if( format_ != kCCTexture2DPixelFormat_RGBA8888 )
+    {
+        texels = malloc(first / 4 * [CCTexture2D bytesPerPixelForFormat:format_]);
+    }
+    
+    if( levels == NULL || (format_ != kCCTexture2DPixelFormat_RGBA8888 && texels == NULL) )
+    {
+        free(levels);
+        free(texels);
+        return;
+    }
+    
+    glBindTexture( GL_TEXTURE_2D, name_ );
+    for( GLint level = 1; w > 1 || h > 1; level++ )
+    {
+        uint8_t *dst = (level & 1) ? levels : levels + first;
+        blit_downsample(dst, src, w, h, premultiplied, mode == kCCTexture2DMipmap_Gamma);
+        w = MAX(w / 2, 1);
+        h = MAX(h / 2, 1);
+        if( texels )
+        {
+            blit_pack(texels, dst, w, h, ccBlitFormat(format_), YES);
+        }
+        ccTexImage2D(level, format_, w, h, texels ? texels : dst);
+        src = dst;
+    }
+    free(levels);
+    free(texels);
+    
+    mipmaps_ = mode;
+    
+    //Reapply the filter so the min filter picks up the levels
+    if( antialiased_ )
+    {
+        antialiased_ = NO;
+        [self setAntiAliasTexParameters];
+    }
+}
+
 -(void) setTexParameters: (ccTexParams*) texParams
 {
 	NSAssert( (width_ == ccNextPOT(width_) && height_ == ccNextPOT(height_)) ||
@@ -760,7 +829,7 @@ static BOOL PVRHaveAlphaPremultiplied_ = NO;
 {
     if( !antialiased_ )
     {
-        ccTexParams texParams = { GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE };
+        ccTexParams texParams = { mipmaps_ ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE };
         
         if ((width_ == ccNextPOT(width_) && height_ == ccNextPOT(height_)))
         {
@@ -787,6 +856,16 @@ static BOOL PVRHaveAlphaPremultiplied_ = NO;
 	defaultAlphaPixelFormat_ = format;
 }
 
++(NSUInteger) bytesPerPixelForFormat:(CCTexture2DPixelFormat)format
+{
+	switch(format)
+	{
+		case kCCTexture2DPixelFormat_RGBA8888:	return 4;
+		case kCCTexture2DPixelFormat_A8:		return 1;
+		default:								return 2;
+	}
+}
+
 +(CCTexture2DPixelFormat) defaultAlphaPixelFormat
 {
 	return defaultAlphaPixelFormat_;
@@ -97,5 +97,11 @@ SYNTHESIZE_SINGLETON_FOR_CLASS_HEADER(LuaState);
 - (BOOL) callKeyboardFunction:(NSString*)newText;
 - (BOOL) callOrientationFunction:(int)newOrientation;
 
+//Delivers results from thread jobs to their callbacks
+- (void) pollThreads;
+
+//Resumes the scheduled tasks that are due at time (ElapsedTime)
+- (void) updateTasks:(double)time;
+
 - (void) disableInstructionLimit;
 @end
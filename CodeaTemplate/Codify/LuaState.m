@@ -55,7 +55,16 @@
 #import "Persistence.h"
 #import "image.h"
 #import "mesh.h"
+#import "tilemap.h"
 #import "soundbuffer.h"
+#import "profiler.h"
+#import "strbuf.h"
+#import "thread.h"
+#import "scheduler.h"
+#import "serialize.h"
+#import "buffer.h"
+#import "vecarray.h"
+#import "watchdog.h"
 
 #import <unistd.h>
 
@@ -65,7 +74,6 @@
 #define LuaRegNamedFunc(x,n)    lua_register(L,#n,x)
 
 const char* TooManyLinesError = "Lua program has exceeded instruction limit";
-int kMaxLineCount = 30000000;
 void TooManyLinesFunc(lua_State *L, lua_Debug *ar)
 {
     luaL_error(L, TooManyLinesError);
@@ -77,12 +85,29 @@ int setInstructionLimit(lua_State *L)
     if(n == 1)
     {
         lua_Number instructionCount = lua_tonumber(L, 1);
-        lua_sethook(L, &TooManyLinesFunc, LUA_MASKCOUNT, instructionCount);
+        profiler_sethook(L, &TooManyLinesFunc, LUA_MASKCOUNT, instructionCount);
     }
     
     return 0;
 }
 
+int setTimeLimit(lua_State *L)
+{
+    watchdog_setlimit(luaL_optnumber(L, 1, WATCHDOG_DEFAULTLIMIT));
+    return 0;
+}
+
+//Host entries into Lua run under the watchdog so a runaway setup, draw or
+//touched raises an error instead of hanging the app
+static int watchedpcall(lua_State *L, int nargs)
+{
+    int status;
+    watchdog_enter(L);
+    status = lua_pcall(L, nargs, 0, 0);
+    watchdog_leave(L);
+    return status;
+}
+
 
 ////////////////////////////////////////////////
 //Custom Lua environment
@@ -116,8 +141,16 @@ static const luaL_Reg codifylibs[] =
     {CODIFY_CONTACT_LIBNAME, luaopen_contact},
     {CODIFY_JOINT_LIBNAME, luaopen_joint},
     {CODIFY_MESH_LIBNAME, luaopen_mesh},
+    {CODIFY_TILEMAPLIBNAME, luaopen_tilemap},
     {CODIFY_IMAGELIBNAME, luaopen_image},    
     {CODIFY_SOUNDBUFFERLIBNAME, luaopen_soundbuffer},
+    {CODIFY_STRBUFLIBNAME, luaopen_strbuf},
+    {CODIFY_PROFILERLIBNAME, luaopen_profiler},
+    {CODIFY_THREADLIBNAME, luaopen_thread},
+    {CODIFY_SCHEDULERLIBNAME, luaopen_scheduler},
+    {CODIFY_SERIALIZELIBNAME, luaopen_serialize},
+    {CODIFY_BUFFERLIBNAME, luaopen_buffer},
+    {CODIFY_VECARRAYLIBNAME, luaopen_vecarray},
 
     {NULL, NULL}
 };
@@ -134,6 +167,42 @@ LUALIB_API void codify_openlibs (lua_State *L)
     }
 }
 ////////////////////////////////////////////////
+//Pure computation libraries for thread jobs (no rendering, sound or IO)
+static const luaL_Reg workerlibs[] = 
+{
+    {"", luaopen_base},
+    {LUA_TABLIBNAME, luaopen_table},
+    {LUA_STRLIBNAME, luaopen_string},
+    {LUA_MATHLIBNAME, luaopen_math},
+    
+    {CODIFY_COLORLIBNAME, luaopen_color},
+    {CODIFY_VEC2LIBNAME, luaopen_vec2},           
+    {CODIFY_VEC3LIBNAME, luaopen_vec3},   
+    {CODIFY_VEC4LIBNAME, luaopen_vec4},
+    {CODIFY_MATRIX44LIBNAME, luaopen_matrix44}, 
+    {CODIFY_STRBUFLIBNAME, luaopen_strbuf},
+    {CODIFY_SERIALIZELIBNAME, luaopen_serialize},
+    {CODIFY_BUFFERLIBNAME, luaopen_buffer},
+    {CODIFY_VECARRAYLIBNAME, luaopen_vecarray},
+    
+    {NULL, NULL}
+};
+
+static int codify_openworkerlibs (lua_State *L) 
+{
+    const luaL_Reg *lib = workerlibs;
+    for (; lib->func; lib++) 
+    {
+        lua_pushcfunction(L, lib->func);
+        lua_pushstring(L, lib->name);
+        lua_call(L, 1, 0);
+    }
+    
+    LuaRegFunc(noise);
+    LuaRegFunc(rsqrt);
+    return 0;
+}
+////////////////////////////////////////////////
 //Dud function
 static int dud_void_function(lua_State* state)
 {
@@ -251,9 +320,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     luaError.lineNumber = NSNotFound;
     luaError.referringLine = NSNotFound;
     
-    lua_sethook(L, &TooManyLinesFunc, LUA_MASKCOUNT, kMaxLineCount);
-    
-    if( luaL_loadstring(L, [string UTF8String]) || lua_pcall(L,0,0,0) )
+    if( luaL_loadstring(L, [string UTF8String]) || watchedpcall(L,0) )
     {
         //[self printErrors:1];    
         
@@ -401,7 +468,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     }
     else
     {
-        [self printErrors:lua_pcall(L, 0, 0, 0)];
+        [self printErrors:watchedpcall(L, 0)];
         
         return YES;
     }    
@@ -409,8 +476,6 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
 
 - (BOOL) callSimpleFunction:(NSString*)funcName
 {
-    //lua_sethook(L, &TooManyLinesFunc, LUA_MASKCOUNT, kMaxLineCount);
-
     lua_getglobal(L, [funcName UTF8String]);
     if( !lua_isfunction(L, -1) )
     {
@@ -422,12 +487,30 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     }
     else
     {
-        [self printErrors:lua_pcall(L, 0, 0, 0)];
+        [self printErrors:watchedpcall(L, 0)];
         
         return YES;
     }
 }
 
+- (void) pollThreads
+{
+    int status;
+    watchdog_enter(L);
+    status = thread_poll(L);
+    watchdog_leave(L);
+    [self printErrors:status];
+}
+
+- (void) updateTasks:(double)time
+{
+    int status;
+    watchdog_enter(L);
+    status = scheduler_tick(L, time);
+    watchdog_leave(L);
+    [self printErrors:status];
+}
+
 - (BOOL) callKeyboardFunction:(NSString*)newText
 {
     lua_getglobal(L, "keyboard");
@@ -439,7 +522,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     else
     {
         lua_pushstring(L, [newText UTF8String]);
-        [self printErrors:lua_pcall(L, 1, 0, 0)];
+        [self printErrors:watchedpcall(L, 1)];
         
         return YES;
     }
@@ -456,7 +539,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     else
     {
         lua_pushinteger(L, newOrientation);
-        [self printErrors:lua_pcall(L, 1, 0, 0)];
+        [self printErrors:watchedpcall(L, 1)];
         
         return YES;
     }    
@@ -511,7 +594,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
             v->deltaX = v->x - v->prevX;
             v->deltaY = v->y - v->prevY;        
 
-            [self printErrors:lua_pcall(L, 1, 0, 0)];
+            [self printErrors:watchedpcall(L, 1)];
             
             lua_getglobal(L, "touched");
         }        
@@ -525,7 +608,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
 
 - (void) disableInstructionLimit
 {
-    lua_sethook(L, NULL, 0, 0);    
+    profiler_sethook(L, NULL, 0, 0);    
 }
 
 #pragma mark - State management
@@ -543,8 +626,10 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     
     //Load only a subset of Lua libs
     codify_openlibs(L);
+    thread_setopenlibs(codify_openworkerlibs);
 
     LuaRegFunc(setInstructionLimit);
+    LuaRegFunc(setTimeLimit);
     
     //Push the render functions
     LuaRegFunc(background);
@@ -703,6 +788,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     codify_openlibs(L);
 
     LuaDudFunc(setInstructionLimit);
+    LuaDudFunc(setTimeLimit);
     
     //Push the render functions
     LuaDudFunc(background);
@@ -833,9 +919,6 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(LuaState);
     //Device Commands
     LuaRegFunc(deviceMetrics);    
     
-    //Set instruction for initial parse
-    lua_sethook(L, &TooManyLinesFunc, LUA_MASKCOUNT, kMaxLineCount);    
-    
     //Setup library globals
     setupDisplayGlobals(self);
     setupSoundGlobals(self);    
@@ -27,6 +27,7 @@
 #import <CoreGraphics/CoreGraphics.h>
 
 #import "image.h"
+#import "strbuf.h"
 #import "lauxlib.h"
 #import "SpriteManager.h"
 #import "UIImage+Resize.h"
@@ -319,6 +320,22 @@ BOOL has_nulls(const char* str, size_t len)
     return NO;
 }
 
+//Text is saved as an NSString; bytes that can't be one, like serialize.encode
+//output, are saved as NSData and read back as the same Lua string
+static NSObject* valueFromBytes(const char* bytes, size_t len)
+{
+    if (!has_nulls(bytes, len))
+    {
+        NSString* nsValue = [[[NSString alloc] initWithBytes:(len ? bytes : "") length:len encoding:NSUTF8StringEncoding] autorelease];
+        if (nsValue != nil)
+        {
+            return nsValue;
+        }
+    }
+    
+    return [NSData dataWithBytes:bytes length:len];
+}
+
 
 //May not return if error is cause
 int saveData(lua_State *L, NSMutableDictionary* saveToDict)
@@ -368,15 +385,14 @@ int saveData(lua_State *L, NSMutableDictionary* saveToDict)
         size_t valueLen = 0;
         const char* value = lua_tolstring(L, 2, &valueLen);
         
-        if (has_nulls(value, valueLen)) 
-        {
-            luaL_error(L, "value cannot have null characters");
-            return 0;
-        }
+        [saveToDict setObject:valueFromBytes(value, valueLen) forKey:nsKey];
+    }
+    else if(getstrbuf(L, 2) != NULL)
+    {
+        //Saved straight from the buffer, without interning it as a Lua string first
+        strbuf_type* value = getstrbuf(L, 2);
         
-        NSString* nsValue = [NSString stringWithCString:value encoding:NSUTF8StringEncoding];
-        //[[NSUserDefaults standardUserDefaults] setObject:nsValue forKey:nsKey];
-        [saveToDict setObject:nsValue forKey:nsKey];
+        [saveToDict setObject:valueFromBytes(value->data, value->len) forKey:nsKey];
     }
     else if(lua_isnil(L, 2))
     {
@@ -384,7 +400,7 @@ int saveData(lua_State *L, NSMutableDictionary* saveToDict)
     }
     else
     {
-        luaL_error(L, "Can only save a string or a number or nil");
+        luaL_error(L, "Can only save a string, strbuf, number or nil");
         return 0;
     }
     
@@ -456,6 +472,12 @@ int readData(lua_State *L, NSDictionary* readFromDict)
         lua_pushnumber(L, num);
         return 1;
     }
+    else if([value isKindOfClass:[NSData class]])
+    {
+        NSData* data = (NSData*)value;
+        lua_pushlstring(L, (const char*)[data bytes], [data length]);
+        return 1;
+    }
     
     
     luaL_error(L, "Value for key cannot be read (but it exists)");
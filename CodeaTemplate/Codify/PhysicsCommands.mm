@@ -31,6 +31,7 @@ extern "C" {
 #import "vec3.h"
 #import "object_reg.h"
 #import "body.h"
+#import "codea_luaext.h"
 #ifdef __cplusplus
 }
 #endif    
@@ -234,20 +235,22 @@ int raycastAll(struct lua_State *L)
         RaycastAllCallback callback;
         callback.L = L;
         
-        // If there are more than 2 arguments, treat the rest as filter categories
-        if (n > 2)
+        // An optional third table argument is cleared and filled instead of a new table
+        int firstCategory = lua_istable(L, 3) ? 4 : 3;
+        
+        // If there are more arguments, treat the rest as filter categories
+        if (n >= firstCategory)
         {
             uint16 maskBits = 0;
-            for (int i = 3; i <= n; i++)
+            for (int i = firstCategory; i <= n; i++)
             {
                 // Make sure bit shifts are clamped in range of 16 bit integer            
-                luaL_checknumber(L, i);
-                maskBits |= 1 << MAX(MIN(luaL_checkinteger(L, -1), 15), 0);
+                maskBits |= 1 << MAX(MIN(luaL_checkinteger(L, i), 15), 0);
             }   
             callback.m_maskBits = maskBits;            
         }
         
-        lua_newtable(L);        
+        pushresulttable(L, 3, 0);
         physicsAPI.world->RayCast(&callback, point1, point2);        
         return 1;
     }    
@@ -319,7 +322,7 @@ int raycast(struct lua_State *L)
 int queryAABB(struct lua_State *L)
 {
     int n = lua_gettop(L);
-    if (n == 2)
+    if (n == 2 || n == 3)
     {
         lua_Number* v1 = checkvec2(L, 1);
         lua_Number* v2 = checkvec2(L, 2);
@@ -334,7 +337,7 @@ int queryAABB(struct lua_State *L)
         QueryCallback callback;
         callback.L = L;
         
-        lua_newtable(L);        
+        pushresulttable(L, 3, 0);
         physicsAPI.world->QueryAABB(&callback, aabb);
         return 1;
     }        
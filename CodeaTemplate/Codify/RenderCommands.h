@@ -84,6 +84,7 @@ int text(struct lua_State *L);
 int point(struct lua_State *L);
 int line(struct lua_State *L);
 int drawMesh(struct lua_State *L);
+int drawTilemap(struct lua_State *L);
     
 int setContext(struct lua_State *L);     
     
@@ -48,11 +48,14 @@ extern "C" {
     #import "image.h"
     #import "mesh.h"
     #import "vec2.h"
+    #import "codea_luaext.h"
 #ifdef __cplusplus
 }
 #endif    
 
 #import "matrix44.h"
+#import "tilemap.h"
+#include "tilegrid.h"
 
 RenderManager *renderAPI;
 
@@ -1649,7 +1652,14 @@ int drawMesh(struct lua_State *L)
         
         if (colored)
         {
-            [renderAPI setAttributeNamed:@"Color" withPointer:m2d->colors.buffer size:m2d->colors.elementSize andType:GL_FLOAT];    
+            if (m2d->packedColors)
+            {
+                [renderAPI setAttributeNamed:@"Color" withPointer:m2d->colors.buffer size:4 type:GL_UNSIGNED_BYTE normalized:YES];
+            }
+            else
+            {
+                [renderAPI setAttributeNamed:@"Color" withPointer:m2d->colors.buffer size:m2d->colors.elementSize andType:GL_FLOAT];    
+            }
         }        
         
         if (textured)
@@ -1699,6 +1709,67 @@ int drawMesh(struct lua_State *L)
     return 1;
 }
 
+//Culls the chunks against the current transform and draws each visible one with a single call,
+//rebuilding it first if its tiles changed
+int drawTilemap(struct lua_State *L)
+{
+    tilemap_type* map = checkTilemap(L, 1);
+    CCTexture2D* texture = nil;
+    BOOL spriteMode = NO;
+    
+    //Need to set blend mode before useShader for cache reasons
+    if( map->image )
+    {
+        updateImageTextureIfRequired(map->image);
+        texture = map->image->texture;
+        [renderAPI setBlendMode:map->image->premultiplied ? BLEND_MODE_PREMULT : BLEND_MODE_NORMAL];
+    }
+    else if( map->texture )
+    {
+        texture = map->texture;
+        spriteMode = YES;
+        [renderAPI setBlendMode:BLEND_MODE_PREMULT];
+    }
+    
+    map->drawnChunks = 0;
+    if( texture == nil )
+    {
+        return 0;
+    }
+    
+    Shader *shader = [renderAPI useShader:@"MeshFillColorTexture"];
+    glUniform1i([shader uniformLocation:@"ColorTexture"], 0);
+    glUniform1i([shader uniformLocation:@"SpriteMode"], spriteMode);
+    
+    if( renderAPI.smooth )
+    {
+        [texture setAntiAliasTexParameters];
+    }
+    else
+    {
+        [texture setAliasTexParameters];
+    }
+    [renderAPI setActiveTexture:GL_TEXTURE0];
+    [renderAPI useTexture:texture.name];
+    
+    static std::vector<int> visible;
+    map->grid->visibleChunks(renderAPI.modelViewMatrix, visible);
+    for( size_t i = 0; i < visible.size(); i++ )
+    {
+        const TileGrid::Chunk& chunk = map->grid->chunk(visible[i]);
+        
+        if( chunk.vertexCount() > 0 )
+        {
+            [renderAPI setAttributeNamed:@"Vertex" withPointer:&chunk.vertices[0] size:2 andType:GL_FLOAT];
+            [renderAPI setAttributeNamed:@"TexCoord" withPointer:&chunk.texCoords[0] size:2 andType:GL_FLOAT];
+            glDrawArrays(GL_TRIANGLES, 0, chunk.vertexCount());
+            map->drawnChunks++;
+        }
+    }
+    
+    return 0;
+}
+
 int setContext(struct lua_State *L)
 {
     int n = lua_gettop(L);
@@ -1891,7 +1962,7 @@ int triangulate(struct lua_State *L)
         int triCount = TriangulatePolygon(trX, trY, n, triangles);
         if (triCount > 0)
         {
-            lua_createtable(L, triCount*3, 0);
+            pushresulttable(L, 2, triCount*3);
             int count = 1;
             for (int i = 1; i <= triCount; i++)
             {
@@ -1904,6 +1975,11 @@ int triangulate(struct lua_State *L)
             }  
             return 1;
         }
+        else if (lua_istable(L, 2))
+        {
+            //A reused result table must not keep the last call's triangles
+            lua_cleartable(L, 2);
+        }
     }
     return 0;
 }
@@ -206,6 +206,7 @@ typedef std::map<GLuint, std::set<GLuint> > AttribLocCache;
 
 #pragma mark - Attributes
 - (void) setAttributeNamed:(NSString*)name withPointer:(const GLvoid*)ptr size:(GLint)size andType:(GLenum)type;
+- (void) setAttributeNamed:(NSString*)name withPointer:(const GLvoid*)ptr size:(GLint)size type:(GLenum)type normalized:(BOOL)normalized;
 - (void) disableAttributeNamed:(NSString*)name;
 
 #pragma mark - Transform
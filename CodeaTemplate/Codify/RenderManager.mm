@@ -356,13 +356,19 @@ int printOglError(const char *file, int line)
 }
 
 - (void) setAttributeNamed:(NSString*)name withPointer:(const GLvoid*)ptr size:(GLint)size andType:(GLenum)type
+{
+    [self setAttributeNamed:name withPointer:ptr size:size type:type normalized:NO];
+}
+
+//Normalized integer attributes (such as RGBA8 colors) arrive in the shader as 0-1 floats
+- (void) setAttributeNamed:(NSString*)name withPointer:(const GLvoid*)ptr size:(GLint)size type:(GLenum)type normalized:(BOOL)normalized
 {
     Shader *current = [[ShaderManager sharedManager] currentShader];
     
     if( current )
     {
         GLuint loc = [current attributeHandle:name];
-        glVertexAttribPointer(loc, size, type, 0, 0, ptr);
+        glVertexAttribPointer(loc, size, type, normalized ? GL_TRUE : GL_FALSE, 0, ptr);
         
         AttribLocCache::iterator ait = shaderActiveAttribs.find( current.programHandle );
         
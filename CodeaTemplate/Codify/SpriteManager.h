@@ -39,6 +39,10 @@ void createDropboxPath();
 - (BOOL) deleteSpriteAtIndex:(NSUInteger)index;
 - (BOOL) deleteSpritesAtIndices:(NSIndexSet*)set;
 
+//The "TextureFormat" hint from the pack's Info.plist (RGBA8888, RGBA4444, RGB5A1, RGB565 or A8)
+//Packs without one use kCCTexture2DPixelFormat_Automatic
+- (CCTexture2DPixelFormat) textureFormat;
+
 @property (nonatomic, assign) BOOL userPack;
 
 @end
@@ -62,6 +66,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS_HEADER(SpriteManager);
 - (void) createLookupCache;
 
 - (CCTexture2D*) spriteTextureFromString:(NSString*)spriteString;
+- (CCTexture2D*) spriteTextureFromString:(NSString*)spriteString mipmaps:(CCTexture2DMipmapMode)mipmaps;
 
 - (UIImage*) spriteImageFromString:(NSString*)spriteString;
 - (UIImage*) spriteImageFromStringUncached:(NSString*)spriteString;
@@ -90,6 +90,24 @@
     }
 }
 
+- (CCTexture2DPixelFormat) textureFormat
+{
+    NSString *format = [self.info objectForKey:@"TextureFormat"];
+    
+    if( [format isEqualToString:@"RGBA8888"] )
+        return kCCTexture2DPixelFormat_RGBA8888;
+    if( [format isEqualToString:@"RGBA4444"] )
+        return kCCTexture2DPixelFormat_RGBA4444;
+    if( [format isEqualToString:@"RGB5A1"] )
+        return kCCTexture2DPixelFormat_RGB5A1;
+    if( [format isEqualToString:@"RGB565"] )
+        return kCCTexture2DPixelFormat_RGB565;
+    if( [format isEqualToString:@"A8"] )
+        return kCCTexture2DPixelFormat_A8;
+    
+    return kCCTexture2DPixelFormat_Automatic;
+}
+
 - (NSString*) spriteNameAtIndex:(NSUInteger)index
 {
     NSString *spriteName = [self fileNameAtIndex:index];
@@ -197,6 +215,11 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(SpriteManager);
 }
 
 - (CCTexture2D*) spriteTextureFromString:(NSString*)spriteString
+{
+    return [self spriteTextureFromString:spriteString mipmaps:kCCTexture2DMipmap_None];
+}
+
+- (CCTexture2D*) spriteTextureFromString:(NSString*)spriteString mipmaps:(CCTexture2DMipmapMode)mipmaps
 {
 //    NSString *relFile = [self relativeSpriteFileFromString:spriteString];
 //    
@@ -210,13 +233,16 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(SpriteManager);
     
     if (file)
     {
+        //A valid file means the pack name resolved
+        SpritePack *pack = [allPacks objectForKey:[[spriteString componentsSeparatedByString:@":"] objectAtIndex:0]];
+        
         if (relative)
         {
-            return [[TextureCache sharedInstance] textureForSprite:[@"SpritePacks" stringByAppendingPathComponent:file]];            
+            return [[TextureCache sharedInstance] textureForSprite:[@"SpritePacks" stringByAppendingPathComponent:file] pixelFormat:pack.textureFormat mipmaps:mipmaps];            
         }
         else
         {
-            return [[TextureCache sharedInstance] textureForSprite:file];            
+            return [[TextureCache sharedInstance] textureForSprite:file pixelFormat:pack.textureFormat mipmaps:mipmaps];            
         }
     }
     
@@ -29,6 +29,9 @@
 }
 
 - (CCTexture2D*) textureForSprite:(NSString*)relSpritePath;
+//Loads in pixelFormat (kCCTexture2DPixelFormat_Automatic for the default) the first time
+//Replaces the cached texture with a mipmapped one if it was loaded without them
+- (CCTexture2D*) textureForSprite:(NSString*)relSpritePath pixelFormat:(CCTexture2DPixelFormat)pixelFormat mipmaps:(CCTexture2DMipmapMode)mipmaps;
 - (void) flushUnusedTextures;
 - (void) flushTextures;
 
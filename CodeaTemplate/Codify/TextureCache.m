@@ -21,6 +21,15 @@
 
 #import "TextureCache.h"
 
+//Only POT textures with colour take mip levels, so others are never reloaded for them
+static BOOL needsMipmaps(CCTexture2D *texture, CCTexture2DMipmapMode mipmaps)
+{
+    NSUInteger w = texture.pixelsWide, h = texture.pixelsHigh;
+    
+    return mipmaps != kCCTexture2DMipmap_None && texture.mipmaps != mipmaps &&
+           texture.pixelFormat != kCCTexture2DPixelFormat_A8 && (w & (w - 1)) == 0 && (h & (h - 1)) == 0;
+}
+
 @implementation TextureCache
 
 SYNTHESIZE_SINGLETON_FOR_CLASS(TextureCache);
@@ -44,10 +53,15 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(TextureCache);
 }
 
 - (CCTexture2D*) textureForSprite:(NSString*)relSpritePath
+{
+    return [self textureForSprite:relSpritePath pixelFormat:kCCTexture2DPixelFormat_Automatic mipmaps:kCCTexture2DMipmap_None];
+}
+
+- (CCTexture2D*) textureForSprite:(NSString*)relSpritePath pixelFormat:(CCTexture2DPixelFormat)pixelFormat mipmaps:(CCTexture2DMipmapMode)mipmaps
 {
     CCTexture2D *texture = [loadedTextures objectForKey:relSpritePath];
     
-    if( texture == nil )
+    if( texture == nil || needsMipmaps(texture, mipmaps) )
     {
         //load it
         //using image named to trigger caching
@@ -58,7 +72,7 @@ SYNTHESIZE_SINGLETON_FOR_CLASS(TextureCache);
             image = [UIImage imageWithContentsOfFile:relSpritePath];
         }
         
-        texture = [[[CCTexture2D alloc] initWithImage:image] autorelease];
+        texture = [[[CCTexture2D alloc] initWithImage:image pixelFormat:pixelFormat mipmaps:mipmaps] autorelease];
         
         //store it
         [loadedTextures setObject:texture forKey:relSpritePath];        
@@ -584,6 +584,16 @@ LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
 }
 
 
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  StkId t;
+  lua_lock(L);
+  t = index2adr(L, idx);
+  api_check(L, ttistable(t));
+  luaH_clear(L, hvalue(t));
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_getmetatable (lua_State *L, int objindex) {
   const TValue *obj;
   Table *mt = NULL;
@@ -948,6 +958,26 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       g->gcstepmul = data;
       break;
     }
+    case LUA_GCGEN: {  /* change collector to generational mode */
+      res = (g->gckind == KGC_GEN);
+      luaC_changemode(L, KGC_GEN);
+      break;
+    }
+    case LUA_GCINC: {  /* change collector to incremental mode */
+      res = (g->gckind == KGC_GEN);
+      luaC_changemode(L, KGC_NORMAL);
+      break;
+    }
+    case LUA_GCSETMINORMUL: {
+      res = g->gcminormul;
+      g->gcminormul = data;
+      break;
+    }
+    case LUA_GCSETMAJORMUL: {
+      res = g->gcmajormul;
+      g->gcmajormul = data;
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
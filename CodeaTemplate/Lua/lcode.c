@@ -837,3 +837,42 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** Superinstructions: once a function is complete, mark pairs that
+** Codea scripts run constantly (`self.a.b' and `obj:method()') so the
+** VM executes both with a single dispatch.
+*/
+void luaK_fuse (FuncState *fs) {
+  Proto *f = fs->f;
+  int pc;
+  for (pc = 0; pc < fs->pc - 1; pc++) {
+    Instruction *i = &f->code[pc];
+    switch (GET_OPCODE(*i)) {
+      case OP_GETTABLE: {
+        if (GET_OPCODE(*(i+1)) == OP_GETTABLE) {
+          SET_OPCODE(*i, OP_GETTABLE2);
+          pc++;
+        }
+        break;
+      }
+      case OP_SELF: {
+        if (GET_OPCODE(*(i+1)) == OP_CALL) {
+          SET_OPCODE(*i, OP_SELFCALL);
+          pc++;
+        }
+        break;
+      }
+      case OP_SETLIST: {
+        if (GETARG_C(*i) == 0) pc++;  /* skip the count */
+        break;
+      }
+      case OP_CLOSURE: {
+        pc += f->p[GETARG_Bx(*i)]->nups;  /* skip pseudo-instructions */
+        break;
+      }
+      default: break;
+    }
+  }
+}
@@ -326,6 +326,12 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
     int b = 0;
     int c = 0;
     check(op < NUM_OPCODES);
+    if (op == OP_GETTABLE2 || op == OP_SELFCALL) {  /* superinstruction? */
+      /* never last, as the last instruction is a return (see precheck) */
+      OpCode next = GET_BASEOP(GET_OPCODE(pt->code[pc+1]));
+      check(next == (op == OP_GETTABLE2 ? OP_GETTABLE : OP_CALL));
+    }
+    op = cast(OpCode, GET_BASEOP(op));
     checkreg(pt, a);
     switch (getOpMode(op)) {
       case iABC: {
@@ -505,7 +511,7 @@ static const char *getobjname (lua_State *L, CallInfo *ci, int stackpos,
       return "local";
     i = symbexec(p, pc, stackpos);  /* try symbolic execution */
     lua_assert(pc != -1);
-    switch (GET_OPCODE(i)) {
+    switch (GET_BASEOP(GET_OPCODE(i))) {
       case OP_GETGLOBAL: {
         int g = GETARG_Bx(i);  /* global index */
         lua_assert(ttisstring(&p->k[g]));
@@ -29,7 +29,7 @@
 #define GCFINALIZECOST	100
 
 
-#define maskmarks	cast_byte(~(bitmask(BLACKBIT)|WHITEBITS))
+#define maskmarks	cast_byte(~(bitmask(BLACKBIT)|WHITEBITS|bitmask(OLDBIT)))
 
 #define makewhite(g,x)	\
    ((x)->gch.marked = cast_byte(((x)->gch.marked & maskmarks) | luaC_white(g)))
@@ -58,6 +58,11 @@
 
 #define setthreshold(g)  (g->GCthreshold = (g->estimate/100) * g->gcpause)
 
+#define setminorthreshold(g)  \
+	(g->GCthreshold = g->totalbytes + (g->estimate/100) * g->gcminormul)
+
+#define isgenerational(g)	((g)->gckind == KGC_GEN)
+
 
 static void removeentry (Node *n) {
   lua_assert(ttisnil(gval(n)));
@@ -131,6 +136,8 @@ size_t luaC_separateudata (lua_State *L, int all) {
   GCObject **p = &g->mainthread->next;
   GCObject *curr;
   while ((curr = *p) != NULL) {
+    if (!all && isgenerational(g) && isold(curr))
+      break;  /* older udata were already handled by previous cycles */
     if (!(iswhite(curr) || all) || isfinalized(gco2u(curr)))
       p = &curr->gch.next;  /* don't bother with them */
     else if (fasttm(L, gco2u(curr)->metatable, TM_GC) == NULL) {
@@ -155,6 +162,22 @@ size_t luaC_separateudata (lua_State *L, int all) {
 }
 
 
+static void traversenodes (global_State *g, Node *node, int size,
+                           int weakkey, int weakvalue) {
+  while (size--) {
+    Node *n = &node[size];
+    lua_assert(ttype(gkey(n)) != LUA_TDEADKEY || ttisnil(gval(n)));
+    if (ttisnil(gval(n)))
+      removeentry(n);  /* remove empty entries */
+    else {
+      lua_assert(!ttisnil(gkey(n)));
+      if (!weakkey) markvalue(g, gkey(n));
+      if (!weakvalue) markvalue(g, gval(n));
+    }
+  }
+}
+
+
 static int traversetable (global_State *g, Table *h) {
   int i;
   int weakkey = 0;
@@ -180,18 +203,9 @@ static int traversetable (global_State *g, Table *h) {
     while (i--)
       markvalue(g, &h->array[i]);
   }
-  i = sizenode(h);
-  while (i--) {
-    Node *n = gnode(h, i);
-    lua_assert(ttype(gkey(n)) != LUA_TDEADKEY || ttisnil(gval(n)));
-    if (ttisnil(gval(n)))
-      removeentry(n);  /* remove empty entries */
-    else {
-      lua_assert(!ttisnil(gkey(n)));
-      if (!weakkey) markvalue(g, gkey(n));
-      if (!weakvalue) markvalue(g, gval(n));
-    }
-  }
+  traversenodes(g, h->node, sizenode(h), weakkey, weakvalue);
+  if (h->oldnode)  /* hash part being migrated? */
+    traversenodes(g, h->oldnode, sizeoldnode(h), weakkey, weakvalue);
   return weakkey || weakvalue;
 }
 
@@ -285,7 +299,7 @@ static l_mem propagatemark (global_State *g) {
       if (traversetable(g, h))  /* table is weak? */
         black2gray(o);  /* keep it gray */
       return sizeof(Table) + sizeof(TValue) * h->sizearray +
-                             sizeof(Node) * sizenode(h);
+                             sizeof(Node) * (sizenode(h) + sizeoldnode(h));
     }
     case LUA_TFUNCTION: {
       Closure *cl = gco2cl(o);
@@ -345,6 +359,18 @@ static int iscleared (const TValue *o, int iskey) {
 }
 
 
+static void clearnodes (Node *node, int size) {
+  while (size--) {
+    Node *n = &node[size];
+    if (!ttisnil(gval(n)) &&  /* non-empty entry? */
+        (iscleared(key2tval(n), 1) || iscleared(gval(n), 0))) {
+      setnilvalue(gval(n));  /* remove value ... */
+      removeentry(n);  /* remove entry from table */
+    }
+  }
+}
+
+
 /*
 ** clear collected entries from weaktables
 */
@@ -361,15 +387,9 @@ static void cleartable (GCObject *l) {
           setnilvalue(o);  /* remove value */
       }
     }
-    i = sizenode(h);
-    while (i--) {
-      Node *n = gnode(h, i);
-      if (!ttisnil(gval(n)) &&  /* non-empty entry? */
-          (iscleared(key2tval(n), 1) || iscleared(gval(n), 0))) {
-        setnilvalue(gval(n));  /* remove value ... */
-        removeentry(n);  /* remove entry from table */
-      }
-    }
+    clearnodes(h->node, sizenode(h));
+    if (h->oldnode)
+      clearnodes(h->oldnode, sizeoldnode(h));
     l = h->gclist;
   }
 }
@@ -404,16 +424,27 @@ static void freeobj (lua_State *L, GCObject *o) {
 #define sweepwholelist(L,p)	sweeplist(L,p,MAX_LUMEM)
 
 
+/*
+** In generational mode new objects are always linked in front of older
+** ones, so a sweep can stop at the first old object it finds (returning
+** NULL). Survivors keep their marks and become old themselves.
+*/
 static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
   GCObject *curr;
   global_State *g = G(L);
   int deadmask = otherwhite(g);
+  int gen = isgenerational(g);
   while ((curr = *p) != NULL && count-- > 0) {
+    if (gen && isold(curr))  /* reached the old generation? */
+      return NULL;  /* nothing more to sweep in this list */
     if (curr->gch.tt == LUA_TTHREAD)  /* sweep open upvalues of each thread */
       sweepwholelist(L, &gco2th(curr)->openupval);
     if ((curr->gch.marked ^ WHITEBITS) & deadmask) {  /* not dead? */
       lua_assert(!isdead(g, curr) || testbit(curr->gch.marked, FIXEDBIT));
-      makewhite(g, curr);  /* make it white (for next cycle) */
+      if (gen)
+        l_setbit(curr->gch.marked, OLDBIT);  /* promote it, keeping its mark */
+      else
+        makewhite(g, curr);  /* make it white (for next cycle) */
       p = &curr->gch.next;
     }
     else {  /* must erase `curr' */
@@ -483,10 +514,11 @@ void luaC_callGCTM (lua_State *L) {
 void luaC_freeall (lua_State *L) {
   global_State *g = G(L);
   int i;
+  g->gckind = KGC_NORMAL;  /* sweep old objects too */
   g->currentwhite = WHITEBITS | bitmask(SFIXEDBIT);  /* mask to collect all elements */
   sweepwholelist(L, &g->rootgc);
-  for (i = 0; i < g->strt.size; i++)  /* free all string lists */
-    sweepwholelist(L, &g->strt.hash[i]);
+  for (i = 0; i < luaS_nbuckets(&g->strt); i++)  /* free all string lists */
+    sweepwholelist(L, luaS_bucket(&g->strt, i));
 }
 
 
@@ -500,6 +532,14 @@ static void markmt (global_State *g) {
 /* mark root set */
 static void markroot (lua_State *L) {
   global_State *g = G(L);
+  if (isgenerational(g) && g->genminor) {
+    /* minor collection: the roots are old, so they are already marked.
+       Young objects are reached through `gray' (filled by barriers) and
+       `grayagain' (threads, weak tables and tables hit by barriers) */
+    g->weak = NULL;
+    g->gcstate = GCSpropagate;
+    return;
+  }
   g->gray = NULL;
   g->grayagain = NULL;
   g->weak = NULL;
@@ -544,6 +584,18 @@ static void atomic (lua_State *L) {
   marktmu(g);  /* mark `preserved' userdata */
   udsize += propagateall(g);  /* remark, to propagate `preserveness' */
   cleartable(g->weak);  /* remove collected objects from weak tables */
+  if (isgenerational(g)) {
+    /* threads and weak tables stay gray after this cycle; keep them in
+       `grayagain' so that the next minor collection traverses them again */
+    GCObject *w = g->weak;
+    while (w) {
+      Table *h = gco2h(w);
+      w = h->gclist;
+      h->gclist = g->grayagain;
+      g->grayagain = obj2gco(h);
+    }
+    g->weak = NULL;
+  }
   /* flip current white */
   g->currentwhite = cast_byte(otherwhite(g));
   g->sweepstrgc = 0;
@@ -571,8 +623,9 @@ static l_mem singlestep (lua_State *L) {
     }
     case GCSsweepstring: {
       lu_mem old = g->totalbytes;
-      sweepwholelist(L, &g->strt.hash[g->sweepstrgc++]);
-      if (g->sweepstrgc >= g->strt.size)  /* nothing more to sweep? */
+      sweepwholelist(L, luaS_bucket(&g->strt, g->sweepstrgc));
+      g->sweepstrgc++;
+      if (g->sweepstrgc >= luaS_nbuckets(&g->strt))  /* nothing more to sweep? */
         g->gcstate = GCSsweep;  /* end sweep-string phase */
       lua_assert(old >= g->totalbytes);
       g->estimate -= old - g->totalbytes;
@@ -580,9 +633,18 @@ static l_mem singlestep (lua_State *L) {
     }
     case GCSsweep: {
       lu_mem old = g->totalbytes;
-      g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
-      if (*g->sweepgc == NULL) {  /* nothing more to sweep? */
+      if (isgenerational(g)) {
+        /* sweep young objects and young userdata (kept after the main
+           thread) in one go; both lists stop at their first old object */
+        sweepwholelist(L, &g->rootgc);
+        sweepwholelist(L, &g->mainthread->next);
+        g->sweepgc = NULL;
+      }
+      else
+        g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
+      if (g->sweepgc == NULL || *g->sweepgc == NULL) {  /* nothing more to sweep? */
         checkSizes(L);
+        g->genminor = isgenerational(g);  /* survivors are old now */
         g->gcstate = GCSfinalize;  /* end sweep phase */
       }
       lua_assert(old >= g->totalbytes);
@@ -607,9 +669,34 @@ static l_mem singlestep (lua_State *L) {
 }
 
 
+/*
+** In generational mode each collection runs to completion at once. A
+** minor collection only traverses and sweeps young objects; when memory
+** has grown too much since the last major collection, a full one is
+** done instead.
+*/
+static void generationalstep (lua_State *L) {
+  global_State *g = G(L);
+  if (g->lastmajormem == 0) {  /* signal for a major collection? */
+    luaC_fullgc(L);
+    return;
+  }
+  do {
+    singlestep(L);
+  } while (g->gcstate != GCSpause);
+  if (g->totalbytes > g->lastmajormem + (g->lastmajormem/100) * g->gcmajormul)
+    g->lastmajormem = 0;  /* next collection will be a major one */
+  setminorthreshold(g);
+}
+
+
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
   l_mem lim = (GCSTEPSIZE/100) * g->gcstepmul;
+  if (isgenerational(g)) {
+    generationalstep(L);
+    return;
+  }
   if (lim == 0)
     lim = (MAX_LUMEM-1)/2;  /* no limit */
   g->gcdept += g->totalbytes - g->GCthreshold;
@@ -635,7 +722,9 @@ void luaC_step (lua_State *L) {
 
 void luaC_fullgc (lua_State *L) {
   global_State *g = G(L);
-  if (g->gcstate <= GCSpropagate) {
+  int gckind = g->gckind;
+  g->gckind = KGC_NORMAL;  /* old objects must be swept back to white */
+  if (g->gcstate <= GCSpropagate || gckind == KGC_GEN) {
     /* reset sweep marks to sweep all elements (returning them to white) */
     g->sweepstrgc = 0;
     g->sweepgc = &g->rootgc;
@@ -651,21 +740,58 @@ void luaC_fullgc (lua_State *L) {
     lua_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
     singlestep(L);
   }
+  g->gckind = cast_byte(gckind);  /* a generational cycle promotes survivors */
   markroot(L);
   while (g->gcstate != GCSpause) {
     singlestep(L);
   }
-  setthreshold(g);
+  if (isgenerational(g)) {
+    g->lastmajormem = g->totalbytes;
+    setminorthreshold(g);
+  }
+  else
+    setthreshold(g);
+}
+
+
+void luaC_changemode (lua_State *L, int mode) {
+  global_State *g = G(L);
+  if (mode == g->gckind) return;  /* nothing to change */
+  if (mode == KGC_GEN) {
+    /* finish the current incremental cycle; the first generational
+       cycle marks everything and promotes all survivors */
+    while (g->gcstate != GCSpause)
+      singlestep(L);
+    g->gckind = KGC_GEN;
+    g->genminor = 0;
+    g->lastmajormem = g->totalbytes;
+    setminorthreshold(g);
+  }
+  else {
+    /* sweep all objects back to white (as the current white has not
+       changed, nothing extra is collected) */
+    g->gckind = KGC_NORMAL;
+    g->sweepstrgc = 0;
+    g->sweepgc = &g->rootgc;
+    g->gray = NULL;
+    g->grayagain = NULL;
+    g->weak = NULL;
+    g->gcstate = GCSsweepstring;
+    while (g->gcstate != GCSpause)
+      singlestep(L);
+    setthreshold(g);
+  }
 }
 
 
 void luaC_barrierf (lua_State *L, GCObject *o, GCObject *v) {
   global_State *g = G(L);
   lua_assert(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-  lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
+  lua_assert(isgenerational(g) ||
+             (g->gcstate != GCSfinalize && g->gcstate != GCSpause));
   lua_assert(ttype(&o->gch) != LUA_TTABLE);
-  /* must keep invariant? */
-  if (g->gcstate == GCSpropagate)
+  /* must keep invariant? (always, for old objects in generational mode) */
+  if (g->gcstate == GCSpropagate || isgenerational(g))
     reallymarkobject(g, v);  /* restore invariant */
   else  /* don't mind */
     makewhite(g, o);  /* mark as white just to avoid other barriers */
@@ -676,7 +802,8 @@ void luaC_barrierback (lua_State *L, Table *t) {
   global_State *g = G(L);
   GCObject *o = obj2gco(t);
   lua_assert(isblack(o) && !isdead(g, o));
-  lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
+  lua_assert(isgenerational(g) ||
+             (g->gcstate != GCSfinalize && g->gcstate != GCSpause));
   black2gray(o);  /* make table gray (again) */
   t->gclist = g->grayagain;
   g->grayagain = o;
@@ -698,7 +825,7 @@ void luaC_linkupval (lua_State *L, UpVal *uv) {
   o->gch.next = g->rootgc;  /* link upvalue into `rootgc' list */
   g->rootgc = o;
   if (isgray(o)) { 
-    if (g->gcstate == GCSpropagate) {
+    if (g->gcstate == GCSpropagate || isgenerational(g)) {
       gray2black(o);  /* closed upvalues need barrier */
       luaC_barrier(L, uv, uv->v);
     }
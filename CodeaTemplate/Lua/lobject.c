@@ -5,6 +5,7 @@
 */
 
 #include <ctype.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -87,6 +88,290 @@ int luaO_rawequalObj (const TValue *t1, const TValue *t2) {
 }
 
 
+/*
+** {======================================================
+** Number <-> string conversion
+** lua_Number is a float here, so numbers are printed with the shortest
+** digits that read back as the same float (Ryu, Ulf Adams 2018) and
+** parsed through an exact double precision fast path (Clinger 1990)
+** =======================================================
+*/
+
+typedef unsigned long long l_uint64;
+
+#define F_MANTBITS	23
+#define F_BIAS		127
+#define F_POW5INVBITS	59
+#define F_POW5BITS	61
+
+/* floor(2^(pow5bits(q)-1+59) / 5^q) + 1 */
+static const l_uint64 pow5inv[31] = {
+  576460752303423489ull, 461168601842738791ull, 368934881474191033ull,
+  295147905179352826ull, 472236648286964522ull, 377789318629571618ull,
+  302231454903657294ull, 483570327845851670ull, 386856262276681336ull,
+  309485009821345069ull, 495176015714152110ull, 396140812571321688ull,
+  316912650057057351ull, 507060240091291761ull, 405648192073033409ull,
+  324518553658426727ull, 519229685853482763ull, 415383748682786211ull,
+  332306998946228969ull, 531691198313966350ull, 425352958651173080ull,
+  340282366920938464ull, 544451787073501542ull, 435561429658801234ull,
+  348449143727040987ull, 557518629963265579ull, 446014903970612463ull,
+  356811923176489971ull, 570899077082383953ull, 456719261665907162ull,
+  365375409332725730ull
+};
+
+/* 5^i scaled to 61 bits */
+static const l_uint64 pow5[47] = {
+  1152921504606846976ull, 1441151880758558720ull, 1801439850948198400ull,
+  2251799813685248000ull, 1407374883553280000ull, 1759218604441600000ull,
+  2199023255552000000ull, 1374389534720000000ull, 1717986918400000000ull,
+  2147483648000000000ull, 1342177280000000000ull, 1677721600000000000ull,
+  2097152000000000000ull, 1310720000000000000ull, 1638400000000000000ull,
+  2048000000000000000ull, 1280000000000000000ull, 1600000000000000000ull,
+  2000000000000000000ull, 1250000000000000000ull, 1562500000000000000ull,
+  1953125000000000000ull, 1220703125000000000ull, 1525878906250000000ull,
+  1907348632812500000ull, 1192092895507812500ull, 1490116119384765625ull,
+  1862645149230957031ull, 1164153218269348144ull, 1455191522836685180ull,
+  1818989403545856475ull, 2273736754432320594ull, 1421085471520200371ull,
+  1776356839400250464ull, 2220446049250313080ull, 1387778780781445675ull,
+  1734723475976807094ull, 2168404344971008868ull, 1355252715606880542ull,
+  1694065894508600678ull, 2117582368135750847ull, 1323488980084844279ull,
+  1654361225106055349ull, 2067951531382569187ull, 1292469707114105741ull,
+  1615587133892632177ull, 2019483917365790221ull
+};
+
+static const double exact10[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define log10pow2(e)	cast_int(((lu_int32)(e) * 78913) >> 18)
+#define log10pow5(e)	cast_int(((lu_int32)(e) * 732923) >> 20)
+#define pow5bits(e)	cast_int((((lu_int32)(e) * 1217359) >> 19) + 1)
+
+
+static int pow5factor (lu_int32 v) {
+  int n = 0;
+  for (; v % 5 == 0; v /= 5) n++;
+  return n;
+}
+
+
+static lu_int32 mulshift (lu_int32 m, l_uint64 factor, int shift) {
+  l_uint64 lo = (l_uint64)m * (lu_int32)factor;
+  l_uint64 hi = (l_uint64)m * (lu_int32)(factor >> 32);
+  return (lu_int32)(((lo >> 32) + hi) >> (shift - 32));
+}
+
+
+/*
+** shortest decimal in the rounding interval of the float with the given
+** mantissa and biased exponent, as digits * 10^(*e10)
+*/
+static lu_int32 f2decimal (lu_int32 mant, int bexp, int *e10) {
+  int e2, q, removed = 0;
+  lu_int32 m2, mv, mp, mm, vr, vp, vm, mmshift, out;
+  int accept, vmzeros = 0, vrzeros = 0, lastdigit = 0;
+  if (bexp == 0) {
+    e2 = 1 - F_BIAS - F_MANTBITS - 2;
+    m2 = mant;
+  }
+  else {
+    e2 = bexp - F_BIAS - F_MANTBITS - 2;
+    m2 = ((lu_int32)1 << F_MANTBITS) | mant;
+  }
+  accept = (m2 & 1) == 0;  /* round-half-even reads back the bounds */
+  mv = 4 * m2;
+  mp = 4 * m2 + 2;
+  mmshift = (mant != 0 || bexp <= 1);  /* narrower below a power of 2 */
+  mm = 4 * m2 - 1 - mmshift;
+  if (e2 >= 0) {
+    int k, i;
+    q = log10pow2(e2);
+    *e10 = q;
+    k = F_POW5INVBITS + pow5bits(q) - 1;
+    i = -e2 + q + k;
+    vr = mulshift(mv, pow5inv[q], i);
+    vp = mulshift(mp, pow5inv[q], i);
+    vm = mulshift(mm, pow5inv[q], i);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      int l = F_POW5INVBITS + pow5bits(q - 1) - 1;
+      lastdigit = cast_int(mulshift(mv, pow5inv[q - 1], -e2 + q - 1 + l) % 10);
+    }
+    if (q <= 9) {
+      if (mv % 5 == 0) vrzeros = pow5factor(mv) >= q;
+      else if (accept) vmzeros = pow5factor(mm) >= q;
+      else vp -= pow5factor(mp) >= q;
+    }
+  }
+  else {
+    int i, j;
+    q = log10pow5(-e2);
+    *e10 = q + e2;
+    i = -e2 - q;
+    j = q - (pow5bits(i) - F_POW5BITS);
+    vr = mulshift(mv, pow5[i], j);
+    vp = mulshift(mp, pow5[i], j);
+    vm = mulshift(mm, pow5[i], j);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      j = q - 1 - (pow5bits(i + 1) - F_POW5BITS);
+      lastdigit = cast_int(mulshift(mv, pow5[i + 1], j) % 10);
+    }
+    if (q <= 1) {
+      vrzeros = 1;
+      if (accept) vmzeros = (mmshift == 1);
+      else vp--;
+    }
+    else if (q < 31)
+      vrzeros = (mv & (((lu_int32)1 << (q - 1)) - 1)) == 0;
+  }
+  if (vmzeros || vrzeros) {  /* rare: exact boundaries need care */
+    while (vp / 10 > vm / 10) {
+      vmzeros &= (vm % 10 == 0);
+      vrzeros &= (lastdigit == 0);
+      lastdigit = cast_int(vr % 10);
+      vr /= 10; vp /= 10; vm /= 10; removed++;
+    }
+    if (vmzeros) {
+      while (vm % 10 == 0) {
+        vrzeros &= (lastdigit == 0);
+        lastdigit = cast_int(vr % 10);
+        vr /= 10; vp /= 10; vm /= 10; removed++;
+      }
+    }
+    if (vrzeros && lastdigit == 5 && vr % 2 == 0)
+      lastdigit = 4;  /* exactly halfway: round to even */
+    out = vr + ((vr == vm && (!accept || !vmzeros)) || lastdigit >= 5);
+  }
+  else {
+    while (vp / 10 > vm / 10) {
+      lastdigit = cast_int(vr % 10);
+      vr /= 10; vp /= 10; vm /= 10; removed++;
+    }
+    out = vr + (vr == vm || lastdigit >= 5);
+  }
+  *e10 += removed;
+  return out;
+}
+
+
+/*
+** lays the digits out the way "%.14g" would: fixed notation for decimal
+** exponents -4..13, otherwise d.ddde+XX; integral values in fixed
+** notation are written exactly (2^31 is 2147483648, not 2147483600)
+*/
+LUA_API int lua_num2str (char *s, lua_Number n) {
+  char digits[10];
+  char *p = s;
+  float f;
+  lu_int32 bits, out;
+  int nd, e10, x, i;
+  if (sizeof(lua_Number) != sizeof(float))
+    return sprintf(s, "%.14g", (LUAI_UACNUMBER)n);
+  f = (float)n;
+  memcpy(&bits, &f, sizeof(bits));
+  if (bits >> 31) *p++ = '-';
+  if (((bits >> F_MANTBITS) & 0xff) == 0xff) {
+    strcpy(p, (bits & 0x7fffff) ? "nan" : "inf");
+    return cast_int(p - s) + 3;
+  }
+  if ((bits & 0x7fffffff) == 0) {
+    *p++ = '0'; *p = '\0';
+    return cast_int(p - s);
+  }
+  out = f2decimal(bits & 0x7fffff, (bits >> F_MANTBITS) & 0xff, &e10);
+  for (nd = 0; out > 0; out /= 10)
+    digits[nd++] = cast(char, '0' + out % 10);  /* reversed */
+  x = e10 + nd - 1;  /* exponent of the leading digit */
+  if (x < -4 || x >= 14) {
+    *p++ = digits[nd - 1];
+    if (nd > 1) {
+      *p++ = '.';
+      for (i = nd - 2; i >= 0; i--) *p++ = digits[i];
+    }
+    *p++ = 'e';
+    *p++ = (x < 0) ? '-' : '+';
+    if (x < 0) x = -x;
+    if (x >= 100) *p++ = cast(char, '0' + x / 100);
+    *p++ = cast(char, '0' + x / 10 % 10);
+    *p++ = cast(char, '0' + x % 10);
+  }
+  else if (x < 0) {
+    *p++ = '0'; *p++ = '.';
+    for (i = x + 1; i < 0; i++) *p++ = '0';
+    for (i = nd - 1; i >= 0; i--) *p++ = digits[i];
+  }
+  else if (e10 > 0) {  /* integral: exact digits, not shortest ones padded with zeros */
+    return cast_int(p - s) + sprintf(p, "%.0f", (double)((bits >> 31) ? -f : f));
+  }
+  else {
+    for (i = nd - 1; i >= 0; i--) {
+      *p++ = digits[i];
+      if (i == nd - 1 - x && i > 0) *p++ = '.';
+    }
+  }
+  *p = '\0';
+  return cast_int(p - s);
+}
+
+
+/*
+** like strtod; decimals of up to 19 significant digits and 10^+-22 are
+** converted exactly in double precision, everything else (and the rare
+** double that lands on a float halfway point) goes to the C library
+*/
+LUA_API lua_Number lua_str2num (const char *s, char **endptr) {
+  const char *p = s;
+  l_uint64 w = 0;
+  int nd = 0, exp = 0, neg = 0, any = 0;
+  if (sizeof(lua_Number) != sizeof(float))
+    return cast_num(strtod(s, endptr));
+  while (isspace(cast(unsigned char, *p))) p++;
+  if (*p == '-' || *p == '+') neg = (*p++ == '-');
+  for (; isdigit(cast(unsigned char, *p)); p++, any = 1) {
+    if (w == 0 && *p == '0') continue;
+    if (nd++ == 19) goto slow;
+    w = w * 10 + (*p - '0');
+  }
+  if (*p == 'x' || *p == 'X') goto slow;  /* hexadecimal */
+  if (*p == '.') {
+    for (p++; isdigit(cast(unsigned char, *p)); p++, any = 1) {
+      exp--;
+      if (w == 0 && *p == '0') continue;
+      if (nd++ == 19) goto slow;
+      w = w * 10 + (*p - '0');
+    }
+  }
+  if (!any) goto slow;  /* "inf", "nan" or not a number */
+  if (*p == 'e' || *p == 'E') {
+    const char *q = p + 1;
+    int e = 0, eneg = 0;
+    if (*q == '-' || *q == '+') eneg = (*q++ == '-');
+    if (isdigit(cast(unsigned char, *q))) {
+      for (; isdigit(cast(unsigned char, *q)); q++)
+        if (e < 10000) e = e * 10 + (*q - '0');
+      exp += eneg ? -e : e;
+      p = q;
+    }
+  }
+  if (endptr) *endptr = cast(char *, p);
+  if (w == 0)
+    return neg ? -cast_num(0) : cast_num(0);
+  if (w < ((l_uint64)1 << 53) && exp >= -22 && exp <= 22) {
+    double d = (double)w;
+    float f;
+    d = (exp < 0) ? d / exact10[-exp] : d * exact10[exp];  /* one rounding */
+    f = (float)d;
+    if ((double)f == d ||
+        (d - f) * 2 != (double)nextafterf(f, (d > f) ? HUGE_VALF : -HUGE_VALF) - f)
+      return cast_num(neg ? -f : f);
+  }
+slow:
+  return cast_num(strtof(s, endptr));
+}
+
+/* }====================================================== */
+
+
 int luaO_str2d (const char *s, lua_Number *result) {
   char *endptr;
   *result = lua_str2number(s, &endptr);
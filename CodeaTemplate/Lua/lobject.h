@@ -339,12 +339,15 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */ 
   lu_byte lsizenode;  /* log2 of size of `node' array */
+  lu_byte loldsizenode;  /* log2 of size of `oldnode' array */
   struct Table *metatable;
   TValue *array;  /* array part */
   Node *node;
   Node *lastfree;  /* any free position is before this position */
+  Node *oldnode;  /* hash part still being migrated into `node' (or NULL) */
   GCObject *gclist;
   int sizearray;  /* size of `array' array */
+  int rehashpos;  /* `oldnode' positions below this are not migrated yet */
 } Table;
 
 
@@ -358,6 +361,7 @@ typedef struct Table {
 
 #define twoto(x)	(1<<(x))
 #define sizenode(t)	(twoto((t)->lsizenode))
+#define sizeoldnode(t)	((t)->oldnode ? twoto((t)->loldsizenode) : 0)
 
 
 #define luaO_nilobject		(&luaO_nilobject_)
@@ -204,11 +204,21 @@ OP_SETLIST,/*	A B C	R(A)[(C-1)*FPF+i] := R(A+i), 1 <= i <= B	*/
 OP_CLOSE,/*	A 	close all variables in the stack up to (>=) R(A)*/
 OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx], R(A), ... ,R(A+n))	*/
 
-OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+
+/* superinstructions (see luaK_fuse) */
+OP_GETTABLE2,/*	A B C	OP_GETTABLE, then the OP_GETTABLE that follows	*/
+OP_SELFCALL,/*	A B C	OP_SELF, then the OP_CALL that follows		*/
+OP_FORLOOPINC/*	A sBx	OP_FORLOOP with a constant positive step	*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_VARARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_FORLOOPINC) + 1)
+
+/* plain opcode that a superinstruction starts with */
+#define GET_BASEOP(o)	((o) == OP_GETTABLE2 ? OP_GETTABLE : \
+			 (o) == OP_SELFCALL ? OP_SELF : \
+			 (o) == OP_FORLOOPINC ? OP_FORLOOP : (o))
 
 
 
@@ -230,6 +240,10 @@ OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
       (true or false).
 
   (*) All `skips' (pc++) assume that next instruction is a jump
+
+  (*) A superinstruction only replaces the opcode of the first instruction
+      of its pair; the second stays in place, so jumps to it, line info
+      and debug information are unchanged.
 ===========================================================================*/
 
 
@@ -39,6 +39,9 @@ typedef struct stringtable {
   GCObject **hash;
   lu_int32 nuse;  /* number of elements */
   int size;
+  GCObject **oldhash;  /* buckets still being migrated into `hash' */
+  int oldsize;
+  int rehashpos;  /* first `oldhash' bucket not migrated yet */
 } stringtable;
 
 
@@ -71,6 +74,8 @@ typedef struct global_State {
   void *ud;         /* auxiliary data to `frealloc' */
   lu_byte currentwhite;
   lu_byte gcstate;  /* state of garbage collector */
+  lu_byte gckind;  /* kind of GC running */
+  lu_byte genminor;  /* true if next generational cycle is a minor one */
   int sweepstrgc;  /* position of sweep in `strt' */
   GCObject *rootgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* position of sweep in `rootgc' */
@@ -85,6 +90,9 @@ typedef struct global_State {
   lu_mem gcdept;  /* how much GC is `behind schedule' */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
+  lu_mem lastmajormem;  /* memory in use after last major collection */
+  int gcminormul;  /* growth (in %) that triggers a minor collection */
+  int gcmajormul;  /* growth (in %) that triggers a major collection */
   lua_CFunction panic;  /* to be called in unprotected errors */
   TValue l_registry;
   struct lua_State *mainthread;
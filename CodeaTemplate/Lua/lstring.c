@@ -12,6 +12,7 @@
 
 #include "lua.h"
 
+#include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -19,31 +20,82 @@
 
 
 
+/*
+** The string table is rehashed incrementally: luaS_resize only allocates
+** the new buckets and keeps the old ones in `oldhash', then every string
+** lookup moves STRREHASHSTEP old buckets over. Lookups search both
+** vectors meanwhile; the collector sweeps both and, as with resizing,
+** nothing moves while it does.
+*/
+#define STRREHASHSTEP	4
+
+
+/*
+** chains the strings of an old bucket into the new vector; old strings
+** go after young ones so that young ones stay in front of them (the
+** generational collector stops at the first old string)
+*/
+static void rehashbucket (stringtable *tb, GCObject *p) {
+  while (p != NULL) {
+    GCObject *next = p->gch.next;
+    GCObject **pp = &tb->hash[lmod(gco2ts(p)->hash, tb->size)];
+    if (isold(p)) {
+      while (*pp != NULL && !isold(*pp))
+        pp = &(*pp)->gch.next;
+    }
+    p->gch.next = *pp;  /* chain it */
+    *pp = p;
+    p = next;
+  }
+}
+
+
+static void migrate (lua_State *L, int n) {
+  stringtable *tb = &G(L)->strt;
+  if (G(L)->gcstate == GCSsweepstring)
+    return;  /* cannot move strings during GC traverse */
+  for (; n > 0 && tb->rehashpos < tb->oldsize; n--) {
+    GCObject *p = tb->oldhash[tb->rehashpos];
+    tb->oldhash[tb->rehashpos++] = NULL;
+    rehashbucket(tb, p);
+  }
+  if (tb->rehashpos == tb->oldsize) {  /* done? */
+    luaM_freearray(L, tb->oldhash, tb->oldsize, TString *);
+    tb->oldhash = NULL;
+    tb->oldsize = 0;
+  }
+}
+
+
+/*
+** growing is incremental; shrinking (from the collector's checkSizes) is
+** done at once, as the sweep step expects memory use to only go down
+*/
 void luaS_resize (lua_State *L, int newsize) {
   GCObject **newhash;
   stringtable *tb;
+  int shrink;
   int i;
   if (G(L)->gcstate == GCSsweepstring)
     return;  /* cannot resize during GC traverse */
-  newhash = luaM_newvector(L, newsize, GCObject *);
   tb = &G(L)->strt;
+  shrink = (newsize < tb->size);
+  if (tb->oldhash != NULL) {
+    if (!shrink)
+      return;  /* previous resize still in progress; retried later */
+    migrate(L, tb->oldsize);  /* finish it first */
+  }
+  newhash = luaM_newvector(L, newsize, GCObject *);
   for (i=0; i<newsize; i++) newhash[i] = NULL;
-  /* rehash */
-  for (i=0; i<tb->size; i++) {
-    GCObject *p = tb->hash[i];
-    while (p) {  /* for each node in the list */
-      GCObject *next = p->gch.next;  /* save next */
-      unsigned int h = gco2ts(p)->hash;
-      int h1 = lmod(h, newsize);  /* new position */
-      lua_assert(cast_int(h%newsize) == lmod(h, newsize));
-      p->gch.next = newhash[h1];  /* chain it */
-      newhash[h1] = p;
-      p = next;
-    }
+  if (tb->size > 0) {
+    tb->oldhash = tb->hash;
+    tb->oldsize = tb->size;
+    tb->rehashpos = 0;
   }
-  luaM_freearray(L, tb->hash, tb->size, TString *);
   tb->size = newsize;
   tb->hash = newhash;
+  if (shrink)
+    migrate(L, tb->oldsize);
 }
 
 
@@ -79,6 +131,8 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
   size_t l1;
   for (l1=l; l1>=step; l1-=step)  /* compute hash */
     h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
+  if (G(L)->strt.oldhash != NULL)
+    migrate(L, STRREHASHSTEP);
   for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
        o != NULL;
        o = o->gch.next) {
@@ -89,6 +143,17 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
       return ts;
     }
   }
+  if (G(L)->strt.oldhash != NULL) {  /* not migrated yet? */
+    for (o = G(L)->strt.oldhash[lmod(h, G(L)->strt.oldsize)];
+         o != NULL;
+         o = o->gch.next) {
+      TString *ts = rawgco2ts(o);
+      if (ts->tsv.len == l && (memcmp(str, getstr(ts), l) == 0)) {
+        if (isdead(G(L), o)) changewhite(o);
+        return ts;
+      }
+    }
+  }
   return newlstr(L, str, l, h);  /* not found */
 }
 
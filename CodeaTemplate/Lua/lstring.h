@@ -23,6 +23,11 @@
 
 #define luaS_fix(s)	l_setbit((s)->tsv.marked, FIXEDBIT)
 
+/* i-th bucket of the string table, counting the old buckets first */
+#define luaS_bucket(tb,i)	((i) < (tb)->oldsize ? &(tb)->oldhash[i] : \
+                                 &(tb)->hash[(i) - (tb)->oldsize])
+#define luaS_nbuckets(tb)	((tb)->oldsize + (tb)->size)
+
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
@@ -463,6 +463,459 @@ static const char *lmemfind (const char *s1, size_t l1,
 }
 
 
+/*
+** {======================================================
+** Compiled patterns
+** Patterns are parsed once into a list of items (single-char classes
+** with their repetition, captures, %b, %f, back references and anchors)
+** that 'pmatch' runs with exactly the same backtracking as 'match'.
+** Bracket classes without locale-dependent escapes become bitmaps.
+** Patterns that 'match' would report as malformed are not compiled; they
+** keep using 'match' so errors are raised at the same point as before.
+** Compiled patterns live in a small LRU cache keyed by the (interned)
+** pattern string.
+** =======================================================
+*/
+
+
+#define PATCACHE_SIZE	32
+
+enum PatOp {
+  P_CHAR, P_ANY, P_CLASS, P_SET, P_SETCLASS,  /* single-char items */
+  P_OPEN, P_POSITION, P_CLOSE, P_BALANCE, P_FRONTIER, P_FRONTIERCLASS,
+  P_BACKREF, P_ENDANCHOR, P_END
+};
+
+typedef struct PatItem {
+  unsigned char op;
+  unsigned char rep;  /* 0, `?', `*', `+' or `-' */
+  unsigned char c1, c2;  /* char, class, capture digit or %b delimiters */
+  int set;  /* P_SET/P_FRONTIER: index of bitmap */
+  const char *p, *ec;  /* P_SETCLASS/P_FRONTIERCLASS: `[' and `]' in pattern */
+} PatItem;
+
+typedef struct Pattern {
+  int valid;  /* 0: malformed, use 'match' */
+  int literal;  /* pattern is a plain string ('lit') */
+  int first;  /* char every match starts with, or -1 */
+  size_t litlen;
+  const char *lit;
+  unsigned char (*sets)[32];
+  PatItem item[1];
+} Pattern;
+
+
+/* `classend' without errors: NULL if malformed */
+static const char *pclassend (const char *p) {
+  switch (*p++) {
+    case L_ESC: {
+      return (*p == '\0') ? NULL : p+1;
+    }
+    case '[': {
+      if (*p == '^') p++;
+      do {  /* look for a `]' */
+        if (*p == '\0') return NULL;
+        if (*(p++) == L_ESC && *p != '\0')
+          p++;  /* skip escapes (e.g. `%]') */
+      } while (*p != ']');
+      return p+1;
+    }
+    default: {
+      return p;
+    }
+  }
+}
+
+
+/* can the class in [p, ec] be precomputed (no locale-dependent escapes)? */
+static int staticset (const char *p, const char *ec) {
+  while (++p < ec) {
+    if (*p == L_ESC) {
+      int c = uchar(*++p);
+      if (c >= 128 || isalnum(c)) return 0;
+    }
+  }
+  return 1;
+}
+
+
+static void makeset (unsigned char *set, const char *p, const char *ec) {
+  int c;
+  memset(set, 0, 32);
+  for (c = 0; c < 256; c++)
+    if (matchbracketclass(c, p, ec))
+      set[c >> 3] |= (unsigned char)(1 << (c & 7));
+}
+
+
+/*
+** Parses 'p' into 'pat' (or only counts items and bitmaps when 'pat' is
+** NULL). Returns the number of items, or -1 if the pattern is malformed.
+*/
+static int parsepattern (const char *p, Pattern *pat, int *nsets) {
+  int n = 0, ns = 0, literal = 1;
+  size_t ll = 0;
+  for (;;) {
+    PatItem it;
+    const char *ep;
+    it.rep = 0; it.c1 = it.c2 = 0; it.set = 0; it.p = it.ec = NULL;
+    switch (*p) {
+      case '(': {
+        if (*(p+1) == ')') { it.op = P_POSITION; p += 2; }
+        else { it.op = P_OPEN; p++; }
+        break;
+      }
+      case ')': {
+        it.op = P_CLOSE; p++;
+        break;
+      }
+      case '\0': {
+        it.op = P_END;
+        break;
+      }
+      case '$': {
+        if (*(p+1) == '\0') { it.op = P_ENDANCHOR; p++; break; }
+        goto dflt;
+      }
+      case L_ESC: {
+        if (*(p+1) == 'b') {
+          if (*(p+2) == 0 || *(p+3) == 0) return -1;
+          it.op = P_BALANCE; it.c1 = uchar(*(p+2)); it.c2 = uchar(*(p+3));
+          p += 4;
+          break;
+        }
+        else if (*(p+1) == 'f') {
+          p += 2;
+          if (*p != '[' || (ep = pclassend(p)) == NULL) return -1;
+          it.p = p; it.ec = ep-1;
+          if (staticset(p, ep-1)) {
+            it.op = P_FRONTIER; it.set = ns;
+            if (pat) makeset(pat->sets[ns], p, ep-1);
+            ns++;
+          }
+          else it.op = P_FRONTIERCLASS;
+          p = ep;
+          break;
+        }
+        else if (isdigit(uchar(*(p+1)))) {
+          it.op = P_BACKREF; it.c1 = uchar(*(p+1));
+          p += 2;
+          break;
+        }
+        goto dflt;
+      }
+      default: dflt: {
+        if ((ep = pclassend(p)) == NULL) return -1;
+        switch (*p) {
+          case '.': it.op = P_ANY; break;
+          case L_ESC: {
+            int cl = uchar(*(p+1));
+            if (cl < 128 && !isalpha(cl)) {  /* escaped literal */
+              it.op = P_CHAR; it.c1 = (unsigned char)cl;
+            }
+            else {
+              it.op = P_CLASS; it.c1 = (unsigned char)cl;
+            }
+            break;
+          }
+          case '[': {
+            it.p = p; it.ec = ep-1;
+            if (staticset(p, ep-1)) {
+              it.op = P_SET; it.set = ns;
+              if (pat) makeset(pat->sets[ns], p, ep-1);
+              ns++;
+            }
+            else it.op = P_SETCLASS;
+            break;
+          }
+          default: it.op = P_CHAR; it.c1 = uchar(*p); break;
+        }
+        if (*ep != '\0' && strchr("?*+-", *ep) != NULL)
+          it.rep = uchar(*ep++);
+        if (it.op == P_CHAR && it.rep == 0) {
+          if (pat) ((char *)pat->lit)[ll] = (char)it.c1;
+          ll++;
+        }
+        else literal = 0;
+        p = ep;
+        break;
+      }
+    }
+    if (it.op != P_END && it.op != P_CHAR) literal = 0;
+    if (pat) pat->item[n] = it;
+    n++;
+    if (it.op == P_END) break;
+  }
+  if (pat) {
+    pat->literal = literal;
+    pat->litlen = ll;
+  }
+  *nsets = ns;
+  return n;
+}
+
+
+/* creates the compiled form of 'p' as a userdata on the stack */
+static Pattern *compilepattern (lua_State *L, const char *p) {
+  Pattern *pat;
+  int i, ns;
+  int n = parsepattern(p, NULL, &ns);
+  size_t items = sizeof(Pattern) + (n > 1 ? n-1 : 0)*sizeof(PatItem);
+  if (n < 0) {
+    pat = (Pattern *)lua_newuserdata(L, sizeof(Pattern));
+    pat->valid = 0;
+    pat->literal = 0;
+    pat->first = -1;
+    return pat;
+  }
+  pat = (Pattern *)lua_newuserdata(L, items + ns*32 + n);
+  pat->valid = 1;
+  pat->sets = (unsigned char (*)[32])((char *)pat + items);
+  pat->lit = (const char *)pat + items + ns*32;
+  parsepattern(p, pat, &ns);
+  /* required first char (leading captures do not consume input) */
+  pat->first = -1;
+  for (i = 0; i < LUA_MAXCAPTURES &&
+              (pat->item[i].op == P_OPEN || pat->item[i].op == P_POSITION); i++) ;
+  if (pat->item[i].op == P_CHAR &&
+      (pat->item[i].rep == 0 || pat->item[i].rep == '+'))
+    pat->first = pat->item[i].c1;
+  return pat;
+}
+
+
+/*
+** Returns the compiled form of pattern 'p' (which points into the string
+** at stack index 'pidx'), using the cache at 'cidx'. With 'pin' the
+** compiled pattern is also left on the stack, so it stays alive even if
+** Lua code run meanwhile evicts it.
+*/
+typedef struct PatCache {
+  unsigned int clock;
+  struct {
+    const char *key;
+    Pattern *pat;
+    unsigned int used;
+  } slot[PATCACHE_SIZE];
+} PatCache;
+
+static Pattern *getpattern (lua_State *L, int cidx, int pidx, const char *p,
+                            int pin) {
+  PatCache *pc = (PatCache *)lua_touserdata(L, cidx);
+  Pattern *pat;
+  int i, victim = 0;
+  for (i = 0; i < PATCACHE_SIZE; i++) {
+    if (pc->slot[i].key == p) {
+      pc->slot[i].used = ++pc->clock;
+      if (pin) {
+        lua_getfenv(L, cidx);
+        lua_rawgeti(L, -1, 2*i+2);
+        lua_remove(L, -2);
+      }
+      return pc->slot[i].pat;
+    }
+    if (pc->slot[i].used < pc->slot[victim].used) victim = i;
+  }
+  pat = compilepattern(L, p);
+  lua_getfenv(L, cidx);  /* keeps the pattern string and its compiled form */
+  lua_pushvalue(L, pidx);
+  lua_rawseti(L, -2, 2*victim+1);
+  lua_pushvalue(L, -2);
+  lua_rawseti(L, -2, 2*victim+2);
+  lua_pop(L, pin ? 1 : 2);
+  pc->slot[victim].key = p;
+  pc->slot[victim].pat = pat;
+  pc->slot[victim].used = ++pc->clock;
+  return pat;
+}
+
+
+static int singleitem (int c, const PatItem *it) {
+  switch (it->op) {
+    case P_CHAR: return (it->c1 == c);
+    case P_ANY: return 1;
+    case P_CLASS: return match_class(c, it->c1);
+    default: return matchbracketclass(c, it->p, it->ec);  /* P_SETCLASS */
+  }
+}
+
+#define itemmatch(pat,c,it) \
+  ((it)->op == P_SET ? ((pat)->sets[(it)->set][(c) >> 3] >> ((c) & 7)) & 1 \
+                     : singleitem(c, it))
+
+
+static const char *pmatch (MatchState *ms, const Pattern *pat,
+                           const char *s, const PatItem *it);
+
+
+static const char *pmax_expand (MatchState *ms, const Pattern *pat,
+                                const char *s, const PatItem *it) {
+  ptrdiff_t i = 0;  /* counts maximum expand for item */
+  while ((s+i)<ms->src_end && itemmatch(pat, uchar(*(s+i)), it))
+    i++;
+  /* keeps trying to match with the maximum repetitions */
+  while (i>=0) {
+    const char *res = pmatch(ms, pat, (s+i), it+1);
+    if (res) return res;
+    i--;  /* else didn't match; reduce 1 repetition to try again */
+  }
+  return NULL;
+}
+
+
+static const char *pmin_expand (MatchState *ms, const Pattern *pat,
+                                const char *s, const PatItem *it) {
+  for (;;) {
+    const char *res = pmatch(ms, pat, s, it+1);
+    if (res != NULL)
+      return res;
+    else if (s<ms->src_end && itemmatch(pat, uchar(*s), it))
+      s++;  /* try with one more repetition */
+    else return NULL;
+  }
+}
+
+
+static const char *pstart_capture (MatchState *ms, const Pattern *pat,
+                                   const char *s, const PatItem *it,
+                                   int what) {
+  const char *res;
+  int level = ms->level;
+  if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+  ms->capture[level].init = s;
+  ms->capture[level].len = what;
+  ms->level = level+1;
+  if ((res=pmatch(ms, pat, s, it)) == NULL)  /* match failed? */
+    ms->level--;  /* undo capture */
+  return res;
+}
+
+
+static const char *pend_capture (MatchState *ms, const Pattern *pat,
+                                 const char *s, const PatItem *it) {
+  int l = capture_to_close(ms);
+  const char *res;
+  ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+  if ((res = pmatch(ms, pat, s, it)) == NULL)  /* match failed? */
+    ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+  return res;
+}
+
+
+static const char *pmatch (MatchState *ms, const Pattern *pat,
+                           const char *s, const PatItem *it) {
+  init: /* using goto's to optimize tail recursion */
+  switch (it->op) {
+    case P_OPEN: {
+      return pstart_capture(ms, pat, s, it+1, CAP_UNFINISHED);
+    }
+    case P_POSITION: {
+      return pstart_capture(ms, pat, s, it+1, CAP_POSITION);
+    }
+    case P_CLOSE: {
+      return pend_capture(ms, pat, s, it+1);
+    }
+    case P_BALANCE: {
+      int cont = 1;
+      if (uchar(*s) != it->c1) return NULL;
+      for (;;) {
+        if (++s >= ms->src_end) return NULL;  /* string ends out of balance */
+        if (uchar(*s) == it->c2) {
+          if (--cont == 0) break;
+        }
+        else if (uchar(*s) == it->c1) cont++;
+      }
+      s++; it++; goto init;
+    }
+    case P_FRONTIER: case P_FRONTIERCLASS: {
+      int previous = (s == ms->src_init) ? '\0' : uchar(*(s-1));
+      int current = uchar(*s);
+      int in_prev, in_cur;
+      if (it->op == P_FRONTIER) {
+        in_prev = (pat->sets[it->set][previous >> 3] >> (previous & 7)) & 1;
+        in_cur = (pat->sets[it->set][current >> 3] >> (current & 7)) & 1;
+      }
+      else {
+        in_prev = matchbracketclass(previous, it->p, it->ec);
+        in_cur = matchbracketclass(current, it->p, it->ec);
+      }
+      if (in_prev || !in_cur) return NULL;
+      it++; goto init;
+    }
+    case P_BACKREF: {
+      s = match_capture(ms, s, it->c1);
+      if (s == NULL) return NULL;
+      it++; goto init;
+    }
+    case P_END: {
+      return s;  /* match succeeded */
+    }
+    case P_ENDANCHOR: {
+      return (s == ms->src_end) ? s : NULL;  /* check end of string */
+    }
+    default: {  /* it is a pattern item */
+      int m = s<ms->src_end && itemmatch(pat, uchar(*s), it);
+      switch (it->rep) {
+        case '?': {  /* optional */
+          const char *res;
+          if (m && ((res=pmatch(ms, pat, s+1, it+1)) != NULL))
+            return res;
+          it++; goto init;
+        }
+        case '*': {  /* 0 or more repetitions */
+          return pmax_expand(ms, pat, s, it);
+        }
+        case '+': {  /* 1 or more repetitions */
+          return (m ? pmax_expand(ms, pat, s+1, it) : NULL);
+        }
+        case '-': {  /* 0 or more repetitions (minimum) */
+          return pmin_expand(ms, pat, s, it);
+        }
+        default: {
+          if (!m) return NULL;
+          s++; it++; goto init;
+        }
+      }
+    }
+  }
+}
+
+
+/*
+** Finds the first match of the pattern starting at or after 's' (only at
+** 's' if 'anchor'); returns its start and sets '*e' to its end
+*/
+static const char *findmatch (MatchState *ms, const Pattern *pat,
+                              const char *p, const char *s, int anchor,
+                              const char **e) {
+  if (pat->literal) {  /* plain substring */
+    const char *s2;
+    ms->level = 0;
+    if (!anchor)
+      s2 = lmemfind(s, ms->src_end-s, pat->lit, pat->litlen);
+    else if ((size_t)(ms->src_end-s) >= pat->litlen &&
+             memcmp(s, pat->lit, pat->litlen) == 0)
+      s2 = s;
+    else
+      s2 = NULL;
+    if (s2) *e = s2+pat->litlen;
+    return s2;
+  }
+  do {
+    if (pat->first >= 0 && !anchor) {  /* skip to the next possible start */
+      s = (const char *)memchr(s, pat->first, ms->src_end-s);
+      if (s == NULL) return NULL;
+    }
+    ms->level = 0;
+    *e = pat->valid ? pmatch(ms, pat, s, pat->item) : match(ms, s, p);
+    if (*e != NULL) return s;
+  } while (s++ < ms->src_end && !anchor);
+  return NULL;
+}
+
+/* }====================================================== */
+
+
 static void push_onecapture (MatchState *ms, int i, const char *s,
                                                     const char *e) {
   if (i >= ms->level) {
@@ -512,23 +965,20 @@ static int str_find_aux (lua_State *L, int find) {
   else {
     MatchState ms;
     int anchor = (*p == '^') ? (p++, 1) : 0;
-    const char *s1=s+init;
+    const Pattern *pat = getpattern(L, lua_upvalueindex(1), 2, p, 0);
+    const char *s1, *res;
     ms.L = L;
     ms.src_init = s;
     ms.src_end = s+l1;
-    do {
-      const char *res;
-      ms.level = 0;
-      if ((res=match(&ms, s1, p)) != NULL) {
-        if (find) {
-          lua_pushinteger(L, s1-s+1);  /* start */
-          lua_pushinteger(L, res-s);   /* end */
-          return push_captures(&ms, NULL, 0) + 2;
-        }
-        else
-          return push_captures(&ms, s1, res);
+    if ((s1 = findmatch(&ms, pat, p, s+init, anchor, &res)) != NULL) {
+      if (find) {
+        lua_pushinteger(L, s1-s+1);  /* start */
+        lua_pushinteger(L, res-s);   /* end */
+        return push_captures(&ms, NULL, 0) + 2;
       }
-    } while (s1++ < ms.src_end && !anchor);
+      else
+        return push_captures(&ms, s1, res);
+    }
   }
   lua_pushnil(L);  /* not found */
   return 1;
@@ -550,22 +1000,20 @@ static int gmatch_aux (lua_State *L) {
   size_t ls;
   const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
   const char *p = lua_tostring(L, lua_upvalueindex(2));
-  const char *src;
+  const Pattern *pat = getpattern(L, lua_upvalueindex(4),
+                                  lua_upvalueindex(2), p, 0);
+  const char *src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3));
+  const char *e;
   ms.L = L;
   ms.src_init = s;
   ms.src_end = s+ls;
-  for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3));
-       src <= ms.src_end;
-       src++) {
-    const char *e;
-    ms.level = 0;
-    if ((e = match(&ms, src, p)) != NULL) {
-      lua_Integer newstart = e-s;
-      if (e == src) newstart++;  /* empty match? go at least one position */
-      lua_pushinteger(L, newstart);
-      lua_replace(L, lua_upvalueindex(3));
-      return push_captures(&ms, src, e);
-    }
+  if (src <= ms.src_end &&
+      (src = findmatch(&ms, pat, p, src, 0, &e)) != NULL) {
+    lua_Integer newstart = e-s;
+    if (e == src) newstart++;  /* empty match? go at least one position */
+    lua_pushinteger(L, newstart);
+    lua_replace(L, lua_upvalueindex(3));
+    return push_captures(&ms, src, e);
   }
   return 0;  /* not found */
 }
@@ -576,7 +1024,8 @@ static int gmatch (lua_State *L) {
   luaL_checkstring(L, 2);
   lua_settop(L, 2);
   lua_pushinteger(L, 0);
-  lua_pushcclosure(L, gmatch_aux, 3);
+  lua_pushvalue(L, lua_upvalueindex(1));  /* pattern cache */
+  lua_pushcclosure(L, gmatch_aux, 4);
   return 1;
 }
 
@@ -651,22 +1100,26 @@ static int str_gsub (lua_State *L) {
   int n = 0;
   MatchState ms;
   luaL_Buffer b;
+  const Pattern *pat;
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table expected");
+  lua_settop(L, 4);
+  /* pinned: replacement functions may run other patterns */
+  pat = getpattern(L, lua_upvalueindex(1), 2, p, 1);
   luaL_buffinit(L, &b);
   ms.L = L;
   ms.src_init = src;
   ms.src_end = src+srcl;
   while (n < max_s) {
     const char *e;
-    ms.level = 0;
-    e = match(&ms, src, p);
-    if (e) {
-      n++;
-      add_value(&ms, &b, src, e);
-    }
-    if (e && e>src) /* non empty match? */
+    const char *m = findmatch(&ms, pat, p, src, anchor, &e);
+    if (m == NULL) break;  /* no more matches; keep the rest */
+    luaL_addlstring(&b, src, m-src);
+    src = m;
+    n++;
+    add_value(&ms, &b, src, e);
+    if (e>src) /* non empty match? */
       src = e;  /* skip it */
     else if (src < ms.src_end)
       luaL_addchar(&b, *src++);
@@ -693,33 +1146,28 @@ static int str_gsub (lua_State *L) {
 #define MAX_FORMAT	(sizeof(FLAGS) + sizeof(LUA_INTFRMLEN) + 10)
 
 
-static void addquoted (lua_State *L, luaL_Buffer *b, int arg) {
+static void addquoted (lua_State *L, lua_Writer w, void *ud, int arg) {
   size_t l;
   const char *s = luaL_checklstring(L, arg, &l);
-  luaL_addchar(b, '"');
+  const char *run = s;  /* start of pending unescaped characters */
+  w(L, "\"", 1, ud);
   while (l--) {
+    const char *esc;
+    size_t el;
     switch (*s) {
-      case '"': case '\\': case '\n': {
-        luaL_addchar(b, '\\');
-        luaL_addchar(b, *s);
-        break;
-      }
-      case '\r': {
-        luaL_addlstring(b, "\\r", 2);
-        break;
-      }
-      case '\0': {
-        luaL_addlstring(b, "\\000", 4);
-        break;
-      }
-      default: {
-        luaL_addchar(b, *s);
-        break;
-      }
+      case '"': esc = "\\\""; el = 2; break;
+      case '\\': esc = "\\\\"; el = 2; break;
+      case '\n': esc = "\\\n"; el = 2; break;
+      case '\r': esc = "\\r"; el = 2; break;
+      case '\0': esc = "\\000"; el = 4; break;
+      default: s++; continue;
     }
-    s++;
+    if (s > run) w(L, run, s - run, ud);
+    w(L, esc, el, ud);
+    run = ++s;
   }
-  luaL_addchar(b, '"');
+  if (s > run) w(L, run, s - run, ud);
+  w(L, "\"", 1, ud);
 }
 
 static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
@@ -753,18 +1201,23 @@ static void addintlen (char *form) {
 }
 
 
-static int str_format (lua_State *L) {
-  int arg = 1;
+/*
+** Formats the arguments from 'arg' on (format string first) straight into
+** 'w', so callers with their own storage (see strbuf) avoid building an
+** intermediate Lua string.
+*/
+LUALIB_API void luaL_writeformat (lua_State *L, int arg, lua_Writer w, void *ud) {
   size_t sfl;
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
   const char *strfrmt_end = strfrmt+sfl;
-  luaL_Buffer b;
-  luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
-    if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
+    if (*strfrmt != L_ESC) {
+      const char *run = strfrmt;
+      while (strfrmt < strfrmt_end && *strfrmt != L_ESC) strfrmt++;
+      w(L, run, strfrmt - run, ud);
+    }
     else if (*++strfrmt == L_ESC)
-      luaL_addchar(&b, *strfrmt++);  /* %% */
+      w(L, strfrmt++, 1, ud);  /* %% */
     else { /* format item */
       char form[MAX_FORMAT];  /* to store the format (`%...') */
       char buff[MAX_ITEM];  /* to store the formatted item */
@@ -791,7 +1244,7 @@ static int str_format (lua_State *L) {
           break;
         }
         case 'q': {
-          addquoted(L, &b, arg);
+          addquoted(L, w, ud, arg);
           continue;  /* skip the 'addsize' at the end */
         }
         case 's': {
@@ -800,8 +1253,7 @@ static int str_format (lua_State *L) {
           if (!strchr(form, '.') && l >= 100) {
             /* no precision and string is too long to be formatted;
                keep original string */
-            lua_pushvalue(L, arg);
-            luaL_addvalue(&b);
+            w(L, s, l, ud);
             continue;  /* skip the `addsize' at the end */
           }
           else {
@@ -810,13 +1262,28 @@ static int str_format (lua_State *L) {
           }
         }
         default: {  /* also treat cases `pnLlh' */
-          return luaL_error(L, "invalid option " LUA_QL("%%%c") " to "
-                               LUA_QL("format"), *(strfrmt - 1));
+          luaL_error(L, "invalid option " LUA_QL("%%%c") " to "
+                        LUA_QL("format"), *(strfrmt - 1));
+          return;
         }
       }
-      luaL_addlstring(&b, buff, strlen(buff));
+      w(L, buff, strlen(buff), ud);
     }
   }
+}
+
+
+static int bufferwriter (lua_State *L, const void *p, size_t sz, void *ud) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer *)ud, (const char *)p, sz);
+  return 0;
+}
+
+
+static int str_format (lua_State *L) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  luaL_writeformat(L, 1, bufferwriter, &b);
   luaL_pushresult(&b);
   return 1;
 }
@@ -858,7 +1325,11 @@ static void createmetatable (lua_State *L) {
 ** Open string library
 */
 LUALIB_API int luaopen_string (lua_State *L) {
-  luaL_register(L, LUA_STRLIBNAME, strlib);
+  PatCache *pc = (PatCache *)lua_newuserdata(L, sizeof(PatCache));
+  memset(pc, 0, sizeof(PatCache));
+  lua_createtable(L, 2*PATCACHE_SIZE, 0);
+  lua_setfenv(L, -2);
+  luaI_openlib(L, LUA_STRLIBNAME, strlib, 1);  /* cache is upvalue 1 */
 #if defined(LUA_COMPAT_GFIND)
   lua_getfield(L, -1, "gmatch");
   lua_setfield(L, -2, "gfind");
@@ -16,6 +16,10 @@
 ** in its main position (i.e. the `original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** Large hash parts grow incrementally: the old node vector is kept in
+** `oldnode' and its entries move to the new one a few at a time, each
+** time a key is added, so that no single insertion pays for the whole
+** rehash. Lookups check the new part first, then the old one.
 */
 
 #include <math.h>
@@ -47,6 +51,14 @@
 #define MAXASIZE	(1 << MAXBITS)
 
 
+/*
+** hash parts with at least MINREHASHINC nodes are migrated incrementally,
+** REHASHSTEP old nodes for each new key
+*/
+#define MINREHASHINC	256
+#define REHASHSTEP	8
+
+
 #define hashpow2(t,n)      (gnode(t, lmod((n), sizenode(t))))
   
 #define hashstr(t,str)  hashpow2(t, (str)->tsv.hash)
@@ -129,10 +141,33 @@ static int arrayindex (const TValue *key) {
 }
 
 
+/*
+** the hash part being migrated, seen as a table of its own
+*/
+#define oldpart(t,v) \
+	((v)->node = (t)->oldnode, (v)->lsizenode = (t)->loldsizenode, \
+	 (v)->oldnode = NULL, (v))
+
+
+static int findnode (Table *t, StkId key) {
+  Node *n = mainposition(t, key);
+  do {  /* check whether `key' is somewhere in the chain */
+    /* key may be dead already, but it is ok to use it in `next' */
+    if (luaO_rawequalObj(key2tval(n), key) ||
+          (ttype(gkey(n)) == LUA_TDEADKEY && iscollectable(key) &&
+           gcvalue(gkey(n)) == gcvalue(key)))
+      return cast_int(n - gnode(t, 0));  /* key index in hash table */
+    else n = gnext(n);
+  } while (n);
+  return -1;
+}
+
+
 /*
 ** returns the index of a `key' for table traversals. First goes all
-** elements in the array part, then elements in the hash part. The
-** beginning of a traversal is signalled by -1.
+** elements in the array part, then elements in the hash part and then
+** those in the old hash part. The beginning of a traversal is signalled
+** by -1.
 */
 static int findindex (lua_State *L, Table *t, StkId key) {
   int i;
@@ -140,22 +175,18 @@ static int findindex (lua_State *L, Table *t, StkId key) {
   i = arrayindex(key);
   if (0 < i && i <= t->sizearray)  /* is `key' inside array part? */
     return i-1;  /* yes; that's the index (corrected to C) */
-  else {
-    Node *n = mainposition(t, key);
-    do {  /* check whether `key' is somewhere in the chain */
-      /* key may be dead already, but it is ok to use it in `next' */
-      if (luaO_rawequalObj(key2tval(n), key) ||
-            (ttype(gkey(n)) == LUA_TDEADKEY && iscollectable(key) &&
-             gcvalue(gkey(n)) == gcvalue(key))) {
-        i = cast_int(n - gnode(t, 0));  /* key index in hash table */
-        /* hash elements are numbered after array ones */
-        return i + t->sizearray;
-      }
-      else n = gnext(n);
-    } while (n);
-    luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
-    return 0;  /* to avoid warnings */
+  /* hash elements are numbered after array ones */
+  i = findnode(t, key);
+  if (i >= 0)
+    return i + t->sizearray;
+  if (t->oldnode) {
+    Table v;
+    i = findnode(oldpart(t, &v), key);
+    if (i >= 0)
+      return i + t->sizearray + sizenode(t);
   }
+  luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
+  return 0;  /* to avoid warnings */
 }
 
 
@@ -175,6 +206,14 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       return 1;
     }
   }
+  for (i -= sizenode(t); i < sizeoldnode(t); i++) {  /* then old hash part */
+    Node *n = &t->oldnode[i];
+    if (!ttisnil(gval(n))) {
+      setobj2s(L, key, key2tval(n));
+      setobj2s(L, key+1, gval(n));
+      return 1;
+    }
+  }
   return 0;  /* no more elements */
 }
 
@@ -186,6 +225,9 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
 */
 
 
+static TValue *newkey (lua_State *L, Table *t, const TValue *key);
+
+
 static int computesizes (int nums[], int *narray) {
   int i;
   int twotoi;  /* 2^i */
@@ -255,6 +297,14 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
       totaluse++;
     }
   }
+  i = sizeoldnode(t);
+  while (i--) {
+    Node *n = &t->oldnode[i];
+    if (!ttisnil(gval(n))) {
+      ause += countint(key2tval(n), nums);
+      totaluse++;
+    }
+  }
   *pnasize += ause;
   return totaluse;
 }
@@ -294,15 +344,61 @@ static void setnodevector (lua_State *L, Table *t, int size) {
 }
 
 
-static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
+static void reinsert (lua_State *L, Table *t, Node *nold, int lsize) {
+  int i;
+  for (i = twoto(lsize) - 1; i >= 0; i--) {
+    Node *old = nold+i;
+    if (!ttisnil(gval(old)))
+      setobjt2t(L, luaH_set(L, t, key2tval(old)), gval(old));
+  }
+  if (nold != dummynode)
+    luaM_freearray(L, nold, twoto(lsize), Node);  /* free old array */
+}
+
+
+/*
+** moves up to `n' entries of the old hash part into the current one,
+** freeing the old part once it is empty
+*/
+static void migrate (lua_State *L, Table *t, int n) {
+  Node *nold = t->oldnode;
+  while (n-- > 0) {
+    Node *old;
+    if (t->rehashpos == 0) {  /* all moved? */
+      luaM_freearray(L, nold, twoto(t->loldsizenode), Node);
+      t->oldnode = NULL;
+      return;
+    }
+    old = nold + --t->rehashpos;
+    if (!ttisnil(gval(old))) {
+      TValue k, v;  /* copies: `newkey' may rehash and free `nold' */
+      setobj(L, &k, key2tval(old));
+      setobj(L, &v, gval(old));
+      setobjt2t(L, newkey(L, t, &k), &v);
+      if (t->oldnode != nold)
+        return;  /* the rehash has merged the rest of the old part */
+      setnilvalue(gval(old));  /* moved */
+    }
+  }
+}
+
+
+static void resize (lua_State *L, Table *t, int nasize, int nhsize,
+                    int incremental) {
   int i;
   int oldasize = t->sizearray;
   int oldhsize = t->lsizenode;
   Node *nold = t->node;  /* save old hash ... */
+  Node *pending = t->oldnode;  /* ... and any part not migrated yet */
+  incremental = incremental && pending == NULL && nasize == oldasize &&
+                nold != dummynode && twoto(oldhsize) >= MINREHASHINC;
+  if (incremental)  /* room for the new keys that drive the migration */
+    nhsize += twoto(oldhsize) / REHASHSTEP;
   if (nasize > oldasize)  /* array part must grow? */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);  
+  t->oldnode = NULL;
   if (nasize < oldasize) {  /* array part must shrink? */
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
@@ -313,20 +409,26 @@ static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
     /* shrink array */
     luaM_reallocvector(L, t->array, oldasize, nasize, TValue);
   }
-  /* re-insert elements from hash part */
-  for (i = twoto(oldhsize) - 1; i >= 0; i--) {
-    Node *old = nold+i;
-    if (!ttisnil(gval(old)))
-      setobjt2t(L, luaH_set(L, t, key2tval(old)), gval(old));
+  if (incremental) {
+    /* keys stay where lookups find them; new keys move them over */
+    t->oldnode = nold;
+    t->loldsizenode = cast_byte(oldhsize);
+    t->rehashpos = twoto(oldhsize);
+    return;
   }
-  if (nold != dummynode)
-    luaM_freearray(L, nold, twoto(oldhsize), Node);  /* free old array */
+  /* re-insert elements from hash part */
+  reinsert(L, t, nold, oldhsize);
+  if (pending)
+    reinsert(L, t, pending, t->loldsizenode);
 }
 
 
 void luaH_resizearray (lua_State *L, Table *t, int nasize) {
-  int nsize = (t->node == dummynode) ? 0 : sizenode(t);
-  resize(L, t, nasize, nsize);
+  int nsize;
+  if (t->oldnode)
+    migrate(L, t, MAX_INT);  /* finish pending migration */
+  nsize = (t->node == dummynode) ? 0 : sizenode(t);
+  resize(L, t, nasize, nsize, 0);
 }
 
 
@@ -345,7 +447,7 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   /* compute new size for array part */
   na = computesizes(nums, &nasize);
   /* resize the table to new computed sizes */
-  resize(L, t, nasize, totaluse - na);
+  resize(L, t, nasize, totaluse - na, 1);
 }
 
 
@@ -365,6 +467,9 @@ Table *luaH_new (lua_State *L, int narray, int nhash) {
   t->sizearray = 0;
   t->lsizenode = 0;
   t->node = cast(Node *, dummynode);
+  t->oldnode = NULL;
+  t->loldsizenode = 0;
+  t->rehashpos = 0;
   setarrayvector(L, t, narray);
   setnodevector(L, t, nhash);
   return t;
@@ -374,11 +479,41 @@ Table *luaH_new (lua_State *L, int narray, int nhash) {
 void luaH_free (lua_State *L, Table *t) {
   if (t->node != dummynode)
     luaM_freearray(L, t->node, sizenode(t), Node);
+  if (t->oldnode)
+    luaM_freearray(L, t->oldnode, sizeoldnode(t), Node);
   luaM_freearray(L, t->array, t->sizearray, TValue);
   luaM_free(L, t);
 }
 
 
+/*
+** empty a table but keep its array and hash parts allocated, so that
+** refilling it up to the same size does not rehash; a pending
+** incremental migration is dropped together with its contents
+*/
+void luaH_clear (lua_State *L, Table *t) {
+  int i;
+  for (i = 0; i < t->sizearray; i++)
+    setnilvalue(&t->array[i]);
+  if (t->node != dummynode) {
+    int size = sizenode(t);
+    for (i = 0; i < size; i++) {
+      Node *n = gnode(t, i);
+      gnext(n) = NULL;
+      setnilvalue(gkey(n));
+      setnilvalue(gval(n));
+    }
+    t->lastfree = gnode(t, size);  /* all positions are free again */
+  }
+  if (t->oldnode) {
+    luaM_freearray(L, t->oldnode, sizeoldnode(t), Node);
+    t->oldnode = NULL;
+    t->loldsizenode = 0;
+    t->rehashpos = 0;
+  }
+}
+
+
 static Node *getfreepos (Table *t) {
   while (t->lastfree-- > t->node) {
     if (ttisnil(gkey(t->lastfree)))
@@ -429,6 +564,23 @@ static TValue *newkey (lua_State *L, Table *t, const TValue *key) {
 }
 
 
+/*
+** search function for the old hash part; entries already moved (or
+** removed) are nil there and count as absent, so that new values for
+** their keys go to the current part
+*/
+static const TValue *getold (Table *t, const TValue *key) {
+  Table v;
+  Node *n = mainposition(oldpart(t, &v), key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (luaO_rawequalObj(key2tval(n), key))
+      return ttisnil(gval(n)) ? luaO_nilobject : gval(n);
+    else n = gnext(n);
+  } while (n);
+  return luaO_nilobject;
+}
+
+
 /*
 ** search function for integers
 */
@@ -444,6 +596,11 @@ const TValue *luaH_getnum (Table *t, int key) {
         return gval(n);  /* that's it */
       else n = gnext(n);
     } while (n);
+    if (t->oldnode) {
+      TValue k;
+      setnvalue(&k, nk);
+      return getold(t, &k);
+    }
     return luaO_nilobject;
   }
 }
@@ -459,6 +616,12 @@ const TValue *luaH_getstr (Table *t, TString *key) {
       return gval(n);  /* that's it */
     else n = gnext(n);
   } while (n);
+  if (t->oldnode) {
+    TValue k;
+    k.value.gc = obj2gco(key);
+    k.tt = LUA_TSTRING;
+    return getold(t, &k);
+  }
   return luaO_nilobject;
 }
 
@@ -485,7 +648,7 @@ const TValue *luaH_get (Table *t, const TValue *key) {
           return gval(n);  /* that's it */
         else n = gnext(n);
       } while (n);
-      return luaO_nilobject;
+      return t->oldnode ? getold(t, key) : luaO_nilobject;
     }
   }
 }
@@ -500,6 +663,7 @@ TValue *luaH_set (lua_State *L, Table *t, const TValue *key) {
     if (ttisnil(key)) luaG_runerror(L, "table index is nil");
     else if (ttisnumber(key) && luai_numisnan(nvalue(key)))
       luaG_runerror(L, "table index is NaN");
+    if (t->oldnode) migrate(L, t, REHASHSTEP);
     return newkey(L, t, key);
   }
 }
@@ -512,6 +676,7 @@ TValue *luaH_setnum (lua_State *L, Table *t, int key) {
   else {
     TValue k;
     setnvalue(&k, cast_num(key));
+    if (t->oldnode) migrate(L, t, REHASHSTEP);
     return newkey(L, t, &k);
   }
 }
@@ -524,6 +689,7 @@ TValue *luaH_setstr (lua_State *L, Table *t, TString *key) {
   else {
     TValue k;
     setsvalue(L, &k, key);
+    if (t->oldnode) migrate(L, t, REHASHSTEP);
     return newkey(L, t, &k);
   }
 }
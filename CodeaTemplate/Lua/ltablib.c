@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define ltablib_c
 #define LUA_LIB
@@ -87,6 +88,31 @@ static int setn (lua_State *L) {
 }
 
 
+/*
+** table.new(narray, nhash): preallocate both parts so that filling the
+** table does not go through repeated rehashes
+*/
+static int tnew (lua_State *L) {
+  int narray = luaL_optint(L, 1, 0);
+  int nhash = luaL_optint(L, 2, 0);
+  luaL_argcheck(L, narray >= 0, 1, "negative size");
+  luaL_argcheck(L, nhash >= 0, 2, "negative size");
+  lua_createtable(L, narray, nhash);
+  return 1;
+}
+
+
+/*
+** table.clear(t): remove every entry but keep the allocated parts, so a
+** table rebuilt each frame can be reused without producing garbage
+*/
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);
+  return 0;
+}
+
+
 static int tinsert (lua_State *L) {
   int e = aux_getn(L, 1) + 1;  /* first empty element */
   int pos;  /* where to insert new element */
@@ -164,9 +190,10 @@ static int tconcat (lua_State *L) {
 
 /*
 ** {======================================================
-** Quicksort
-** (based on `Algorithms in MODULA-3', Robert Sedgewick;
-**  Addison-Wesley, 1993.)
+** Introsort
+** (quicksort based on `Algorithms in MODULA-3', Robert Sedgewick;
+**  Addison-Wesley, 1993; falls back to heapsort when partitioning
+**  degenerates, so the worst case is O(n log n))
 */
 
 
@@ -190,9 +217,56 @@ static int sort_comp (lua_State *L, int a, int b) {
     return lua_lessthan(L, a, b);
 }
 
-static void auxsort (lua_State *L, int l, int u) {
+static int sort_depth (int n) {
+  int d = 0;
+  while (n > 1) { n >>= 1; d += 2; }  /* 2*log2(n) */
+  return d;
+}
+
+static void siftdown (lua_State *L, int lo, int i, int n) {
+  for (;;) {  /* a[lo+i-1] is the root of a max-heap of n elements */
+    int c = 2*i;
+    if (c > n) break;
+    lua_rawgeti(L, 1, lo+c-1);
+    if (c < n) {
+      lua_rawgeti(L, 1, lo+c);
+      if (sort_comp(L, -2, -1)) {  /* left child < right child? */
+        lua_remove(L, -2);
+        c++;
+      }
+      else
+        lua_pop(L, 1);
+    }
+    lua_rawgeti(L, 1, lo+i-1);
+    if (!sort_comp(L, -1, -2)) {  /* parent >= larger child? */
+      lua_pop(L, 2);
+      break;
+    }
+    set2(L, lo+c-1, lo+i-1);
+    i = c;
+  }
+}
+
+static void heapsort (lua_State *L, int l, int u) {
+  int n = u-l+1;
+  int i;
+  for (i = n/2; i >= 1; i--)
+    siftdown(L, l, i, n);
+  for (i = n; i > 1; i--) {
+    lua_rawgeti(L, 1, l);
+    lua_rawgeti(L, 1, l+i-1);
+    set2(L, l, l+i-1);  /* move the maximum to the end */
+    siftdown(L, l, 1, i-1);
+  }
+}
+
+static void auxsort (lua_State *L, int l, int u, int depth) {
   while (l < u) {  /* for tail recursion */
     int i, j;
+    if (depth-- == 0) {  /* too many bad partitions */
+      heapsort(L, l, u);
+      return;
+    }
     /* sort elements a[l], a[(l+u)/2] and a[u] */
     lua_rawgeti(L, 1, l);
     lua_rawgeti(L, 1, u);
@@ -249,17 +323,254 @@ static void auxsort (lua_State *L, int l, int u) {
     else {
       j=i+1; i=u; u=j-2;
     }
-    auxsort(L, j, i);  /* call recursively the smaller one */
+    auxsort(L, j, i, depth);  /* call recursively the smaller one */
   }  /* repeat the routine for the larger one */
 }
 
+
+/*
+** Homogeneous number or string arrays are copied into a C array and
+** sorted there, without going through the API for every comparison.
+** Keys carry their original position, which breaks ties and makes the
+** order total (and `sortby' stable).
+*/
+
+typedef struct SortKey {
+  lua_Number n;
+  const char *s;
+  size_t l;
+  int i;  /* original (0-based) position */
+} SortKey;
+
+#define SORT_NUMBERS	0
+#define SORT_STRINGS	1
+
+#define SORT_INSERTION	12  /* partitions smaller than this use insertion sort */
+
+#define sort_isnan(x)	((x) != (x))
+
+/* same ordering as lua_lessthan on two strings (see l_strcmp in lvm.c) */
+static int sort_strcmp (const SortKey *a, const SortKey *b) {
+  const char *l = a->s;
+  size_t ll = a->l;
+  const char *r = b->s;
+  size_t rl = b->l;
+  for (;;) {
+    int temp = strcoll(l, r);
+    if (temp != 0) return temp;
+    else {  /* strings are equal up to a `\0' */
+      size_t len = strlen(l);  /* index of first `\0' in both strings */
+      if (len == rl)  /* r is finished? */
+        return (len == ll) ? 0 : 1;
+      else if (len == ll)  /* l is finished? */
+        return -1;  /* l is smaller than r (because r is not finished) */
+      /* both strings longer than `len'; go on comparing (after the `\0') */
+      len++;
+      l += len; ll -= len; r += len; rl -= len;
+    }
+  }
+}
+
+static int key_lt (const SortKey *a, const SortKey *b, int kind) {
+  if (kind == SORT_NUMBERS) {
+    if (a->n < b->n) return 1;
+    if (a->n != b->n) {
+      /* greater, or a NaN is involved: NaNs go last */
+      if (sort_isnan(a->n) && !sort_isnan(b->n)) return 0;
+      if (sort_isnan(b->n) && !sort_isnan(a->n)) return 1;
+      if (!sort_isnan(a->n)) return 0;
+    }
+  }
+  else {
+    int c = sort_strcmp(a, b);
+    if (c != 0) return c < 0;
+  }
+  return a->i < b->i;
+}
+
+static void key_swap (SortKey *a, SortKey *b) {
+  SortKey t = *a; *a = *b; *b = t;
+}
+
+static void key_siftdown (SortKey *a, int i, int n, int kind) {
+  for (;;) {  /* a[i] is the root of a max-heap of n elements (0-based) */
+    int c = 2*i+1;
+    if (c >= n) break;
+    if (c+1 < n && key_lt(&a[c], &a[c+1], kind)) c++;
+    if (!key_lt(&a[i], &a[c], kind)) break;
+    key_swap(&a[i], &a[c]);
+    i = c;
+  }
+}
+
+static void key_heapsort (SortKey *a, int n, int kind) {
+  int i;
+  for (i = n/2-1; i >= 0; i--)
+    key_siftdown(a, i, n, kind);
+  for (i = n-1; i > 0; i--) {
+    key_swap(&a[0], &a[i]);
+    key_siftdown(a, 0, i, kind);
+  }
+}
+
+static void key_sort (SortKey *a, int l, int u, int depth, int kind) {
+  int i, j;
+  while (u-l >= SORT_INSERTION) {
+    SortKey *p;
+    if (depth-- == 0) {
+      key_heapsort(a+l, u-l+1, kind);
+      return;
+    }
+    /* median of three; a[l] <= a[m] <= a[u] act as sentinels */
+    i = l+(u-l)/2;
+    if (key_lt(&a[i], &a[l], kind)) key_swap(&a[i], &a[l]);
+    if (key_lt(&a[u], &a[i], kind)) {
+      key_swap(&a[u], &a[i]);
+      if (key_lt(&a[i], &a[l], kind)) key_swap(&a[i], &a[l]);
+    }
+    key_swap(&a[i], &a[u-1]);
+    p = &a[u-1];
+    i = l; j = u-1;
+    for (;;) {
+      while (key_lt(&a[++i], p, kind)) ;
+      while (key_lt(p, &a[--j], kind)) ;
+      if (j < i) break;
+      key_swap(&a[i], &a[j]);
+    }
+    key_swap(&a[u-1], &a[i]);
+    /* recurse into the smaller half, loop on the larger one */
+    if (i-l < u-i) {
+      key_sort(a, l, i-1, depth, kind);
+      l = i+1;
+    }
+    else {
+      key_sort(a, i+1, u, depth, kind);
+      u = i-1;
+    }
+  }
+  for (i = l+1; i <= u; i++) {  /* insertion sort */
+    SortKey t = a[i];
+    for (j = i; j > l && key_lt(&t, &a[j-1], kind); j--)
+      a[j] = a[j-1];
+    a[j] = t;
+  }
+}
+
+/*
+** Reads the key at the top of the stack into 'k' (popping it); returns
+** 0 if it does not match 'kind' (or 'kind' is -1 and it is neither a
+** number nor a string)
+*/
+static int getkey (lua_State *L, SortKey *k, int *kind) {
+  int t = lua_type(L, -1);
+  if (t == LUA_TNUMBER && *kind != SORT_STRINGS) {
+    *kind = SORT_NUMBERS;
+    k->n = lua_tonumber(L, -1);
+  }
+  else if (t == LUA_TSTRING && *kind != SORT_NUMBERS) {
+    *kind = SORT_STRINGS;
+    k->s = lua_tolstring(L, -1, &k->l);
+  }
+  else {
+    lua_pop(L, 1);
+    return 0;
+  }
+  lua_pop(L, 1);
+  return 1;
+}
+
+/* writes a[l-1..u-1] back as t[l..u], taking values from table 'from' */
+static void permute (lua_State *L, SortKey *a, int n, int from) {
+  int k;
+  for (k = 0; k < n; k++) {
+    lua_rawgeti(L, from, a[k].i+1);
+    lua_rawseti(L, 1, k+1);
+  }
+}
+
+static void copyarray (lua_State *L, int n) {
+  int i;
+  lua_createtable(L, n, 0);  /* keeps the values alive while 't' is rewritten */
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, 1, i);
+    lua_rawseti(L, -2, i);
+  }
+}
+
+/* sorts a number-only or string-only array in C; returns 0 otherwise */
+static int fastsort (lua_State *L, int n) {
+  SortKey *a;
+  int i, kind = -1;
+  if (n < 2) return 1;
+  a = (SortKey *)lua_newuserdata(L, n*sizeof(SortKey));
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, 1, i+1);
+    if (lua_type(L, -1) == LUA_TNUMBER && sort_isnan(lua_tonumber(L, -1))) {
+      lua_pop(L, 2);  /* keep lua_lessthan's behaviour for NaN */
+      return 0;
+    }
+    if (!getkey(L, &a[i], &kind)) {
+      lua_pop(L, 1);  /* remove keys */
+      return 0;
+    }
+    a[i].i = i;
+  }
+  key_sort(a, 0, n-1, sort_depth(n), kind);
+  if (kind == SORT_NUMBERS) {
+    for (i = 0; i < n; i++) {
+      lua_pushnumber(L, a[i].n);
+      lua_rawseti(L, 1, i+1);
+    }
+  }
+  else {
+    copyarray(L, n);
+    permute(L, a, n, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);  /* remove keys */
+  return 1;
+}
+
 static int sort (lua_State *L) {
   int n = aux_getn(L, 1);
   luaL_checkstack(L, 40, "");  /* assume array is smaller than 2^40 */
   if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
     luaL_checktype(L, 2, LUA_TFUNCTION);
   lua_settop(L, 2);  /* make sure there is two arguments */
-  auxsort(L, 1, n);
+  if (lua_isnil(L, 2) && fastsort(L, n))
+    return 0;
+  auxsort(L, 1, n, sort_depth(n));
+  return 0;
+}
+
+/*
+** table.sortby(t, key): sorts the records of 't' by their (raw) field
+** 'key', which must be all numbers or all strings. Ties keep their order.
+*/
+static int sortby (lua_State *L) {
+  SortKey *a;
+  int i, kind = -1;
+  int n = aux_getn(L, 1);
+  luaL_argcheck(L, !lua_isnoneornil(L, 2), 2, "key expected");
+  lua_settop(L, 2);
+  if (n < 2) return 0;
+  a = (SortKey *)lua_newuserdata(L, n*sizeof(SortKey));
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, 1, i+1);
+    if (!lua_istable(L, -1))
+      return luaL_error(L, "invalid value (at index %d) in table for "
+                           LUA_QL("sortby"), i+1);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+    if (!getkey(L, &a[i], &kind))
+      return luaL_error(L, "invalid key (at index %d) in table for "
+                           LUA_QL("sortby") " (mixed or non number/string keys)", i+1);
+    a[i].i = i;
+  }
+  key_sort(a, 0, n-1, sort_depth(n), kind);
+  copyarray(L, n);
+  permute(L, a, n, lua_gettop(L));
   return 0;
 }
 
@@ -267,15 +578,18 @@ static int sort (lua_State *L) {
 
 
 static const luaL_Reg tab_funcs[] = {
+  {"clear", tclear},
   {"concat", tconcat},
   {"foreach", foreach},
   {"foreachi", foreachi},
   {"getn", getn},
   {"maxn", maxn},
   {"insert", tinsert},
+  {"new", tnew},
   {"remove", tremove},
   {"setn", setn},
   {"sort", sort},
+  {"sortby", sortby},
   {NULL, NULL}
 };
 
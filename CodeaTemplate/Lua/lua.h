@@ -179,6 +179,7 @@ LUA_API void  (lua_getfield) (lua_State *L, int idx, const char *k);
 LUA_API void  (lua_rawget) (lua_State *L, int idx);
 LUA_API void  (lua_rawgeti) (lua_State *L, int idx, int n);
 LUA_API void  (lua_createtable) (lua_State *L, int narr, int nrec);
+LUA_API void  (lua_cleartable) (lua_State *L, int idx);
 LUA_API void *(lua_newuserdata) (lua_State *L, size_t sz);
 LUA_API int   (lua_getmetatable) (lua_State *L, int objindex);
 LUA_API void  (lua_getfenv) (lua_State *L, int idx);
@@ -226,6 +227,10 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCSTEP		5
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
+#define LUA_GCGEN		8
+#define LUA_GCINC		9
+#define LUA_GCSETMINORMUL	10
+#define LUA_GCSETMAJORMUL	11
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
@@ -243,6 +248,10 @@ LUA_API void  (lua_concat) (lua_State *L, int n);
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud);
 
+/* number <-> string conversions behind lua_number2str/lua_str2number */
+LUA_API int   (lua_num2str) (char *s, lua_Number n);
+LUA_API lua_Number (lua_str2num) (const char *s, char **endptr);
+
 
 
 /* 
@@ -313,6 +313,22 @@
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 
 
+/*
+@@ LUAI_GENMINORMUL defines how much memory (as a percentage of the
+@* memory in use) can be allocated before a minor collection when the
+@* collector runs in generational mode.
+@@ LUAI_GENMAJORMUL defines how much the memory in use can grow (as a
+@* percentage of its size after the last major collection) before the
+@* generational collector performs a major (full) collection.
+** CHANGE them if most of your short-lived objects survive a minor
+** collection (raise LUAI_GENMINORMUL) or if old garbage accumulates
+** for too long (lower LUAI_GENMAJORMUL). You can also change these
+** values dynamically.
+*/
+#define LUAI_GENMINORMUL	20
+#define LUAI_GENMAJORMUL	100
+
+
 
 /*
 @@ LUA_COMPAT_GETN controls compatibility with old getn behavior.
@@ -382,6 +398,16 @@
 #endif
 
 
+/*
+@@ LUA_USE_COMPUTED_GOTO makes the VM dispatch opcodes with computed gotos
+@* (labels as values), an extension supported by GCC and Clang.
+** CHANGE it (define LUA_NO_COMPUTED_GOTO) to use a plain `switch'.
+*/
+#if defined(__GNUC__) && !defined(LUA_NO_COMPUTED_GOTO)
+#define LUA_USE_COMPUTED_GOTO
+#endif
+
+
 /*
 @@ LUAI_BITSINT defines the number of bits in an int.
 ** CHANGE here if Lua cannot automatically detect the number of bits of
@@ -517,12 +543,15 @@
 @@ lua_number2str converts a number to a string.
 @@ LUAI_MAXNUMBER2STR is maximum size of previous conversion.
 @@ lua_str2number converts a string to a number.
+** lua_num2str writes the shortest digits that read back as the same
+** float and lua_str2num is a correctly rounded parser (see lobject.c);
+** both fall back to "%.14g" and strtod when lua_Number is double.
 */
 #define LUA_NUMBER_SCAN		"%f"
 #define LUA_NUMBER_FMT		"%g"
-#define lua_number2str(s,n)	sprintf((s), LUA_NUMBER_FMT, (n))
+#define lua_number2str(s,n)	lua_num2str((s), (n))
 #define LUAI_MAXNUMBER2STR	32 /* 16 digits, sign, point, and \0 */
-#define lua_str2number(s,p)	strtod((s), (p))
+#define lua_str2number(s,p)	lua_str2num((s), (p))
 
 
 /*
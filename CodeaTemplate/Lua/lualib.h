@@ -40,6 +40,10 @@ LUALIB_API int (luaopen_debug) (lua_State *L);
 LUALIB_API int (luaopen_package) (lua_State *L);
 
 
+/* string.format into a writer (lstrlib.c) */
+LUALIB_API void (luaL_writeformat) (lua_State *L, int arg, lua_Writer w, void *ud);
+
+
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L); 
 
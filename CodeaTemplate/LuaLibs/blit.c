@@ -0,0 +1,667 @@
+//
+//  blit.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blit.h"
+
+//Two pixels at a time, widened to 16 bit lanes with the GCC/Clang vector extension (SSE on the
+//simulator, NEON on devices)
+typedef uint8_t blit_bytes __attribute__((vector_size(8)));
+typedef uint16_t blit_wide __attribute__((vector_size(16)));
+
+//One pixel in 32 bit lanes, for the filters' weighted sums
+typedef uint8_t blit_pixelbytes __attribute__((vector_size(4)));
+typedef uint32_t blit_pixel __attribute__((vector_size(16)));
+typedef float blit_pixelf __attribute__((vector_size(16)));
+
+typedef void (*blit_kernel)(uint8_t *dst, const uint8_t *src, size_t n, int premultiplied);
+
+static const blit_wide blit_alphalanes = { 0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF };
+
+static inline blit_wide blit_load(const uint8_t *p)
+{
+    blit_bytes b;
+    memcpy(&b, p, sizeof(b));
+    return __builtin_convertvector(b, blit_wide);
+}
+
+static inline void blit_store(uint8_t *p, blit_wide w)
+{
+    blit_bytes b = __builtin_convertvector(w, blit_bytes);
+    memcpy(p, &b, sizeof(b));
+}
+
+static inline blit_pixel blit_loadpixel(const uint8_t *p)
+{
+    blit_pixelbytes b;
+    memcpy(&b, p, sizeof(b));
+    return __builtin_convertvector(b, blit_pixel);
+}
+
+static inline void blit_storepixel(uint8_t *p, blit_pixel c)
+{
+    blit_pixelbytes b = __builtin_convertvector(c, blit_pixelbytes);
+    memcpy(p, &b, sizeof(b));
+}
+
+//x / 255, rounded, exact for every product of two bytes
+static inline blit_wide blit_div255(blit_wide x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline blit_wide blit_min255(blit_wide x)
+{
+    blit_wide over = (blit_wide)(x > 255);
+    return (x & ~over) | (over & 255);
+}
+
+//Two source pixels, premultiplied if they are not already, and their alphas in every lane
+static inline blit_wide blit_source(const uint8_t *p, int premultiplied, blit_wide *alpha)
+{
+    blit_wide s = blit_load(p);
+    *alpha = __builtin_shufflevector(s, s, 3, 3, 3, 3, 7, 7, 7, 7);
+    if (!premultiplied)
+    {
+        s = blit_div255(s * ((*alpha & ~blit_alphalanes) | (blit_alphalanes & 255)));
+    }
+    return s;
+}
+
+//Nothing to draw: both alphas are zero, and for premultiplied sources the colours too
+static inline int blit_clear(const uint8_t *p, int premultiplied)
+{
+    uint64_t bits;
+    memcpy(&bits, p, sizeof(bits));
+    return premultiplied ? bits == 0 : (p[3] | p[7]) == 0;
+}
+
+//Kernels take an even n
+
+static void blit_over(uint8_t *dst, const uint8_t *src, size_t n, int premultiplied)
+{
+    blit_wide s, a;
+    
+    for (; n; n -= 2, dst += 8, src += 8)
+    {
+        if ((src[3] & src[7]) == 255)
+        {
+            memcpy(dst, src, 8);
+        }
+        else if (!blit_clear(src, premultiplied))
+        {
+            s = blit_source(src, premultiplied, &a);
+            blit_store(dst, blit_min255(s + blit_div255(blit_load(dst) * (255 - a))));
+        }
+    }
+}
+
+static void blit_add(uint8_t *dst, const uint8_t *src, size_t n, int premultiplied)
+{
+    blit_wide s, a;
+    
+    for (; n; n -= 2, dst += 8, src += 8)
+    {
+        s = blit_source(src, premultiplied, &a);
+        blit_store(dst, blit_min255(blit_load(dst) + s));
+    }
+}
+
+static void blit_multiply(uint8_t *dst, const uint8_t *src, size_t n, int premultiplied)
+{
+    blit_wide s, a, d, m;
+    
+    for (; n; n -= 2, dst += 8, src += 8)
+    {
+        s = blit_source(src, premultiplied, &a);
+        d = blit_load(dst);
+        m = (blit_div255(s * d) & ~blit_alphalanes) | (s & blit_alphalanes);
+        blit_store(dst, blit_min255(m + blit_div255(d * (255 - a))));
+    }
+}
+
+static void blit_composite(uint8_t *dst, const uint8_t *src, size_t n, blit_mode mode, int premultiplied)
+{
+    static const blit_kernel kernels[] = { blit_over, blit_add, blit_multiply };
+    size_t even = n & ~(size_t)1;
+    
+    kernels[mode](dst, src, even, premultiplied);
+    
+    //The odd pixel goes through the same kernel, padded with a transparent one
+    if (n & 1)
+    {
+        uint8_t d[8] = { 0 }, s[8] = { 0 };
+        memcpy(d, dst + even * 4, 4);
+        memcpy(s, src + even * 4, 4);
+        kernels[mode](d, s, 2, premultiplied);
+        memcpy(dst + even * 4, d, 4);
+    }
+}
+
+static int blit_opaque(const uint8_t *p, size_t n)
+{
+    uint8_t alpha = 255;
+    
+    for (size_t i = 0; i < n; i++)
+    {
+        alpha &= p[i * 4 + 3];
+    }
+    return alpha == 255;
+}
+
+//Premultiplies n straight pixels from src into dst, which may be src
+static void blit_premultiply(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    blit_wide a;
+    size_t i = 0;
+    
+    for (; i + 2 <= n; i += 2)
+    {
+        blit_store(dst + i * 4, blit_source(src + i * 4, 0, &a));
+    }
+    if (i < n)
+    {
+        uint8_t p[8] = { 0 };
+        memcpy(p, src + i * 4, 4);
+        blit_store(p, blit_source(p, 0, &a));
+        memcpy(dst + i * 4, p, 4);
+    }
+}
+
+//255 / alpha in 16.16 fixed point, so turning colours back is a multiply
+static uint32_t blit_unpremultiplier[256];
+
+static void blit_unpremultipliers(void)
+{
+    static int ready = 0;
+    
+    if (ready)
+    {
+        return;
+    }
+    for (int a = 1; a < 256; a++)
+    {
+        blit_unpremultiplier[a] = ((255u << 16) + a / 2) / a;
+    }
+    ready = 1;
+}
+
+//Turns n premultiplied pixels from src back into straight ones in dst; transparent pixels come out black
+static void blit_unpremultiply(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    blit_unpremultipliers();
+    for (size_t i = 0; i < n; i++, dst += 4, src += 4)
+    {
+        uint8_t a = src[3];
+        blit_pixel c = (blit_loadpixel(src) * blit_unpremultiplier[a] + 32768) >> 16;
+        blit_pixel over = (blit_pixel)(c > 255);
+        
+        c = (c & ~over) | (over & 255);
+        c[3] = a;
+        blit_storepixel(dst, c);
+    }
+}
+
+//Pixels of straight destinations are blended a chunk at a time in a premultiplied copy
+#define BLITCHUNK 64
+
+void blit_row(uint8_t *dst, const uint8_t *src, size_t n, blit_mode mode, int premultiplied, int dstpremultiplied)
+{
+    uint8_t tmp[BLITCHUNK * 4];
+    
+    if (mode == BLIT_COPY)
+    {
+        if (premultiplied == dstpremultiplied)
+        {
+            memmove(dst, src, n * 4);
+        }
+        else if (premultiplied)
+        {
+            blit_unpremultiply(dst, src, n);
+        }
+        else
+        {
+            blit_premultiply(dst, src, n);
+        }
+        return;
+    }
+    
+    if (dstpremultiplied)
+    {
+        blit_composite(dst, src, n, mode, premultiplied);
+        return;
+    }
+    
+    //Opaque straight pixels are the same premultiplied, and every mode leaves them opaque, so runs of
+    //them are blended in place
+    for (size_t i = 0; i < n; i += BLITCHUNK)
+    {
+        size_t m = n - i < BLITCHUNK ? n - i : BLITCHUNK;
+        uint8_t *d = dst + i * 4;
+        
+        if (blit_opaque(d, m))
+        {
+            blit_composite(d, src + i * 4, m, mode, premultiplied);
+        }
+        else
+        {
+            blit_premultiply(tmp, d, m);
+            blit_composite(tmp, src + i * 4, m, mode, premultiplied);
+            blit_unpremultiply(d, tmp, m);
+        }
+    }
+}
+
+//Scaling
+//
+//Destination pixel centres are mapped onto the source in 16.16 fixed point. Bilinear weights are
+//8 bit, so the four products of a pixel's weights add up to exactly 65536
+
+//The first of two taps at 16.16 position pos in a row (or column) of m pixels, and the weight of the
+//second. Positions before the first pixel or past the last one clamp to it
+static inline size_t blit_tap(int64_t pos, size_t m, uint32_t *weight)
+{
+    size_t t;
+    
+    if (pos < 0)
+    {
+        *weight = 0;
+        return 0;
+    }
+    t = (size_t)(pos >> 16);
+    if (t >= m - 1)
+    {
+        *weight = 0;
+        return m - 1;
+    }
+    *weight = (uint32_t)(pos >> 8) & 255;
+    return t;
+}
+
+static void blit_nearest(uint8_t *dst, size_t dw, size_t dh, const uint8_t *src, size_t sw, size_t sh)
+{
+    uint64_t xstep = ((uint64_t)sw << 16) / dw, ystep = ((uint64_t)sh << 16) / dh;
+    uint64_t x, y = ystep / 2;
+    
+    for (size_t j = 0; j < dh; j++, y += ystep)
+    {
+        const uint8_t *row = src + (size_t)(y >> 16) * sw * 4;
+        
+        x = xstep / 2;
+        for (size_t i = 0; i < dw; i++, x += xstep, dst += 4)
+        {
+            memcpy(dst, row + (size_t)(x >> 16) * 4, 4);
+        }
+    }
+}
+
+static void blit_bilinear(uint8_t *dst, size_t dw, size_t dh, const uint8_t *src, size_t sw, size_t sh, int premultiplied)
+{
+    int64_t xstep = (int64_t)(((uint64_t)sw << 16) / dw), ystep = (int64_t)(((uint64_t)sh << 16) / dh);
+    int64_t x, y = ystep / 2 - 32768;
+    
+    for (size_t j = 0; j < dh; j++, y += ystep)
+    {
+        uint32_t wy, wx;
+        size_t y0 = blit_tap(y, sh, &wy), y1 = wy ? y0 + 1 : y0;
+        const uint8_t *row0 = src + y0 * sw * 4, *row1 = src + y1 * sw * 4;
+        
+        x = xstep / 2 - 32768;
+        for (size_t i = 0; i < dw; i++, x += xstep, dst += 4)
+        {
+            size_t x0 = blit_tap(x, sw, &wx), x1 = (wx ? x0 + 1 : x0) * 4;
+            uint32_t w00 = (256 - wx) * (256 - wy), w01 = wx * (256 - wy), w10 = (256 - wx) * wy, w11 = wx * wy;
+            blit_pixel p00 = blit_loadpixel(row0 + x0 * 4), p01 = blit_loadpixel(row0 + x1);
+            blit_pixel p10 = blit_loadpixel(row1 + x0 * 4), p11 = blit_loadpixel(row1 + x1);
+            blit_pixel c;
+            
+            if (premultiplied)
+            {
+                c = (p00 * w00 + p01 * w01 + p10 * w10 + p11 * w11 + 32768) >> 16;
+            }
+            else
+            {
+                //Colours weighted by alpha too, then divided by the total weight of those alphas.
+                //The largest sum, 65536 * 255 * 255, still fits 32 bits; the division is a float
+                //reciprocal, as vector integer division is a scalar loop
+                w00 *= p00[3]; w01 *= p01[3]; w10 *= p10[3]; w11 *= p11[3];
+                uint32_t total = w00 + w01 + w10 + w11;
+                if (total)
+                {
+                    blit_pixelf sum = __builtin_convertvector(p00 * w00 + p01 * w01 + p10 * w10 + p11 * w11, blit_pixelf);
+                    c = __builtin_convertvector(sum * (1.0f / total) + 0.5f, blit_pixel);
+                }
+                else
+                {
+                    c = (blit_pixel){ 0, 0, 0, 0 };
+                }
+                c[3] = (total + 32768) >> 16;
+            }
+            blit_storepixel(dst, c);
+        }
+    }
+}
+
+//Downsampling
+//
+//Each level halves the one before with a 2x2 box. Premultiplied colours are plain averages, two
+//pixels at a time; straight alpha colours are weighted by their alphas like the bilinear filter, and
+//gamma aware levels average in linear light through lookup tables (sRGB to 16 bit linear, and 12 bit
+//linear back to sRGB)
+
+static uint16_t blit_tolinear[256];
+static uint8_t blit_tosrgb[4096];
+
+static void blit_gammatables(void)
+{
+    static int ready = 0;
+    
+    if (ready)
+    {
+        return;
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        float c = i / 255.0f;
+        c = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        blit_tolinear[i] = (uint16_t)(c * 65535 + 0.5f);
+    }
+    for (int i = 0; i < 4096; i++)
+    {
+        float c = (i + 0.5f) / 4096;
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1 / 2.4f) - 0.055f;
+        blit_tosrgb[i] = (uint8_t)(c * 255 + 0.5f);
+    }
+    ready = 1;
+}
+
+static void blit_box(uint8_t *out, const uint8_t *p0, const uint8_t *p1, size_t xstep, int premultiplied, int gamma)
+{
+    const uint8_t *taps[4] = { p0, p0 + xstep, p1, p1 + xstep };
+    blit_pixel sum = { 0, 0, 0, 0 }, c;
+    uint32_t alpha = 0, weight = 0;
+    
+    for (int k = 0; k < 4; k++)
+    {
+        const uint8_t *p = taps[k];
+        uint32_t w = premultiplied ? 1 : p[3];
+        
+        c = gamma ? (blit_pixel){ blit_tolinear[p[0]], blit_tolinear[p[1]], blit_tolinear[p[2]], 0 } : blit_loadpixel(p);
+        sum += c * w;
+        alpha += p[3];
+        weight += w;
+    }
+    
+    c = (blit_pixel){ 0, 0, 0, 0 };
+    if (weight)
+    {
+        blit_pixelf mean = __builtin_convertvector(sum, blit_pixelf) * (1.0f / weight);
+        c = __builtin_convertvector(mean + 0.5f, blit_pixel);
+    }
+    if (gamma)
+    {
+        c = (blit_pixel){ blit_tosrgb[c[0] >> 4], blit_tosrgb[c[1] >> 4], blit_tosrgb[c[2] >> 4], 0 };
+    }
+    c[3] = (alpha + 2) >> 2;
+    blit_storepixel(out, c);
+}
+
+void blit_downsample(uint8_t *dst, const uint8_t *src, size_t sw, size_t sh, int premultiplied, int gamma)
+{
+    size_t dw = sw > 1 ? sw / 2 : 1, dh = sh > 1 ? sh / 2 : 1;
+    size_t xstep = sw > 1 ? 4 : 0, ystep = sh > 1 ? sw * 4 : 0;
+    
+    if (gamma)
+    {
+        blit_gammatables();
+    }
+    
+    for (size_t j = 0; j < dh; j++, dst += dw * 4)
+    {
+        const uint8_t *row0 = src + j * 2 * ystep, *row1 = row0 + ystep;
+        size_t i = 0;
+        
+        if (premultiplied && !gamma && xstep)
+        {
+            for (; i + 2 <= dw; i += 2)
+            {
+                blit_wide a = blit_load(row0 + i * 8) + blit_load(row1 + i * 8);
+                blit_wide b = blit_load(row0 + i * 8 + 8) + blit_load(row1 + i * 8 + 8);
+                blit_wide s = __builtin_shufflevector(a, b, 0, 1, 2, 3, 8, 9, 10, 11) + __builtin_shufflevector(a, b, 4, 5, 6, 7, 12, 13, 14, 15);
+                blit_store(dst + i * 4, (s + 2) >> 2);
+            }
+        }
+        for (; i < dw; i++)
+        {
+            blit_box(dst + i * 4, row0 + i * 2 * xstep, row1 + i * 2 * xstep, xstep, premultiplied, gamma);
+        }
+    }
+}
+
+void blit_scale(uint8_t *dst, size_t dw, size_t dh, const uint8_t *src, size_t sw, size_t sh, int bilinear, int premultiplied)
+{
+    if (dw == 0 || dh == 0 || sw == 0 || sh == 0)
+    {
+        return;
+    }
+    
+    if (bilinear)
+    {
+        //Bilinear taps skip source pixels when shrinking by more than half, so larger reductions
+        //first halve the source with box filtered levels like a mip chain. Each level only needs the
+        //one before, so they alternate between two buffers
+        size_t first = (sw / 2) * (sh / 2) * 4;
+        uint8_t *levels = NULL, *level = NULL;
+        
+        if (sw >= dw * 2 && sh >= dh * 2)
+        {
+            levels = malloc(first + (sw / 4) * (sh / 4) * 4);
+        }
+        while (levels && sw >= dw * 2 && sh >= dh * 2)
+        {
+            level = level == levels ? levels + first : levels;
+            blit_downsample(level, src, sw, sh, premultiplied, 0);
+            src = level;
+            sw /= 2;
+            sh /= 2;
+        }
+        blit_bilinear(dst, dw, dh, src, sw, sh, premultiplied);
+        free(levels);
+    }
+    else
+    {
+        blit_nearest(dst, dw, dh, src, sw, sh);
+    }
+}
+
+//Rotation
+//
+//Quarter turns read rows and write columns (or the reverse), so they walk the image in tiles that
+//keep both sides in the cache
+
+#define BLITTILE 32
+
+void blit_rotate(uint8_t *dst, const uint8_t *src, size_t w, size_t h, int turns)
+{
+    size_t count = w * h;
+    
+    if (count == 0)
+    {
+        return;
+    }
+    
+    switch (((turns % 4) + 4) % 4)
+    {
+        case 0:
+            memcpy(dst, src, count * 4);
+            break;
+            
+        case 2:
+            for (size_t i = 0; i < count; i++)
+            {
+                memcpy(dst + (count - 1 - i) * 4, src + i * 4, 4);
+            }
+            break;
+            
+        default:
+        {
+            int ccw = ((turns % 4) + 4) % 4 == 1;
+            
+            for (size_t ty = 0; ty < h; ty += BLITTILE)
+            {
+                for (size_t tx = 0; tx < w; tx += BLITTILE)
+                {
+                    size_t ey = ty + BLITTILE < h ? ty + BLITTILE : h;
+                    size_t ex = tx + BLITTILE < w ? tx + BLITTILE : w;
+                    
+                    for (size_t y = ty; y < ey; y++)
+                    {
+                        for (size_t x = tx; x < ex; x++)
+                        {
+                            //x, y goes to h-1-y, x counterclockwise and y, w-1-x clockwise
+                            size_t i = ccw ? x * h + (h - 1 - y) : (w - 1 - x) * h + y;
+                            memcpy(dst + i * 4, src + (y * w + x) * 4, 4);
+                        }
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
+
+//Texel formats
+//
+//Channels are quantized as (c * levels + offset) / 255, where the offset is 127 to round or a 4x4
+//Bayer threshold to dither. An ordered pattern depends only on the pixel's position, so textures that
+//are rebuilt every frame do not shimmer the way error diffusion would
+
+static const uint8_t blit_bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+
+typedef struct blit_layout
+{
+    uint16_t levels[4];     //Largest value of each channel, 0 for channels the format drops
+    uint16_t scales[4];     //Each channel's place in the texel, as a multiplier (lanes do not shift separately)
+} blit_layout;
+
+static const blit_layout blit_layouts[] =
+{
+    { { 15, 15, 15, 15 }, { 1 << 12, 1 << 8, 1 << 4, 1 } },     //BLIT_RGBA4444
+    { { 31, 31, 31, 1 }, { 1 << 11, 1 << 6, 1 << 1, 1 } },      //BLIT_RGB5A1
+    { { 31, 63, 31, 0 }, { 1 << 11, 1 << 5, 1, 0 } },           //BLIT_RGB565
+};
+
+//x / 255 rounded down, exact below 65280
+static inline blit_wide blit_floor255(blit_wide x)
+{
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+static inline blit_wide blit_pair(const uint16_t *lanes)
+{
+    return (blit_wide){ lanes[0], lanes[1], lanes[2], lanes[3], lanes[0], lanes[1], lanes[2], lanes[3] };
+}
+
+//Two texels from two pixels. The channels' bits do not overlap, so adding the lanes of each pixel
+//packs them
+static inline blit_wide blit_texels(const uint8_t *p, blit_wide levels, blit_wide scales, blit_wide offsets)
+{
+    blit_wide q = blit_floor255(blit_load(p) * levels + offsets) * scales;
+    q += __builtin_shufflevector(q, q, 1, 0, 3, 2, 5, 4, 7, 6);
+    return q + __builtin_shufflevector(q, q, 2, 3, 0, 1, 6, 7, 4, 5);
+}
+
+void blit_pack(void *dst, const uint8_t *src, size_t w, size_t h, blit_format format, int dither)
+{
+    const blit_layout *layout = &blit_layouts[format];
+    blit_wide levels, scales, offsets[2], q;
+    uint16_t *out = dst;
+    
+    if (format == BLIT_A8)
+    {
+        uint8_t *alpha = dst;
+        for (size_t i = 0; i < w * h; i++)
+        {
+            alpha[i] = src[i * 4 + 3];
+        }
+        return;
+    }
+    
+    levels = blit_pair(layout->levels);
+    scales = blit_pair(layout->scales);
+    
+    for (size_t y = 0; y < h; y++)
+    {
+        size_t x = 0;
+        
+        //Thresholds for pixel pairs at x % 4 of 0-1 and 2-3. Single bit channels always round
+        for (int k = 0; k < 2; k++)
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                int t = blit_bayer[y & 3][k * 2 + c / 4] * 16 + 8;
+                offsets[k][c] = dither && levels[c] > 1 ? t : 127;
+            }
+        }
+        
+        for (; x + 2 <= w; x += 2, src += 8, out += 2)
+        {
+            q = blit_texels(src, levels, scales, offsets[(x >> 1) & 1]);
+            out[0] = q[0];
+            out[1] = q[4];
+        }
+        
+        //The odd pixel at the end of a row is read with a copy of itself
+        if (x < w)
+        {
+            uint8_t pad[8];
+            memcpy(pad, src, 4);
+            memcpy(pad + 4, src, 4);
+            q = blit_texels(pad, levels, scales, offsets[(x >> 1) & 1]);
+            *out++ = q[0];
+            src += 4;
+        }
+    }
+}
+
+void blit_quantize(uint8_t *rgba, size_t n, blit_format format)
+{
+    for (size_t i = 0; i < n; i++, rgba += 4)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            if (format == BLIT_A8)
+            {
+                //Alpha textures sample as black
+                if (c < 3) rgba[c] = 0;
+            }
+            else
+            {
+                unsigned levels = blit_layouts[format].levels[c];
+                unsigned q = (rgba[c] * levels + 127) / 255;
+                rgba[c] = levels ? (uint8_t)((q * 255 + levels / 2) / levels) : 255;
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+//
+//  blit.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#ifndef Codify_blit_h
+#define Codify_blit_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Compositing kernels for RGBA8 pixels (r, g, b, a bytes in memory order, the layout of image data).
+//They know nothing of Lua or images; image.m clips and validates before calling them
+
+typedef enum blit_mode
+{
+    BLIT_NORMAL,        //Source over destination
+    BLIT_ADD,           //Source added to destination, saturated
+    BLIT_MULTIPLY,      //Destination multiplied by the source, then source over destination
+    BLIT_COPY,          //Source replaces destination
+} blit_mode;
+
+//Composites n source pixels onto n destination pixels; premultiplied and dstpremultiplied say how each
+//side stores its colours. Blending happens premultiplied, and the result is written back in the
+//destination's form
+void blit_row(uint8_t *dst, const uint8_t *src, size_t n, blit_mode mode, int premultiplied, int dstpremultiplied);
+
+//Resamples a whole sw x sh image into dw x dh, by nearest pixel or bilinear filtering. Straight alpha
+//images are filtered with alpha weighted colours, so transparent pixels do not bleed into edges.
+//Bilinear reductions of half or more go through box filtered levels first, so they do not alias
+void blit_scale(uint8_t *dst, size_t dw, size_t dh, const uint8_t *src, size_t sw, size_t sh, int bilinear, int premultiplied);
+
+//Halves a sw x sh image with a 2x2 box filter into max(1, sw/2) x max(1, sh/2), the next level of a mip
+//chain; odd sizes drop their last row or column. gamma averages sRGB colours in linear light
+void blit_downsample(uint8_t *dst, const uint8_t *src, size_t sw, size_t sh, int premultiplied, int gamma);
+
+//Rotates a w x h image by turns quarter turns counterclockwise (with row 0 at the bottom). dst must
+//not overlap src and is h x w for odd turns
+void blit_rotate(uint8_t *dst, const uint8_t *src, size_t w, size_t h, int turns);
+
+//Texture formats with fewer bits per pixel than RGBA8
+typedef enum blit_format
+{
+    BLIT_RGBA4444,
+    BLIT_RGB5A1,
+    BLIT_RGB565,
+    BLIT_A8,
+} blit_format;
+
+//Packs w x h pixels into 16 bit texels (8 bit for BLIT_A8, which keeps only alpha), rounded to the
+//nearest value or with 4x4 ordered dithering
+void blit_pack(void *dst, const uint8_t *src, size_t w, size_t h, blit_format format, int dither);
+
+//Rounds n pixels in place to the colours the format can hold, without dithering
+void blit_quantize(uint8_t *rgba, size_t n, blit_format format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
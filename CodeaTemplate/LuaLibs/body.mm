@@ -22,10 +22,77 @@
 #include "body.h"
 #import "PhysicsManager.h"
 #import "PhysicsCommands.h"
+#include "codea_luaext.h"
+#include "points.h"
 
 #define RIGIDBODY_TYPE   "body"
 #define RIGIDBODY_SIZE   sizeof(body_wrapper_type)
 
+enum
+{
+    FIELD_X,
+    FIELD_Y,
+    FIELD_POSITION,
+    FIELD_ANGLE,
+    FIELD_LINEARVELOCITY,
+    FIELD_ANGULARVELOCITY,
+    FIELD_AWAKE,
+    FIELD_TYPE,
+    FIELD_DENSITY,
+    FIELD_MASS,
+    FIELD_INERTIA,
+    FIELD_SENSOR,
+    FIELD_BULLET,
+    FIELD_FRICTION,
+    FIELD_RESTITUTION,
+    FIELD_FIXEDROTATION,
+    FIELD_ACTIVE,
+    FIELD_SLEEPINGALLOWED,
+    FIELD_LINEARDAMPING,
+    FIELD_ANGULARDAMPING,
+    FIELD_INTERPOLATE,
+    FIELD_GRAVITYSCALE,
+    FIELD_CATEGORIES,
+    FIELD_MASK,
+    FIELD_SHAPETYPE,
+    FIELD_RADIUS,
+    FIELD_INFO,
+    FIELD_POINTS
+};
+
+static const char *const fields[] =
+{
+    "x",
+    "y",
+    "position",
+    "angle",
+    "linearVelocity",
+    "angularVelocity",
+    "awake",
+    "type",
+    "density",
+    "mass",
+    "inertia",
+    "sensor",
+    "bullet",
+    "friction",
+    "restitution",
+    "fixedRotation",
+    "active",
+    "sleepingAllowed",
+    "linearDamping",
+    "angularDamping",
+    "interpolate",
+    "gravityScale",
+    "categories",
+    "mask",
+    "shapeType",
+    "radius",
+    "info",
+    "points",
+    NULL
+};
+
 extern float PTM_RATIO;
 
 body_wrapper_type* checkRigidbody(lua_State *L, int i)
@@ -170,231 +237,233 @@ static int Lnew(lua_State *L)			/** circleBody(x, y, r) */
 
 static int Lget( lua_State *L)
 {
-    body_wrapper_type *body = checkRigidbody(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    body_wrapper_type *body = (body_wrapper_type*)checkfieldudata(L, 1, RIGIDBODY_TYPE);
  
     if (body->body == NULL) return 0;    
     
     b2Fixture* fixture = body->body->GetFixtureList();
     
-    if( strcmp(c, "x") == 0 )
+    switch( fieldindex(L,2) )
     {
-        if (body->interpolate)
+        case FIELD_X:
         {
-            lua_pushnumber(L, body->renderX * PTM_RATIO);       
-        }
-        else
+            if (body->interpolate)
+            {
+                lua_pushnumber(L, body->renderX * PTM_RATIO);       
+            }
+            else
+            {
+                lua_pushnumber(L, body->body->GetPosition().x * PTM_RATIO);    
+            }
+        } break;
+        case FIELD_Y:
         {
-            lua_pushnumber(L, body->body->GetPosition().x * PTM_RATIO);    
-        }        
-    }
-    else if( strcmp(c, "y") == 0 )
-    {
-        if (body->interpolate)
+            if (body->interpolate)
+            {
+                lua_pushnumber(L, body->renderY * PTM_RATIO);       
+            }
+            else
+            {        
+                lua_pushnumber(L, body->body->GetPosition().y * PTM_RATIO);        
+            }
+        } break;
+        case FIELD_POSITION:
         {
-            lua_pushnumber(L, body->renderY * PTM_RATIO);       
-        }
-        else
-        {        
-            lua_pushnumber(L, body->body->GetPosition().y * PTM_RATIO);        
-        }        
-    }
-    else if (strcmp(c, "position") == 0 )
-    {
-        if (body->interpolate)
+            if (body->interpolate)
+            {
+                pushvec2(L, body->renderX * PTM_RATIO, body->renderY * PTM_RATIO);
+            }
+            else
+            {        
+                pushvec2(L, body->body->GetPosition().x * PTM_RATIO, body->body->GetPosition().y * PTM_RATIO);
+            }
+        } break;
+        case FIELD_ANGLE:
         {
-            pushvec2(L, body->renderX * PTM_RATIO, body->renderY * PTM_RATIO);
-        }
-        else
-        {        
-            pushvec2(L, body->body->GetPosition().x * PTM_RATIO, body->body->GetPosition().y * PTM_RATIO);
-        }        
-    }        
-    else if( strcmp(c, "angle") == 0 )
-    {
-        if (body->interpolate)
+            if (body->interpolate)
+            {
+                lua_pushnumber(L, body->renderAngle / M_PI * 180.0f);        
+            }
+            else
+            {        
+                lua_pushnumber(L, body->body->GetAngle() / M_PI * 180.0f);        
+            }
+        } break;
+        case FIELD_LINEARVELOCITY:
         {
-            lua_pushnumber(L, body->renderAngle / M_PI * 180.0f);        
-        }
-        else
-        {        
-            lua_pushnumber(L, body->body->GetAngle() / M_PI * 180.0f);        
-        }                
-    }    
-    else if (strcmp(c, "linearVelocity") == 0 )
-    {
-        pushvec2(L, body->body->GetLinearVelocity().x * PTM_RATIO, body->body->GetLinearVelocity().y * PTM_RATIO);
-    }            
-    else if( strcmp(c, "angularVelocity") == 0 )
-    {
-        lua_pushnumber(L, body->body->GetAngularVelocity() / M_PI * 180.0f);        
-    }    
-    else if ( strcmp(c, "awake") == 0 )
-    {
-        lua_pushboolean(L, fixture->GetBody()->IsAwake());
-    }         
-    else if ( strcmp(c, "type") == 0 )
-    {
-        lua_pushinteger(L, (lua_Integer)body->body->GetType());
-    }
-    else if ( strcmp(c, "density") == 0 )
-    {
-        lua_pushnumber(L, fixture->GetDensity());        
-    }    
-    else if ( strcmp(c, "mass") == 0 )
-    {
-        lua_pushnumber(L, body->body->GetMass());        
-    }        
-    else if ( strcmp(c, "inertia") == 0 )
-    {
-        lua_pushnumber(L, body->body->GetInertia());        
-    }        
-    else if ( strcmp(c, "sensor") == 0 )
-    {
-        lua_pushboolean(L, fixture->IsSensor());        
-    }     
-    else if ( strcmp(c, "bullet") == 0 )
-    {
-        lua_pushboolean(L, body->body->IsBullet());        
-    }         
-    else if ( strcmp(c, "friction") == 0 )
-    {
-        lua_pushnumber(L, fixture->GetFriction());        
-    }        
-    else if ( strcmp(c, "restitution") == 0 )
-    {
-        lua_pushnumber(L, fixture->GetRestitution());        
-    }        
-    else if ( strcmp(c, "fixedRotation") == 0 )
-    {
-        body->body->IsFixedRotation();
-    }
-    else if ( strcmp(c, "active") == 0 )
-    {
-        lua_pushboolean(L, fixture->GetBody()->IsActive());
-    }
-    else if ( strcmp(c, "sleepingAllowed") == 0 )
-    {
-        lua_pushboolean(L, fixture->GetBody()->IsSleepingAllowed());
-    }
-    else if ( strcmp(c, "linearDamping") == 0 )
-    {            
-        lua_pushboolean(L, body->body->GetLinearDamping());
-    }    
-    else if ( strcmp(c, "angularDamping") == 0 )
-    {            
-        lua_pushboolean(L, body->body->GetAngularDamping());
-    }        
-    else if ( strcmp(c, "interpolate") == 0 )
-    {            
-        lua_pushboolean(L, body->interpolate);
-    }    
-    else if ( strcmp(c, "gravityScale") == 0)
-    {
-        lua_pushnumber(L, body->body->GetGravityScale());
-    }    
-    else if ( strcmp(c, "categories") == 0)
-    {
-                
-        if( body && body->body)
+            pushvec2(L, body->body->GetLinearVelocity().x * PTM_RATIO, body->body->GetLinearVelocity().y * PTM_RATIO);
+        } break;
+        case FIELD_ANGULARVELOCITY:
         {
-            
-            b2Filter filter(body->body->GetFixtureList()->GetFilterData());
-            int n = 0;
-            for (int i = 0; i <= 15; i++)
+            lua_pushnumber(L, body->body->GetAngularVelocity() / M_PI * 180.0f);
+        } break;
+        case FIELD_AWAKE:
+        {
+            lua_pushboolean(L, fixture->GetBody()->IsAwake());
+        } break;
+        case FIELD_TYPE:
+        {
+            lua_pushinteger(L, (lua_Integer)body->body->GetType());
+        } break;
+        case FIELD_DENSITY:
+        {
+            lua_pushnumber(L, fixture->GetDensity());
+        } break;
+        case FIELD_MASS:
+        {
+            lua_pushnumber(L, body->body->GetMass());
+        } break;
+        case FIELD_INERTIA:
+        {
+            lua_pushnumber(L, body->body->GetInertia());
+        } break;
+        case FIELD_SENSOR:
+        {
+            lua_pushboolean(L, fixture->IsSensor());
+        } break;
+        case FIELD_BULLET:
+        {
+            lua_pushboolean(L, body->body->IsBullet());
+        } break;
+        case FIELD_FRICTION:
+        {
+            lua_pushnumber(L, fixture->GetFriction());
+        } break;
+        case FIELD_RESTITUTION:
+        {
+            lua_pushnumber(L, fixture->GetRestitution());
+        } break;
+        case FIELD_FIXEDROTATION:
+        {
+            lua_pushboolean(L, body->body->IsFixedRotation());
+        } break;
+        case FIELD_ACTIVE:
+        {
+            lua_pushboolean(L, fixture->GetBody()->IsActive());
+        } break;
+        case FIELD_SLEEPINGALLOWED:
+        {
+            lua_pushboolean(L, fixture->GetBody()->IsSleepingAllowed());
+        } break;
+        case FIELD_LINEARDAMPING:
+        {
+            lua_pushboolean(L, body->body->GetLinearDamping());
+        } break;
+        case FIELD_ANGULARDAMPING:
+        {
+            lua_pushboolean(L, body->body->GetAngularDamping());
+        } break;
+        case FIELD_INTERPOLATE:
+        {
+            lua_pushboolean(L, body->interpolate);
+        } break;
+        case FIELD_GRAVITYSCALE:
+        {
+            lua_pushnumber(L, body->body->GetGravityScale());
+        } break;
+        case FIELD_CATEGORIES:
+        {
+            if( body && body->body)
             {
-                if (filter.categoryBits & (1 << i))
+            
+                b2Filter filter(body->body->GetFixtureList()->GetFilterData());
+                int n = 0;
+                for (int i = 0; i <= 15; i++)
                 {
-                    n++;
-                }
-            }        
+                    if (filter.categoryBits & (1 << i))
+                    {
+                        n++;
+                    }
+                }        
             
-            lua_createtable(L, n, 0);
-            int count = 1;
-            for (int i = 0; i <= 15; i++)
-            {
-                if (filter.categoryBits & (1 << i))
+                lua_createtable(L, n, 0);
+                int count = 1;
+                for (int i = 0; i <= 15; i++)
                 {
-                    lua_pushinteger(L, i);
-                    lua_rawseti(L, -2, count);
-                    count++;
-                }
-            }        
+                    if (filter.categoryBits & (1 << i))
+                    {
+                        lua_pushinteger(L, i);
+                        lua_rawseti(L, -2, count);
+                        count++;
+                    }
+                }        
          
-            return 1;
-        }
-    }        
-    else if ( strcmp(c, "mask") == 0)
-    {
-        
-        if( body && body->body)
+                return 1;
+            }
+        } break;
+        case FIELD_MASK:
         {
-            
-            b2Filter filter(body->body->GetFixtureList()->GetFilterData());
-            int n = 0;
-            for (int i = 0; i <= 15; i++)
+            if( body && body->body)
             {
-                if (filter.maskBits & (1 << i))
+            
+                b2Filter filter(body->body->GetFixtureList()->GetFilterData());
+                int n = 0;
+                for (int i = 0; i <= 15; i++)
                 {
-                    n++;
-                }
-            }        
+                    if (filter.maskBits & (1 << i))
+                    {
+                        n++;
+                    }
+                }        
             
-            lua_createtable(L, n, 0);
-            int count = 1;
-            for (int i = 0; i <= 15; i++)
-            {
-                if (filter.maskBits & (1 << i))
+                lua_createtable(L, n, 0);
+                int count = 1;
+                for (int i = 0; i <= 15; i++)
                 {
-                    lua_pushinteger(L, i);
-                    lua_rawseti(L, -2, count);
-                    count++;
-                }
-            }        
+                    if (filter.maskBits & (1 << i))
+                    {
+                        lua_pushinteger(L, i);
+                        lua_rawseti(L, -2, count);
+                        count++;
+                    }
+                }        
             
-            return 1;
-        }
-    }        
-    else if ( strcmp(c, "shapeType") == 0)
-    {
-        lua_pushnumber(L, body->type);
-    }        
-    else if ( strcmp(c, "radius") == 0 && body->type == RIGIDBODY_CIRCLE)
-    {
-        b2Fixture* fixture = body->body->GetFixtureList();
-        b2CircleShape* circle = (b2CircleShape*)fixture->GetShape();
-        lua_pushnumber(L, circle->m_radius * PTM_RATIO);
-    }
-    else if ( strcmp(c, "info") == 0 )
-    {
-        lua_getfenv(L, 1);
-        
-//        if (body->infoRef != LUA_NOREF)
-//        {
-//            lua_rawgeti(L, LUA_REGISTRYINDEX, body->infoRef);
-//        }
-//        else
-//        {
-//            lua_pushnil(L);
-//        }
-    }
-    else if ( strcmp(c, "points") == 0 && body->pointCount > 0)
-    {
-        // Create table for points and leave on the stack
-        lua_newtable(L);
-        for (int i = 0; i < body->pointCount; i++)
+                return 1;
+            }
+        } break;
+        case FIELD_SHAPETYPE:
         {
-            lua_pushnumber(L, i+1);
-            pushvec2(L, body->x[i], body->y[i]);
-            lua_settable(L, -3);
-        }        
-    }
-    else
-    {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, RIGIDBODY_TYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);
+            lua_pushnumber(L, body->type);
+        } break;
+        case FIELD_RADIUS:
+            if( body->type == RIGIDBODY_CIRCLE )
+            {
+                b2Fixture* fixture = body->body->GetFixtureList();
+                b2CircleShape* circle = (b2CircleShape*)fixture->GetShape();
+                lua_pushnumber(L, circle->m_radius * PTM_RATIO);
+            }
+            else
+                lua_pushnil(L);
+            break;
+        case FIELD_INFO:
+        {
+            lua_getfenv(L, 1);
+        
+    //        if (body->infoRef != LUA_NOREF)
+    //        {
+    //            lua_rawgeti(L, LUA_REGISTRYINDEX, body->infoRef);
+    //        }
+    //        else
+    //        {
+    //            lua_pushnil(L);
+    //        }
+        } break;
+        case FIELD_POINTS:
+            if( body->pointCount > 0 )
+            {
+                // Create table for points and leave on the stack
+                lua_newtable(L);
+                for (int i = 0; i < body->pointCount; i++)
+                {
+                    lua_pushnumber(L, i+1);
+                    pushvec2(L, body->x[i], body->y[i]);
+                    lua_settable(L, -3);
+                }
+            }
+            else
+                lua_pushnil(L);
+            break;
+        default: break;     //The method (or nil) for key is on the stack
     }    
     
     return 1;
@@ -402,219 +471,220 @@ static int Lget( lua_State *L)
 
 int Lset(lua_State *L) 
 {
-    body_wrapper_type *body = checkRigidbody(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    body_wrapper_type *body = (body_wrapper_type*)checkfieldudata(L, 1, RIGIDBODY_TYPE);
     
     if (body->body == NULL) return 0;
     
-    if (strcmp(c, "position") == 0 )
+    switch( fieldindex(L,2) )
     {
-        lua_Number* v = checkvec2(L, 3);
-        if (v)
+        case FIELD_POSITION:
+        {
+            lua_Number* v = checkvec2(L, 3);
+            if (v)
+            {
+                b2Vec2 pos = b2Vec2(v[0] * INV_PTM_RATIO, v[1] * INV_PTM_RATIO);
+                body->body->SetTransform(pos, 0);          
+                body->prevX = body->renderX = pos.x;
+                body->prevY = body->renderY = pos.y;
+            }
+
+            return 1;
+        }
+        case FIELD_LINEARVELOCITY:
         {
-            b2Vec2 pos = b2Vec2(v[0] * INV_PTM_RATIO, v[1] * INV_PTM_RATIO);
-            body->body->SetTransform(pos, 0);          
+            lua_Number* v = checkvec2(L, 3);        
+            if (v)
+            {
+                b2Vec2 pos = b2Vec2(v[0] * INV_PTM_RATIO, v[1] * INV_PTM_RATIO);            
+                body->body->SetLinearVelocity(pos);            
+            }
+            return 1;
+        }
+        case FIELD_ANGULARVELOCITY:
+        {
+            body->body->SetAngularVelocity(luaL_checknumber(L,3) * M_PI / 180.0f);
+            return 1;
+        }
+        case FIELD_X:
+        {
+            b2Vec2 pos = body->body->GetPosition();
+            pos.x = luaL_checknumber(L,3) * INV_PTM_RATIO;
+            body->body->SetTransform(pos, body->body->GetAngle());
             body->prevX = body->renderX = pos.x;
+            return 1;
+        }
+        case FIELD_Y:
+        {
+            b2Vec2 pos = body->body->GetPosition();
+            pos.y = luaL_checknumber(L,3) * INV_PTM_RATIO;
+            body->body->SetTransform(pos, body->body->GetAngle());
             body->prevY = body->renderY = pos.y;
+            return 1;
         }
-
-        return 1;        
-    }
-    else if (strcmp(c, "linearVelocity") == 0 )
-    {
-        lua_Number* v = checkvec2(L, 3);        
-        if (v)
+        case FIELD_ANGLE:
         {
-            b2Vec2 pos = b2Vec2(v[0] * INV_PTM_RATIO, v[1] * INV_PTM_RATIO);            
-            body->body->SetLinearVelocity(pos);            
+            b2Vec2 pos = body->body->GetPosition();        
+            body->body->SetTransform(pos, luaL_checknumber(L,3) * M_PI / 180.0f);
+            body->renderAngle = body->prevAngle = body->body->GetAngle();
+            return 1;
         }
-        return 1;        
-    }    
-    else if (strcmp(c, "angularVelocity") == 0 )
-    {
-        body->body->SetAngularVelocity(luaL_checknumber(L,3) * M_PI / 180.0f);
-        return 1;        
-    }        
-    else if( strcmp(c, "x") == 0 )
-    {       
-        b2Vec2 pos = body->body->GetPosition();
-        pos.x = luaL_checknumber(L,3) * INV_PTM_RATIO;
-        body->body->SetTransform(pos, body->body->GetAngle());
-        body->prevX = body->renderX = pos.x;
-        return 1;        
-    }
-    else if( strcmp(c, "y") == 0 )
-    {       
-        b2Vec2 pos = body->body->GetPosition();
-        pos.y = luaL_checknumber(L,3) * INV_PTM_RATIO;
-        body->body->SetTransform(pos, body->body->GetAngle());
-        body->prevY = body->renderY = pos.y;
-        return 1;        
-    }
-    else if (strcmp(c, "angle") == 0 )
-    {
-        b2Vec2 pos = body->body->GetPosition();        
-        body->body->SetTransform(pos, luaL_checknumber(L,3) * M_PI / 180.0f);
-        body->renderAngle = body->prevAngle = body->body->GetAngle();
-        return 1;        
-    }    
-    else if (strcmp(c, "type") == 0 )
-    {
-        body->body->SetType(CLAMP((b2BodyType)luaL_checkinteger(L,3), b2_staticBody, b2_dynamicBody));
-        return 1;        
-    }
-    else if ( strcmp(c, "density") == 0 )
-    {
-        float density = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
-        for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+        case FIELD_TYPE:
         {
-            f->SetDensity(density);
+            body->body->SetType(CLAMP((b2BodyType)luaL_checkinteger(L,3), b2_staticBody, b2_dynamicBody));
+            return 1;
         }
-        body->body->ResetMassData();
-        return 1;        
-    }    
-    else if ( strcmp(c, "mass") == 0 )
-    {
-        float mass = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
-        b2MassData massData;
-        body->body->GetMassData(&massData);
-        massData.mass = mass;
-        body->body->SetMassData(&massData);
-        return 1;        
-    }        
-    else if ( strcmp(c, "sensor") == 0 )
-    {
-        BOOL sensor = lua_toboolean(L, 3);
-        for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+        case FIELD_DENSITY:
         {
-            f->SetSensor(sensor);
+            float density = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
+            for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+            {
+                f->SetDensity(density);
+            }
+            body->body->ResetMassData();
+            return 1;
         }
-        return 1;        
-    }
-    else if ( strcmp(c, "bullet") == 0 )
-    {
-        body->body->SetBullet(lua_toboolean(L, 3));
-    }
-    else if ( strcmp(c, "sleepingAllowed") == 0 )
-    {
-        body->body->SetSleepingAllowed(lua_toboolean(L, 3));
-    }
-    else if ( strcmp(c, "friction") == 0 )
-    {              
-        float friction = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
-        for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+        case FIELD_MASS:
         {
-            f->SetFriction(friction);
+            float mass = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
+            b2MassData massData;
+            body->body->GetMassData(&massData);
+            massData.mass = mass;
+            body->body->SetMassData(&massData);
+            return 1;
         }
-        return 1;        
-    }        
-    else if ( strcmp(c, "restitution") == 0 )
-    {
-        float restitution = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
-        for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+        case FIELD_SENSOR:
         {
-            f->SetRestitution(restitution);
+            BOOL sensor = lua_toboolean(L, 3);
+            for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+            {
+                f->SetSensor(sensor);
+            }
+            return 1;
         }
-        return 1;        
-    }          
-    else if ( strcmp(c, "fixedRotation") == 0 )
-    {
-        body->body->SetFixedRotation(lua_toboolean(L, 3));
-        return 1;
-    }    
-    else if ( strcmp(c, "active") == 0 )
-    {            
-        body->body->SetActive(lua_toboolean(L, 3));
-        return 1;
-    }        
-    else if ( strcmp(c, "linearDamping") == 0 )
-    {            
-        body->body->SetLinearDamping(luaL_checknumber(L, 3));
-        return 1;
-    }   
-    else if ( strcmp(c, "angularDamping") == 0 )
-    {            
-        body->body->SetAngularDamping(luaL_checknumber(L, 3));
-        return 1;
-    }       
-    else if ( strcmp(c, "interpolate") == 0 )
-    {            
-        body->interpolate = lua_toboolean(L, 3);
-        return 1;
-    }
-    else if ( strcmp(c, "gravityScale") == 0)
-    {
-        body->body->SetGravityScale(CLAMP(luaL_checknumber(L, 3), -b2_maxFloat, b2_maxFloat));
-        return 1;
-    }    
-    else if ( strcmp(c, "categories") == 0)
-    {
-        
-        /* 1st argument must be a table (t) */
-        luaL_checktype(L, 3, LUA_TTABLE);
-        
-        int n = luaL_getn(L, 3);  /* get size of table */
-                
-        if( body && body->body && n >= 1)
+        case FIELD_BULLET:
         {
-            b2Filter filter(body->body->GetFixtureList()->GetFilterData());
-            filter.categoryBits = 0;
-            for (int i = 1; i <= n; i++)
+            body->body->SetBullet(lua_toboolean(L, 3));
+        } break;
+        case FIELD_SLEEPINGALLOWED:
+        {
+            body->body->SetSleepingAllowed(lua_toboolean(L, 3));
+        } break;
+        case FIELD_FRICTION:
+        {
+            float friction = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
+            for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
             {
-                // Make sure bit shifts are clamped in range of 16 bit integer            
-                lua_rawgeti(L, 3, i);
-                filter.categoryBits |= 1 << MAX(MIN(luaL_checkinteger(L, -1), 15), 0);
-                lua_pop(L, 1);
-            }        
+                f->SetFriction(friction);
+            }
+            return 1;
+        }
+        case FIELD_RESTITUTION:
+        {
+            float restitution = CLAMP(luaL_checknumber(L,3), 0, b2_maxFloat);
             for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
             {
-                f->SetFilterData(filter);
-            }        
+                f->SetRestitution(restitution);
+            }
+            return 1;
         }
-                
-        return 1;
-    }    
-    else if ( strcmp(c, "mask") == 0)
-    {
+        case FIELD_FIXEDROTATION:
+        {
+            body->body->SetFixedRotation(lua_toboolean(L, 3));
+            return 1;
+        }
+        case FIELD_ACTIVE:
+        {
+            body->body->SetActive(lua_toboolean(L, 3));
+            return 1;
+        }
+        case FIELD_LINEARDAMPING:
+        {
+            body->body->SetLinearDamping(luaL_checknumber(L, 3));
+            return 1;
+        }
+        case FIELD_ANGULARDAMPING:
+        {
+            body->body->SetAngularDamping(luaL_checknumber(L, 3));
+            return 1;
+        }
+        case FIELD_INTERPOLATE:
+        {
+            body->interpolate = lua_toboolean(L, 3);
+            return 1;
+        }
+        case FIELD_GRAVITYSCALE:
+        {
+            body->body->SetGravityScale(CLAMP(luaL_checknumber(L, 3), -b2_maxFloat, b2_maxFloat));
+            return 1;
+        }
+        case FIELD_CATEGORIES:
+        {
+            /* 1st argument must be a table (t) */
+            luaL_checktype(L, 3, LUA_TTABLE);
         
-        /* 1st argument must be a table (t) */
-        luaL_checktype(L, 3, LUA_TTABLE);
+            int n = luaL_getn(L, 3);  /* get size of table */
+                
+            if( body && body->body && n >= 1)
+            {
+                b2Filter filter(body->body->GetFixtureList()->GetFilterData());
+                filter.categoryBits = 0;
+                for (int i = 1; i <= n; i++)
+                {
+                    // Make sure bit shifts are clamped in range of 16 bit integer            
+                    lua_rawgeti(L, 3, i);
+                    filter.categoryBits |= 1 << MAX(MIN(luaL_checkinteger(L, -1), 15), 0);
+                    lua_pop(L, 1);
+                }        
+                for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+                {
+                    f->SetFilterData(filter);
+                }        
+            }
+                
+            return 1;
+        }
+        case FIELD_MASK:
+        {
+            /* 1st argument must be a table (t) */
+            luaL_checktype(L, 3, LUA_TTABLE);
         
-        int n = luaL_getn(L, 3);  /* get size of table */
+            int n = luaL_getn(L, 3);  /* get size of table */
         
-        if( body && body->body && n >= 1)
-        {
-            b2Filter filter(body->body->GetFixtureList()->GetFilterData());
-            filter.maskBits = 0;
-            for (int i = 1; i <= n; i++)
-            {
-                // Make sure bit shifts are clamped in range of 16 bit integer            
-                lua_rawgeti(L, 3, i);
-                filter.maskBits |= 1 << MAX(MIN(luaL_checkinteger(L, -1), 15), 0);
-                lua_pop(L, 1);
-            }        
-            for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+            if( body && body->body && n >= 1)
             {
-                f->SetFilterData(filter);
-            }        
-        }
+                b2Filter filter(body->body->GetFixtureList()->GetFilterData());
+                filter.maskBits = 0;
+                for (int i = 1; i <= n; i++)
+                {
+                    // Make sure bit shifts are clamped in range of 16 bit integer            
+                    lua_rawgeti(L, 3, i);
+                    filter.maskBits |= 1 << MAX(MIN(luaL_checkinteger(L, -1), 15), 0);
+                    lua_pop(L, 1);
+                }        
+                for (b2Fixture* f = body->body->GetFixtureList(); f; f = f->GetNext())
+                {
+                    f->SetFilterData(filter);
+                }        
+            }
         
-        return 1;
-    }        
-    else if ( strcmp(c, "info") == 0)
-    {
-        lua_pushvalue(L, 3);
-        lua_setfenv(L, 1);
+            return 1;
+        }
+        case FIELD_INFO:
+        {
+            lua_pushvalue(L, 3);
+            lua_setfenv(L, 1);
         
-//        // unref previous info value
-//        if (body->infoRef != LUA_NOREF && body->infoRef != LUA_REFNIL)
-//        {
-//            luaL_unref(L, LUA_REGISTRYINDEX, body->infoRef);
-//        }
-//        // ref new info value
-//        lua_pushvalue(L, 3);
-//        body->infoRef = luaL_ref(L, LUA_REGISTRYINDEX);                
-        return 1;
+    //        // unref previous info value
+    //        if (body->infoRef != LUA_NOREF && body->infoRef != LUA_REFNIL)
+    //        {
+    //            luaL_unref(L, LUA_REGISTRYINDEX, body->infoRef);
+    //        }
+    //        // ref new info value
+    //        lua_pushvalue(L, 3);
+    //        body->infoRef = luaL_ref(L, LUA_REGISTRYINDEX);                
+            return 1;
+        }
+        default: break;
     }    
     
     return 0;
@@ -838,6 +908,50 @@ static int LgetWorldPoint(lua_State *L)
     return 0;
 }
 
+//getWorldPoint over a whole array, buffer or mesh of points; z and w are passed through unchanged
+static int LgetWorldPoints(lua_State *L)    /** body:getWorldPoints(src, [dst]) */
+{
+    body_wrapper_type *poly = checkRigidbody(L, 1);
+    if(poly && poly->body)
+    {
+        int dst = lua_isnoneornil(L, 3) ? 2 : 3;
+        points_type s, d;
+        b2Transform tx;
+        
+        checkpoints(L, 2, &s, 2);
+        targetpoints(L, dst, &d, s.count, s.components);
+        
+        if (poly->interpolate)
+        {
+            tx.Set(b2Vec2(poly->renderX, poly->renderY), poly->renderAngle);
+        }
+        else
+        {
+            tx = poly->body->GetTransform();
+        }
+        
+        const float *sp = s.data;
+        float *dp = d.data;
+        for (size_t i = 0; i < s.count; i++, sp += s.stride, dp += d.stride)
+        {
+            b2Vec2 worldPoint = b2Mul(tx, b2Vec2(sp[0] * INV_PTM_RATIO, sp[1] * INV_PTM_RATIO));
+            float z = s.components > 2 ? sp[2] : 0;
+            float w = s.components > 3 ? sp[3] : 1;
+            
+            dp[0] = worldPoint.x * PTM_RATIO;
+            dp[1] = worldPoint.y * PTM_RATIO;
+            if (d.components > 2) dp[2] = z;
+            if (d.components > 3) dp[3] = w;
+        }
+        
+        storepoints(L, &d);
+        lua_pushvalue(L, dst);
+        return 1;
+    }
+    
+    return 0;
+}
+
 static int LgetLinearVelocityFromWorldPoint(lua_State *L)
 {
     body_wrapper_type *rb = checkRigidbody(L, 1);
@@ -923,8 +1037,6 @@ static int LgetLinearVelocityFromLocalPoint(lua_State *L)
 
 static const luaL_reg R[] =
 {
-    { "__index", Lget },
-	{ "__newindex",	Lset},    
     { "__tostring", Ltostring },
     { "__eq", Leq},
     { "__gc", Lgc },
@@ -934,6 +1046,7 @@ static const luaL_reg R[] =
     { "testOverlap", LtestOverlap },
     { "getLocalPoint", LgetLocalPoint },
     { "getWorldPoint", LgetWorldPoint },
+    { "getWorldPoints", LgetWorldPoints },
     { "getLinearVelocityFromWorldPoint", LgetLinearVelocityFromWorldPoint },
     { "getLinearVelocityFromLocalPoint", LgetLinearVelocityFromLocalPoint },    
 //    { "setFilterCategories", LsetFilterCategories },
@@ -952,6 +1065,7 @@ LUALIB_API int luaopen_rigidbody(lua_State *L)
 {
     luaL_newmetatable(L,RIGIDBODY_TYPE);    
     luaL_openlib(L,NULL,R,0);
+    setfieldhandlers(L,Lget,Lset,fields);
     //lua_register(L,RIGIDBODY_TYPE,Lnew);    
     luaL_openlib(L,CODIFY_PHYSICSLIBNAME, P, 0);
     return 1;
@@ -0,0 +1,533 @@
+//
+//  buffer.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "codea_luaext.h"
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "color.h"
+
+#define BUFFERTYPE      "buffer"
+#define BUFFERALIGN     16
+
+enum { FIELD_COMPONENTS };
+static const char *const fields[] = { "components", NULL };
+
+//Four floats at a time with the GCC/Clang vector extension (SSE on the simulator, NEON on devices).
+//The reduced alignment allows loads from slices that do not start on a 16 byte boundary
+typedef float buffer_vec __attribute__((vector_size(16), aligned(4)));
+typedef int32_t buffer_mask __attribute__((vector_size(16), aligned(4)));
+
+#define PATTERNSIZE     12      /* a multiple of 4 and of every component count */
+
+//The right hand side of an operation: another buffer, or a number or vector repeated over every element
+typedef struct buffer_operand
+{
+    const float *p;
+    size_t wrap;                        /* floats before p repeats, (size_t)-1 for buffers */
+    float pattern[PATTERNSIZE + 4];     /* the repeated value when p points here */
+} buffer_operand;
+
+static void pushmetatable(lua_State *L);
+
+buffer_type *getbuffer(lua_State *L, int i)
+{
+    if( lua_isuserdata(L, i) )
+    {
+        return testudata(L, i, BUFFERTYPE);
+    }
+    
+    return NULL;
+}
+
+buffer_type *checkbuffer(lua_State *L, int i)
+{
+    buffer_type *b = getbuffer(L, i);
+    if (b == NULL) luaL_typerror(L, i, BUFFERTYPE);
+    return b;
+}
+
+buffer_type *pushbuffer(lua_State *L, size_t count, int components)
+{
+    buffer_type *b = lua_newuserdata(L, sizeof(buffer_type));
+    size_t size;
+    
+    b->data = b->storage = NULL;
+    b->count = 0;
+    b->components = components;
+    pushmetatable(L);
+    lua_setmetatable(L, -2);
+    
+    if (count > ((size_t)-1) / sizeof(float) / 4 - 1)
+        luaL_error(L, "buffer too large");
+    
+    //Rounded up to whole vectors so kernels never touch memory past the allocation
+    size = ((count * components + 3) & ~(size_t)3) * sizeof(float);
+    if (size > 0)
+    {
+        if (posix_memalign((void**)&b->storage, BUFFERALIGN, size) != 0)
+            luaL_error(L, "not enough memory");
+        memset(b->storage, 0, size);
+    }
+    b->data = b->storage;
+    b->count = count;
+    return b;
+}
+
+static size_t length(buffer_type *b)
+{
+    return b->count * b->components;
+}
+
+//Kernels
+
+static inline buffer_vec vload(const float *p)
+{
+    return *(const buffer_vec*)p;
+}
+
+static inline void vstore(float *p, buffer_vec v)
+{
+    *(buffer_vec*)p = v;
+}
+
+static inline buffer_vec vmin(buffer_vec a, buffer_vec b)
+{
+    buffer_mask m = (buffer_mask)(a < b);
+    return (buffer_vec)((m & (buffer_mask)a) | (~m & (buffer_mask)b));
+}
+
+static inline buffer_vec vmax(buffer_vec a, buffer_vec b)
+{
+    buffer_mask m = (buffer_mask)(a > b);
+    return (buffer_vec)((m & (buffer_mask)a) | (~m & (buffer_mask)b));
+}
+
+static inline float smin(float a, float b) { return a < b ? a : b; }
+static inline float smax(float a, float b) { return a > b ? a : b; }
+
+static inline size_t advance(size_t j, size_t n, size_t wrap)
+{
+    j += n;
+    return j == wrap ? 0 : j;
+}
+
+//a[i] = expr for every float, where expr sees a, x and y as vectors (va, vx, vy) then as floats (sa, sx, sy)
+#define BUFFER_KERNEL(name, vexpr, sexpr) \
+static void name(float *a, size_t n, const buffer_operand *x, const buffer_operand *y) \
+{ \
+    size_t i = 0, jx = 0, jy = 0; \
+    for (; i + 4 <= n; i += 4) \
+    { \
+        buffer_vec va = vload(a + i), vx = vload(x->p + jx), vy = vload(y->p + jy); \
+        (void)va; (void)vx; (void)vy; \
+        vstore(a + i, vexpr); \
+        jx = advance(jx, 4, x->wrap); \
+        jy = advance(jy, 4, y->wrap); \
+    } \
+    for (; i < n; i++) \
+    { \
+        float sa = a[i], sx = x->p[jx], sy = y->p[jy]; \
+        (void)sa; (void)sx; (void)sy; \
+        a[i] = sexpr; \
+        jx = advance(jx, 1, x->wrap); \
+        jy = advance(jy, 1, y->wrap); \
+    } \
+}
+
+BUFFER_KERNEL(kset, vx, sx)
+BUFFER_KERNEL(kadd, va + vx, sa + sx)
+BUFFER_KERNEL(ksub, va - vx, sa - sx)
+BUFFER_KERNEL(kmul, va * vx, sa * sx)
+BUFFER_KERNEL(kfma, va + vx * vy, sa + sx * sy)
+BUFFER_KERNEL(klerp, va + (vx - va) * vy, sa + (sx - sa) * sy)
+BUFFER_KERNEL(kmin, vmin(va, vx), smin(sa, sx))
+BUFFER_KERNEL(kmax, vmax(va, vx), smax(sa, sx))
+BUFFER_KERNEL(kclamp, vmin(vmax(va, vx), vy), smin(smax(sa, sx), sy))
+
+//Sums every component separately into sums[0..components-1]
+static void ksum(const float *a, size_t n, int components, float *sums)
+{
+    buffer_vec acc[PATTERNSIZE / 4] = { { 0 } };
+    float lanes[PATTERNSIZE];
+    size_t i = 0, j = 0;
+    int k;
+    
+    //Float i belongs to component i % components, and PATTERNSIZE keeps that true lane by lane
+    for (; i + 4 <= n; i += 4)
+    {
+        acc[j / 4] += vload(a + i);
+        j = advance(j, 4, PATTERNSIZE);
+    }
+    memcpy(lanes, acc, sizeof(lanes));
+    for (k = 0; k < components; k++) sums[k] = 0;
+    for (k = 0; k < PATTERNSIZE; k++) sums[k % components] += lanes[k];
+    for (; i < n; i++) sums[i % components] += a[i];
+}
+
+static float kdot(const float *a, size_t n, const buffer_operand *x)
+{
+    buffer_vec acc = { 0 };
+    float lanes[4], sum;
+    size_t i = 0, jx = 0;
+    
+    for (; i + 4 <= n; i += 4)
+    {
+        acc += vload(a + i) * vload(x->p + jx);
+        jx = advance(jx, 4, x->wrap);
+    }
+    memcpy(lanes, &acc, sizeof(lanes));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++)
+    {
+        sum += a[i] * x->p[jx];
+        jx = advance(jx, 1, x->wrap);
+    }
+    return sum;
+}
+
+//Reads the operand at index i for an operation on b
+static void getoperand(lua_State *L, int i, buffer_type *b, buffer_operand *o)
+{
+    buffer_type *other;
+    lua_Number v[4] = { 0 };
+    int n = 0, k;
+    color_type *c;
+    lua_Number *p;
+    
+    if (lua_type(L, i) == LUA_TNUMBER)
+    {
+        v[0] = lua_tonumber(L, i);
+        n = 1;
+    }
+    else if ((other = getbuffer(L, i)) != NULL)
+    {
+        luaL_argcheck(L, length(other) == length(b), i, "buffer sizes differ");
+        o->p = other->data;
+        o->wrap = (size_t)-1;
+        return;
+    }
+    else if ((p = getvec2(L, i)) != NULL) { memcpy(v, p, 2 * sizeof(lua_Number)); n = 2; }
+    else if ((p = getvec3(L, i)) != NULL) { memcpy(v, p, 3 * sizeof(lua_Number)); n = 3; }
+    else if ((p = getvec4(L, i)) != NULL) { memcpy(v, p, 4 * sizeof(lua_Number)); n = 4; }
+    else if ((c = getcolor(L, i)) != NULL)
+    {
+        v[0] = c->r; v[1] = c->g; v[2] = c->b; v[3] = c->a;
+        n = 4;
+    }
+    else
+        luaL_typerror(L, i, "number, vector or buffer");
+    
+    luaL_argcheck(L, n == 1 || n == b->components, i, "vector size does not match the buffer's components");
+    for (k = 0; k < PATTERNSIZE + 4; k++)
+        o->pattern[k] = (float)v[k % n];
+    o->p = o->pattern;
+    o->wrap = PATTERNSIZE;
+}
+
+static const buffer_operand zero = { zero.pattern, PATTERNSIZE, { 0 } };
+
+typedef void (*buffer_kernel)(float *a, size_t n, const buffer_operand *x, const buffer_operand *y);
+
+static int apply(lua_State *L, buffer_kernel k, int nargs)
+{
+    buffer_type *b = checkbuffer(L, 1);
+    buffer_operand x, y;
+    getoperand(L, 2, b, &x);
+    if (nargs > 1) getoperand(L, 3, b, &y);
+    k(b->data, length(b), &x, nargs > 1 ? &y : &zero);
+    lua_settop(L, 1);
+    return 1;
+}
+
+//Elements
+
+static size_t checkindex(lua_State *L, buffer_type *b, int i)
+{
+    lua_Number n = luaL_checknumber(L, i);
+    if (!(n >= 1 && n <= (lua_Number)b->count))
+        luaL_error(L, "buffer index %f out of range (1 to %d)", (double)n, (int)b->count);
+    return (size_t)n - 1;
+}
+
+static void pushelement(lua_State *L, buffer_type *b, size_t i)
+{
+    const float *e = b->data + i * b->components;
+    switch (b->components)
+    {
+        case 1: lua_pushnumber(L, e[0]); break;
+        case 2: pushvec2(L, e[0], e[1]); break;
+        case 3: pushvec3(L, e[0], e[1], e[2]); break;
+        default: pushvec4(L, e[0], e[1], e[2], e[3]); break;
+    }
+}
+
+static void setelement(lua_State *L, buffer_type *b, size_t i, int v)
+{
+    float *e = b->data + i * b->components;
+    buffer_operand o;
+    int k;
+    getoperand(L, v, b, &o);
+    luaL_argcheck(L, o.p == o.pattern, v, "number or vector expected");
+    for (k = 0; k < b->components; k++)
+        e[k] = o.pattern[k];
+}
+
+static int Lnew(lua_State *L)       /** buffer(count or table, [components]) */
+{
+    int components = luaL_optint(L, 2, 1);
+    luaL_argcheck(L, components >= 1 && components <= 4, 2, "components must be 1 to 4");
+    
+    if (lua_istable(L, 1))
+    {
+        //A table of numbers (components per element, flattened) or of vectors
+        size_t i, n = lua_objlen(L, 1);
+        buffer_type *b;
+        int numbers;
+        lua_rawgeti(L, 1, 1);
+        numbers = lua_type(L, -1) == LUA_TNUMBER;
+        lua_pop(L, 1);
+        if (numbers)
+        {
+            luaL_argcheck(L, n % components == 0, 1, "number count is not a multiple of components");
+            b = pushbuffer(L, n / components, components);
+            for (i = 0; i < n; i++)
+            {
+                lua_rawgeti(L, 1, (int)i + 1);
+                if (lua_type(L, -1) != LUA_TNUMBER)
+                    luaL_error(L, "invalid value (at index %d) in table for 'buffer'", (int)i + 1);
+                b->data[i] = (float)lua_tonumber(L, -1);
+                lua_pop(L, 1);
+            }
+        }
+        else
+        {
+            b = pushbuffer(L, n, components);
+            for (i = 0; i < n; i++)
+            {
+                lua_rawgeti(L, 1, (int)i + 1);
+                setelement(L, b, i, lua_gettop(L));
+                lua_pop(L, 1);
+            }
+        }
+    }
+    else
+    {
+        lua_Number n = luaL_checknumber(L, 1);
+        luaL_argcheck(L, n >= 0, 1, "count must not be negative");
+        pushbuffer(L, (size_t)n, components);
+    }
+    return 1;
+}
+
+static int Lget(lua_State *L)
+{
+    buffer_type *b = checkfieldudata(L, 1, BUFFERTYPE);
+    
+    if (lua_type(L, 2) == LUA_TNUMBER)
+    {
+        pushelement(L, b, checkindex(L, b, 2));
+        return 1;
+    }
+    
+    switch( fieldindex(L,2) )
+    {
+        case FIELD_COMPONENTS:  lua_pushinteger(L, b->components); break;
+        default: break;         //The method (or nil) for key is on the stack
+    }
+    
+    return 1;
+}
+
+static int Lset(lua_State *L)
+{
+    buffer_type *b = checkfieldudata(L, 1, BUFFERTYPE);
+    
+    if (lua_type(L, 2) == LUA_TNUMBER)
+        setelement(L, b, checkindex(L, b, 2), 3);
+    else
+        luaL_error(L, "buffer elements are set by number");
+    return 0;
+}
+
+static int Lassign(lua_State *L)    /** b:set(x) copies a buffer or repeats a number or vector */
+{
+    return apply(L, kset, 1);
+}
+
+static int Ladd(lua_State *L)       /** b:add(x) */
+{
+    return apply(L, kadd, 1);
+}
+
+static int Lsub(lua_State *L)       /** b:sub(x) */
+{
+    return apply(L, ksub, 1);
+}
+
+static int Lmul(lua_State *L)       /** b:mul(x) */
+{
+    return apply(L, kmul, 1);
+}
+
+static int Lfma(lua_State *L)       /** b:fma(x, y) adds x * y */
+{
+    return apply(L, kfma, 2);
+}
+
+static int Llerp(lua_State *L)      /** b:lerp(x, t) moves each value toward x by t */
+{
+    return apply(L, klerp, 2);
+}
+
+static int Lmin(lua_State *L)       /** b:min(x) */
+{
+    return apply(L, kmin, 1);
+}
+
+static int Lmax(lua_State *L)       /** b:max(x) */
+{
+    return apply(L, kmax, 1);
+}
+
+static int Lclamp(lua_State *L)     /** b:clamp(lo, hi) */
+{
+    return apply(L, kclamp, 2);
+}
+
+static int Lsum(lua_State *L)       /** b:sum() returns one total per component */
+{
+    buffer_type *b = checkbuffer(L, 1);
+    float sums[4];
+    int k;
+    ksum(b->data, length(b), b->components, sums);
+    for (k = 0; k < b->components; k++)
+        lua_pushnumber(L, sums[k]);
+    return b->components;
+}
+
+static int Ldot(lua_State *L)       /** b:dot(x) sums the products of every value */
+{
+    buffer_type *b = checkbuffer(L, 1);
+    buffer_operand x;
+    getoperand(L, 2, b, &x);
+    lua_pushnumber(L, kdot(b->data, length(b), &x));
+    return 1;
+}
+
+static int Lslice(lua_State *L)     /** b:slice(first, [last]) shares b's storage */
+{
+    buffer_type *b = checkbuffer(L, 1);
+    lua_Integer first = luaL_checkinteger(L, 2);
+    lua_Integer last = luaL_optinteger(L, 3, (lua_Integer)b->count);
+    buffer_type *s;
+    
+    luaL_argcheck(L, first >= 1 && first <= (lua_Integer)b->count + 1, 2, "out of range");
+    luaL_argcheck(L, last >= first - 1 && last <= (lua_Integer)b->count, 3, "out of range");
+    
+    s = pushbuffer(L, 0, b->components);
+    s->data = b->data + (first - 1) * b->components;
+    s->count = (size_t)(last - first + 1);
+    
+    //The slice keeps its parent alive
+    lua_createtable(L, 1, 0);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    lua_setfenv(L, -2);
+    return 1;
+}
+
+static int Lclone(lua_State *L)     /** b:clone() */
+{
+    buffer_type *b = checkbuffer(L, 1);
+    buffer_type *c = pushbuffer(L, b->count, b->components);
+    if (length(b)) memcpy(c->data, b->data, length(b) * sizeof(float));
+    return 1;
+}
+
+static int Llen(lua_State *L)
+{
+    buffer_type *b = checkbuffer(L, 1);
+    lua_pushinteger(L, (lua_Integer)b->count);
+    return 1;
+}
+
+static int Ltostring(lua_State *L)
+{
+    buffer_type *b = checkbuffer(L, 1);
+    char s[64];
+    sprintf(s, "buffer: %d x %d", (int)b->count, b->components);
+    lua_pushstring(L, s);
+    return 1;
+}
+
+static int Lgc(lua_State *L)
+{
+    buffer_type *b = checkbuffer(L, 1);
+    free(b->storage);
+    b->data = b->storage = NULL;
+    b->count = 0;
+    return 0;
+}
+
+static const luaL_reg R[] =
+{
+    { "set",        Lassign     },
+    { "add",        Ladd        },
+    { "sub",        Lsub        },
+    { "mul",        Lmul        },
+    { "fma",        Lfma        },
+    { "lerp",       Llerp       },
+    { "min",        Lmin        },
+    { "max",        Lmax        },
+    { "clamp",      Lclamp      },
+    { "sum",        Lsum        },
+    { "dot",        Ldot        },
+    { "slice",      Lslice      },
+    { "clone",      Lclone      },
+    { "__tostring", Ltostring   },
+    { "__len",      Llen        },
+    { "__gc",       Lgc         },
+    { NULL,         NULL        }
+};
+
+//Created on first use too, so C code can make buffers in states that never opened the library
+static void pushmetatable(lua_State *L)
+{
+    if (luaL_newmetatable(L,BUFFERTYPE))
+    {
+        luaL_openlib(L,NULL,R,0);
+        setfieldhandlers(L,Lget,Lset,fields);
+    }
+}
+
+LUALIB_API int luaopen_buffer(lua_State *L)
+{
+    pushmetatable(L);
+    lua_register(L,"buffer",Lnew);
+    return 1;
+}
@@ -0,0 +1,53 @@
+//
+//  buffer.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+#ifndef Codify_buffer_h
+#define Codify_buffer_h
+
+#include <stddef.h>
+
+#include "lua.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CODIFY_BUFFERLIBNAME "buffer"
+
+//count elements of 1 to 4 floats each, stored contiguously
+typedef struct buffer_type_t
+{
+    float *data;        //First float of this buffer, inside storage (possibly another buffer's)
+    size_t count;
+    int components;
+    float *storage;     //The allocation this buffer owns, NULL for slices
+} buffer_type;
+
+LUALIB_API int (luaopen_buffer) (lua_State *L);
+buffer_type *getbuffer(lua_State *L, int i);
+buffer_type *checkbuffer(lua_State *L, int i);
+
+//Creates a zero-filled buffer on the stack, 16 byte aligned
+buffer_type *pushbuffer(lua_State *L, size_t count, int components);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,7 +32,107 @@ void *testudata (lua_State *L, int ud, const char *tname)
                 lua_pop(L, 2);  /* remove both metatables */
                 return p;
             }
+            lua_pop(L, 2);
         }
     }
     return NULL;  /* to avoid warnings */
-}
\ No newline at end of file
+}
+
+void setfieldhandlers (lua_State *L, lua_CFunction get, lua_CFunction set, const char *const fields[])
+{
+    int mt = lua_gettop(L);
+    int i;
+    
+    //Copy the methods and metamethods, then add the field names on top
+    lua_newtable(L);
+    lua_pushnil(L);
+    while (lua_next(L, mt) != 0) {
+        if (lua_type(L, -2) == LUA_TSTRING && !lua_islightuserdata(L, -1)) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -4);
+        }
+        else
+            lua_pop(L, 1);
+    }
+    for (i = 0; fields[i] != NULL; i++) {
+        lua_pushstring(L, fields[i]);
+        if (lua_isnumber(L, -1)) {
+            //Numeral names also match the number itself (v[1] as well as v["1"])
+            lua_pushnumber(L, lua_tonumber(L, -1));
+            lua_pushlightuserdata(L, (char *)NULL + i + 1);
+            lua_rawset(L, -4);
+        }
+        lua_pushlightuserdata(L, (char *)NULL + i + 1);
+        lua_rawset(L, -3);
+    }
+    
+    lua_pushvalue(L, -1);
+    lua_pushvalue(L, mt);
+    lua_pushcclosure(L, get, 2);
+    lua_setfield(L, mt, "__index");
+    
+    if (set) {
+        lua_pushvalue(L, mt);
+        lua_pushcclosure(L, set, 2);
+        lua_setfield(L, mt, "__newindex");
+    }
+    else
+        lua_pop(L, 1);
+}
+
+void *checkfieldudata (lua_State *L, int ud, const char *tname)
+{
+    void *p = lua_touserdata(L, ud);
+    if (p != NULL && lua_getmetatable(L, ud)) {
+        int same = lua_rawequal(L, -1, lua_upvalueindex(2));
+        lua_pop(L, 1);
+        if (same)
+            return p;
+    }
+    luaL_typerror(L, ud, tname);
+    return NULL;
+}
+
+int fieldindex (lua_State *L, int key)
+{
+    char *i;
+    lua_pushvalue(L, key);
+    lua_rawget(L, lua_upvalueindex(1));
+    i = (char *)lua_touserdata(L, -1);  /* fields are stored as light userdata */
+    if (i == NULL) {
+        if (lua_isnil(L, -1)) {
+            //Methods added to the metatable after the table was interned
+            lua_pop(L, 1);
+            lua_pushvalue(L, key);
+            lua_rawget(L, lua_upvalueindex(2));
+        }
+        return -1;  /* method or nil left on the stack */
+    }
+    lua_pop(L, 1);
+    return (int)(i - (char *)NULL) - 1;
+}
+
+int formatnumbers (char *s, const lua_Number *v, int n)
+{
+    int i, len = 0;
+    s[len++] = '(';
+    for (i = 0; i < n; i++)
+    {
+        if (i > 0) { s[len++] = ','; s[len++] = ' '; }
+        len += lua_num2str(s + len, v[i]);
+    }
+    s[len++] = ')';
+    s[len] = '\0';
+    return len;
+}
+
+void pushresulttable (lua_State *L, int i, int narray)
+{
+    if (lua_istable(L, i)) {
+        lua_cleartable(L, i);
+        lua_pushvalue(L, i);
+    }
+    else
+        lua_createtable(L, narray, 0);
+}
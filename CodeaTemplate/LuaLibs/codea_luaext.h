@@ -22,6 +22,57 @@
 #ifndef Codea_codea_luaext_h
 #define Codea_codea_luaext_h
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+
 void *testudata (lua_State *L, int ud, const char *tname);
 
+/*
+ * Field dispatch for userdata __index/__newindex handlers.
+ *
+ * setfieldhandlers interns the NULL-terminated list of field names once,
+ * when the library is opened, into a lookup table that maps each name to
+ * its position in the list and every other name in the metatable (methods,
+ * metamethods) to its value. Numeral names also match the number key.
+ *
+ * The metatable on top of the stack gets its __index and __newindex set to
+ * closures of get/set over that table (pass NULL for set to leave
+ * __newindex alone).
+ *
+ * Inside those handlers, fieldindex looks up the value at stack index key
+ * with a single raw table access. It returns the field's position, or -1
+ * with the matching method (or nil) left on top of the stack. Names missing
+ * from the interned table are looked up in the metatable itself, so methods
+ * added to it later are still found.
+ * checkfieldudata is luaL_checkudata for the same handlers; it compares
+ * against the metatable held by the closure instead of the registry's.
+ */
+void setfieldhandlers (lua_State *L, lua_CFunction get, lua_CFunction set, const char *const fields[]);
+int fieldindex (lua_State *L, int key);
+void *checkfieldudata (lua_State *L, int ud, const char *tname);
+
+/*
+ * Writes "(a, b, ...)" for the n numbers at v into s, formatted like
+ * tostring(number), and returns the length. s needs room for
+ * n*(LUAI_MAXNUMBER2STR+2)+2 characters. Used by the value types'
+ * __tostring and strbuf so they print the same digits.
+ */
+#define FORMATNUMBERS_SIZE(n)   ((n)*(LUAI_MAXNUMBER2STR+2)+2)
+int formatnumbers (char *s, const lua_Number *v, int n);
+
+/*
+ * Pushes the table that a list-returning function should fill. If the
+ * argument at i is a table it is emptied with lua_cleartable and reused,
+ * keeping its allocated parts; otherwise a new table sized for narray
+ * entries is created.
+ */
+void pushresulttable (lua_State *L, int i, int narray);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
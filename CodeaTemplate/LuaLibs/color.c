@@ -28,6 +28,7 @@
 #include "color.h"
 #include "lua.h"
 #include "lauxlib.h"
+#include "codea_luaext.h"
 
 #if !defined(MIN)
     #define MIN(A,B)	((A) < (B) ? (A) : (B))
@@ -39,8 +40,21 @@
 
 #define COLORTYPE	"color"
 #define COLDIM      4
+
+static const char *const fields[] = { "r", "g", "b", "a", "x", "y", "z", "w", "1", "2", "3", "4", "packed", NULL };
+#define COLPACKED   12  /* index of the packed field, after three names for each element */
 #define COLCLAMP(x) MAX(MIN((x),255),0)
 
+color_type *getcolor(lua_State *L, int i)
+{
+    if( lua_isuserdata(L, i) )
+    {
+        return testudata(L, i, COLORTYPE);
+    }
+    
+    return NULL;
+}
+
 color_type *checkcolor(lua_State *L, int i)
 {
     if( lua_isuserdata(L, i) )
@@ -80,9 +94,50 @@ color_type* pushcolor(lua_State *L, lua_Number r, lua_Number g, lua_Number b, lu
     return v;
 }
 
-static int Lnew(lua_State *L)			/** color(r, g, b, a) */
+int getpackedcolor(lua_State *L, int i, color_packed *p)
+{
+    color_type *c = getcolor(L, i);
+    size_t len;
+    const char *s;
+    
+    if (c != NULL)
+    {
+        *p = color_pack(c->r, c->g, c->b, c->a);
+        return 1;
+    }
+    
+    if (lua_type(L, i) == LUA_TSTRING && (s = lua_tolstring(L, i, &len)) != NULL && len == sizeof(color_packed))
+    {
+        memcpy(p, s, sizeof(color_packed));
+        return 1;
+    }
+    
+    return 0;
+}
+
+static void setpacked(lua_State *L, color_type *v, int i)
+{
+    color_packed p;
+    lua_Number rgba[4];
+    
+    if (lua_type(L, i) != LUA_TSTRING || !getpackedcolor(L, i, &p))
+        luaL_argerror(L, i, "packed color (4 byte string) expected");
+    color_unpack(p, rgba);
+    v->r = rgba[0];
+    v->g = rgba[1];
+    v->b = rgba[2];
+    v->a = rgba[3];
+}
+
+static int Lnew(lua_State *L)			/** color(r, g, b, a) or color(packed) */
 {
     color_type *v;
+    if (lua_type(L,1) == LUA_TSTRING)
+    {
+        v=Pnew(L);
+        setpacked(L,v,1);
+        return 1;
+    }
     lua_settop(L,COLDIM);
     v=Pnew(L);
     v->r=luaL_optnumber(L,1,0);
@@ -94,32 +149,23 @@ static int Lnew(lua_State *L)			/** color(r, g, b, a) */
 
 static int Lget(lua_State *L)
 {
-    color_type *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
+    color_type *v=checkfieldudata(L,1,COLORTYPE);
+    int i=fieldindex(L,2);
     
-    if( strlen(i) == 1 )
+    if (i == COLPACKED)
     {
-        switch (*i)
-        {		/* lazy! */
-            case '1': case 'x': case 'r': lua_pushnumber(L,v->r); break;
-            case '2': case 'y': case 'g': lua_pushnumber(L,v->g); break;
-            case '3': case 'z': case 'b': lua_pushnumber(L,v->b); break;
-            case '4': case 'w': case 'a': lua_pushnumber(L,v->a); break;         
-            default: 
-            {
-                //Load the metatable and value for key
-                luaL_getmetatable(L, COLORTYPE);
-                lua_pushstring(L, i);
-                lua_gettable(L, -2);
-            } break;
-        }
+        color_packed p = color_pack(v->r, v->g, v->b, v->a);
+        lua_pushlstring(L, (const char*)&p, sizeof(p));
+        return 1;
     }
-    else
+    
+    switch (i % COLDIM)
     {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, COLORTYPE);
-        lua_pushstring(L, i);
-        lua_gettable(L, -2);
+        case 0: lua_pushnumber(L,v->r); break;
+        case 1: lua_pushnumber(L,v->g); break;
+        case 2: lua_pushnumber(L,v->b); break;
+        case 3: lua_pushnumber(L,v->a); break;
+        default: break;     /* the method (or nil) for key is on the stack */
     }
     
     return 1;
@@ -127,15 +173,21 @@ static int Lget(lua_State *L)
 
 static int Lset(lua_State *L) 
 {
-    color_type *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
-    lua_Number t=luaL_checknumber(L,3);
-    switch (*i) 
-    {		/* lazy! */
-        case '1': case 'x': case 'r': v->r = t; break;
-        case '2': case 'y': case 'g': v->g = t; break;
-        case '3': case 'z': case 'b': v->b = t; break;
-        case '4': case 'w': case 'a': v->a = t; break;         
+    color_type *v=checkfieldudata(L,1,COLORTYPE);
+    int i=fieldindex(L,2);
+    lua_Number t;
+    if (i == COLPACKED)
+    {
+        setpacked(L,v,3);
+        return 1;
+    }
+    t=luaL_checknumber(L,3);
+    switch (i % COLDIM)
+    {
+        case 0: v->r = t; break;
+        case 1: v->g = t; break;
+        case 2: v->b = t; break;
+        case 3: v->a = t; break;
         default: break;
     }
     return 1;
@@ -144,9 +196,9 @@ static int Lset(lua_State *L)
 static int Ltostring(lua_State *L)
 {
     color_type *v=Pget(L,1);
-    char s[64];
-    sprintf(s,"(%d, %d, %d, %d)",(int)v->r,(int)v->g,(int)v->b,(int)v->a);
-    lua_pushstring(L,s);
+    lua_Number c[4] = { v->r, v->g, v->b, v->a };
+    char s[FORMATNUMBERS_SIZE(4)];
+    lua_pushlstring(L,s,formatnumbers(s,c,4));
     return 1;
 }
 
@@ -259,8 +311,6 @@ static int Llerp(lua_State *L)
 
 static const luaL_reg R[] =
 {
-	{ "__index",	Lget		},
-	{ "__newindex",	Lset		},
 	{ "__tostring",	Ltostring	},
     { "__add",      Ladd        }, 
     { "__mul",      Lmul        },    
@@ -274,11 +324,8 @@ LUALIB_API int luaopen_color(lua_State *L)
 {
     luaL_newmetatable(L,COLORTYPE);
 
-    lua_pushstring(L, "__index");
-    lua_pushvalue(L, -2);
-    lua_settable(L, -3);
-    
     luaL_register(L, NULL, R);
+    setfieldhandlers(L, Lget, Lset, fields);
     lua_register(L,"color",Lnew);
     
     return 1;
@@ -22,6 +22,9 @@
 #ifndef Codify_color_h
 #define Codify_color_h
 
+#include <stdint.h>
+#include <string.h>
+
 #include "lua.h"
 
 #define CODIFY_COLORLIBNAME "color"
@@ -32,9 +35,70 @@ typedef struct color_type_t
 } color_type;
 
 LUALIB_API int (luaopen_color) (lua_State *L);
+color_type *getcolor(lua_State *L, int i);
 color_type *checkcolor(lua_State *L, int i);
 
 //Creates the userdata and puts it on the stack, and returns the same userdata
 color_type* pushcolor(lua_State *L, lua_Number r, lua_Number g, lua_Number b, lua_Number a);
 
+//Packed colours: r, g, b and a as bytes in that memory order, the layout of RGBA8 textures, vertex
+//colours and image data. In Lua they are 4 byte strings, since a float lua_Number cannot hold 32 bits
+typedef uint32_t color_packed;
+
+//Clamped and rounded to the nearest byte, as GL converts normalized colours
+static inline unsigned char color_packelement(lua_Number x)
+{
+    return !(x > 0) ? 0 : x >= 255 ? 255 : (unsigned char)(x + 0.5f);
+}
+
+static inline color_packed color_pack(lua_Number r, lua_Number g, lua_Number b, lua_Number a)
+{
+    unsigned char bytes[4] = { color_packelement(r), color_packelement(g), color_packelement(b), color_packelement(a) };
+    color_packed p;
+    memcpy(&p, bytes, sizeof(p));
+    return p;
+}
+
+static inline void color_unpack(color_packed p, lua_Number *rgba)
+{
+    unsigned char bytes[4];
+    int i;
+    memcpy(bytes, &p, sizeof(p));
+    for (i = 0; i < 4; i++)
+        rgba[i] = bytes[i];
+}
+
+//The blend and mix kernels work on two channels per multiply (the even and odd bytes), so they do
+//not depend on byte order. Weights are 0 to 256
+
+//x * t + y * (256 - t), rounded, all four channels, like c:mix
+static inline color_packed color_mixpacked(color_packed x, color_packed y, unsigned t)
+{
+    const uint32_t mask = 0x00FF00FF, half = 0x00800080;
+    uint32_t u = 256 - t;
+    uint32_t even = (((x & mask) * t + (y & mask) * u + half) >> 8) & mask;
+    uint32_t odd = ((((x >> 8) & mask) * t + ((y >> 8) & mask) * u + half) >> 8) & mask;
+    return even | (odd << 8);
+}
+
+//x over y by x's alpha, with the alphas added and saturated, like c:blend
+static inline color_packed color_blendpacked(color_packed x, color_packed y)
+{
+    unsigned char xb[4], yb[4];
+    unsigned alpha, sum;
+    color_packed r;
+    memcpy(xb, &x, sizeof(x));
+    memcpy(yb, &y, sizeof(y));
+    alpha = xb[3] + (xb[3] >> 7);   //0-255 to 0-256
+    sum = xb[3] + yb[3];
+    r = color_mixpacked(x, y, alpha);
+    memcpy(xb, &r, sizeof(r));
+    xb[3] = sum > 255 ? 255 : (unsigned char)sum;
+    memcpy(&r, xb, sizeof(r));
+    return r;
+}
+
+//The packed colour at index i: a color or a 4 byte string. Returns 0 if it is neither
+int getpackedcolor(lua_State *L, int i, color_packed *p);
+
 #endif
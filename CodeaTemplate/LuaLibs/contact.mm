@@ -22,10 +22,42 @@
 #include "contact.h"
 #import "PhysicsManager.h"
 #import "PhysicsCommands.h"
+#include "codea_luaext.h"
 
 #define CONTACT_TYPE   "contact"
 #define CONTACT_SIZE   sizeof(contact_wrapper_type)
 
+enum
+{
+    FIELD_ID,
+    FIELD_STATE,
+    FIELD_TOUCHING,
+    FIELD_POSITION,
+    FIELD_NORMAL,
+    FIELD_NORMALIMPULSE,
+    FIELD_TANGENTIMPULSE,
+    FIELD_POINTCOUNT,
+    FIELD_POINTS,
+    FIELD_BODYA,
+    FIELD_BODYB
+};
+
+static const char *const fields[] =
+{
+    "id",
+    "state",
+    "touching",
+    "position",
+    "normal",
+    "normalImpulse",
+    "tangentImpulse",
+    "pointCount",
+    "points",
+    "bodyA",
+    "bodyB",
+    NULL
+};
+
 extern float PTM_RATIO;
 
 contact_wrapper_type* checkContact(lua_State *L, int i)
@@ -152,8 +184,7 @@ void push_contact(lua_State *L, ContactPoint* cp)
 
 static int Lget( lua_State *L)
 {
-    contact_wrapper_type *cw = checkContact(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    contact_wrapper_type *cw = (contact_wrapper_type*)checkfieldudata(L, 1, CONTACT_TYPE);
     
     if (cw->contact == NULL) 
     {
@@ -161,75 +192,72 @@ static int Lget( lua_State *L)
     }
     
     
-    if (strcmp(c, "id") == 0 )
-    {
-        lua_pushinteger(L, cw->contact->ID);        
-    }
-    else if (strcmp(c, "state") == 0 )
-    {
-        lua_pushinteger(L, cw->contact->state);
-    }
-    else if (strcmp(c, "touching") == 0 )
-    {
-        lua_pushinteger(L, cw->contact->touching);
-    }    
-    else if (strcmp(c, "position") == 0 )
+    switch( fieldindex(L,2) )
     {
-        pushvec2(L, cw->contact->position.x * PTM_RATIO, cw->contact->position.y * PTM_RATIO);    
-    }        
-    else if (strcmp(c, "normal") == 0 )
-    {
-        pushvec2(L, cw->contact->normal.x, cw->contact->normal.y);    
-    }    
-    else if (strcmp(c, "normalImpulse") == 0 )
-    {
-        lua_pushnumber(L, cw->contact->normalImpulse);
-    }    
-    else if (strcmp(c, "tangentImpulse") == 0 )
-    {
-        lua_pushnumber(L, cw->contact->tangentImpulse);
-    }    
-    else if (strcmp(c, "pointCount") == 0 )
-    {
-        lua_pushinteger(L, cw->contact->pointCount);
-    }    
-    else if (strcmp(c, "points") == 0 )
-    {
-        lua_createtable(L, cw->contact->pointCount, 0);        
-        for (int i = 0; i < cw->contact->pointCount; i++)
+        case FIELD_ID:
         {
-            pushvec2(L, cw->contact->points[i].x * PTM_RATIO, cw->contact->points[i].y * PTM_RATIO);
-            lua_rawseti(L, -2, i+1);                
-        }
-    }
-    else if (strcmp(c, "bodyA") == 0 )
-    {
-        // push environment table
-        lua_getfenv(L, 1);
-        // push bodyA reference
-        lua_rawgeti(L, -1, 1);
-        // remove environment table
-        lua_remove(L, -2);        
+            lua_pushinteger(L, cw->contact->ID);
+        } break;
+        case FIELD_STATE:
+        {
+            lua_pushinteger(L, cw->contact->state);
+        } break;
+        case FIELD_TOUCHING:
+        {
+            lua_pushinteger(L, cw->contact->touching);
+        } break;
+        case FIELD_POSITION:
+        {
+            pushvec2(L, cw->contact->position.x * PTM_RATIO, cw->contact->position.y * PTM_RATIO);
+        } break;
+        case FIELD_NORMAL:
+        {
+            pushvec2(L, cw->contact->normal.x, cw->contact->normal.y);
+        } break;
+        case FIELD_NORMALIMPULSE:
+        {
+            lua_pushnumber(L, cw->contact->normalImpulse);
+        } break;
+        case FIELD_TANGENTIMPULSE:
+        {
+            lua_pushnumber(L, cw->contact->tangentImpulse);
+        } break;
+        case FIELD_POINTCOUNT:
+        {
+            lua_pushinteger(L, cw->contact->pointCount);
+        } break;
+        case FIELD_POINTS:
+        {
+            lua_createtable(L, cw->contact->pointCount, 0);        
+            for (int i = 0; i < cw->contact->pointCount; i++)
+            {
+                pushvec2(L, cw->contact->points[i].x * PTM_RATIO, cw->contact->points[i].y * PTM_RATIO);
+                lua_rawseti(L, -2, i+1);                
+            }
+        } break;
+        case FIELD_BODYA:
+        {
+            // push environment table
+            lua_getfenv(L, 1);
+            // push bodyA reference
+            lua_rawgeti(L, -1, 1);
+            // remove environment table
+            lua_remove(L, -2);        
         
-        //push_obj(L, cw->contact->fixtureA->GetBody()->GetUserData());
-    }   
-    else if (strcmp(c, "bodyB") == 0 )
-    {
-        // push environment table
-        lua_getfenv(L, 1);
-        // push bodyA reference
-        lua_rawgeti(L, -1, 2);
-        // remove environment table
-        lua_remove(L, -2);        
+            //push_obj(L, cw->contact->fixtureA->GetBody()->GetUserData());
+        } break;
+        case FIELD_BODYB:
+        {
+            // push environment table
+            lua_getfenv(L, 1);
+            // push bodyA reference
+            lua_rawgeti(L, -1, 2);
+            // remove environment table
+            lua_remove(L, -2);        
         
-        //        push_obj(L, cw->contact->fixtureB->GetBody()->GetUserData());
-    }   
-    else
-    {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, CONTACT_TYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);
+            //        push_obj(L, cw->contact->fixtureB->GetBody()->GetUserData());
+        } break;
+        default: break;     //The method (or nil) for key is on the stack
     }    
     
     return 1;
@@ -253,7 +281,6 @@ static int Ltostring(lua_State *L)
 
 static const luaL_reg R[] =
 {
-    { "__index", Lget },
     { "__gc", Lgc },
     { "__tostring", Ltostring },
     { NULL, NULL }
@@ -263,6 +290,7 @@ LUALIB_API int luaopen_contact(lua_State *L)
 {
     luaL_newmetatable(L,CONTACT_TYPE);    
     luaL_openlib(L,NULL,R,0);
+    setfieldhandlers(L,Lget,NULL,fields);
     return 1;
 }
 
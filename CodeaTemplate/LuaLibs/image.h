@@ -42,6 +42,8 @@ typedef struct image_type_t
     BOOL dataChanged;
     CCTexture2D* texture;
     boolean_t premultiplied;
+    int mipmaps; //A CCTexture2DMipmapMode, the levels are built with the texture
+    int format; //A CCTexture2DPixelFormat for the texture, data stays RGBA8888 so it can be dithered on upload
 } image_type;
 
 
@@ -59,6 +61,13 @@ extern "C" {
     
     void updateImageTextureIfRequired(image_type* image);
     
+    //The mipmap texture option at index i (false, true or "gamma") as a CCTexture2DMipmapMode, and back
+    int checkmipmaps(lua_State *L, int i);
+    void pushmipmaps(lua_State *L, int mipmaps);
+    
+    //Texture memory the image takes, in bytes
+    size_t imageTextureBytes(image_type* image);
+    
 #ifdef __cplusplus
 }
 #endif 
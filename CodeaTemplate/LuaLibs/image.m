@@ -26,8 +26,12 @@
 #include "image.h"
 #include "lua.h"
 #include "lauxlib.h"
+#include "codea_luaext.h"
 
 #include "color.h"
+#include "buffer.h"
+#include "matrix44.h"
+#include "blit.h"
 
 #import "CCTexture2D.h"
 
@@ -37,6 +41,9 @@
 #define IMAGETYPE "codeaimage"
 #define IMAGESIZE sizeof(image_type)
 
+enum { FIELD_WIDTH, FIELD_HEIGHT, FIELD_RAWWIDTH, FIELD_RAWHEIGHT, FIELD_PREMULTIPLIED, FIELD_MIPMAP, FIELD_FORMAT, FIELD_TEXTUREBYTES };
+static const char *const fields[] = { "width", "height", "rawWidth", "rawHeight", "premultiplied", "mipmap", "format", "textureBytes", NULL };
+
 #define RED(x) 
 
 void updateImageTextureIfRequired(image_type* image)
@@ -45,7 +52,7 @@ void updateImageTextureIfRequired(image_type* image)
     {
         [image->texture release];
         
-        image->texture = [[CCTexture2D alloc] initWithData:image->data pixelFormat:kCCTexture2DPixelFormat_RGBA8888 pixelsWide:image->rawWidth pixelsHigh:image->rawHeight contentSize:CGSizeMake(image->rawWidth, image->rawHeight)];
+        image->texture = [[CCTexture2D alloc] initWithRGBA8888Data:image->data pixelFormat:image->format pixelsWide:image->rawWidth pixelsHigh:image->rawHeight contentSize:CGSizeMake(image->rawWidth, image->rawHeight) mipmaps:image->mipmaps premultiplied:image->premultiplied];
         
         image->texture.scale = image->scaleFactor; //[SharedRenderer renderer].glView.contentScaleFactor;
 
@@ -53,6 +60,71 @@ void updateImageTextureIfRequired(image_type* image)
     }
 }
 
+//Texture options
+
+static const char *const mipmapmodes[] = { "box", "gamma", NULL };
+
+int checkmipmaps(lua_State *L, int i)
+{
+    if (lua_type(L, i) == LUA_TSTRING)
+    {
+        return kCCTexture2DMipmap_Box + luaL_checkoption(L, i, NULL, mipmapmodes);
+    }
+    return lua_toboolean(L, i) ? kCCTexture2DMipmap_Box : kCCTexture2DMipmap_None;
+}
+
+void pushmipmaps(lua_State *L, int mipmaps)
+{
+    if (mipmaps == kCCTexture2DMipmap_Gamma)
+    {
+        lua_pushstring(L, mipmapmodes[1]);
+    }
+    else
+    {
+        lua_pushboolean(L, mipmaps != kCCTexture2DMipmap_None);
+    }
+}
+
+//Pixel formats, by name for image(w, h, format) and the format field
+static const char *const pixelformats[] = { "rgba8888", "rgba4444", "rgb5a1", "rgb565", "a8", NULL };
+static const CCTexture2DPixelFormat texformats[] = { kCCTexture2DPixelFormat_RGBA8888, kCCTexture2DPixelFormat_RGBA4444, kCCTexture2DPixelFormat_RGB5A1, kCCTexture2DPixelFormat_RGB565, kCCTexture2DPixelFormat_A8 };
+static const blit_format blitformats[] = { 0, BLIT_RGBA4444, BLIT_RGB5A1, BLIT_RGB565, BLIT_A8 };
+
+static int formatIndex(int format)
+{
+    for (int i = 1; pixelformats[i]; i++)
+    {
+        if (texformats[i] == format) return i;
+    }
+    return 0;
+}
+
+//Rounds pixels read from the image to what its texture holds, so reads match what is drawn
+static void quantizePixels(image_type* v, image_type_data* p, size_t n)
+{
+    int i = formatIndex(v->format);
+    
+    if (i > 0)
+    {
+        blit_quantize((uint8_t*)p, n, blitformats[i]);
+    }
+}
+
+size_t imageTextureBytes(image_type* image)
+{
+    if (image->texture && !image->dataChanged)
+    {
+        return image->texture.textureBytes;
+    }
+    
+    //Not uploaded yet, so count it the way CCTexture2D will (levels only go on POT textures with colour)
+    size_t w = image->rawWidth, h = image->rawHeight;
+    size_t bytes = w * h * [CCTexture2D bytesPerPixelForFormat:image->format];
+    BOOL levels = image->mipmaps != kCCTexture2DMipmap_None && image->format != kCCTexture2DPixelFormat_A8 &&
+                  (w & (w - 1)) == 0 && (h & (h - 1)) == 0;
+    return levels ? bytes + bytes / 3 : bytes;
+}
+
 static image_type* Pget( lua_State *L, int i )
 {
     if (luaL_checkudata(L,i,IMAGETYPE)==NULL) luaL_typerror(L,i,IMAGETYPE);
@@ -127,6 +199,12 @@ inline static ptrdiff_t xyToIdx(lua_Integer x, lua_Integer y, lua_Integer width,
 }
 
 
+//Every change to pixel data goes through here, so the texture is rebuilt before the next draw
+static inline void imageChanged(image_type* v)
+{
+    v->dataChanged = YES;
+}
+
 // _a_b (0,0) touches 1,4,5.  (1,0) touches 3,6,7
 // aabb
 // _c_d (0,1) touches 9,12,13 (1,1) touches 11,14,15
@@ -163,17 +241,36 @@ static int setPixel_internal( lua_State *L, image_type* v, lua_Integer width, lu
     switch (n) {
         case 4:
         {
-            //Was given color
+            //Was given color, or a packed color which is already pixel data
             lua_Integer x = luaL_checkinteger(L, 2)-1;
             lua_Integer y = luaL_checknumber(L, 3)-1; 
 
-            color_type* c = checkcolor(L, 4);
+            color_packed packed;
+            color_type* c = NULL;
+            BOOL isPacked = lua_type(L, 4) == LUA_TSTRING;
+            
+            if (isPacked)
+            {
+                luaL_argcheck(L, getpackedcolor(L, 4, &packed), 4, "packed color (4 byte string) expected");
+            }
+            else
+            {
+                c = checkcolor(L, 4);
+            }
             
             if (x >= 0 && x < width && y >= 0 && y < height) 
             {
-                image_type_data col = colorToImageData(c);
+                image_type_data col;
+                if (isPacked)
+                {
+                    memcpy(&col, &packed, sizeof(col));
+                }
+                else
+                {
+                    col = colorToImageData(c);
+                }
                 fillColor(v,x,y,width,scaleFactor,&col);
-                v->dataChanged = YES;
+                imageChanged(v);
             }
             else
             {
@@ -199,7 +296,7 @@ static int setPixel_internal( lua_State *L, image_type* v, lua_Integer width, lu
             {                
                 image_type_data col = createImageDataType(r, g, b, a);
                 fillColor(v, x, y, width, scaleFactor, &col);
-                v->dataChanged = YES;
+                imageChanged(v);
             }
             else
             {
@@ -253,11 +350,12 @@ static int getPixel_internal( lua_State *L, image_type* v, lua_Integer width, lu
     if (x >= 0 && x < width && y >= 0 && y < height) 
     {                
 
-        image_type_data *d = v->data+xyToIdx(x, y, width, scaleFactor);
-        lua_pushinteger(L, d->r);
-        lua_pushinteger(L, d->g);
-        lua_pushinteger(L, d->b);
-        lua_pushinteger(L, d->a);
+        image_type_data d = v->data[xyToIdx(x, y, width, scaleFactor)];
+        quantizePixels(v, &d, 1);
+        lua_pushinteger(L, d.r);
+        lua_pushinteger(L, d.g);
+        lua_pushinteger(L, d.b);
+        lua_pushinteger(L, d.a);
         
         return 4;
     }
@@ -289,6 +387,419 @@ static int getPixelRaw( lua_State *L )
     return getPixel_internal(L, v, v->rawWidth, v->rawHeight, 1);
 }
 
+//Raw pixels as a buffer of 4 components (0-255), with pixel x, y at element (y-1)*rawWidth + x
+static int toBuffer( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    size_t n = v->rawWidth*v->rawHeight;
+    buffer_type *b = pushbuffer(L, n, 4);
+    const image_color_element *src = (const image_color_element*)v->data;
+    
+    for (size_t i = 0; i < n*4; i++)
+    {
+        b->data[i] = src[i];
+    }
+    
+    return 1;
+}
+
+static int fromBuffer( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    buffer_type *b = checkbuffer(L,2);
+    size_t n = v->rawWidth*v->rawHeight;
+    image_color_element *dst = (image_color_element*)v->data;
+    
+    luaL_argcheck(L, b->components == 4 && b->count == n, 2, "buffer must have 4 components and one element per raw pixel");
+    
+    for (size_t i = 0; i < n*4; i++)
+    {
+        float c = b->data[i];
+        dst[i] = !(c > 0) ? 0 : c >= 255 ? 255 : (image_color_element)c;
+    }
+    imageChanged(v);
+    
+    return 0;
+}
+
+//Regions
+//
+//The bulk pixel operations below work on rectangles given as optional x, y, width, height (1-based)
+//after their other arguments, defaulting to the whole image. The plain methods take points like
+//get/set and cover every raw pixel beneath them on retina images; the raw methods take raw pixels
+
+typedef struct image_region
+{
+    lua_Integer x, y, width, height;    //Raw pixels
+    lua_Integer step;                   //Raw pixels per point
+} image_region;
+
+//Reads the rectangle at index i. Clipped rectangles are trimmed to the image (and may end up
+//empty); otherwise a rectangle outside the image is an error
+static void checkregion(lua_State *L, image_type* v, int i, NSUInteger scaleFactor, BOOL clip, image_region* r)
+{
+    lua_Integer width = v->rawWidth / scaleFactor, height = v->rawHeight / scaleFactor;
+    lua_Integer x = luaL_optinteger(L, i, 1) - 1;
+    lua_Integer y = luaL_optinteger(L, i+1, 1) - 1;
+    lua_Integer w = luaL_optinteger(L, i+2, width - x);
+    lua_Integer h = luaL_optinteger(L, i+3, height - y);
+    
+    if (clip)
+    {
+        if (x < 0) { w += x; x = 0; }
+        if (y < 0) { h += y; y = 0; }
+        if (x + w > width) w = width - x;
+        if (y + h > height) h = height - y;
+        if (w < 0) w = 0;
+        if (h < 0) h = 0;
+    }
+    else if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > width || y + h > height)
+    {
+        luaL_error(L, "region %d, %d, %d, %d is outside the %d x %d image", (int)x+1, (int)y+1, (int)w, (int)h, (int)width, (int)height);
+    }
+    
+    r->x = x * scaleFactor;
+    r->y = y * scaleFactor;
+    r->width = w * scaleFactor;
+    r->height = h * scaleFactor;
+    r->step = scaleFactor;
+}
+
+static inline image_type_data* regionRow(image_type* v, const image_region* r, lua_Integer j)
+{
+    return v->data + (r->y + j) * v->rawWidth + r->x;
+}
+
+static int fill_internal( lua_State *L, image_type* v, NSUInteger scaleFactor )
+{
+    image_region r;
+    color_packed c;
+    image_type_data col;
+    
+    luaL_argcheck(L, getpackedcolor(L, 2, &c), 2, "color expected");
+    memcpy(&col, &c, sizeof(col));
+    checkregion(L, v, 3, scaleFactor, YES, &r);
+    
+    for (lua_Integer j = 0; j < r.height; j++)
+    {
+        image_type_data* row = regionRow(v, &r, j);
+        for (lua_Integer i = 0; i < r.width; i++)
+        {
+            row[i] = col;
+        }
+    }
+    imageChanged(v);
+    
+    return 0;
+}
+
+static int fill( lua_State *L )             /** image:fill(color, [x, y, w, h]) */
+{
+    image_type *v=Pget(L,1);
+    return fill_internal(L, v, v->scaleFactor);
+}
+
+static int fillRaw( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return fill_internal(L, v, 1);
+}
+
+//One pixel per point, read from the top left raw pixel of each like get
+static int getPixels_internal( lua_State *L, image_type* v, NSUInteger scaleFactor )
+{
+    image_region r;
+    image_type_data* out;
+    size_t n;
+    
+    checkregion(L, v, 2, scaleFactor, NO, &r);
+    
+    //Gathered into scratch space, then copied into the string once
+    n = (size_t)(r.width / r.step) * (size_t)(r.height / r.step);
+    out = lua_newuserdata(L, n * sizeof(image_type_data));
+    for (lua_Integer j = 0; j < r.height; j += r.step)
+    {
+        const image_type_data* row = regionRow(v, &r, j);
+        
+        if (r.step == 1)
+        {
+            memcpy(out, row, r.width * sizeof(image_type_data));
+            out += r.width;
+        }
+        else
+        {
+            for (lua_Integer i = 0; i < r.width; i += r.step)
+            {
+                *out++ = row[i];
+            }
+        }
+    }
+    quantizePixels(v, lua_touserdata(L, -1), n);
+    lua_pushlstring(L, lua_touserdata(L, -1), n * sizeof(image_type_data));
+    
+    return 1;
+}
+
+static int getPixels( lua_State *L )        /** image:getPixels([x, y, w, h]) returns packed pixels */
+{
+    image_type *v=Pget(L,1);
+    return getPixels_internal(L, v, v->scaleFactor);
+}
+
+static int getPixelsRaw( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return getPixels_internal(L, v, 1);
+}
+
+//One pixel per point, written to every raw pixel beneath it like set
+static int setPixels_internal( lua_State *L, image_type* v, NSUInteger scaleFactor )
+{
+    image_region r;
+    size_t len;
+    const char* s = luaL_checklstring(L, 2, &len);
+    const image_type_data* src;
+    
+    checkregion(L, v, 3, scaleFactor, NO, &r);
+    luaL_argcheck(L, len == (size_t)(r.width / r.step) * (size_t)(r.height / r.step) * sizeof(image_type_data), 2, "string does not hold one packed pixel per point of the region");
+    
+    src = (const image_type_data*)s;
+    for (lua_Integer j = 0; j < r.height; j++)
+    {
+        image_type_data* row = regionRow(v, &r, j);
+        const image_type_data* in = src + (j / r.step) * (r.width / r.step);
+        
+        if (r.step == 1)
+        {
+            memcpy(row, in, r.width * sizeof(image_type_data));
+        }
+        else
+        {
+            for (lua_Integer i = 0; i < r.width; i++)
+            {
+                row[i] = in[i / r.step];
+            }
+        }
+    }
+    imageChanged(v);
+    
+    return 0;
+}
+
+static int setPixels( lua_State *L )        /** image:setPixels(packed, [x, y, w, h]) */
+{
+    image_type *v=Pget(L,1);
+    return setPixels_internal(L, v, v->scaleFactor);
+}
+
+static int setPixelsRaw( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return setPixels_internal(L, v, 1);
+}
+
+//Native kernels for map
+
+enum { MAP_INVERT, MAP_GRAYSCALE, MAP_PREMULTIPLY, MAP_UNPREMULTIPLY, MAP_THRESHOLD, MAP_LUT, MAP_MATRIX };
+static const char *const mapkernels[] = { "invert", "grayscale", "premultiply", "unpremultiply", "threshold", "lut", "matrix", NULL };
+
+typedef struct image_kernel
+{
+    int kind;
+    image_color_element lut[4][256];    //Per channel tables for MAP_LUT
+    lua_Number m[16];                   //Column major colour matrix for MAP_MATRIX
+    lua_Integer threshold;
+} image_kernel;
+
+static inline image_color_element clampElement(lua_Number x)
+{
+    return !(x > 0) ? 0 : x >= 255 ? 255 : (image_color_element)(x + 0.5f);
+}
+
+static void mapRow(const image_kernel* k, image_type_data* p, lua_Integer n)
+{
+    for (lua_Integer i = 0; i < n; i++, p++)
+    {
+        switch (k->kind)
+        {
+            case MAP_INVERT:
+                p->r = 255 - p->r;
+                p->g = 255 - p->g;
+                p->b = 255 - p->b;
+                break;
+            case MAP_GRAYSCALE:
+            {
+                //Rec. 601 luma in 8.8 fixed point
+                image_color_element l = (image_color_element)((77 * p->r + 150 * p->g + 29 * p->b + 128) >> 8);
+                p->r = p->g = p->b = l;
+            }   break;
+            case MAP_PREMULTIPLY:
+                p->r = (image_color_element)((p->r * p->a + 127) / 255);
+                p->g = (image_color_element)((p->g * p->a + 127) / 255);
+                p->b = (image_color_element)((p->b * p->a + 127) / 255);
+                break;
+            case MAP_UNPREMULTIPLY:
+                if (p->a > 0)
+                {
+                    p->r = (image_color_element)MIN(255, (p->r * 255 + p->a / 2) / p->a);
+                    p->g = (image_color_element)MIN(255, (p->g * 255 + p->a / 2) / p->a);
+                    p->b = (image_color_element)MIN(255, (p->b * 255 + p->a / 2) / p->a);
+                }
+                break;
+            case MAP_THRESHOLD:
+            {
+                image_color_element l = (77 * p->r + 150 * p->g + 29 * p->b + 128) >> 8 >= k->threshold ? 255 : 0;
+                p->r = p->g = p->b = l;
+            }   break;
+            case MAP_LUT:
+                p->r = k->lut[0][p->r];
+                p->g = k->lut[1][p->g];
+                p->b = k->lut[2][p->b];
+                p->a = k->lut[3][p->a];
+                break;
+            case MAP_MATRIX:
+            {
+                const lua_Number* m = k->m;
+                lua_Number r = p->r, g = p->g, b = p->b, a = p->a;
+                p->r = clampElement(m[0]*r + m[4]*g + m[8]*b + m[12]*a);
+                p->g = clampElement(m[1]*r + m[5]*g + m[9]*b + m[13]*a);
+                p->b = clampElement(m[2]*r + m[6]*g + m[10]*b + m[14]*a);
+                p->a = clampElement(m[3]*r + m[7]*g + m[11]*b + m[15]*a);
+            }   break;
+        }
+    }
+}
+
+//image:map(kernel, [arg], [x, y, w, h]) runs one native kernel over every raw pixel of the region:
+//"invert", "grayscale", "premultiply", "unpremultiply", "threshold" (luma 0-255), "lut" (a 256
+//byte string for r, g and b, or 1024 bytes of r, g, b and a tables) or "matrix" (a colour matrix
+//applied to 0-255 r, g, b, a)
+static int map_internal( lua_State *L, image_type* v, NSUInteger scaleFactor )
+{
+    image_kernel k;
+    image_region r;
+    int region = 3;
+    
+    k.kind = luaL_checkoption(L, 2, NULL, mapkernels);
+    switch (k.kind)
+    {
+        case MAP_THRESHOLD:
+            k.threshold = luaL_checkinteger(L, 3);
+            region = 4;
+            break;
+        case MAP_LUT:
+        {
+            size_t len;
+            const char* s = luaL_checklstring(L, 3, &len);
+            luaL_argcheck(L, len == 256 || len == 1024, 3, "lookup table of 256 or 1024 bytes expected");
+            for (int c = 0; c < 4; c++)
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    //A 256 byte table leaves alpha alone
+                    k.lut[c][i] = len == 1024 ? (image_color_element)s[c * 256 + i] : c < 3 ? (image_color_element)s[i] : (image_color_element)i;
+                }
+            }
+            region = 4;
+        }   break;
+        case MAP_MATRIX:
+        {
+            lua_Number* m = getmatrix44(L, 3);
+            luaL_argcheck(L, m != NULL, 3, "matrix expected");
+            memcpy(k.m, m, sizeof(k.m));
+            region = 4;
+        }   break;
+        default:
+            break;
+    }
+    
+    checkregion(L, v, region, scaleFactor, YES, &r);
+    for (lua_Integer j = 0; j < r.height; j++)
+    {
+        mapRow(&k, regionRow(v, &r, j), r.width);
+    }
+    imageChanged(v);
+    
+    return 0;
+}
+
+static int map( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return map_internal(L, v, v->scaleFactor);
+}
+
+static int mapRaw( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return map_internal(L, v, 1);
+}
+
+//Compositing
+
+static const char *const blitmodes[] = { "normal", "premultiplied", "add", "multiply", "copy", NULL };
+static const blit_mode blitkernels[] = { BLIT_NORMAL, BLIT_NORMAL, BLIT_ADD, BLIT_MULTIPLY, BLIT_COPY };
+
+//image:blit(src, x, y, [sx, sy, sw, sh], [mode]) composites the region of src (all of it by default)
+//onto this image with its bottom left corner at x, y, clipped to both images. Raw pixels are copied
+//one to one, so images of different scale factors draw at their raw size. The source's premultiplied
+//flag decides how its colours are read; "premultiplied" reads them that way regardless. Results are
+//written in the form of this image's own flag
+static int blit_internal( lua_State *L, image_type* v, NSUInteger scaleFactor, BOOL raw )
+{
+    image_type* src = Pget(L, 2);
+    lua_Integer x = (luaL_checkinteger(L, 3) - 1) * scaleFactor;
+    lua_Integer y = (luaL_checkinteger(L, 4) - 1) * scaleFactor;
+    BOOL rect = lua_type(L, 5) == LUA_TNUMBER;
+    int modearg = rect ? 9 : 5;
+    int mode = luaL_checkoption(L, modearg, src->premultiplied ? "premultiplied" : "normal", blitmodes);
+    const image_type_data* from;
+    image_region r;
+    
+    checkregion(L, src, rect ? 5 : lua_gettop(L) + 1, raw ? 1 : src->scaleFactor, YES, &r);
+    
+    if (x < 0) { r.x -= x; r.width += x; x = 0; }
+    if (y < 0) { r.y -= y; r.height += y; y = 0; }
+    if (x + r.width > v->rawWidth) r.width = v->rawWidth - x;
+    if (y + r.height > v->rawHeight) r.height = v->rawHeight - y;
+    if (r.width <= 0 || r.height <= 0)
+    {
+        return 0;
+    }
+    
+    //Blitting an image onto itself reads from a copy of the region, so rows can overlap
+    from = src->data + r.y * src->rawWidth + r.x;
+    if (src == v)
+    {
+        image_type_data* copy = lua_newuserdata(L, r.width * r.height * sizeof(image_type_data));
+        for (lua_Integer j = 0; j < r.height; j++)
+        {
+            memcpy(copy + j * r.width, regionRow(src, &r, j), r.width * sizeof(image_type_data));
+        }
+        from = copy;
+    }
+    
+    for (lua_Integer j = 0; j < r.height; j++)
+    {
+        const image_type_data* row = src == v ? from + j * r.width : from + j * src->rawWidth;
+        blit_row((uint8_t*)(v->data + (y + j) * v->rawWidth + x), (const uint8_t*)row, r.width, blitkernels[mode], mode == 1 || src->premultiplied, v->premultiplied);
+    }
+    imageChanged(v);
+    
+    return 0;
+}
+
+static int blit( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return blit_internal(L, v, v->scaleFactor, NO);
+}
+
+static int blitRaw( lua_State *L )
+{
+    image_type *v=Pget(L,1);
+    return blit_internal(L, v, 1, YES);
+}
 
 static image_type* Pnew( lua_State *L )
 {
@@ -300,6 +811,8 @@ static image_type* Pnew( lua_State *L )
     v->scaledWidth = 0;
     v->scaledHeight = 0;
     v->premultiplied = 0;
+    v->mipmaps = kCCTexture2DMipmap_None;
+    v->format = kCCTexture2DPixelFormat_RGBA8888;
     v->scaleFactor = 1;
     v->data = 0;
     luaL_getmetatable(L,IMAGETYPE);
@@ -432,6 +945,7 @@ static int copyImage_internal( lua_State *L, image_type* v, lua_Integer width, l
             newImage->scaledWidth = v->scaledWidth;
             newImage->scaledHeight = v->scaledHeight;
             newImage->scaleFactor = v->scaleFactor;
+            newImage->format = v->format;
             allocateData(newImage);
             memcpy(newImage->data, v->data, v->rawWidth*v->rawHeight*sizeof(image_type_data));
             break;
@@ -485,16 +999,15 @@ static int copyImage_internal( lua_State *L, image_type* v, lua_Integer width, l
             newImage->scaledWidth = targetWidth;
             newImage->scaledHeight = targetHeight;
             newImage->scaleFactor = v->scaleFactor;
+            newImage->format = v->format;
             allocateData(newImage);
             
+            //Whole rows at a time, from the raw pixels under the region's points
             for (int j = 0; j<newImage->rawHeight; j++) 
             {
-                for(int i = 0; i<newImage->rawWidth; i++)
-                {
-                    ptrdiff_t vIndex = xyToIdx(x+i, y+j, width*scaleFactor, 1);
-                    ptrdiff_t index = xyToIdx(i, j, newImage->rawWidth, 1);
-                    newImage->data[index] = v->data[vIndex];
-                }
+                ptrdiff_t vIndex = xyToIdx(x, y, width, scaleFactor) + j*width*scaleFactor;
+                ptrdiff_t index = xyToIdx(0, j, newImage->rawWidth, 1);
+                memcpy(newImage->data + index, v->data + vIndex, newImage->rawWidth*sizeof(image_type_data));
             }
             
             break;            
@@ -529,6 +1042,58 @@ static int copyImageRaw( lua_State* L )
     return copyImage_internal(L, v, v->rawWidth, v->rawHeight, 1);
 }
 
+//A new image on the stack of rawWidth x rawHeight pixels, with v's scale factor, alpha mode, mipmaps and format
+static image_type* pushImageLike( lua_State *L, image_type* v, lua_Integer rawWidth, lua_Integer rawHeight )
+{
+    image_type *newImage = Pnew(L);
+    
+    newImage->rawWidth = rawWidth;
+    newImage->rawHeight = rawHeight;
+    newImage->scaledWidth = rawWidth / v->scaleFactor;
+    newImage->scaledHeight = rawHeight / v->scaleFactor;
+    newImage->scaleFactor = v->scaleFactor;
+    newImage->premultiplied = v->premultiplied;
+    newImage->mipmaps = v->mipmaps;
+    newImage->format = v->format;
+    allocateData(newImage);
+    
+    return newImage;
+}
+
+static const char *const scalefilters[] = { "nearest", "bilinear", NULL };
+
+static int scaledImage( lua_State *L )      /** image:scaled(w, h, ["nearest" | "bilinear"]) */
+{
+    image_type *v=Pget(L,1);
+    lua_Integer width = luaL_checkinteger(L, 2);
+    lua_Integer height = luaL_checkinteger(L, 3);
+    int filter = luaL_checkoption(L, 4, "bilinear", scalefilters);
+    image_type *newImage;
+    
+    luaL_argcheck(L, width > 0, 2, "target width must be > 0");
+    luaL_argcheck(L, height > 0, 3, "target height must be > 0");
+    
+    newImage = pushImageLike(L, v, width * v->scaleFactor, height * v->scaleFactor);
+    blit_scale((uint8_t*)newImage->data, newImage->rawWidth, newImage->rawHeight, (const uint8_t*)v->data, v->rawWidth, v->rawHeight, filter == 1, v->premultiplied);
+    
+    return 1;
+}
+
+static int rotatedImage( lua_State *L )     /** image:rotated(degrees), a multiple of 90 counterclockwise */
+{
+    image_type *v=Pget(L,1);
+    lua_Integer degrees = luaL_checkinteger(L, 2);
+    int turns = (int)((degrees / 90) % 4);
+    image_type *newImage;
+    
+    luaL_argcheck(L, degrees % 90 == 0, 2, "multiple of 90 degrees expected");
+    
+    newImage = turns % 2 ? pushImageLike(L, v, v->rawHeight, v->rawWidth) : pushImageLike(L, v, v->rawWidth, v->rawHeight);
+    blit_rotate((uint8_t*)newImage->data, (const uint8_t*)v->data, v->rawWidth, v->rawHeight, turns);
+    
+    return 1;
+}
+
 static int decompress(lua_State *L)
 {
     int n = lua_gettop(L);
@@ -564,6 +1129,7 @@ static int Lnew( lua_State *L )
         v->rawHeight = v->scaledHeight * scaleFactor;
         v->scaleFactor = scaleFactor;
         v->premultiplied = 0;
+        v->format = texformats[luaL_checkoption(L, 3, pixelformats[0], pixelformats)];
         allocateData(v);     
     }
     
@@ -572,35 +1138,19 @@ static int Lnew( lua_State *L )
 
 static int Lget( lua_State *L )
 {
-    image_type *v=Pget(L,1);
-    const char* c = luaL_checkstring(L,2);
+    image_type *v=checkfieldudata(L,1,IMAGETYPE);
     
-    if( strcmp(c, "width") == 0 )
+    switch( fieldindex(L,2) )
     {
-        lua_pushnumber(L, v->scaledWidth);
-    }
-    else if( strcmp(c, "height") == 0 )
-    {
-        lua_pushnumber(L, v->scaledHeight);        
-    }
-    else if( strcmp(c, "rawWidth") == 0 )
-    {
-        lua_pushnumber(L, v->rawWidth);
-    }
-    else if( strcmp(c, "rawHeight") == 0 )
-    {
-        lua_pushnumber(L, v->rawHeight);        
-    }
-    else if( strcmp(c, "premultiplied") == 0)
-    {
-        lua_pushboolean(L, v->premultiplied);
-    }
-    else
-    {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, IMAGETYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);
+        case FIELD_WIDTH:           lua_pushnumber(L, v->scaledWidth); break;
+        case FIELD_HEIGHT:          lua_pushnumber(L, v->scaledHeight); break;
+        case FIELD_RAWWIDTH:        lua_pushnumber(L, v->rawWidth); break;
+        case FIELD_RAWHEIGHT:       lua_pushnumber(L, v->rawHeight); break;
+        case FIELD_PREMULTIPLIED:   lua_pushboolean(L, v->premultiplied); break;
+        case FIELD_MIPMAP:          pushmipmaps(L, v->mipmaps); break;
+        case FIELD_FORMAT:          lua_pushstring(L, pixelformats[formatIndex(v->format)]); break;
+        case FIELD_TEXTUREBYTES:    lua_pushinteger(L, imageTextureBytes(v)); break;
+        default: break;     //The method (or nil) for key is on the stack
     }
     
     return 1;
@@ -608,12 +1158,27 @@ static int Lget( lua_State *L )
 
 static int Lset(lua_State *L) 
 {
-    image_type *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
-    if(strcmp(i, "premultiplied") == 0)
+    image_type *v=checkfieldudata(L,1,IMAGETYPE);
+    switch( fieldindex(L,2) )
     {
-        lua_Number b =lua_toboolean(L, 3);
-        v->premultiplied = b;
+        case FIELD_PREMULTIPLIED:
+        {
+            lua_Number b =lua_toboolean(L, 3);
+            v->premultiplied = b;
+        } break;
+        case FIELD_MIPMAP:
+        {
+            //The levels are built with the texture
+            v->mipmaps = checkmipmaps(L, 3);
+            imageChanged(v);
+        } break;
+        case FIELD_FORMAT:
+        {
+            //The pixels are packed with the texture
+            v->format = texformats[luaL_checkoption(L, 3, NULL, pixelformats)];
+            imageChanged(v);
+        } break;
+        default: break;
     }
     return 1;
 }
@@ -645,8 +1210,6 @@ static int Ltostring(lua_State *L)
 
 static const luaL_reg R[] =
 {
-    { "__index", Lget },
-    { "__newindex",	Lset		},
     { "__tostring", Ltostring },
     { "__gc", Lgc },
     { "get", getPixel },
@@ -655,6 +1218,20 @@ static const luaL_reg R[] =
     { "rawCopy", copyImageRaw },
     { "rawGet", getPixelRaw },
     { "rawSet", setPixelRaw },
+    { "toBuffer", toBuffer },
+    { "fromBuffer", fromBuffer },
+    { "fill", fill },
+    { "rawFill", fillRaw },
+    { "getPixels", getPixels },
+    { "rawGetPixels", getPixelsRaw },
+    { "setPixels", setPixels },
+    { "rawSetPixels", setPixelsRaw },
+    { "map", map },
+    { "rawMap", mapRaw },
+    { "blit", blit },
+    { "rawBlit", blitRaw },
+    { "scaled", scaledImage },
+    { "rotated", rotatedImage },
     { "decompressImage", decompress}, 
     { NULL, NULL }
 };
@@ -663,11 +1240,8 @@ LUALIB_API int luaopen_image(lua_State *L)
 {
     luaL_newmetatable(L,IMAGETYPE);
 
-    lua_pushstring(L, "__index");
-    lua_pushvalue(L, -2);   // pushes the metatable
-    lua_settable(L, -3);    // metatable.__index = metatable
-
     luaL_register(L, NULL, R);
+    setfieldhandlers(L, Lget, Lset, fields);
     
     
     lua_register(L,"image",Lnew);
@@ -24,10 +24,66 @@
 #include "body.h"
 #import "PhysicsManager.h"
 #import "PhysicsCommands.h"
+#include "codea_luaext.h"
 
 #define JOINT_TYPE   "joint"
 #define JOINT_SIZE   sizeof(joint_wrapper_type)
 
+enum
+{
+    FIELD_ENABLEMOTOR,
+    FIELD_MOTORSPEED,
+    FIELD_MAXMOTORTORQUE,
+    FIELD_ENABLELIMIT,
+    FIELD_LOWERLIMIT,
+    FIELD_UPPERLIMIT,
+    FIELD_JOINTANGLE,
+    FIELD_JOINTSPEED,
+    FIELD_REFERENCEANGLE,
+    FIELD_COLLIDECONNECTED,
+    FIELD_LENGTH,
+    FIELD_FREQUENCY,
+    FIELD_DAMPINGRATIO,
+    FIELD_MAXMOTORFORCE,
+    FIELD_JOINTTRANSLATION,
+    FIELD_MOTORFORCE,
+    FIELD_TYPE,
+    FIELD_ANCHORA,
+    FIELD_ANCHORB,
+    FIELD_BODYA,
+    FIELD_BODYB,
+    FIELD_REACTIONTORQUE,
+    FIELD_REACTIONFORCE
+};
+
+static const char *const fields[] =
+{
+    "enableMotor",
+    "motorSpeed",
+    "maxMotorTorque",
+    "enableLimit",
+    "lowerLimit",
+    "upperLimit",
+    "jointAngle",
+    "jointSpeed",
+    "referenceAngle",
+    "collideConnected",
+    "length",
+    "frequency",
+    "dampingRatio",
+    "maxMotorForce",
+    "jointTranslation",
+    "motorForce",
+    "type",
+    "anchorA",
+    "anchorB",
+    "bodyA",
+    "bodyB",
+    "reactionTorque",
+    "reactionForce",
+    NULL
+};
+
 extern float PTM_RATIO;
 
 joint_wrapper_type* checkJoint(lua_State *L, int i)
@@ -91,300 +147,334 @@ static int Lnew(lua_State *L)			/** joint(t, b1, b1, a) */
 
 static int Lget( lua_State *L)
 {
-    joint_wrapper_type *j = checkJoint(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    joint_wrapper_type *j = (joint_wrapper_type*)checkfieldudata(L, 1, JOINT_TYPE);
+    int field = fieldindex(L, 2);
+    
+    if (field < 0) return 1;    //The method (or nil) for key is on the stack
     
     if (j->joint)
     {                        
         if (j->joint->GetType() == e_revoluteJoint)
         {
             b2RevoluteJoint* joint = (b2RevoluteJoint*)j->joint;
-            if ( strcmp(c, "enableMotor") == 0 )
-            {
-                lua_pushboolean(L, joint->IsMotorEnabled());
-                return 1;
-            }
-            else if ( strcmp(c, "motorSpeed") == 0 )
-            {
-                lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetMotorSpeed()));
-                return 1;            
-            }        
-            else if ( strcmp(c, "maxMotorTorque") == 0 )
-            {
-                lua_pushnumber(L, joint->GetMaxMotorTorque());
-                return 1;            
-            }                
-            else if ( strcmp(c, "enableLimit") == 0 )
+            switch( field )
             {
-                lua_pushboolean(L, joint->IsLimitEnabled());
-                return 1;            
-            }
-            else if ( strcmp(c, "lowerLimit") == 0 )
-            {
-                lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetLowerLimit()));
-                return 1;            
-            }
-            else if ( strcmp(c, "upperLimit") == 0 )
-            {
-                lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetUpperLimit()));
-                return 1;            
-            }       
-            else if ( strcmp(c, "jointAngle") == 0 )
-            {
-                lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetJointAngle()));
-                return 1;            
-            }       
-            else if ( strcmp(c, "jointSpeed") == 0 )
-            {
-                lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetJointSpeed()));
-                return 1;            
-            }               
-            else if ( strcmp(c, "referenceAngle") == 0 )
-            {
-                lua_pushnumber(L, joint->GetReferenceAngle());
-                return 1;            
-            }       
-            else if ( strcmp(c, "collideConnected") == 0 )
-            {
-                lua_pushboolean(L, joint->GetCollideConnected());
-                return 1;            
+                case FIELD_ENABLEMOTOR:
+                {
+                    lua_pushboolean(L, joint->IsMotorEnabled());
+                    return 1;
+                }
+                case FIELD_MOTORSPEED:
+                {
+                    lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetMotorSpeed()));
+                    return 1;
+                }
+                case FIELD_MAXMOTORTORQUE:
+                {
+                    lua_pushnumber(L, joint->GetMaxMotorTorque());
+                    return 1;
+                }
+                case FIELD_ENABLELIMIT:
+                {
+                    lua_pushboolean(L, joint->IsLimitEnabled());
+                    return 1;
+                }
+                case FIELD_LOWERLIMIT:
+                {
+                    lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetLowerLimit()));
+                    return 1;
+                }
+                case FIELD_UPPERLIMIT:
+                {
+                    lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetUpperLimit()));
+                    return 1;
+                }
+                case FIELD_JOINTANGLE:
+                {
+                    lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetJointAngle()));
+                    return 1;
+                }
+                case FIELD_JOINTSPEED:
+                {
+                    lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetJointSpeed()));
+                    return 1;
+                }
+                case FIELD_REFERENCEANGLE:
+                {
+                    lua_pushnumber(L, joint->GetReferenceAngle());
+                    return 1;
+                }
+                case FIELD_COLLIDECONNECTED:
+                {
+                    lua_pushboolean(L, joint->GetCollideConnected());
+                    return 1;
+                }
+                default: break;
             }               
         }
         else if (j->joint->GetType() == e_distanceJoint)
         {
             b2DistanceJoint* joint = (b2DistanceJoint*)j->joint;
             
-            if ( strcmp(c, "length") == 0 )
-            {
-                lua_pushnumber(L, joint->GetLength() * PTM_RATIO);
-                return 1;
-            }        
-            else if ( strcmp(c, "frequency") == 0 )
-            {
-                lua_pushnumber(L, joint->GetFrequency());
-                return 1;            
-            }                
-            else if ( strcmp(c, "dampingRatio") == 0 )
+            switch( field )
             {
-                lua_pushnumber(L, joint->GetDampingRatio());
-                return 1;            
+                case FIELD_LENGTH:
+                {
+                    lua_pushnumber(L, joint->GetLength() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_FREQUENCY:
+                {
+                    lua_pushnumber(L, joint->GetFrequency());
+                    return 1;
+                }
+                case FIELD_DAMPINGRATIO:
+                {
+                    lua_pushnumber(L, joint->GetDampingRatio());
+                    return 1;
+                }
+                default: break;
             } 
         }
         else if (j->joint->GetType() == e_weldJoint)
         {
             b2WeldJoint* joint = (b2WeldJoint*)j->joint;
             
-            if ( strcmp(c, "frequency") == 0 )
-            {
-                lua_pushnumber(L, joint->GetFrequency());
-                return 1;            
-            }                
-            else if ( strcmp(c, "dampingRatio") == 0 )
+            switch( field )
             {
-                lua_pushnumber(L, joint->GetDampingRatio());
-                return 1;            
+                case FIELD_FREQUENCY:
+                {
+                    lua_pushnumber(L, joint->GetFrequency());
+                    return 1;
+                }
+                case FIELD_DAMPINGRATIO:
+                {
+                    lua_pushnumber(L, joint->GetDampingRatio());
+                    return 1;
+                }
+                default: break;
             }   
         }
         else if (j->joint->GetType() == e_prismaticJoint)
         {
             b2PrismaticJoint* joint = (b2PrismaticJoint*)j->joint;
-            if ( strcmp(c, "enableMotor") == 0 )
+            switch( field )
             {
-                lua_pushboolean(L, joint->IsMotorEnabled());
+                case FIELD_ENABLEMOTOR:
+                {
+                    lua_pushboolean(L, joint->IsMotorEnabled());
+                    return 1;
+                }
+                case FIELD_MOTORSPEED:
+                {
+                    lua_pushnumber(L, joint->GetMotorSpeed() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_MAXMOTORFORCE:
+                {
+                    lua_pushnumber(L, joint->GetMaxMotorForce() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_REFERENCEANGLE:
+                {
+                    lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetReferenceAngle()));
+                    return 1;
+                }
+                case FIELD_JOINTTRANSLATION:
+                {
+                    lua_pushnumber(L, joint->GetJointTranslation() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_JOINTSPEED:
+                {
+                    lua_pushnumber(L, joint->GetJointSpeed() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_ENABLELIMIT:
+                {
+                    lua_pushboolean(L, joint->IsLimitEnabled());
+                    return 1;
+                }
+                case FIELD_LOWERLIMIT:
+                {
+                    lua_pushnumber(L, joint->GetLowerLimit() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_UPPERLIMIT:
+                {
+                    lua_pushnumber(L, joint->GetUpperLimit() * PTM_RATIO);
+                    return 1;
+                }
+                case FIELD_MOTORFORCE:
+                {
+                    float force = joint->GetMotorForce(getPhysicsAPI().invTimeStep);
+                    lua_pushnumber(L, force);
+                    return 1;
+                }
+                default: break;
+            }            
+        }
+        
+        // Common methods
+        switch( field )
+        {
+            case FIELD_TYPE:
+            {
+                lua_pushnumber(L, (int)j->joint->GetType());
                 return 1;
             }
-            else if ( strcmp(c, "motorSpeed") == 0 )
-            {
-                lua_pushnumber(L, joint->GetMotorSpeed() * PTM_RATIO);
-                return 1;            
-            }                    
-            else if ( strcmp(c, "maxMotorForce") == 0 )
+            case FIELD_ANCHORA:
             {
-                lua_pushnumber(L, joint->GetMaxMotorForce() * PTM_RATIO);
-                return 1;            
-            }                                
-            else if ( strcmp(c, "referenceAngle") == 0 )
-            {
-                lua_pushnumber(L, RADIANS_TO_DEGREES(joint->GetReferenceAngle()));
-                return 1;            
-            }                    
-            else if ( strcmp(c, "jointTranslation") == 0 )
-            {
-                lua_pushnumber(L, joint->GetJointTranslation() * PTM_RATIO);
+                b2Vec2 anchor = j->joint->GetAnchorA();
+                pushvec2(L, anchor.x * PTM_RATIO, anchor.y * PTM_RATIO);
                 return 1;
             }
-            else if ( strcmp(c, "jointSpeed") == 0 )
+            case FIELD_ANCHORB:
             {
-                lua_pushnumber(L, joint->GetJointSpeed() * PTM_RATIO);
+                b2Vec2 anchor = j->joint->GetAnchorB();
+                pushvec2(L, anchor.x * PTM_RATIO, anchor.y * PTM_RATIO);
                 return 1;
-            }            
-            else if ( strcmp(c, "enableLimit") == 0 )
+            }
+            case FIELD_BODYA:
             {
-                lua_pushboolean(L, joint->IsLimitEnabled());
-                return 1;            
-            }            
-            else if ( strcmp(c, "lowerLimit") == 0 )
+                push_obj(L, (body_wrapper_type*)j->joint->GetBodyA()->GetUserData());
+                return 1;
+            }
+            case FIELD_BODYB:
             {
-                lua_pushnumber(L, joint->GetLowerLimit() * PTM_RATIO);
-                return 1;            
+                push_obj(L, (body_wrapper_type*)j->joint->GetBodyB()->GetUserData());
+                return 1;
             }
-            else if ( strcmp(c, "upperLimit") == 0 )
+            case FIELD_REACTIONTORQUE:
             {
-                lua_pushnumber(L, joint->GetUpperLimit() * PTM_RATIO);
-                return 1;            
-            }        
-            else if ( strcmp(c, "motorForce") == 0 )
+                float torque = j->joint->GetReactionTorque(getPhysicsAPI().invTimeStep);
+                lua_pushnumber(L, torque);
+                return 1;
+            }
+            case FIELD_REACTIONFORCE:
             {
-                float force = joint->GetMotorForce(getPhysicsAPI().invTimeStep);
-                lua_pushnumber(L, force);
+                b2Vec2 force = j->joint->GetReactionForce(getPhysicsAPI().invTimeStep);
+                pushvec2(L, force.x * PTM_RATIO, force.y * PTM_RATIO);
                 return 1;
-            }            
-        }
-        
-        // Common methods
-        if ( strcmp(c, "type") == 0 )
-        {
-            lua_pushnumber(L, (int)j->joint->GetType());
-            return 1;
-        }                
-        else if ( strcmp(c, "anchorA") == 0 )
-        {
-            b2Vec2 anchor = j->joint->GetAnchorA();
-            pushvec2(L, anchor.x * PTM_RATIO, anchor.y * PTM_RATIO);
-            return 1;            
-        }               
-        else if ( strcmp(c, "anchorB") == 0 )
-        {
-            b2Vec2 anchor = j->joint->GetAnchorB();
-            pushvec2(L, anchor.x * PTM_RATIO, anchor.y * PTM_RATIO);
-            return 1;            
-        }    
-        else if ( strcmp(c, "bodyA") == 0 )
-        {
-            push_obj(L, (body_wrapper_type*)j->joint->GetBodyA()->GetUserData());
-            return 1;
-        }
-        else if ( strcmp(c, "bodyB") == 0 )
-        {
-            push_obj(L, (body_wrapper_type*)j->joint->GetBodyB()->GetUserData());
-            return 1;
-        }    
-        else if ( strcmp(c, "reactionTorque") == 0 )
-        {
-            float torque = j->joint->GetReactionTorque(getPhysicsAPI().invTimeStep);
-            lua_pushnumber(L, torque);
-            return 1;
-        }
-        else if ( strcmp(c, "reactionForce") == 0 )
-        {
-            b2Vec2 force = j->joint->GetReactionForce(getPhysicsAPI().invTimeStep);
-            pushvec2(L, force.x * PTM_RATIO, force.y * PTM_RATIO);
-            return 1;
+            }
+            default: break;
         }        
     }
 
     
-    {        
-        //Load the metatable and value for key
-        luaL_getmetatable(L, JOINT_TYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);    
-    }
+    //Not a field of this kind of joint
+    lua_pushnil(L);
     return 1;
 }
 
 static int Lset(lua_State *L)
 {   
-    joint_wrapper_type *j = checkJoint(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    joint_wrapper_type *j = (joint_wrapper_type*)checkfieldudata(L, 1, JOINT_TYPE);
+    int field = fieldindex(L, 2);
     
     if (j->joint == NULL) return 0;
     
     if (j->joint->GetType() == e_revoluteJoint)
     {
         b2RevoluteJoint* joint = (b2RevoluteJoint*)j->joint;
-        if ( strcmp(c, "enableMotor") == 0 )
+        switch( field )
         {
-            joint->EnableMotor(lua_toboolean(L, 3));
-        }
-        else if ( strcmp(c, "motorSpeed") == 0 )
-        {
-            joint->SetMotorSpeed(DEGREES_TO_RADIANS(luaL_checknumber(L, 3)));
-        }        
-        else if ( strcmp(c, "maxMotorTorque") == 0 )
-        {
-            joint->SetMaxMotorTorque(luaL_checknumber(L, 3));
-        }                
-        else if ( strcmp(c, "enableLimit") == 0 )
-        {
-            joint->EnableLimit(lua_toboolean(L, 3));
-        }
-        else if ( strcmp(c, "lowerLimit") == 0 )
-        {
-            joint->SetLimits(DEGREES_TO_RADIANS(luaL_checknumber(L, 3)), joint->GetUpperLimit());
-        }
-        else if ( strcmp(c, "upperLimit") == 0 )
-        {
-            joint->SetLimits(joint->GetLowerLimit(), DEGREES_TO_RADIANS(luaL_checknumber(L, 3)));
+            case FIELD_ENABLEMOTOR:
+            {
+                joint->EnableMotor(lua_toboolean(L, 3));
+            } break;
+            case FIELD_MOTORSPEED:
+            {
+                joint->SetMotorSpeed(DEGREES_TO_RADIANS(luaL_checknumber(L, 3)));
+            } break;
+            case FIELD_MAXMOTORTORQUE:
+            {
+                joint->SetMaxMotorTorque(luaL_checknumber(L, 3));
+            } break;
+            case FIELD_ENABLELIMIT:
+            {
+                joint->EnableLimit(lua_toboolean(L, 3));
+            } break;
+            case FIELD_LOWERLIMIT:
+            {
+                joint->SetLimits(DEGREES_TO_RADIANS(luaL_checknumber(L, 3)), joint->GetUpperLimit());
+            } break;
+            case FIELD_UPPERLIMIT:
+            {
+                joint->SetLimits(joint->GetLowerLimit(), DEGREES_TO_RADIANS(luaL_checknumber(L, 3)));
+            } break;
+            default: break;
         }        
     }
     else if (j->joint->GetType() == e_distanceJoint)
     {
         b2DistanceJoint* joint = (b2DistanceJoint*)j->joint;
 
-        if ( strcmp(c, "length") == 0 )
-        {
-            joint->SetLength(luaL_checknumber(L, 3) * INV_PTM_RATIO);
-        }        
-        else if ( strcmp(c, "frequency") == 0 )
+        switch( field )
         {
-            joint->SetFrequency(luaL_checknumber(L, 3));
-        }                
-        else if ( strcmp(c, "dampingRatio") == 0 )
-        {
-            joint->SetDampingRatio(luaL_checknumber(L, 3));
+            case FIELD_LENGTH:
+            {
+                joint->SetLength(luaL_checknumber(L, 3) * INV_PTM_RATIO);
+            } break;
+            case FIELD_FREQUENCY:
+            {
+                joint->SetFrequency(luaL_checknumber(L, 3));
+            } break;
+            case FIELD_DAMPINGRATIO:
+            {
+                joint->SetDampingRatio(luaL_checknumber(L, 3));
+            } break;
+            default: break;
         }        
     }
     else if (j->joint->GetType() == e_weldJoint)
     {
         b2WeldJoint* joint = (b2WeldJoint*)j->joint;
         
-        if ( strcmp(c, "frequency") == 0 )
-        {
-            joint->SetFrequency(luaL_checknumber(L, 3));
-        }                
-        else if ( strcmp(c, "dampingRatio") == 0 )
+        switch( field )
         {
-            joint->SetDampingRatio(luaL_checknumber(L, 3));
+            case FIELD_FREQUENCY:
+            {
+                joint->SetFrequency(luaL_checknumber(L, 3));
+            } break;
+            case FIELD_DAMPINGRATIO:
+            {
+                joint->SetDampingRatio(luaL_checknumber(L, 3));
+            } break;
+            default: break;
         }        
     }
     else if (j->joint->GetType() == e_prismaticJoint)
     {
         b2PrismaticJoint* joint = (b2PrismaticJoint*)j->joint;
         
-        if ( strcmp(c, "enableMotor") == 0 )
-        {
-            joint->EnableMotor(lua_toboolean(L, 3));
-        }
-        else if ( strcmp(c, "motorSpeed") == 0 )
+        switch( field )
         {
-            joint->SetMotorSpeed(luaL_checknumber(L, 3) * INV_PTM_RATIO);
-        }
-        else if ( strcmp(c, "maxMotorForce") == 0 )
-        {            
-            joint->SetMaxMotorForce(luaL_checknumber(L, 3));
-        }                        
-        else if ( strcmp(c, "enableLimit") == 0 )
-        {
-            joint->EnableLimit(lua_toboolean(L, 3));
-        }
-        else if ( strcmp(c, "lowerLimit") == 0 )
-        {
-            joint->SetLimits(luaL_checknumber(L, 3) * INV_PTM_RATIO, joint->GetUpperLimit());
-        }
-        else if ( strcmp(c, "upperLimit") == 0 )
-        {
-            joint->SetLimits(joint->GetLowerLimit(), luaL_checknumber(L, 3) * INV_PTM_RATIO);
+            case FIELD_ENABLEMOTOR:
+            {
+                joint->EnableMotor(lua_toboolean(L, 3));
+            } break;
+            case FIELD_MOTORSPEED:
+            {
+                joint->SetMotorSpeed(luaL_checknumber(L, 3) * INV_PTM_RATIO);
+            } break;
+            case FIELD_MAXMOTORFORCE:
+            {
+                joint->SetMaxMotorForce(luaL_checknumber(L, 3));
+            } break;
+            case FIELD_ENABLELIMIT:
+            {
+                joint->EnableLimit(lua_toboolean(L, 3));
+            } break;
+            case FIELD_LOWERLIMIT:
+            {
+                joint->SetLimits(luaL_checknumber(L, 3) * INV_PTM_RATIO, joint->GetUpperLimit());
+            } break;
+            case FIELD_UPPERLIMIT:
+            {
+                joint->SetLimits(joint->GetLowerLimit(), luaL_checknumber(L, 3) * INV_PTM_RATIO);
+            } break;
+            default: break;
         }        
         
 
@@ -434,8 +524,6 @@ static int Lgc(lua_State *L)
 
 static const luaL_reg R[] =
 {
-    { "__index", Lget },
-	{ "__newindex",	Lset},
     { "__tostring", Ltostring },
     { "__gc", Lgc },
     { "destroy", Ldestroy },
@@ -452,6 +540,7 @@ LUALIB_API int luaopen_joint(lua_State *L)
 {
     luaL_newmetatable(L, JOINT_TYPE);    
     luaL_openlib(L, NULL, R, 0);
+    setfieldhandlers(L, Lget, Lset, fields);
     //lua_register(L, JOINT_TYPE, Lnew);    
     luaL_openlib(L, CODIFY_PHYSICSLIBNAME, P, 0);
     return 1;
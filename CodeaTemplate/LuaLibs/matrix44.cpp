@@ -31,6 +31,8 @@ extern "C"
 #endif
       
 #include "lauxlib.h"
+#include "codea_luaext.h"
+#include "points.h"
     
 #ifdef __cplusplus
 }
@@ -40,8 +42,20 @@ extern "C"
 #define MATRIX44TYPE    "matrix"
 #define MATRIX44SIZE    16
 
+static const char *const fields[] = { NULL };   //Only numeric indices and methods
+
 #define MATHF(c)    c##f
 
+lua_Number *getmatrix44(lua_State *L, int i)
+{
+    if( lua_isuserdata(L, i) )
+    {
+        return (lua_Number*) testudata(L, i, MATRIX44TYPE);
+    }
+    
+    return NULL;
+}
+
 lua_Number *checkmatrix44(lua_State *L, int i)
 {
     if( lua_isuserdata(L, i) )
@@ -70,6 +84,202 @@ static lua_Number *Pnew(lua_State *L)
     return v;
 }
 
+//Kernels
+//
+//Matrices are stored column major, as GLM does. With the GCC/Clang vector extension (SSE on the
+//simulator, NEON on devices) each column is one register; elsewhere the kernels fall back to
+//GLM's scalar code. Results may alias the inputs, which is what the in-place methods rely on.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__SSE__) || defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define MATRIX44_SIMD
+#endif
+
+#ifdef MATRIX44_SIMD
+
+//Userdata is only guaranteed 8 byte alignment, hence the reduced alignment
+typedef float matrix44_col __attribute__((vector_size(16), aligned(4)));
+
+static inline matrix44_col colload(const float *p)
+{
+    return *(const matrix44_col*)p;
+}
+
+static inline void colstore(float *p, matrix44_col c)
+{
+    *(matrix44_col*)p = c;
+}
+
+static inline matrix44_col splat(float x)
+{
+    matrix44_col c = { x, x, x, x };
+    return c;
+}
+
+//r = a * b
+static void mat4_mul(float *r, const float *a, const float *b)
+{
+    matrix44_col a0 = colload(a), a1 = colload(a+4), a2 = colload(a+8), a3 = colload(a+12);
+    
+    for (int j = 0; j < 16; j += 4)
+    {
+        float b0 = b[j], b1 = b[j+1], b2 = b[j+2], b3 = b[j+3];
+        colstore(r+j, a0*splat(b0) + a1*splat(b1) + a2*splat(b2) + a3*splat(b3));
+    }
+}
+
+//r (4 floats) = m * (x, y, z, w)
+static void mat4_transform(float *r, const float *m, float x, float y, float z, float w)
+{
+    colstore(r, colload(m)*splat(x) + colload(m+4)*splat(y) + colload(m+8)*splat(z) + colload(m+12)*splat(w));
+}
+
+//r = inverse(m), GLM's cofactor expansion with four lanes per step
+static void mat4_inverse(float *r, const float *m)
+{
+    matrix44_col c0 = colload(m), c1 = colload(m+4), c2 = colload(m+8), c3 = colload(m+12);
+    
+    //2x2 minors of columns 1-3: fac(p,q) = A[p]*B[q] - B[p]*A[q]
+    matrix44_col A[4], B[4];
+    for (int p = 0; p < 4; p++)
+    {
+        matrix44_col a = { c2[p], c2[p], c1[p], c1[p] };
+        matrix44_col b = { c3[p], c3[p], c3[p], c2[p] };
+        A[p] = a;
+        B[p] = b;
+    }
+    matrix44_col fac0 = A[2]*B[3] - B[2]*A[3];
+    matrix44_col fac1 = A[1]*B[3] - B[1]*A[3];
+    matrix44_col fac2 = A[1]*B[2] - B[1]*A[2];
+    matrix44_col fac3 = A[0]*B[3] - B[0]*A[3];
+    matrix44_col fac4 = A[0]*B[2] - B[0]*A[2];
+    matrix44_col fac5 = A[0]*B[1] - B[0]*A[1];
+    
+    matrix44_col vec0 = { c1[0], c0[0], c0[0], c0[0] };
+    matrix44_col vec1 = { c1[1], c0[1], c0[1], c0[1] };
+    matrix44_col vec2 = { c1[2], c0[2], c0[2], c0[2] };
+    matrix44_col vec3 = { c1[3], c0[3], c0[3], c0[3] };
+    
+    const matrix44_col signA = { 1, -1, 1, -1 };
+    const matrix44_col signB = { -1, 1, -1, 1 };
+    matrix44_col inv0 = signA * (vec1*fac0 - vec2*fac1 + vec3*fac2);
+    matrix44_col inv1 = signB * (vec0*fac0 - vec2*fac3 + vec3*fac4);
+    matrix44_col inv2 = signA * (vec0*fac1 - vec1*fac3 + vec3*fac5);
+    matrix44_col inv3 = signB * (vec0*fac2 - vec1*fac4 + vec2*fac5);
+    
+    matrix44_col row0 = { inv0[0], inv1[0], inv2[0], inv3[0] };
+    matrix44_col dot = c0 * row0;
+    matrix44_col det = splat(dot[0] + dot[1] + dot[2] + dot[3]);
+    
+    colstore(r, inv0 / det);
+    colstore(r+4, inv1 / det);
+    colstore(r+8, inv2 / det);
+    colstore(r+12, inv3 / det);
+}
+
+//d = m * s for n points; missing source components are z = 0 and w = 1, and destinations with
+//fewer than four components divide by w when project is set. s and d may be the same points
+static void mat4_transformpoints(const float *m, const float *s, int sstride, int sc,
+                                 float *d, int dstride, int dc, size_t n, bool project)
+{
+    matrix44_col c0 = colload(m), c1 = colload(m+4), c2 = colload(m+8), c3 = colload(m+12);
+    float r[4];
+    
+    for (size_t i = 0; i < n; i++, s += sstride, d += dstride)
+    {
+        matrix44_col p = c0*splat(s[0]) + c1*splat(s[1]);
+        if (sc > 2)
+            p += c2*splat(s[2]);
+        p += sc > 3 ? c3*splat(s[3]) : c3;
+        if (project)
+            p /= splat(p[3]);
+        colstore(r, p);
+        memcpy(d, r, sizeof(float)*dc);
+    }
+}
+
+#else
+
+static void mat4_mul(float *r, const float *a, const float *b)
+{
+    glm::mat4 res = *(const glm::mat4*)a * *(const glm::mat4*)b;
+    memcpy(r, glm::value_ptr(res), sizeof(float)*MATRIX44SIZE);
+}
+
+static void mat4_transform(float *r, const float *m, float x, float y, float z, float w)
+{
+    glm::vec4 res = *(const glm::mat4*)m * glm::vec4(x, y, z, w);
+    memcpy(r, glm::value_ptr(res), sizeof(float)*4);
+}
+
+static void mat4_inverse(float *r, const float *m)
+{
+    glm::mat4 res = glm::inverse(*(const glm::mat4*)m);
+    memcpy(r, glm::value_ptr(res), sizeof(float)*MATRIX44SIZE);
+}
+
+static void mat4_transformpoints(const float *m, const float *s, int sstride, int sc,
+                                 float *d, int dstride, int dc, size_t n, bool project)
+{
+    const glm::mat4& mat = *(const glm::mat4*)m;
+    
+    for (size_t i = 0; i < n; i++, s += sstride, d += dstride)
+    {
+        glm::vec4 res = mat * glm::vec4(s[0], s[1], sc > 2 ? s[2] : 0, sc > 3 ? s[3] : 1);
+        if (project)
+            res /= res.w;
+        memcpy(d, glm::value_ptr(res), sizeof(float)*dc);
+    }
+}
+
+#endif
+
+static void mat4_transpose(float *r, const float *m)
+{
+    float t[MATRIX44SIZE];
+    for (int c = 0; c < 4; c++)
+        for (int row = 0; row < 4; row++)
+            t[row*4+c] = m[c*4+row];
+    memcpy(r, t, sizeof(t));
+}
+
+//r = m * translation(x, y, z)
+static void mat4_translate(float *r, const float *m, float x, float y, float z)
+{
+    if (r != m)
+        memcpy(r, m, sizeof(float)*12);
+    mat4_transform(r+12, m, x, y, z, 1);
+}
+
+//r = m * scale(x, y, z)
+static void mat4_scale(float *r, const float *m, float x, float y, float z)
+{
+    const float s[3] = { x, y, z };
+    for (int c = 0; c < 3; c++)
+        for (int row = 0; row < 4; row++)
+            r[c*4+row] = m[c*4+row] * s[c];
+    if (r != m)
+        memcpy(r+12, m+12, sizeof(float)*4);
+}
+
+//r = m * rotation(angle degrees about x, y, z), the same rotation matrix as glm::rotate
+static void mat4_rotate(float *r, const float *m, float angle, float x, float y, float z)
+{
+    float a = glm::radians(angle);
+    float c = cosf(a);
+    float s = sinf(a);
+    glm::vec3 axis = glm::normalize(glm::vec3(x, y, z));
+    glm::vec3 temp = (1.f - c) * axis;
+    
+    float rot[MATRIX44SIZE] =
+    {
+        c + temp[0]*axis[0],            temp[0]*axis[1] + s*axis[2],    temp[0]*axis[2] - s*axis[1],    0,
+        temp[1]*axis[0] - s*axis[2],    c + temp[1]*axis[1],            temp[1]*axis[2] + s*axis[0],    0,
+        temp[2]*axis[0] + s*axis[1],    temp[2]*axis[1] - s*axis[0],    c + temp[2]*axis[2],            0,
+        0,                              0,                              0,                              1
+    };
+    mat4_mul(r, m, rot);
+}
+
 static int Lnew(lua_State *L)			/** matrix44(x1, ... ,x16) */
 {
     
@@ -124,7 +334,7 @@ void pushmatrix44(lua_State *L, const lua_Number* data)
 
 static int Lget(lua_State *L)
 {
-    lua_Number *v = Pget(L,1);
+    lua_Number *v = (lua_Number*) checkfieldudata(L,1,MATRIX44TYPE);
 
     bool isnumber = lua_isnumber(L, 2);
     if (isnumber) 
@@ -143,11 +353,8 @@ static int Lget(lua_State *L)
     }
     else
     {
-        const char* tag = luaL_checkstring(L,2);
-        //Load the metatable and value for key
-        luaL_getmetatable(L, MATRIX44TYPE);
-        lua_pushstring(L, tag);
-        lua_gettable(L, -2);
+        //The method (or nil) for key is left on the stack
+        fieldindex(L, 2);
 
         return 1;
     }
@@ -155,7 +362,7 @@ static int Lget(lua_State *L)
 
 static int Lset(lua_State *L) 
 {
-    lua_Number *v = Pget(L,1);
+    lua_Number *v = (lua_Number*) checkfieldudata(L,1,MATRIX44TYPE);
     
 
     lua_Integer i = luaL_checkinteger(L,2);
@@ -216,35 +423,7 @@ static int Lmul(lua_State *L)
         lua_Number *r = Pnew(L);
              
         //Column major multiplication
-        glm::mat4& m1 = *(glm::mat4*)v;
-        glm::mat4& m2 = *(glm::mat4*)v2;
-        
-        glm::mat4& res = *(glm::mat4*)r;
-        
-        res = m1 * m2;
-        
-        //glm::mat4 res = (*m1) * (*m2);        
-        //lua_Number *resV = glm::value_ptr(res);
-        
-        //memcpy(r, resV, 16*sizeof(lua_Number));
-        
-        //Do matrix multiplication using row major matricies (not sure if this is correct, it might need to be
-        //column major
-        //This is very naive, and there are probably a lot of faster ways
-        /*
-        for (int leftRow=0; leftRow < 4; leftRow++) 
-        {
-            for (int rightCol=0; rightCol < 4; rightCol++)
-            {
-                float element = 0;
-                for (int i = 0; i < 4; i++) 
-                {
-                    element += v[leftRow*4+i] * v2[i*4+rightCol];
-                }
-                r[leftRow*4+rightCol] = element;
-            }
-        }
-        */
+        mat4_mul(r, v, v2);
          
         return 1;
     }
@@ -355,36 +534,72 @@ static int Leq(lua_State *L)
     return 0;
 }
 
+//Arguments from index 2 on: (r) or (r, x, y, z), about the z axis by default
+static void rotateargs(lua_State *L, lua_Number *r, lua_Number *x, lua_Number *y, lua_Number *z)
+{
+    *r = 0;
+    *x = 0; *y = 0; *z = 1;
+    switch(lua_gettop(L))
+    {
+        case 5: /* matrix.rotate( m, r, x, y, z ) */
+            *x = luaL_checknumber(L, 3);      
+            *y = luaL_checknumber(L, 4);      
+            *z = luaL_checknumber(L, 5);  
+            
+        case 2: /* matrix.rotate( m, r ) */
+            *r = luaL_checknumber(L, 2);                        
+            break;
+    }
+}
+
+//Arguments from index 2 on: (x, y) or (x, y, z)
+static void translateargs(lua_State *L, lua_Number *x, lua_Number *y, lua_Number *z)
+{
+    *x = 0; *y = 0; *z = 0;
+    switch(lua_gettop(L))
+    {
+        case 4:                
+            *z = luaL_checknumber(L, 4);      
+        case 3:
+            *x = luaL_checknumber(L, 2);      
+            *y = luaL_checknumber(L, 3);                  
+            break;
+    }
+}
+
+//Arguments from index 2 on: (s), (x, y) or (x, y, z)
+static void scaleargs(lua_State *L, lua_Number *x, lua_Number *y, lua_Number *z)
+{
+    *x = 1; *y = 1; *z = 1;
+    switch(lua_gettop(L))
+    {
+        case 4:                
+            *z = luaL_checknumber(L, 4);      
+        case 3:
+            *x = luaL_checknumber(L, 2);      
+            *y = luaL_checknumber(L, 3);                                  
+            break;
+        case 2:
+            *x = luaL_checknumber(L, 2);      
+            *y = *x;
+            *z = *x;
+            break;
+    }
+}
+
 static int Lrotate(lua_State *L)
 {
-    int n = lua_gettop(L);
-    
     lua_Number *m = checkmatrix44(L, 1);    
     
     luaL_argcheck(L, m != NULL, 1, "`matrix' expected");        
     
     if( m != NULL )
     {
-        lua_Number r = 0;
-        lua_Number x = 0,y = 0,z = 1;
-        switch(n)
-        {
-            case 5: /* matrix.rotate( m, r, x, y, z ) */
-                x = luaL_checknumber(L, 3);      
-                y = luaL_checknumber(L, 4);      
-                z = luaL_checknumber(L, 5);  
-                
-            case 2: /* matrix.rotate( m, r ) */
-                r = luaL_checknumber(L, 2);                        
-                break;
-        }
-
-        lua_Number *mv = Pnew(L);
-        
-        glm::mat4& mat = *(glm::mat4*)m;       
-        glm::mat4& rotated = *(glm::mat4*)mv;
+        lua_Number r, x, y, z;
+        rotateargs(L, &r, &x, &y, &z);
         
-        rotated = glm::rotate(mat, r, glm::vec3( x, y, z ) );        
+        lua_Number *mv = Pnew(L);
+        mat4_rotate(mv, m, r, x, y, z);
         
         return 1;
     }
@@ -394,31 +609,17 @@ static int Lrotate(lua_State *L)
 
 static int Ltranslate(lua_State *L)
 {
-    int n = lua_gettop(L);
-    
     lua_Number *m = checkmatrix44(L, 1);    
     
     luaL_argcheck(L, m != NULL, 1, "`matrix' expected");        
     
     if( m != NULL )
     {
-        lua_Number x = 0,y = 0,z = 0;
-        switch(n)
-        {
-            case 4:                
-                z = luaL_checknumber(L, 4);      
-            case 3:
-                x = luaL_checknumber(L, 2);      
-                y = luaL_checknumber(L, 3);                  
-                break;
-        }
+        lua_Number x, y, z;
+        translateargs(L, &x, &y, &z);
         
         lua_Number *mv = Pnew(L);
-        
-        glm::mat4& mat = *(glm::mat4*)m;        
-        glm::mat4& translated = *(glm::mat4*)mv;
-        
-        translated = glm::translate(mat, glm::vec3(x, y, z) );        
+        mat4_translate(mv, m, x, y, z);
         
         return 1;
     }
@@ -428,36 +629,17 @@ static int Ltranslate(lua_State *L)
 
 static int Lscale(lua_State *L)
 {
-    int n = lua_gettop(L);
-    
     lua_Number *m = checkmatrix44(L, 1);    
     
     luaL_argcheck(L, m != NULL, 1, "`matrix' expected");        
     
     if( m != NULL )
     {
-        lua_Number x = 1,y = 1,z = 1;
-        switch(n)
-        {
-            case 4:                
-                z = luaL_checknumber(L, 4);      
-            case 3:
-                x = luaL_checknumber(L, 2);      
-                y = luaL_checknumber(L, 3);                                  
-                break;
-            case 2:
-                x = luaL_checknumber(L, 2);      
-                y = x;
-                z = x;
-                break;
-        }
+        lua_Number x, y, z;
+        scaleargs(L, &x, &y, &z);
         
         lua_Number *mv = Pnew(L);
-        
-        glm::mat4& mat = *(glm::mat4*)m; 
-        glm::mat4& scaled = *(glm::mat4*)mv;
-        
-        scaled = glm::scale(mat, glm::vec3(x,y,z));
+        mat4_scale(mv, m, x, y, z);
         
         return 1;
     }
@@ -474,10 +656,7 @@ static int Linverse(lua_State *L)
     if( m != NULL )
     {
         lua_Number *r = Pnew(L);        
-        glm::mat4& mat = *(glm::mat4*)m;
-        glm::mat4& inverted = *(glm::mat4*)r;
-        
-        inverted = glm::inverse(mat);
+        mat4_inverse(r, m);
         
         return 1;
     }
@@ -494,16 +673,130 @@ static int Ltranspose(lua_State *L)
     if( m != NULL )
     {
         lua_Number *r = Pnew(L);        
-        glm::mat4& mat = *(glm::mat4*)m;
-        glm::mat4& transposed = *(glm::mat4*)r;
-        
-        transposed = glm::transpose(mat);
+        mat4_transpose(r, m);
         return 1;
     }
     
     return 0;
 }
 
+//In-place variants: these overwrite m and return it, so per-frame code can reuse its matrices
+
+static int Lassign(lua_State *L)   /** m:set(o) or m:set(x1, ..., x16) or m:set() for identity */
+{
+    lua_Number *m = Pget(L, 1);
+    int n = lua_gettop(L);
+    
+    if (n == 1)
+    {
+        memset(m, 0, sizeof(float)*MATRIX44SIZE);
+        m[0] = m[5] = m[10] = m[15] = 1;
+    }
+    else if (n == MATRIX44SIZE+1)
+    {
+        for (int i = 0; i < MATRIX44SIZE; i++)
+            m[i] = luaL_checknumber(L, i+2);
+    }
+    else
+    {
+        lua_Number *o = Pget(L, 2);
+        memmove(m, o, sizeof(float)*MATRIX44SIZE);
+    }
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LmulInPlace(lua_State *L)    /** m:mulInPlace(o) is m = m * o */
+{
+    lua_Number *m = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    
+    //Same operand order as __mul
+    mat4_mul(m, o, m);
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LrotateInPlace(lua_State *L)
+{
+    lua_Number *m = Pget(L, 1);
+    lua_Number r, x, y, z;
+    
+    rotateargs(L, &r, &x, &y, &z);
+    mat4_rotate(m, m, r, x, y, z);
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LtranslateInPlace(lua_State *L)
+{
+    lua_Number *m = Pget(L, 1);
+    lua_Number x, y, z;
+    
+    translateargs(L, &x, &y, &z);
+    mat4_translate(m, m, x, y, z);
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LscaleInPlace(lua_State *L)
+{
+    lua_Number *m = Pget(L, 1);
+    lua_Number x, y, z;
+    
+    scaleargs(L, &x, &y, &z);
+    mat4_scale(m, m, x, y, z);
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LinverseInPlace(lua_State *L)
+{
+    lua_Number *m = Pget(L, 1);
+    
+    mat4_inverse(m, m);
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LtransposeInPlace(lua_State *L)
+{
+    lua_Number *m = Pget(L, 1);
+    
+    mat4_transpose(m, m);
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+//Transforms a whole array, buffer, mesh or string of points at once, without a userdata per point.
+//dst defaults to src; components gives the point size of a string of packed floats
+
+static int LtransformPoints(lua_State *L)   /** m:transformPoints(src, [dst], [components]) */
+{
+    lua_Number *m = Pget(L, 1);
+    int dst = lua_isnoneornil(L, 3) ? 2 : 3;
+    points_type s, d;
+    
+    checkpoints(L, 2, &s, luaL_optint(L, 4, 3));
+    targetpoints(L, dst, &d, s.count, s.components);
+    
+    //Only projective matrices need the divide by w
+    bool project = d.components < 4 && (m[3] != 0 || m[7] != 0 || m[11] != 0 || m[15] != 1);
+    
+    mat4_transformpoints(m, s.data, s.stride, s.components, d.data, d.stride, d.components, s.count, project);
+    storepoints(L, &d);
+    
+    lua_pushvalue(L, dst);
+    return 1;
+}
+
 static int Ldeterminant(lua_State *L)
 {
     lua_Number *m = checkmatrix44(L, 1);
@@ -524,8 +817,6 @@ static int Ldeterminant(lua_State *L)
 
 static const luaL_reg R[] =
 {    
-	{ "__index",	Lget		},
-	{ "__newindex",	Lset		},
 	{ "__tostring",	Ltostring	},
     { "__add",      Ladd        },
     { "__sub",      Lsub        },        
@@ -539,6 +830,14 @@ static const luaL_reg R[] =
     { "inverse",    Linverse    },   
     { "transpose",  Ltranspose  },
     { "determinant",  Ldeterminant  },
+    { "set",        Lassign     },
+    { "mulInPlace", LmulInPlace },
+    { "rotateInPlace",    LrotateInPlace    },
+    { "translateInPlace", LtranslateInPlace },
+    { "scaleInPlace",     LscaleInPlace     },
+    { "inverseInPlace",   LinverseInPlace   },
+    { "transposeInPlace", LtransposeInPlace },
+    { "transformPoints",  LtransformPoints  },
 //    { "dot",        Ldot        },   
 //    { "normalize",  Lnormalize  },       
 //    { "dist",       Ldist       },       
@@ -571,11 +870,8 @@ LUALIB_API int luaopen_matrix44(lua_State *L)
 { 
     luaL_newmetatable(L,MATRIX44TYPE);         
     
-    lua_pushstring(L, "__index");
-    lua_pushvalue(L, -2);   // pushes the metatable
-    lua_settable(L, -3);    // metatable.__index = metatable
-    
     luaL_register(L,NULL,R);        
+    setfieldhandlers(L,Lget,Lset,fields);
     
     lua_register(L,"matrix",Lnew);
     
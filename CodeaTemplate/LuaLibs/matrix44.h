@@ -32,6 +32,7 @@ extern "C"
 #define CODIFY_MATRIX44LIBNAME "matrix44"
     
 LUALIB_API int (luaopen_matrix44) (lua_State *L);
+lua_Number *getmatrix44(lua_State *L, int i);
 lua_Number *checkmatrix44(lua_State *L, int i);
 void pushmatrix44(lua_State *L, const lua_Number* data); //data must be 16 elements long
 
@@ -56,6 +56,8 @@ typedef struct mesh_type_t
 //    float_buffer texCoordsReversed;
     
     BOOL valid;
+    BOOL packedColors;  //colors holds one RGBA8 color_packed per vertex instead of four floats
+    CCTexture2DMipmapMode mipmaps;  //Requested of the texture, a sprite or an image
     
     NSString* spriteName;
     CCTexture2D* texture;
@@ -27,7 +27,11 @@
 #include "lauxlib.h"
 #include "vec2.h"
 #include "vec3.h"
+#include "buffer.h"
+#include "points.h"
+#include "vecarray.h"
 #include "object_reg.h"
+#include "codea_luaext.h"
 
 #import "RenderCommands.h"
 #import "SpriteManager.h"
@@ -35,6 +39,11 @@
 #define MESH_TYPE		"mesh"
 #define MESH_SIZE     sizeof(mesh_type)
 
+enum { FIELD_TEXTURE, FIELD_SIZE, FIELD_VERTICES, FIELD_COLORS, FIELD_TEXCOORDS, 
+       FIELD_TEXTUREWIDTH, FIELD_TEXTUREHEIGHT, FIELD_VALID, FIELD_PACKEDCOLORS, FIELD_MIPMAP };
+static const char *const fields[] = { "texture", "size", "vertices", "colors", "texCoords", 
+                                      "textureWidth", "textureHeight", "valid", "packedColors", "mipmap", NULL };
+
 static void initBuffer(float_buffer* buffer, size_t elementSize)
 {
     buffer->capacity = 3000;
@@ -115,6 +124,157 @@ static void resizeBuffer(float_buffer* buffer, int newLength)
     buffer->length = newLength;
 }
 
+//One bulk copy from a buffer; elements with fewer components than the mesh's are zero padded
+static void copyFromBuffer(float_buffer* buffer, buffer_type* src, float scale)
+{
+    resizeBuffer(buffer, (int)src->count);
+    
+    if (buffer->buffer == NULL)
+    {
+        return;
+    }
+    
+    if (src->components == buffer->elementSize && scale == 1)
+    {
+        memcpy(buffer->buffer, src->data, src->count * src->components * sizeof(GLfloat));
+        return;
+    }
+    
+    for (size_t i = 0; i < src->count; i++)
+    {
+        const float* s = src->data + i * src->components;
+        GLfloat* d = buffer->buffer + i * buffer->elementSize;
+        for (int j = 0; j < buffer->elementSize; j++)
+        {
+            d[j] = j < src->components ? s[j] * scale : 0;
+        }
+    }
+}
+
+//One interleaving pass from a vec2array or vec3array; vec2s get z = 0
+static void copyFromPlanes(float_buffer* buffer, vecarray_type* src)
+{
+    resizeBuffer(buffer, (int)src->count);
+    
+    if (buffer->buffer == NULL)
+    {
+        return;
+    }
+    
+    for (size_t i = 0; i < src->count; i++)
+    {
+        GLfloat* d = buffer->buffer + i * buffer->elementSize;
+        for (int j = 0; j < buffer->elementSize; j++)
+        {
+            d[j] = j < src->dim ? src->planes[j][i] : 0;
+        }
+    }
+}
+
+//Colors are four 0-1 floats per vertex, or in packedColors mode one RGBA8 value per vertex: a
+//quarter of the memory, uploaded as normalized bytes
+
+//Sets the color at slot (from getColor) to r, g, b, a in 0-255 like color()
+static void storeColor(mesh_type *mesh, GLfloat *slot, lua_Number r, lua_Number g, lua_Number b, lua_Number a)
+{
+    if (mesh->packedColors)
+    {
+        *(color_packed*)slot = color_pack(r, g, b, a);
+    }
+    else
+    {
+        slot[0] = r/255.0f;
+        slot[1] = g/255.0f;
+        slot[2] = b/255.0f;
+        slot[3] = a/255.0f;
+    }
+}
+
+//The color at slot in 0-255
+static void loadColor(mesh_type *mesh, const GLfloat *slot, lua_Number *rgba)
+{
+    if (mesh->packedColors)
+    {
+        color_unpack(*(const color_packed*)slot, rgba);
+    }
+    else
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            rgba[i] = slot[i] * 255;
+        }
+    }
+}
+
+//Sets vertices first to last - 1 to one 0-1 color
+static void fillColors(mesh_type *mesh, int first, int last, const GLfloat *color)
+{
+    if (mesh->packedColors)
+    {
+        color_packed p = color_pack(color[0] * 255, color[1] * 255, color[2] * 255, color[3] * 255);
+        color_packed* dst = (color_packed*)mesh->colors.buffer;
+        for (int i = first; i < last; i++)
+        {
+            dst[i] = p;
+        }
+    }
+    else
+    {
+        for (int i = first; i < last; i++)
+        {
+            memcpy(&mesh->colors.buffer[i * 4], color, 4 * sizeof(GLfloat));
+        }
+    }
+}
+
+//Converts the colors in place between the two storage modes
+static void setPackedColors(mesh_type *mesh, BOOL packed)
+{
+    float_buffer* buffer = &mesh->colors;
+    
+    if (packed == mesh->packedColors || buffer->buffer == NULL)
+    {
+        return;
+    }
+    
+    if (packed)
+    {
+        //Forwards: each packed value lands at or before the floats it replaces
+        color_packed* dst = (color_packed*)buffer->buffer;
+        for (int i = 0; i < buffer->length; i++)
+        {
+            const GLfloat* c = &buffer->buffer[i * 4];
+            dst[i] = color_pack(c[0] * 255, c[1] * 255, c[2] * 255, c[3] * 255);
+        }
+        buffer->elementSize = 1;
+        buffer->buffer = realloc(buffer->buffer, buffer->capacity * sizeof(GLfloat));
+    }
+    else
+    {
+        GLfloat* grown = realloc(buffer->buffer, buffer->capacity * 4 * sizeof(GLfloat));
+        if (grown == NULL)
+        {
+            NSLog(@"Mesh: buffer failed to resize");
+            return;
+        }
+        buffer->buffer = grown;
+        buffer->elementSize = 4;
+        
+        //Backwards, so packed values are read before they are overwritten
+        for (int i = buffer->length - 1; i >= 0; i--)
+        {
+            lua_Number rgba[4];
+            color_unpack(((const color_packed*)buffer->buffer)[i], rgba);
+            for (int j = 0; j < 4; j++)
+            {
+                buffer->buffer[i * 4 + j] = rgba[j] / 255.0f;
+            }
+        }
+    }
+    
+    mesh->packedColors = packed;
+}
+
 mesh_type *checkMesh(lua_State *L, int i)
 {
     if( lua_isuserdata(L, i) )
@@ -129,6 +289,46 @@ mesh_type *checkMesh(lua_State *L, int i)
     return NULL;
 }
 
+float *getmeshvertices(lua_State *L, int i, size_t *count, int *stride)
+{
+    mesh_type *meshData = lua_isuserdata(L, i) ? testudata(L, i, MESH_TYPE) : NULL;
+    
+    if (meshData == NULL || meshData->vertices.buffer == NULL)
+    {
+        return NULL;
+    }
+    
+    *count = meshData->vertices.length;
+    *stride = (int)meshData->vertices.elementSize;
+    return meshData->vertices.buffer;
+}
+
+//The mipmap option applies to the mesh's texture: sprites are reloaded from the texture cache with
+//mip levels, and images build theirs with their next texture
+static void applyMipmaps(mesh_type* meshData)
+{
+    if (meshData->mipmaps == kCCTexture2DMipmap_None)
+    {
+        return;
+    }
+    
+    if (meshData->texture)
+    {
+        CCTexture2D* texture = [[SpriteManager sharedInstance] spriteTextureFromString:meshData->spriteName mipmaps:meshData->mipmaps];
+        if (texture)
+        {
+            [texture retain];
+            [meshData->texture release];
+            meshData->texture = texture;
+        }
+    }
+    else if (meshData->image && meshData->image->mipmaps != meshData->mipmaps)
+    {
+        meshData->image->mipmaps = meshData->mipmaps;
+        meshData->image->dataChanged = YES;
+    }
+}
+
 static mesh_type *Pget(lua_State *L, int i)
 {
     if (luaL_checkudata(L, i, MESH_TYPE) == NULL) luaL_typerror(L, i, MESH_TYPE);
@@ -144,6 +344,8 @@ static mesh_type *Pnew(lua_State *L)
 //    initBuffer(&meshData->texCoordsReversed, 2);
     
     meshData->valid = YES;
+    meshData->packedColors = NO;
+    meshData->mipmaps = kCCTexture2DMipmap_None;
     meshData->spriteName = nil;
     meshData->texture = nil;
     meshData->image = NULL;
@@ -187,91 +389,106 @@ static BOOL checkValid(mesh_type* meshData)
 
 static int Lget(lua_State *L)
 {
-    mesh_type *meshData = checkMesh(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    mesh_type *meshData = checkfieldudata(L, 1, MESH_TYPE);
     
-    if ( strcmp(c, "texture") == 0 )
+    switch( fieldindex(L,2) )
     {
-        if (meshData->texture)
+        case FIELD_TEXTURE:
+        {
+            if (meshData->texture)
+            {
+                lua_pushstring(L, [meshData->spriteName UTF8String]);
+            }
+            else if (meshData->image)
+            {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, meshData->imageRef);
+            }        
+            else
+            {
+                lua_pushnil(L);
+            }
+        } break;
+        case FIELD_SIZE:
         {
-            lua_pushstring(L, [meshData->spriteName UTF8String]);
+            lua_pushinteger(L, meshData->vertices.length);
+            return 1;
         }
-        else if (meshData->image)
+        case FIELD_VERTICES:
         {
-            lua_rawgeti(L, LUA_REGISTRYINDEX, meshData->imageRef);
-        }        
-        else
+            // TODO: 2D and 3D mode checks...
+            lua_createtable(L, meshData->vertices.length, 0);
+            for (int i = 1, j = 0; i <= meshData->vertices.length; i++)
+            {          
+                pushvec3(L, meshData->vertices.buffer[j++], meshData->vertices.buffer[j++], meshData->vertices.buffer[j++]);
+                lua_rawseti(L, -2, i);
+            }
+        } break;
+        case FIELD_COLORS:
         {
-            lua_pushnil(L);
-        }
-    }    
-    else if ( strcmp(c, "size" ) == 0 )
-    {
-        lua_pushinteger(L, meshData->vertices.length);
-        return 1;
-    }
-    else if ( strcmp(c, "vertices") == 0 )
-    {
-        // TODO: 2D and 3D mode checks...
-        lua_createtable(L, meshData->vertices.length, 0);
-        for (int i = 1, j = 0; i <= meshData->vertices.length; i++)
-        {          
-            pushvec3(L, meshData->vertices.buffer[j++], meshData->vertices.buffer[j++], meshData->vertices.buffer[j++]);
-            lua_rawseti(L, -2, i);
-        }        
-    } 
-    else if ( strcmp(c, "colors") == 0 )
-    {
-        lua_createtable(L, meshData->colors.length, 0);
-        for (int i = 1, j = 0; i <= meshData->colors.length; i++)
-        {            
-            pushcolor(L, meshData->colors.buffer[j++], meshData->colors.buffer[j++], meshData->colors.buffer[j++], meshData->colors.buffer[j++]);
-            lua_rawseti(L, -2, i);
-        }                
-    } 
-    else if ( strcmp(c, "texCoords") == 0 )
-    {
-        lua_createtable(L, meshData->texCoords.length, 0);
-        for (int i = 1, j = 0; i <= meshData->texCoords.length; i++)
-        {            
-            pushvec2(L, meshData->texCoords.buffer[j++], 1-meshData->texCoords.buffer[j++]);
-//            pushvec2(L, meshData->texCoordsReversed.buffer[j], 1-meshData->texCoordsReversed.buffer[j+1]);            
-//            j += 2;
-            lua_rawseti(L, -2, i);
-        }                
-    } 
-    else if ( strcmp(c, "textureWidth") == 0 )
-    {
-        if (meshData->texture)
+            lua_createtable(L, meshData->colors.length, 0);
+            for (int i = 1; i <= meshData->colors.length; i++)
+            {
+                //colors has always read back in 0-1, unlike mesh:color(i); packed meshes too
+                lua_Number rgba[4];
+                loadColor(meshData, getColor(meshData, i - 1), rgba);
+                pushcolor(L, rgba[0] / 255, rgba[1] / 255, rgba[2] / 255, rgba[3] / 255);
+                lua_rawseti(L, -2, i);
+            }
+        } break;
+        case FIELD_TEXCOORDS:
         {
-            lua_pushinteger(L, meshData->texture.pixelsWide);
-        }
-        else if (meshData->image)
+            lua_createtable(L, meshData->texCoords.length, 0);
+            for (int i = 1, j = 0; i <= meshData->texCoords.length; i++)
+            {            
+                pushvec2(L, meshData->texCoords.buffer[j++], 1-meshData->texCoords.buffer[j++]);
+    //            pushvec2(L, meshData->texCoordsReversed.buffer[j], 1-meshData->texCoordsReversed.buffer[j+1]);            
+    //            j += 2;
+                lua_rawseti(L, -2, i);
+            }
+        } break;
+        case FIELD_TEXTUREWIDTH:
         {
-            lua_pushinteger(L, meshData->image->scaledWidth);
-        }
-    }
-    else if ( strcmp(c, "textureHeight") == 0 )
-    {
-        if (meshData->texture)
+            if (meshData->texture)
+            {
+                lua_pushinteger(L, meshData->texture.pixelsWide);
+            }
+            else if (meshData->image)
+            {
+                lua_pushinteger(L, meshData->image->scaledWidth);
+            }
+            else
+            {
+                lua_pushnil(L);
+            }
+        } break;
+        case FIELD_TEXTUREHEIGHT:
         {
-            lua_pushinteger(L, meshData->texture.pixelsHigh);
-        }
-        else if (meshData->image)
+            if (meshData->texture)
+            {
+                lua_pushinteger(L, meshData->texture.pixelsHigh);
+            }
+            else if (meshData->image)
+            {
+                lua_pushinteger(L, meshData->image->scaledHeight);
+            }
+            else
+            {
+                lua_pushnil(L);
+            }
+        } break;
+        case FIELD_VALID:
         {
-            lua_pushinteger(L, meshData->image->scaledHeight);
-        }
-    }
-    else if ( strcmp(c, "valid") == 0 )
-    {
-        lua_pushboolean(L, meshData->valid);
-    }
-    else
-    {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, MESH_TYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);
+            lua_pushboolean(L, meshData->valid);
+        } break;
+        case FIELD_PACKEDCOLORS:
+        {
+            lua_pushboolean(L, meshData->packedColors);
+        } break;
+        case FIELD_MIPMAP:
+        {
+            pushmipmaps(L, meshData->mipmaps);
+        } break;
+        default: break;     //The method (or nil) for key is on the stack
     }    
     
     return 1;    
@@ -279,203 +496,275 @@ static int Lget(lua_State *L)
 
 static int Lset(lua_State *L)
 {
-    mesh_type *meshData = checkMesh(L, 1);
-    const char* c = luaL_checkstring(L,2);
+    mesh_type *meshData = checkfieldudata(L, 1, MESH_TYPE);
     
-    if (strcmp(c, "texture") == 0 )
+    switch( fieldindex(L,2) )
     {
-        if (lua_isnil(L, 3))
+        case FIELD_TEXTURE:
         {
-            if (meshData->texture)
-            {
-                [meshData->texture release];
-                meshData->texture = nil;
-                [meshData->spriteName release];
-                meshData->spriteName = nil;
-            }
-            else if (meshData->image)
-            {
-                luaL_unref(L, LUA_REGISTRYINDEX, meshData->imageRef);
-                meshData->image = NULL;
-            }
-            
-            meshData->valid = checkValid(meshData);
-            
-            return 1;
-        }
-        else if (lua_isstring(L, 3))
-        {                        
-            // set texture based on sprite name
-            size_t texStrLen = 0;
-            const char* texStr = lua_tolstring(L, 3, &texStrLen);
-            if (texStr && texStrLen > 0)
-            {
-                // if image is being used as texture, clear it
-                if (meshData->image)
-                {
-                    luaL_unref(L, LUA_REGISTRYINDEX, meshData->imageRef);    
-                    meshData->image = NULL;
-                }                
-                else if (meshData->texture)
-                {
-                    [meshData->spriteName release];           
-                    [meshData->texture release];
-                }                
-                meshData->spriteName = [[NSString alloc] initWithUTF8String:texStr];                
-                meshData->texture = [[[SpriteManager sharedInstance] spriteTextureFromString:meshData->spriteName] retain];                                
-                if (meshData->texture == nil)
-                {
-                    [meshData->spriteName release];
-                    meshData->spriteName = nil;
-                }
-                
-                meshData->valid = checkValid(meshData);                
-                
-                return 1;
-            }            
-        }
-        else 
-        {
-            image_type* image = checkimage(L, 3);
-            if (image != NULL) 
+            if (lua_isnil(L, 3))
             {
-                // if sprite is being used as texture, clear it
                 if (meshData->texture)
                 {
-                    [meshData->spriteName release];
-                    meshData->spriteName = nil;
                     [meshData->texture release];
                     meshData->texture = nil;
+                    [meshData->spriteName release];
+                    meshData->spriteName = nil;
                 }
                 else if (meshData->image)
                 {
                     luaL_unref(L, LUA_REGISTRYINDEX, meshData->imageRef);
+                    meshData->image = NULL;
                 }
-                meshData->image = image;
-                // copy value then add reference
-                lua_pushvalue(L, 3);
-                meshData->imageRef = luaL_ref(L, LUA_REGISTRYINDEX);        
-                
+            
                 meshData->valid = checkValid(meshData);
-                
+            
                 return 1;
             }
-        }
-    }
-    else if (strcmp(c, "vertices") == 0 )
-    {
-        if (lua_isnil(L, 3))
-        {
-            // clear vertices
-            clearBuffer(&meshData->vertices);
-        }
-        else
+            else if (lua_isstring(L, 3))
+            {                        
+                // set texture based on sprite name
+                size_t texStrLen = 0;
+                const char* texStr = lua_tolstring(L, 3, &texStrLen);
+                if (texStr && texStrLen > 0)
+                {
+                    // if image is being used as texture, clear it
+                    if (meshData->image)
+                    {
+                        luaL_unref(L, LUA_REGISTRYINDEX, meshData->imageRef);    
+                        meshData->image = NULL;
+                    }                
+                    else if (meshData->texture)
+                    {
+                        [meshData->spriteName release];           
+                        [meshData->texture release];
+                    }                
+                    meshData->spriteName = [[NSString alloc] initWithUTF8String:texStr];                
+                    meshData->texture = [[[SpriteManager sharedInstance] spriteTextureFromString:meshData->spriteName mipmaps:meshData->mipmaps] retain];                                
+                    if (meshData->texture == nil)
+                    {
+                        [meshData->spriteName release];
+                        meshData->spriteName = nil;
+                    }
+                
+                    meshData->valid = checkValid(meshData);                
+                
+                    return 1;
+                }            
+            }
+            else 
+            {
+                image_type* image = checkimage(L, 3);
+                if (image != NULL) 
+                {
+                    // if sprite is being used as texture, clear it
+                    if (meshData->texture)
+                    {
+                        [meshData->spriteName release];
+                        meshData->spriteName = nil;
+                        [meshData->texture release];
+                        meshData->texture = nil;
+                    }
+                    else if (meshData->image)
+                    {
+                        luaL_unref(L, LUA_REGISTRYINDEX, meshData->imageRef);
+                    }
+                    meshData->image = image;
+                    // copy value then add reference
+                    lua_pushvalue(L, 3);
+                    meshData->imageRef = luaL_ref(L, LUA_REGISTRYINDEX);        
+                    applyMipmaps(meshData);
+                
+                    meshData->valid = checkValid(meshData);
+                
+                    return 1;
+                }
+            }
+        } break;
+        case FIELD_VERTICES:
         {
-            luaL_checktype(L, 3, LUA_TTABLE);
+            buffer_type* buf = NULL;
+            vecarray_type* arr = NULL;
+            if (lua_isnil(L, 3))
+            {
+                // clear vertices
+                clearBuffer(&meshData->vertices);
+            }
+            else if ((buf = getbuffer(L, 3)) != NULL)
+            {
+                luaL_argcheck(L, buf->components == 2 || buf->components == 3, 3, "buffer of 2 or 3 components expected");
+                copyFromBuffer(&meshData->vertices, buf, 1);
+            }
+            else if ((arr = getvecarray(L, 3)) != NULL)
+            {
+                copyFromPlanes(&meshData->vertices, arr);
+            }
+            else
+            {
+                luaL_checktype(L, 3, LUA_TTABLE);
             
-            int n = luaL_getn(L, 3);  /* get size of table */                    
-            resizeBuffer(&meshData->vertices, n);
+                int n = luaL_getn(L, 3);  /* get size of table */                    
+                resizeBuffer(&meshData->vertices, n);
             
-            const int elSize = meshData->vertices.elementSize;
+                const int elSize = meshData->vertices.elementSize;
             
-            if(n >= 1)
-            {  
-                lua_rawgeti(L, 3, 1);
-                if (isudatatype(L, -1, "vec3"))
-                {
-                    for (int i = 1; i <= n; i++)
-                    {                        
-                        lua_rawgeti(L, 3, i);                                                                                 
-                        lua_Number* v = luaL_checkudata(L, -1, "vec3");                        
-                        meshData->vertices.buffer[(i-1)*elSize+0] = v[0];
-                        meshData->vertices.buffer[(i-1)*elSize+1] = v[1]; 
-                        meshData->vertices.buffer[(i-1)*elSize+2] = v[2];                         
-                        lua_pop(L, 1);                    
-                    }        
-                }
-                else
-                {
-                    for (int i = 1; i <= n; i++)
-                    {                        
-                        lua_rawgeti(L, 3, i);                                                                                 
-                        lua_Number* v = checkvec2(L, -1);
-                        meshData->vertices.buffer[(i-1)*elSize+0] = v[0];
-                        meshData->vertices.buffer[(i-1)*elSize+1] = v[1]; 
-                        meshData->vertices.buffer[(i-1)*elSize+2] = 0;
-                        lua_pop(L, 1);                    
-                    }                            
-                }                
-            }            
-        }
+                if(n >= 1)
+                {  
+                    lua_rawgeti(L, 3, 1);
+                    if (isudatatype(L, -1, "vec3"))
+                    {
+                        for (int i = 1; i <= n; i++)
+                        {                        
+                            lua_rawgeti(L, 3, i);                                                                                 
+                            lua_Number* v = luaL_checkudata(L, -1, "vec3");                        
+                            meshData->vertices.buffer[(i-1)*elSize+0] = v[0];
+                            meshData->vertices.buffer[(i-1)*elSize+1] = v[1]; 
+                            meshData->vertices.buffer[(i-1)*elSize+2] = v[2];                         
+                            lua_pop(L, 1);                    
+                        }        
+                    }
+                    else
+                    {
+                        for (int i = 1; i <= n; i++)
+                        {                        
+                            lua_rawgeti(L, 3, i);                                                                                 
+                            lua_Number* v = checkvec2(L, -1);
+                            meshData->vertices.buffer[(i-1)*elSize+0] = v[0];
+                            meshData->vertices.buffer[(i-1)*elSize+1] = v[1]; 
+                            meshData->vertices.buffer[(i-1)*elSize+2] = 0;
+                            lua_pop(L, 1);                    
+                        }                            
+                    }                
+                }            
+            }
         
-        meshData->valid = checkValid(meshData);
+            meshData->valid = checkValid(meshData);
 
-        return 1;        
-    }
-    else if (strcmp(c, "colors") == 0 )
-    {
-        if (lua_isnil(L, 3))
-        {
-            // clear colors
-            clearBuffer(&meshData->colors);
+            return 1;
         }
-        else
+        case FIELD_COLORS:
         {
-            luaL_checktype(L, 3, LUA_TTABLE);
-            
-            int n = luaL_getn(L, 3);  /* get size of table */
-            
-            if(n >= 1)
+            buffer_type* buf = NULL;
+            if (lua_isnil(L, 3))
+            {
+                // clear colors
+                clearBuffer(&meshData->colors);
+            }
+            else if ((buf = getbuffer(L, 3)) != NULL)
             {
+                // 0-255 like color()
+                luaL_argcheck(L, buf->components == 4, 3, "buffer of 4 components expected");
+                if (meshData->packedColors)
+                {
+                    resizeBuffer(&meshData->colors, (int)buf->count);
+                    for (size_t i = 0; i < buf->count; i++)
+                    {
+                        const float* c = buf->data + i * 4;
+                        storeColor(meshData, getColor(meshData, (int)i), c[0], c[1], c[2], c[3]);
+                    }
+                }
+                else
+                {
+                    copyFromBuffer(&meshData->colors, buf, 1 / 255.0f);
+                }
+            }
+            else if (lua_type(L, 3) == LUA_TSTRING)
+            {
+                // packed colors, 4 bytes per vertex
+                size_t len;
+                const char* bytes = lua_tolstring(L, 3, &len);
+                luaL_argcheck(L, len % sizeof(color_packed) == 0, 3, "string of packed colors expected");
+                int n = (int)(len / sizeof(color_packed));
                 resizeBuffer(&meshData->colors, n);
-                for (int i = 1; i <= n; i++)
+                if (meshData->packedColors && meshData->colors.buffer)
                 {
-                    lua_rawgeti(L, 3, i);
-                    color_type* c = checkcolor(L, -1);
-                    meshData->colors.buffer[(i-1)*4] = c->r / 255.0f;
-                    meshData->colors.buffer[(i-1)*4+1] = c->g / 255.0f;
-                    meshData->colors.buffer[(i-1)*4+2] = c->b / 255.0f;
-                    meshData->colors.buffer[(i-1)*4+3] = c->a / 255.0f;
-                    lua_pop(L, 1);
-                }                
-            } 
+                    memcpy(meshData->colors.buffer, bytes, len);
+                }
+                else
+                {
+                    for (int i = 0; i < n; i++)
+                    {
+                        color_packed p;
+                        lua_Number rgba[4];
+                        memcpy(&p, bytes + i * sizeof(p), sizeof(p));
+                        color_unpack(p, rgba);
+                        storeColor(meshData, getColor(meshData, i), rgba[0], rgba[1], rgba[2], rgba[3]);
+                    }
+                }
+            }
+            else
+            {
+                luaL_checktype(L, 3, LUA_TTABLE);
+            
+                int n = luaL_getn(L, 3);  /* get size of table */
+            
+                if(n >= 1)
+                {
+                    resizeBuffer(&meshData->colors, n);
+                    for (int i = 1; i <= n; i++)
+                    {
+                        lua_rawgeti(L, 3, i);
+                        color_type* c = checkcolor(L, -1);
+                        storeColor(meshData, getColor(meshData, i-1), c->r, c->g, c->b, c->a);
+                        lua_pop(L, 1);
+                    }                
+                } 
         
-        }
+            }
         
-        meshData->valid = checkValid(meshData);
+            meshData->valid = checkValid(meshData);
         
-        return 1;        
-    }
-    else if (strcmp(c, "texCoords") == 0 )
-    {
-        if (lua_isnil(L, 3))
+            return 1;
+        }
+        case FIELD_PACKEDCOLORS:
         {
-            // clear colors
-            clearBuffer(&meshData->texCoords);
+            setPackedColors(meshData, lua_toboolean(L, 3));
+            return 1;
         }
-        else
+        case FIELD_MIPMAP:
+        {
+            meshData->mipmaps = checkmipmaps(L, 3);
+            applyMipmaps(meshData);
+            return 1;
+        }
+        case FIELD_TEXCOORDS:
         {
-            luaL_checktype(L, 3, LUA_TTABLE);
+            buffer_type* buf = NULL;
+            if (lua_isnil(L, 3))
+            {
+                // clear colors
+                clearBuffer(&meshData->texCoords);
+            }
+            else if ((buf = getbuffer(L, 3)) != NULL)
+            {
+                luaL_argcheck(L, buf->components == 2, 3, "buffer of 2 components expected");
+                copyFromBuffer(&meshData->texCoords, buf, 1);
+            }
+            else
+            {
+                luaL_checktype(L, 3, LUA_TTABLE);
             
-            int n = luaL_getn(L, 3);  /* get size of table */
-            resizeBuffer(&meshData->texCoords, n);
+                int n = luaL_getn(L, 3);  /* get size of table */
+                resizeBuffer(&meshData->texCoords, n);
             
-            if(n >= 1)
-            {
-                for (int i = 1; i <= n; i++)
+                if(n >= 1)
                 {
-                    lua_rawgeti(L, 3, i);
-                    lua_Number* v = checkvec2(L, -1);
-                    meshData->texCoords.buffer[(i-1)*2] = v[0];
-                    meshData->texCoords.buffer[(i-1)*2+1] = v[1];
-                    lua_pop(L, 1);                    
-                }        
-            }            
-        }
+                    for (int i = 1; i <= n; i++)
+                    {
+                        lua_rawgeti(L, 3, i);
+                        lua_Number* v = checkvec2(L, -1);
+                        meshData->texCoords.buffer[(i-1)*2] = v[0];
+                        meshData->texCoords.buffer[(i-1)*2+1] = v[1];
+                        lua_pop(L, 1);                    
+                    }        
+                }            
+            }
         
-        meshData->valid = checkValid(meshData);
+            meshData->valid = checkValid(meshData);
         
-        return 1;        
+            return 1;
+        }
+        default: break;
     }
 
     
@@ -521,13 +810,7 @@ static int LsetColors(lua_State *L)
         
         resizeBuffer(&meshData->colors, meshData->vertices.length);
         
-        for (int i = 0; i < meshData->colors.length; i++)
-        {
-            meshData->colors.buffer[i*4] = color[0];
-            meshData->colors.buffer[i*4+1] = color[1];
-            meshData->colors.buffer[i*4+2] = color[2];
-            meshData->colors.buffer[i*4+3] = color[3];        
-        }
+        fillColors(meshData, 0, meshData->colors.length, color);
         
         meshData->valid = checkValid(meshData);        
     }
@@ -637,13 +920,8 @@ static int LaddQuad(lua_State *L)
             }            
         }
         
-        for (int i = nVerts; i < meshData->colors.length; i++)
-        {
-            meshData->colors.buffer[i*4] = 1.0f;
-            meshData->colors.buffer[i*4+1] = 1.0f;
-            meshData->colors.buffer[i*4+2] = 1.0f;
-            meshData->colors.buffer[i*4+3] = 1.0f;            
-        }     
+        const GLfloat white[4] = {1,1,1,1};
+        fillColors(meshData, nVerts, meshData->colors.length, white);     
         
         // return quad index
         lua_pushinteger(L, (nVerts/6)+1);
@@ -882,7 +1160,9 @@ static int Lcolor(lua_State *L)
                 
                 if( color )
                 {
-                    pushcolor(L, color[0] * 255, color[1] * 255, color[2] * 255, color[3] * 255);
+                    lua_Number rgba[4];
+                    loadColor(meshData, color, rgba);
+                    pushcolor(L, rgba[0], rgba[1], rgba[2], rgba[3]);
                     return 1;
                 }
                 else
@@ -901,10 +1181,7 @@ static int Lcolor(lua_State *L)
     
     if( color )
     {
-        color[0] = r/255.0f;
-        color[1] = g/255.0f;
-        color[2] = b/255.0f;
-        color[3] = a/255.0f;        
+        storeColor(meshData, color, r, g, b, a);
     }
     else
     {
@@ -1029,13 +1306,7 @@ static int LsetQuadColor(lua_State *L)
             return 0;
         }        
         
-        for (int i = nVerts, j = nVerts*4; i < nVerts+6; i++)
-        {
-            meshData->colors.buffer[j++] = color[0];
-            meshData->colors.buffer[j++] = color[1];
-            meshData->colors.buffer[j++] = color[2];
-            meshData->colors.buffer[j++] = color[3];       
-        }             
+        fillColors(meshData, nVerts, nVerts+6, color);             
     }
     
     return 0;
@@ -1157,8 +1428,6 @@ static int Ltostring(lua_State *L)
 
 static const luaL_reg R[] =
 {
-	{ "__index",	  Lget		    },
-	{ "__newindex",	  Lset		    },
     { "__gc",         Lgc           },
 	{ "__tostring",	  Ltostring	    },
     { "setColors",    LsetColors    },
@@ -1179,6 +1448,7 @@ LUALIB_API int luaopen_mesh(lua_State *L)
 {
     luaL_newmetatable(L, MESH_TYPE);
     luaL_openlib(L,NULL,R,0);
+    setfieldhandlers(L,Lget,Lset,fields);
     lua_register(L,"mesh",Lnew);
     return 1;
 }
@@ -0,0 +1,214 @@
+//
+//  points.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+
+#include <string.h>
+
+#include "points.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "buffer.h"
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+
+//The vector at index i as floats, with its component count, or NULL
+static lua_Number *getvector(lua_State *L, int i, int *components)
+{
+    lua_Number *v;
+    if ((v = getvec2(L, i)) != NULL) *components = 2;
+    else if ((v = getvec3(L, i)) != NULL) *components = 3;
+    else if ((v = getvec4(L, i)) != NULL) *components = 4;
+    return v;
+}
+
+//Storage for points kept in an array, left on the stack until storepoints
+static void scratch(lua_State *L, points_type *p, int i, size_t count, int components)
+{
+    buffer_type *b = pushbuffer(L, count, components);
+    p->data = b->data;
+    p->count = count;
+    p->stride = p->components = components;
+    p->table = i;
+    p->planar = NULL;
+}
+
+//Interleaves a vecarray's planes into scratch storage
+static void gatherplanes(lua_State *L, points_type *p, vecarray_type *a)
+{
+    size_t j;
+    int k;
+    
+    scratch(L, p, 0, a->count, a->dim);
+    p->planar = a;
+    for (j = 0; j < a->count; j++)
+        for (k = 0; k < a->dim; k++)
+            p->data[j * a->dim + k] = a->planes[k][j];
+}
+
+void checkpoints(lua_State *L, int i, points_type *p, int components)
+{
+    buffer_type *b;
+    vecarray_type *a;
+    size_t length;
+    const char *s;
+    
+    i = i < 0 ? lua_gettop(L) + i + 1 : i;
+    p->table = 0;
+    p->planar = NULL;
+    
+    if ((b = getbuffer(L, i)) != NULL)
+    {
+        luaL_argcheck(L, b->components >= 2, i, "buffer must have 2 to 4 components");
+        p->data = b->data;
+        p->count = b->count;
+        p->stride = p->components = b->components;
+    }
+    else if ((p->data = getmeshvertices(L, i, &p->count, &p->stride)) != NULL)
+    {
+        p->components = p->stride;
+    }
+    else if ((a = getvecarray(L, i)) != NULL)
+    {
+        gatherplanes(L, p, a);
+    }
+    else if (lua_type(L, i) == LUA_TSTRING)
+    {
+        //Packed floats, as written by string.pack or read from a file
+        luaL_argcheck(L, components >= 2 && components <= 4, i, "components must be 2 to 4");
+        s = lua_tolstring(L, i, &length);
+        luaL_argcheck(L, length % (components * sizeof(float)) == 0, i, "string length is not a whole number of points");
+        p->data = (float *)s;   //Only ever read; string storage is suitably aligned
+        p->count = length / (components * sizeof(float));
+        p->stride = p->components = components;
+    }
+    else if (lua_istable(L, i))
+    {
+        size_t j, n = lua_objlen(L, i);
+        lua_Number *v;
+        int k, c = 2;
+        
+        lua_rawgeti(L, i, 1);
+        if (n > 0 && getvector(L, -1, &c) == NULL)
+            luaL_argerror(L, i, "table of vec2, vec3 or vec4 expected");
+        lua_pop(L, 1);
+        
+        scratch(L, p, i, n, c);
+        for (j = 0; j < n; j++)
+        {
+            lua_rawgeti(L, i, (int)j + 1);
+            v = getvector(L, -1, &k);
+            if (v == NULL || k != c)
+                luaL_error(L, "invalid value (at index %d) in table of points", (int)j + 1);
+            for (k = 0; k < c; k++)
+                p->data[j * c + k] = (float)v[k];
+            lua_pop(L, 1);
+        }
+    }
+    else
+    {
+        luaL_typerror(L, i, "points");
+    }
+}
+
+void targetpoints(lua_State *L, int i, points_type *p, size_t count, int components)
+{
+    buffer_type *b;
+    vecarray_type *a;
+    
+    i = i < 0 ? lua_gettop(L) + i + 1 : i;
+    p->table = 0;
+    p->planar = NULL;
+    
+    if ((b = getbuffer(L, i)) != NULL)
+    {
+        luaL_argcheck(L, b->components >= 2, i, "buffer must have 2 to 4 components");
+        luaL_argcheck(L, b->count >= count, i, "buffer is too small");
+        p->data = b->data;
+        p->stride = p->components = b->components;
+    }
+    else if ((p->data = getmeshvertices(L, i, &p->count, &p->stride)) != NULL)
+    {
+        luaL_argcheck(L, p->count >= count, i, "mesh has too few vertices");
+        p->components = p->stride;
+    }
+    else if ((a = getvecarray(L, i)) != NULL)
+    {
+        luaL_argcheck(L, a->count >= count, i, "vecarray is too small");
+        scratch(L, p, 0, count, a->dim);
+        p->planar = a;
+    }
+    else if (lua_istable(L, i))
+    {
+        //Keep the array's own vector type if it already holds points
+        lua_rawgeti(L, i, 1);
+        getvector(L, -1, &components);
+        lua_pop(L, 1);
+        scratch(L, p, i, count, components);
+    }
+    else
+    {
+        luaL_typerror(L, i, "buffer, mesh or table");
+    }
+    
+    p->count = count;
+}
+
+void storepoints(lua_State *L, const points_type *p)
+{
+    size_t j;
+    lua_Number *v;
+    const float *s;
+    int k, c;
+    
+    if (p->planar != NULL)
+    {
+        for (j = 0; j < p->count; j++)
+            for (k = 0; k < p->components; k++)
+                p->planar->planes[k][j] = p->data[j * p->stride + k];
+        return;
+    }
+    
+    if (p->table == 0)
+        return;
+    
+    for (j = 0; j < p->count; j++)
+    {
+        s = p->data + j * p->stride;
+        lua_rawgeti(L, p->table, (int)j + 1);
+        v = getvector(L, -1, &c);
+        lua_pop(L, 1);
+        
+        if (v != NULL && c == p->components)
+        {
+            for (k = 0; k < c; k++)
+                v[k] = s[k];
+            continue;
+        }
+        
+        switch (p->components)
+        {
+            case 2: pushvec2(L, s[0], s[1]); break;
+            case 3: pushvec3(L, s[0], s[1], s[2]); break;
+            default: pushvec4(L, s[0], s[1], s[2], s[3]); break;
+        }
+        lua_rawseti(L, p->table, (int)j + 1);
+    }
+}
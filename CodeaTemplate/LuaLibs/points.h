@@ -0,0 +1,66 @@
+//
+//  points.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+
+#ifndef Codify_points_h
+#define Codify_points_h
+
+#include <stddef.h>
+
+#include "lua.h"
+#include "vecarray.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//A run of points for bulk operations: count points of 2 to 4 floats, stride floats apart. Points come
+//from a buffer, a mesh's vertices, a string of packed floats, a vec2array/vec3array or a Lua array of
+//vec2/vec3/vec4; the last two are gathered into (and scattered back from) a scratch userdata left on
+//the stack
+typedef struct points_type_t
+{
+    float *data;
+    size_t count;
+    int stride;
+    int components;
+    int table;          //Stack index of the Lua array behind data, 0 if data is the storage itself
+    vecarray_type *planar;  //The vecarray behind data, NULL if data is the storage itself
+} points_type;
+
+//Describes the points at index i for reading; components is only used for strings
+void checkpoints(lua_State *L, int i, points_type *p, int components);
+
+//Describes count points to be written to the buffer, mesh, vecarray or array at index i. All but empty
+//Lua arrays keep their own component count (components is used for those), and all but Lua arrays
+//must already hold at least count points
+void targetpoints(lua_State *L, int i, points_type *p, size_t count, int components);
+
+//Writes back points that were gathered from an array or vecarray, reusing vectors where it can
+void storepoints(lua_State *L, const points_type *p);
+
+//The vertex storage of the mesh at index i, or NULL if it is not a mesh (mesh.m)
+float *getmeshvertices(lua_State *L, int i, size_t *count, int *stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,574 @@
+//
+//  profiler.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "profiler.h"
+#include "lua.h"
+#include "lauxlib.h"
+
+#define PROFILER_MAXDEPTH       64
+#define PROFILER_DEFAULTCOUNT   10000   /* instructions between samples */
+#define PROFILER_DEFAULTTIME    1000    /* microseconds between samples */
+#define PROFILER_TIMECHECK      1000    /* instructions between clock checks in time mode */
+
+//A distinct function seen in a sample, keyed by the text of its label. The
+//strings lua_getinfo hands back can be freed and their addresses reused by
+//other functions, so pointers would not do as keys.
+typedef struct profiler_frame
+{
+    unsigned int hash;
+    char *label;
+} profiler_frame;
+
+//Samples are aggregated into a call tree; node 0 is the root
+typedef struct profiler_node
+{
+    int frame;
+    int parent;
+    unsigned long count;
+} profiler_node;
+
+typedef struct profiler_state
+{
+    const void *registry;   /* identifies the profiled lua_State */
+    int running;
+    profiler_mode mode;
+    int interval;
+    int hookmask;
+    int hookcount;
+    long long nextsample;   /* time mode: due time in microseconds */
+    unsigned long samples;
+    
+    /* count hook installed by the host (instruction limit) */
+    lua_Hook chainhook;
+    int chainmask;
+    int chaincount;
+    int chainleft;
+    
+    profiler_frame *frames;
+    int nframes, maxframes;
+    int *framehash;         /* open addressing, -1 = empty */
+    int framehashsize;
+    
+    profiler_node *nodes;
+    int nnodes, maxnodes;
+    int *nodehash;          /* (parent, frame) -> node */
+    int nodehashsize;
+} profiler_state;
+
+static profiler_state P = { NULL };
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int issamestate(lua_State *L)
+{
+    return P.registry != NULL && P.registry == lua_topointer(L, LUA_REGISTRYINDEX);
+}
+
+
+static unsigned int hashptrs(const void *a, const void *b, int c, const void *d)
+{
+    size_t h = (size_t)a * 31u ^ (size_t)b * 131u ^ (size_t)c * 2654435761u ^ (size_t)d;
+    return (unsigned int)(h ^ (h >> 15));
+}
+
+static unsigned int hashstring(const char *s)
+{
+    unsigned int h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static int *newhash(int size)
+{
+    int *h = malloc(size * sizeof(int));
+    if (h) memset(h, -1, size * sizeof(int));
+    return h;
+}
+
+static int growframes(void)
+{
+    int i, size = P.framehashsize ? P.framehashsize * 2 : 256;
+    int *h = newhash(size);
+    profiler_frame *f = realloc(P.frames, (size / 2) * sizeof(profiler_frame));
+    if (h == NULL || f == NULL) { free(h); if (f) P.frames = f; return 0; }
+    P.frames = f;
+    P.maxframes = size / 2;
+    for (i = 0; i < P.nframes; i++)
+    {
+        unsigned int j = P.frames[i].hash & (size - 1);
+        while (h[j] >= 0) j = (j + 1) & (size - 1);
+        h[j] = i;
+    }
+    free(P.framehash);
+    P.framehash = h;
+    P.framehashsize = size;
+    return 1;
+}
+
+static void framelabel(char *s, size_t size, lua_Debug *ar, lua_CFunction cfunc)
+{
+    if (cfunc)
+    {
+        if (ar->name) snprintf(s, size, "%s [C]", ar->name);
+        else snprintf(s, size, "[C] %p", (void*)(size_t)cfunc);
+    }
+    else if (*ar->what == 'm')
+        snprintf(s, size, "main (%s)", ar->short_src);
+    else
+        snprintf(s, size, "%s (%s:%d)", ar->name ? ar->name : "?", ar->short_src, ar->linedefined);
+}
+
+static int internframe(lua_Debug *ar, lua_CFunction cfunc)
+{
+    char label[LUA_IDSIZE + 128];
+    unsigned int h, j;
+    profiler_frame *f;
+    
+    if (P.nframes >= P.maxframes && !growframes())
+        return -1;
+    
+    framelabel(label, sizeof(label), ar, cfunc);
+    h = hashstring(label);
+    for (j = h & (P.framehashsize - 1); P.framehash[j] >= 0; j = (j + 1) & (P.framehashsize - 1))
+    {
+        f = &P.frames[P.framehash[j]];
+        if (f->hash == h && strcmp(f->label, label) == 0)
+            return P.framehash[j];
+    }
+    
+    f = &P.frames[P.nframes];
+    f->hash = h;
+    f->label = strdup(label);
+    if (f->label == NULL)
+        return -1;
+    P.framehash[j] = P.nframes;
+    return P.nframes++;
+}
+
+static int grownodes(void)
+{
+    int i, size = P.nodehashsize ? P.nodehashsize * 2 : 1024;
+    int *h = newhash(size);
+    profiler_node *n = realloc(P.nodes, (size / 2) * sizeof(profiler_node));
+    if (h == NULL || n == NULL) { free(h); if (n) P.nodes = n; return 0; }
+    P.nodes = n;
+    P.maxnodes = size / 2;
+    for (i = 1; i < P.nnodes; i++)
+    {
+        unsigned int j = hashptrs(NULL, NULL, P.nodes[i].parent, (const void*)(size_t)P.nodes[i].frame) & (size - 1);
+        while (h[j] >= 0) j = (j + 1) & (size - 1);
+        h[j] = i;
+    }
+    free(P.nodehash);
+    P.nodehash = h;
+    P.nodehashsize = size;
+    return 1;
+}
+
+static int childnode(int parent, int frame)
+{
+    unsigned int j;
+    profiler_node *n;
+    
+    if (P.nnodes >= P.maxnodes && !grownodes())
+        return -1;
+    
+    for (j = hashptrs(NULL, NULL, parent, (const void*)(size_t)frame) & (P.nodehashsize - 1); 
+         P.nodehash[j] >= 0; j = (j + 1) & (P.nodehashsize - 1))
+    {
+        n = &P.nodes[P.nodehash[j]];
+        if (n->parent == parent && n->frame == frame)
+            return P.nodehash[j];
+    }
+    
+    n = &P.nodes[P.nnodes];
+    n->parent = parent;
+    n->frame = frame;
+    n->count = 0;
+    P.nodehash[j] = P.nnodes;
+    return P.nnodes++;
+}
+
+static void takesample(lua_State *L, unsigned long weight)
+{
+    int frames[PROFILER_MAXDEPTH];
+    int n = 0, level, node = 0;
+    lua_Debug ar;
+    
+    if (P.nnodes == 0)
+    {
+        if (!grownodes()) return;
+        P.nodes[0].parent = -1;
+        P.nodes[0].frame = -1;
+        P.nodes[0].count = 0;
+        P.nnodes = 1;
+    }
+    
+    for (level = 0; n < PROFILER_MAXDEPTH && lua_getstack(L, level, &ar); level++)
+    {
+        lua_CFunction cfunc;
+        lua_getinfo(L, "Snf", &ar);
+        cfunc = lua_tocfunction(L, -1);
+        lua_pop(L, 1);
+        if ((frames[n] = internframe(&ar, cfunc)) < 0) return;
+        n++;
+    }
+    
+    //Walk from the outermost frame down to the sampled function
+    while (n-- > 0)
+    {
+        if ((node = childnode(node, frames[n])) < 0) return;
+    }
+    
+    P.nodes[node].count += weight;
+    P.samples += weight;
+}
+
+static void freeprofile(void)
+{
+    int i;
+    for (i = 0; i < P.nframes; i++) free(P.frames[i].label);
+    free(P.frames);
+    free(P.framehash);
+    free(P.nodes);
+    free(P.nodehash);
+    P.frames = NULL; P.framehash = NULL; P.nodes = NULL; P.nodehash = NULL;
+    P.nframes = P.maxframes = P.framehashsize = 0;
+    P.nnodes = P.maxnodes = P.nodehashsize = 0;
+    P.samples = 0;
+}
+
+
+static void profilerhook(lua_State *L, lua_Debug *ar)
+{
+    if (!P.running || !issamestate(L))
+    {
+        //A coroutine still carrying the hook after profiler_stop
+        lua_sethook(L, P.chainhook, P.chainmask, P.chaincount);
+        return;
+    }
+    
+    if (P.mode == PROFILER_COUNT)
+        takesample(L, 1);
+    else
+    {
+        long long t = now_us();
+        if (t >= P.nextsample)
+        {
+            unsigned long weight = 1 + (unsigned long)((t - P.nextsample) / P.interval);
+            P.nextsample += (long long)weight * P.interval;
+            takesample(L, weight);
+        }
+    }
+    
+    if (P.chainhook && (P.chainleft -= P.hookcount) <= 0)
+    {
+        P.chainleft += P.chaincount;
+        P.chainhook(L, ar);
+    }
+}
+
+void profiler_sethook(lua_State *L, lua_Hook f, int mask, int count)
+{
+    if (P.running && issamestate(L))
+    {
+        P.chainhook = (mask & LUA_MASKCOUNT) ? f : NULL;
+        P.chainmask = mask;
+        P.chaincount = count;
+        P.chainleft = count;
+    }
+    else
+        lua_sethook(L, f, mask, count);
+}
+
+
+int profiler_start(lua_State *L, profiler_mode mode, int interval)
+{
+    if (P.running)
+        return issamestate(L);  /* only one state at a time */
+    
+    if (!issamestate(L))
+        freeprofile();          /* samples from another state are meaningless here */
+    
+    P.registry = lua_topointer(L, LUA_REGISTRYINDEX);
+    P.mode = mode;
+    P.interval = interval > 0 ? interval : (mode == PROFILER_TIME ? PROFILER_DEFAULTTIME : PROFILER_DEFAULTCOUNT);
+    
+    P.chainhook = (lua_gethookmask(L) & LUA_MASKCOUNT) ? lua_gethook(L) : NULL;
+    P.chainmask = lua_gethookmask(L);
+    P.chaincount = lua_gethookcount(L);
+    P.chainleft = P.chaincount;
+    
+    if (mode == PROFILER_TIME)
+    {
+        //The clock is only read on count events, so time spent inside a C
+        //function is charged to the Lua frame that called it
+        P.hookmask = LUA_MASKCOUNT;
+        P.hookcount = PROFILER_TIMECHECK;
+        P.nextsample = now_us() + P.interval;
+    }
+    else
+    {
+        P.hookmask = LUA_MASKCOUNT;
+        P.hookcount = P.interval;
+    }
+    
+    P.running = 1;
+    lua_sethook(L, profilerhook, P.hookmask, P.hookcount);
+    return 1;
+}
+
+void profiler_stop(lua_State *L)
+{
+    if (!P.running || !issamestate(L))
+        return;
+    
+    P.running = 0;
+    lua_sethook(L, P.chainhook, P.chainmask, P.chaincount);
+}
+
+void profiler_reset(lua_State *L)
+{
+    if (issamestate(L))
+        freeprofile();
+}
+
+
+typedef void (*profiler_writer)(void *ud, const char *s, size_t len);
+
+static void writestr(profiler_writer w, void *ud, const char *s)
+{
+    w(ud, s, strlen(s));
+}
+
+static void writejsonstr(profiler_writer w, void *ud, const char *s)
+{
+    w(ud, "\"", 1);
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            char e[2] = { '\\', (char)c };
+            w(ud, e, 2);
+        }
+        else if (c < 0x20)
+        {
+            char e[8];
+            snprintf(e, sizeof(e), "\\u%04x", c);
+            w(ud, e, 6);
+        }
+        else
+            w(ud, (const char*)&c, 1);
+    }
+    w(ud, "\"", 1);
+}
+
+static void dumpcollapsed(profiler_writer w, void *ud)
+{
+    int path[PROFILER_MAXDEPTH];
+    char num[32];
+    int i, n, node;
+    
+    for (i = 1; i < P.nnodes; i++)
+    {
+        if (P.nodes[i].count == 0) continue;
+        
+        for (n = 0, node = i; node > 0 && n < PROFILER_MAXDEPTH; node = P.nodes[node].parent)
+            path[n++] = node;
+        
+        while (n-- > 0)
+        {
+            const char *label = P.frames[P.nodes[path[n]].frame].label;
+            //';' separates frames in this format
+            for (; *label; label++)
+                w(ud, *label == ';' ? ":" : label, 1);
+            w(ud, n > 0 ? ";" : " ", 1);
+        }
+        snprintf(num, sizeof(num), "%lu\n", P.nodes[i].count);
+        writestr(w, ud, num);
+    }
+}
+
+static void dumpchrome(profiler_writer w, void *ud)
+{
+    char num[96];
+    int i, first = 1;
+    double ts = 0;
+    double step = P.mode == PROFILER_TIME ? P.interval : 1;
+    
+    writestr(w, ud, "{\"traceEvents\":[],\"stackFrames\":{");
+    for (i = 1; i < P.nnodes; i++)
+    {
+        snprintf(num, sizeof(num), "%s\"%d\":{\"category\":\"lua\",\"name\":", i > 1 ? "," : "", i);
+        writestr(w, ud, num);
+        writejsonstr(w, ud, P.frames[P.nodes[i].frame].label);
+        if (P.nodes[i].parent > 0)
+        {
+            snprintf(num, sizeof(num), ",\"parent\":\"%d\"", P.nodes[i].parent);
+            writestr(w, ud, num);
+        }
+        writestr(w, ud, "}");
+    }
+    writestr(w, ud, "},\"samples\":[");
+    for (i = 1; i < P.nnodes; i++)
+    {
+        if (P.nodes[i].count == 0) continue;
+        snprintf(num, sizeof(num), "%s{\"cpu\":0,\"tid\":1,\"ts\":%.0f,\"name\":\"lua\",\"sf\":\"%d\",\"weight\":%lu}",
+                 first ? "" : ",", ts, i, P.nodes[i].count);
+        writestr(w, ud, num);
+        ts += step * P.nodes[i].count;
+        first = 0;
+    }
+    writestr(w, ud, "]}\n");
+}
+
+static void dumpprofile(profiler_writer w, void *ud, profiler_format format)
+{
+    if (format == PROFILER_CHROME)
+        dumpchrome(w, ud);
+    else
+        dumpcollapsed(w, ud);
+}
+
+static void filewriter(void *ud, const char *s, size_t len)
+{
+    fwrite(s, 1, len, (FILE*)ud);
+}
+
+int profiler_dump(lua_State *L, FILE *f, profiler_format format)
+{
+    if (!issamestate(L))
+        return 0;
+    dumpprofile(filewriter, f, format);
+    return 1;
+}
+
+
+static void bufferwriter(void *ud, const char *s, size_t len)
+{
+    luaL_addlstring((luaL_Buffer*)ud, s, len);
+}
+
+static int Lstart(lua_State *L)     /** profiler.start([mode], [interval]) */
+{
+    static const char *const modes[] = { "count", "time", NULL };
+    int mode = luaL_checkoption(L, 1, "count", modes);
+    int interval = luaL_optint(L, 2, 0);
+    
+    if (!profiler_start(L, (profiler_mode)mode, interval))
+        return luaL_error(L, "profiler is already running in another Lua state");
+    return 0;
+}
+
+static int Lstop(lua_State *L)
+{
+    profiler_stop(L);
+    return 0;
+}
+
+static int Lreset(lua_State *L)
+{
+    profiler_reset(L);
+    return 0;
+}
+
+static int Lrunning(lua_State *L)
+{
+    lua_pushboolean(L, P.running && issamestate(L));
+    return 1;
+}
+
+static int Lsamples(lua_State *L)
+{
+    lua_pushnumber(L, issamestate(L) ? (lua_Number)P.samples : 0);
+    return 1;
+}
+
+static int Ldump(lua_State *L)      /** profiler.dump([path], [format]) */
+{
+    static const char *const formats[] = { "collapsed", "chrome", NULL };
+    const char *path = luaL_optstring(L, 1, NULL);
+    profiler_format format = (profiler_format)luaL_checkoption(L, 2, "collapsed", formats);
+    
+    if (path)
+    {
+        FILE *f = fopen(path, "w");
+        if (f == NULL)
+            return luaL_error(L, "cannot open %s for writing", path);
+        profiler_dump(L, f, format);
+        fclose(f);
+        return 0;
+    }
+    else
+    {
+        luaL_Buffer b;
+        luaL_buffinit(L, &b);
+        if (issamestate(L))
+            dumpprofile(bufferwriter, &b, format);
+        luaL_pushresult(&b);
+        return 1;
+    }
+}
+
+static int Lgc(lua_State *L)
+{
+    //The profiled state is closing
+    if (issamestate(L))
+    {
+        P.running = 0;
+        freeprofile();
+        P.registry = NULL;
+    }
+    return 0;
+}
+
+static const luaL_reg R[] =
+{
+    { "start",      Lstart      },
+    { "stop",       Lstop       },
+    { "reset",      Lreset      },
+    { "dump",       Ldump       },
+    { "running",    Lrunning    },
+    { "samples",    Lsamples    },
+    { NULL,         NULL        }
+};
+
+LUALIB_API int luaopen_profiler(lua_State *L)
+{
+    //Sentinel so the profile is released along with the state
+    lua_newuserdata(L, 1);
+    lua_newtable(L);
+    lua_pushcfunction(L, Lgc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, "codeaprofiler");
+    
+    luaL_register(L, CODIFY_PROFILERLIBNAME, R);
+    return 1;
+}
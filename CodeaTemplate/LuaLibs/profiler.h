@@ -0,0 +1,62 @@
+//
+//  profiler.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+#ifndef Codify_profiler_h
+#define Codify_profiler_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include "lua.h"
+
+#define CODIFY_PROFILERLIBNAME "profiler"
+
+typedef enum profiler_mode
+{
+    PROFILER_COUNT = 0,     // sample every 'interval' VM instructions
+    PROFILER_TIME,          // sample every 'interval' microseconds
+} profiler_mode;
+
+typedef enum profiler_format
+{
+    PROFILER_COLLAPSED = 0, // "frame;frame;frame count" lines (flamegraph.pl, speedscope)
+    PROFILER_CHROME,        // Chrome trace event JSON (chrome://tracing)
+} profiler_format;
+
+LUALIB_API int (luaopen_profiler) (lua_State *L);
+
+//Host side control, the same as profiler.start/stop/reset/dump from Lua.
+//Only one lua_State can be profiled at a time. Hooks are per coroutine in Lua,
+//so coroutines created before profiler_start are not sampled.
+int profiler_start(lua_State *L, profiler_mode mode, int interval);
+void profiler_stop(lua_State *L);
+void profiler_reset(lua_State *L);
+int profiler_dump(lua_State *L, FILE *f, profiler_format format);
+
+//Use instead of lua_sethook for count hooks (such as the instruction limit) so
+//that they keep firing while the profiler owns the hook
+void profiler_sethook(lua_State *L, lua_Hook f, int mask, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
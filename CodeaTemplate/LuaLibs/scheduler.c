@@ -0,0 +1,709 @@
+//
+//  scheduler.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+
+#include <math.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "scheduler.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "codea_luaext.h"
+
+//Tasks are coroutines resumed from the frame loop. A task that waits is
+//parked in a hierarchical timer wheel (milliseconds for wait, frames for
+//waitFrames) or on an event list (waitFor), so idle tasks cost nothing per
+//frame; scheduler_tick only walks the wheel slots that elapsed and resumes
+//what became due.
+
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    4
+#define WHEEL_SPAN      (1u << (WHEEL_BITS * WHEEL_LEVELS))    /* ticks covered by the wheel */
+
+#define SCHEDULER       "codeascheduler"
+#define TASKTYPE        "task"
+
+enum { TASK_READY, TASK_SLEEPING, TASK_WAITING, TASK_RUNNING, TASK_DEAD };
+
+//What a yielding task waits for. The waiting functions only record it, and the task is parked once
+//its yield has succeeded; a yield that fails (inside a pcall) leaves it running and unlisted. They
+//yield waittag first, so a later plain coroutine.yield() is never taken for a stale wait
+enum { WAIT_FRAME, WAIT_TIMER, WAIT_FRAMES, WAIT_EVENT };
+static const char waittag = 0;
+static const char *const statenames[] = { "ready", "sleeping", "waiting", "running", "dead" };
+
+enum { FIELD_STATUS };
+static const char *const fields[] = { "status", NULL };
+
+//Slots of the scheduler's environment table
+enum { ENV_THREADS = 1, ENV_EVENTS, ENV_WAITING };
+
+typedef struct sched_link
+{
+    struct sched_link *prev;
+    struct sched_link *next;
+} sched_link;
+
+struct sched_wheel;
+
+typedef struct sched_task
+{
+    sched_link link;            /* must come first, lists hold tasks by their link */
+    lua_State *co;
+    struct sched_wheel *wheel;  /* wheel holding the task while it sleeps */
+    unsigned int expires;
+    int state;
+    int pending;                /* WAIT_* for the next yield */
+    int nargs;                  /* values on co's stack to resume it with */
+} sched_task;
+
+typedef struct sched_wheel
+{
+    unsigned int base;          /* next tick to expire */
+    int count;
+    sched_link slot[WHEEL_LEVELS][WHEEL_SIZE];
+} sched_wheel;
+
+typedef struct scheduler_state
+{
+    sched_wheel timers;         /* milliseconds */
+    sched_wheel frames;
+    sched_link ready;           /* resumed on the next tick, in order */
+    sched_link running;         /* the rest of the current tick */
+    double time;
+    unsigned int frame;
+    int ntasks;
+    int resumed;                /* profiling: last tick */
+    long long elapsed;          /* profiling: microseconds spent in the last tick */
+} scheduler_state;
+
+#define totask(l)   ((sched_task *)(l))
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static unsigned int tomilliseconds(double t)
+{
+    return (unsigned int)(long long)floor(t * 1000.0);
+}
+
+//Lists
+
+static void link_init(sched_link *l)
+{
+    l->prev = l->next = l;
+}
+
+static int link_empty(sched_link *head)
+{
+    return head->next == head;
+}
+
+static void link_remove(sched_link *l)
+{
+    l->prev->next = l->next;
+    l->next->prev = l->prev;
+    link_init(l);
+}
+
+static void link_append(sched_link *head, sched_link *l)
+{
+    l->prev = head->prev;
+    l->next = head;
+    head->prev->next = l;
+    head->prev = l;
+}
+
+//Moves all of src in front of dst's entries
+static void link_prepend_all(sched_link *dst, sched_link *src)
+{
+    if (link_empty(src))
+        return;
+    src->prev->next = dst->next;
+    dst->next->prev = src->prev;
+    dst->next = src->next;
+    src->next->prev = dst;
+    link_init(src);
+}
+
+//Timer wheel
+
+static void wheel_init(sched_wheel *w)
+{
+    int l, i;
+    w->base = 0;
+    w->count = 0;
+    for (l = 0; l < WHEEL_LEVELS; l++)
+        for (i = 0; i < WHEEL_SIZE; i++)
+            link_init(&w->slot[l][i]);
+}
+
+static void makeready(scheduler_state *s, sched_task *t)
+{
+    t->state = TASK_READY;
+    t->wheel = NULL;
+    link_append(&s->ready, &t->link);
+}
+
+//Level l holds what expires within WHEEL_SIZE^(l+1) ticks of base, in the
+//slot picked by the expiry's l-th group of bits
+static void wheel_add(scheduler_state *s, sched_wheel *w, sched_task *t)
+{
+    unsigned int delta = t->expires - w->base;
+    unsigned int e = t->expires;
+    int l = 0;
+    
+    if ((int)delta < 0)
+    {
+        makeready(s, t);
+        return;
+    }
+    if (delta >= WHEEL_SPAN)
+    {
+        //Parked at the far end; it is placed again when that slot cascades
+        e = w->base + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    while (delta >= (1u << (WHEEL_BITS * (l + 1))))
+        l++;
+    
+    t->state = TASK_SLEEPING;
+    t->wheel = w;
+    link_append(&w->slot[l][(e >> (WHEEL_BITS * l)) & WHEEL_MASK], &t->link);
+    w->count++;
+}
+
+static void wheel_remove(sched_task *t)
+{
+    link_remove(&t->link);
+    t->wheel->count--;
+    t->wheel = NULL;
+}
+
+//Spreads a slot of level l over the levels below; returns the slot index
+static int wheel_cascade(scheduler_state *s, sched_wheel *w, int l, int i)
+{
+    sched_link *head = &w->slot[l][i];
+    while (!link_empty(head))
+    {
+        sched_task *t = totask(head->next);
+        wheel_remove(t);
+        wheel_add(s, w, t);
+    }
+    return i;
+}
+
+//Expires every tick up to and including to
+static void wheel_advance(scheduler_state *s, sched_wheel *w, unsigned int to)
+{
+    while ((int)(to - w->base) >= 0)
+    {
+        int i = w->base & WHEEL_MASK;
+        sched_link *head;
+        
+        if (w->count == 0)
+        {
+            w->base = to + 1;   /* nothing to expire, skip idle time */
+            return;
+        }
+        
+        if (i == 0 &&
+            wheel_cascade(s, w, 1, (w->base >> WHEEL_BITS) & WHEEL_MASK) == 0 &&
+            wheel_cascade(s, w, 2, (w->base >> (2 * WHEEL_BITS)) & WHEEL_MASK) == 0)
+            wheel_cascade(s, w, 3, (w->base >> (3 * WHEEL_BITS)) & WHEEL_MASK);
+        w->base++;
+        
+        head = &w->slot[0][i];
+        while (!link_empty(head))
+        {
+            sched_task *t = totask(head->next);
+            wheel_remove(t);
+            makeready(s, t);
+        }
+    }
+}
+
+//Scheduler
+
+//Pushes the scheduler (or nil), creating it when create is set
+static scheduler_state *getscheduler(lua_State *L, int create)
+{
+    scheduler_state *s;
+    
+    lua_getfield(L, LUA_REGISTRYINDEX, SCHEDULER);
+    s = lua_touserdata(L, -1);
+    if (s || !create)
+        return s;
+    lua_pop(L, 1);
+    
+    s = lua_newuserdata(L, sizeof(scheduler_state));
+    memset(s, 0, sizeof(scheduler_state));
+    wheel_init(&s->timers);
+    wheel_init(&s->frames);
+    link_init(&s->ready);
+    link_init(&s->running);
+    
+    //Tasks by coroutine (which also keeps both alive), waiting tasks by event
+    //and the event each waiting task is listed under
+    lua_createtable(L, 3, 0);
+    lua_newtable(L);
+    lua_rawseti(L, -2, ENV_THREADS);
+    lua_newtable(L);
+    lua_rawseti(L, -2, ENV_EVENTS);
+    lua_newtable(L);
+    lua_rawseti(L, -2, ENV_WAITING);
+    lua_setfenv(L, -2);
+    
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, SCHEDULER);
+    return s;
+}
+
+static void pushenv(lua_State *L, int sched, int slot)
+{
+    lua_getfenv(L, sched);
+    lua_rawgeti(L, -1, slot);
+    lua_remove(L, -2);
+}
+
+static sched_task *checktask(lua_State *L, int i)
+{
+    return luaL_checkudata(L, i, TASKTYPE);
+}
+
+//The task running on L, or an error naming the waiting function
+static sched_task *currenttask(lua_State *L, scheduler_state **s, const char *name)
+{
+    sched_task *t = NULL;
+    *s = getscheduler(L, 0);
+    if (*s)
+    {
+        pushenv(L, lua_gettop(L), ENV_THREADS);
+        lua_pushthread(L);
+        lua_rawget(L, -2);
+        t = lua_touserdata(L, -1);
+        lua_pop(L, 3);
+    }
+    else
+        lua_pop(L, 1);
+    if (t == NULL)
+        luaL_error(L, "tasks.%s must be called from a task", name);
+    return t;
+}
+
+//Removes the task at index ud from the event list it waits on
+static void unlistwaiting(lua_State *L, int sched, int ud)
+{
+    int i, n;
+    pushenv(L, sched, ENV_WAITING);     /* waiting */
+    pushenv(L, sched, ENV_EVENTS);      /* events */
+    lua_pushvalue(L, ud);
+    lua_rawget(L, -3);                  /* event */
+    lua_rawget(L, -2);                  /* list */
+    n = (int)lua_objlen(L, -1);
+    for (i = 1; i <= n; i++)
+    {
+        lua_rawgeti(L, -1, i);
+        if (lua_touserdata(L, -1) == lua_touserdata(L, ud))
+        {
+            lua_pop(L, 1);
+            for (; i < n; i++)
+            {
+                lua_rawgeti(L, -1, i + 1);
+                lua_rawseti(L, -2, i);
+            }
+            lua_pushnil(L);
+            lua_rawseti(L, -2, n);
+            break;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 2);
+    lua_pushvalue(L, ud);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+}
+
+//Forgets a finished or cancelled task, taking it off the wheel or list that holds it; its coroutine
+//is left to the collector
+static void release(lua_State *L, scheduler_state *s, sched_task *t)
+{
+    lua_State *co = t->co;
+    int sched;
+    
+    getscheduler(L, 0);
+    sched = lua_gettop(L);
+    switch (t->state)
+    {
+        case TASK_SLEEPING:
+            wheel_remove(t);
+            break;
+        case TASK_READY:
+            link_remove(&t->link);
+            break;
+        case TASK_WAITING:
+            pushenv(L, sched, ENV_THREADS);
+            lua_pushthread(co);
+            lua_xmove(co, L, 1);
+            lua_rawget(L, -2);
+            unlistwaiting(L, sched, lua_gettop(L));
+            break;
+        default:
+            break;
+    }
+    t->state = TASK_DEAD;
+    t->co = NULL;
+    s->ntasks--;
+    
+    pushenv(L, sched, ENV_THREADS);
+    lua_pushthread(co);
+    lua_xmove(co, L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    lua_settop(L, sched - 1);
+}
+
+//Lists the task under the event its coroutine yielded for tasks.signal: events[event] is the
+//list of tasks and waiting[task] the event
+static void listwaiting(lua_State *L, sched_task *t)
+{
+    int sched, event;
+    
+    getscheduler(L, 0);
+    sched = lua_gettop(L);
+    lua_xmove(t->co, L, 1);
+    event = lua_gettop(L);
+    
+    pushenv(L, sched, ENV_EVENTS);
+    lua_pushvalue(L, event);
+    lua_rawget(L, -2);
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, event);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);
+    }
+    pushenv(L, sched, ENV_THREADS);
+    lua_pushthread(t->co);
+    lua_xmove(t->co, L, 1);
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, -3, (int)lua_objlen(L, -3) + 1);
+    pushenv(L, sched, ENV_WAITING);
+    lua_insert(L, -2);
+    lua_pushvalue(L, event);
+    lua_rawset(L, -3);
+    
+    t->state = TASK_WAITING;
+    lua_settop(L, sched - 1);
+}
+
+static void cancel(lua_State *L, scheduler_state *s, sched_task *t)
+{
+    if (t->state == TASK_RUNNING)
+        t->state = TASK_DEAD;   /* released by the tick once it yields */
+    else if (t->state != TASK_DEAD)
+        release(L, s, t);
+}
+
+//Runs one task until it waits, returns or fails
+static int resume(lua_State *L, scheduler_state *s, sched_task *t)
+{
+    lua_State *co = t->co;
+    int nargs = t->nargs;
+    int status;
+    
+    t->state = TASK_RUNNING;
+    t->pending = WAIT_FRAME;
+    t->nargs = 0;
+    status = lua_resume(co, nargs);
+    
+    if (status == LUA_YIELD)
+    {
+        if (lua_touserdata(co, 1) != &waittag)
+            t->pending = WAIT_FRAME;
+        
+        if (t->state == TASK_DEAD)
+            release(L, s, t);
+        else if (t->pending == WAIT_TIMER)
+            wheel_add(s, &s->timers, t);
+        else if (t->pending == WAIT_FRAMES)
+            wheel_add(s, &s->frames, t);
+        else if (t->pending == WAIT_EVENT)
+            listwaiting(L, t);
+        else
+        {
+            //A plain coroutine.yield() waits for the next frame
+            t->expires = s->frame + 1;
+            wheel_add(s, &s->frames, t);
+        }
+        if (t->co)
+            lua_settop(co, 0);
+        return 0;
+    }
+    
+    if (status != 0)
+        lua_xmove(co, L, 1);
+    release(L, s, t);
+    return status;
+}
+
+int scheduler_tick(lua_State *L, double now)
+{
+    scheduler_state *s = getscheduler(L, 0);
+    long long start = now_us();
+    int status = 0;
+    
+    lua_pop(L, 1);
+    if (s == NULL)
+        return 0;
+    
+    s->frame++;
+    s->time = now;
+    wheel_advance(s, &s->frames, s->frame);
+    wheel_advance(s, &s->timers, tomilliseconds(now));
+    
+    //Tasks made ready while these run wait for the next tick
+    link_prepend_all(&s->running, &s->ready);
+    s->resumed = 0;
+    while (!link_empty(&s->running))
+    {
+        sched_task *t = totask(s->running.next);
+        link_remove(&t->link);
+        s->resumed++;
+        status = resume(L, s, t);
+        if (status != 0)
+            break;  /* the rest runs on the next tick */
+    }
+    link_prepend_all(&s->ready, &s->running);
+    
+    s->elapsed = now_us() - start;
+    return status;
+}
+
+//Task userdata
+
+static int Lget(lua_State *L)
+{
+    sched_task *t = checkfieldudata(L, 1, TASKTYPE);
+    
+    switch (fieldindex(L, 2))
+    {
+        case FIELD_STATUS:  lua_pushstring(L, statenames[t->state]); break;
+        default: break;             //The method (or nil) for key is on the stack
+    }
+    return 1;
+}
+
+static int Ltostring(lua_State *L)
+{
+    sched_task *t = checktask(L, 1);
+    lua_pushfstring(L, "task: %s", statenames[t->state]);
+    return 1;
+}
+
+static int Lcancel(lua_State *L)    /** task:cancel() or tasks.cancel(task) */
+{
+    scheduler_state *s;
+    sched_task *t = checktask(L, 1);
+    s = getscheduler(L, 1);
+    cancel(L, s, t);
+    return 0;
+}
+
+//Library
+
+static int Lspawn(lua_State *L)     /** tasks.spawn(f, ...) */
+{
+    int n = lua_gettop(L);
+    scheduler_state *s;
+    sched_task *t;
+    lua_State *co;
+    int sched, i;
+    
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    s = getscheduler(L, 1);
+    sched = lua_gettop(L);
+    
+    //The coroutine starts with f and its arguments on its stack
+    co = lua_newthread(L);
+    if (!lua_checkstack(co, n))
+        luaL_error(L, "too many arguments to spawn");
+    for (i = 1; i <= n; i++)
+        lua_pushvalue(L, i);
+    lua_xmove(L, co, n);
+    
+    t = lua_newuserdata(L, sizeof(sched_task));
+    memset(t, 0, sizeof(sched_task));
+    luaL_getmetatable(L, TASKTYPE);
+    lua_setmetatable(L, -2);
+    t->co = co;
+    t->nargs = n - 1;
+    link_init(&t->link);
+    makeready(s, t);
+    s->ntasks++;
+    
+    pushenv(L, sched, ENV_THREADS);
+    lua_pushvalue(L, -3);   /* coroutine */
+    lua_pushvalue(L, -3);   /* task */
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    return 1;
+}
+
+static int Lwait(lua_State *L)      /** tasks.wait(seconds) */
+{
+    double seconds = luaL_optnumber(L, 1, 0);
+    scheduler_state *s;
+    sched_task *t = currenttask(L, &s, "wait");
+    
+    t->expires = tomilliseconds(s->time) + (unsigned int)(long long)ceil(seconds * 1000.0);
+    t->pending = WAIT_TIMER;
+    lua_pushlightuserdata(L, (void*)&waittag);
+    return lua_yield(L, 1);
+}
+
+static int LwaitFrames(lua_State *L)    /** tasks.waitFrames(n) */
+{
+    int n = luaL_optint(L, 1, 1);
+    scheduler_state *s;
+    sched_task *t = currenttask(L, &s, "waitFrames");
+    
+    t->expires = s->frame + (n > 0 ? n : 0);
+    t->pending = WAIT_FRAMES;
+    lua_pushlightuserdata(L, (void*)&waittag);
+    return lua_yield(L, 1);
+}
+
+static int LwaitFor(lua_State *L)   /** tasks.waitFor(event) returns the values passed to tasks.signal */
+{
+    scheduler_state *s;
+    sched_task *t;
+    
+    luaL_argcheck(L, !lua_isnoneornil(L, 1), 1, "event expected");
+    lua_settop(L, 1);
+    t = currenttask(L, &s, "waitFor");
+    
+    //The event is yielded so the tick can list the task under it
+    t->pending = WAIT_EVENT;
+    lua_pushlightuserdata(L, (void*)&waittag);
+    lua_insert(L, 1);
+    return lua_yield(L, 2);
+}
+
+static int Lsignal(lua_State *L)    /** tasks.signal(event, ...) returns the number of tasks woken */
+{
+    int nargs = lua_gettop(L) - 1;
+    scheduler_state *s;
+    int sched, list, i, n, woken = 0;
+    
+    luaL_argcheck(L, !lua_isnoneornil(L, 1), 1, "event expected");
+    s = getscheduler(L, 1);
+    sched = lua_gettop(L);
+    
+    pushenv(L, sched, ENV_EVENTS);
+    lua_pushvalue(L, 1);
+    lua_rawget(L, -2);
+    if (lua_isnil(L, -1))
+    {
+        lua_pushinteger(L, 0);
+        return 1;
+    }
+    list = lua_gettop(L);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, list - 1);
+    
+    pushenv(L, sched, ENV_WAITING);
+    n = (int)lua_objlen(L, list);
+    for (i = 1; i <= n; i++)
+    {
+        sched_task *t;
+        int a;
+        
+        lua_rawgeti(L, list, i);
+        t = lua_touserdata(L, -1);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        if (t->state != TASK_WAITING)
+            continue;
+        
+        if (!lua_checkstack(t->co, nargs))
+            luaL_error(L, "too many values to signal");
+        for (a = 2; a <= nargs + 1; a++)
+            lua_pushvalue(L, a);
+        lua_xmove(L, t->co, nargs);
+        t->nargs = nargs;
+        makeready(s, t);
+        woken++;
+    }
+    lua_pushinteger(L, woken);
+    return 1;
+}
+
+static int Lstats(lua_State *L)     /** tasks.stats() returns resumed, milliseconds, tasks for the last frame */
+{
+    scheduler_state *s = getscheduler(L, 0);
+    lua_pushinteger(L, s ? s->resumed : 0);
+    lua_pushnumber(L, s ? (lua_Number)(s->elapsed / 1000.0) : 0);
+    lua_pushinteger(L, s ? s->ntasks : 0);
+    return 3;
+}
+
+static const luaL_reg M[] =
+{
+    { "cancel",     Lcancel     },
+    { "__tostring", Ltostring   },
+    { NULL,         NULL        }
+};
+
+static const luaL_reg R[] =
+{
+    { "spawn",      Lspawn      },
+    { "wait",       Lwait       },
+    { "waitFrames", LwaitFrames },
+    { "waitFor",    LwaitFor    },
+    { "signal",     Lsignal     },
+    { "cancel",     Lcancel     },
+    { "stats",      Lstats      },
+    { NULL,         NULL        }
+};
+
+LUALIB_API int luaopen_scheduler(lua_State *L)
+{
+    luaL_newmetatable(L, TASKTYPE);
+    luaL_openlib(L, NULL, M, 0);
+    setfieldhandlers(L, Lget, NULL, fields);
+    lua_pop(L, 1);
+    
+    luaL_register(L, CODIFY_SCHEDULERLIBNAME, R);
+    return 1;
+}
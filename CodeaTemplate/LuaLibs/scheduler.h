@@ -0,0 +1,44 @@
+//
+//  scheduler.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+
+#ifndef Codify_scheduler_h
+#define Codify_scheduler_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+
+#define CODIFY_SCHEDULERLIBNAME "tasks"
+
+LUALIB_API int (luaopen_scheduler) (lua_State *L);
+
+//Resumes the tasks that are due at time now (seconds, same clock as ElapsedTime) and advances the
+//frame count; call once per frame on the main thread. Sleeping tasks are not touched until they are due.
+//Returns a lua_pcall status, with the error message on the stack when a task failed
+int scheduler_tick(lua_State *L, double now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
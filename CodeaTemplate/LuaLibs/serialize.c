@@ -0,0 +1,526 @@
+//
+//  serialize.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "serialize.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "color.h"
+#include "matrix44.h"
+
+/*
+ * Format: 'C' 'S' version, then one value. A value is a tag byte followed by
+ * its payload; integers are LEB128 varints and floats are little-endian IEEE.
+ * Tables and strings of SERIALIZE_MINREF bytes or more are numbered in the
+ * order they are first written, and later occurrences are written as
+ * T_REF, so shared tables, cycles and repeated keys are stored once.
+ */
+
+#define SERIALIZE_MAXDEPTH  200
+#define SERIALIZE_MINREF    3   /* shorter strings are cheaper to repeat */
+
+enum
+{
+    T_NIL, T_FALSE, T_TRUE,
+    T_INT,          /* zigzag varint */
+    T_FLOAT,        /* 4 bytes */
+    T_DOUBLE,       /* 8 bytes */
+    T_STRING,       /* varint length, bytes */
+    T_TABLE,        /* varint array count, varint hash count, values, key/value pairs */
+    T_REF,          /* varint index of an earlier table or string */
+    T_VEC2, T_VEC3, T_VEC4, T_COLOR, T_MATRIX   /* floats */
+};
+
+typedef struct encoder
+{
+    lua_State *L;
+    strbuf_type *b;
+    int refs;       /* stack index of value -> ref index */
+    int nrefs;
+} encoder;
+
+typedef struct decoder
+{
+    lua_State *L;
+    const char *p;
+    const char *end;
+    int refs;       /* stack index of ref index -> value */
+    int nrefs;
+} decoder;
+
+static void putbyte(encoder *e, int c)
+{
+    char ch = (char)c;
+    strbuf_append(e->L, e->b, &ch, 1);
+}
+
+static void putvarint(encoder *e, uint32_t v)
+{
+    char s[5];
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        s[n++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    s[n++] = (char)v;
+    strbuf_append(e->L, e->b, s, n);
+}
+
+static void putfloats(encoder *e, const lua_Number *v, int n)
+{
+    char s[16 * 4];
+    int i, j;
+    for (i = 0; i < n; i++)
+    {
+        float f = (float)v[i];
+        uint32_t u;
+        memcpy(&u, &f, 4);
+        for (j = 0; j < 4; j++)
+            s[i * 4 + j] = (char)(u >> (8 * j));
+    }
+    strbuf_append(e->L, e->b, s, n * 4);
+}
+
+static void putnumber(encoder *e, lua_Number n)
+{
+    //Integral values (most of them in save data) are written as varints; -0 keeps its sign
+    if (n == n && n >= -2147483648.0 && n <= 2147483647.0 && (n != 0 || !signbit(n)))
+    {
+        int32_t i = (int32_t)n;
+        if ((lua_Number)i == n)
+        {
+            putbyte(e, T_INT);
+            putvarint(e, ((uint32_t)i << 1) ^ (uint32_t)(i >> 31));
+            return;
+        }
+    }
+    
+    if (sizeof(lua_Number) == sizeof(float) || (lua_Number)(float)n == n || n != n)
+    {
+        putbyte(e, T_FLOAT);
+        putfloats(e, &n, 1);
+    }
+    else
+    {
+        double d = (double)n;
+        uint64_t u;
+        char s[8];
+        int j;
+        memcpy(&u, &d, 8);
+        for (j = 0; j < 8; j++)
+            s[j] = (char)(u >> (8 * j));
+        putbyte(e, T_DOUBLE);
+        strbuf_append(e->L, e->b, s, 8);
+    }
+}
+
+//Writes a T_REF if the value at i was seen before, otherwise numbers it
+static int putref(encoder *e, int i)
+{
+    lua_State *L = e->L;
+    lua_pushvalue(L, i);
+    lua_rawget(L, e->refs);
+    if (!lua_isnil(L, -1))
+    {
+        int ref = (int)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        putbyte(e, T_REF);
+        putvarint(e, (uint32_t)ref);
+        return 1;
+    }
+    lua_pop(L, 1);
+    lua_pushvalue(L, i);
+    lua_pushinteger(L, e->nrefs++);
+    lua_rawset(L, e->refs);
+    return 0;
+}
+
+static int isarraykey(lua_State *L, int i, size_t n)
+{
+    lua_Number k;
+    if (lua_type(L, i) != LUA_TNUMBER)
+        return 0;
+    k = lua_tonumber(L, i);
+    return k >= 1 && k <= (lua_Number)n && (lua_Number)(size_t)k == k;
+}
+
+static void encodevalue(encoder *e, int i, int depth)
+{
+    lua_State *L = e->L;
+    lua_Number *v;
+    color_type *c;
+    
+    if (i < 0) i = lua_gettop(L) + i + 1;
+    
+    switch (lua_type(L, i))
+    {
+        case LUA_TNIL:
+            putbyte(e, T_NIL);
+            return;
+        case LUA_TBOOLEAN:
+            putbyte(e, lua_toboolean(L, i) ? T_TRUE : T_FALSE);
+            return;
+        case LUA_TNUMBER:
+            putnumber(e, lua_tonumber(L, i));
+            return;
+        case LUA_TSTRING:
+        {
+            size_t len;
+            const char *s = lua_tolstring(L, i, &len);
+            if (len >= SERIALIZE_MINREF && putref(e, i))
+                return;
+            putbyte(e, T_STRING);
+            putvarint(e, (uint32_t)len);
+            strbuf_append(L, e->b, s, len);
+            return;
+        }
+        case LUA_TTABLE:
+        {
+            size_t n, k, nhash = 0;
+            if (putref(e, i))
+                return;
+            if (depth >= SERIALIZE_MAXDEPTH)
+                luaL_error(L, "table is nested too deeply to serialize");
+            luaL_checkstack(L, 3, "table is nested too deeply to serialize");
+            
+            n = lua_objlen(L, i);
+            lua_pushnil(L);
+            while (lua_next(L, i))
+            {
+                if (!isarraykey(L, -2, n)) nhash++;
+                lua_pop(L, 1);
+            }
+            
+            putbyte(e, T_TABLE);
+            putvarint(e, (uint32_t)n);
+            putvarint(e, (uint32_t)nhash);
+            for (k = 1; k <= n; k++)
+            {
+                lua_rawgeti(L, i, (int)k);
+                encodevalue(e, -1, depth + 1);
+                lua_pop(L, 1);
+            }
+            lua_pushnil(L);
+            while (lua_next(L, i))
+            {
+                if (!isarraykey(L, -2, n))
+                {
+                    encodevalue(e, -2, depth + 1);
+                    encodevalue(e, -1, depth + 1);
+                }
+                lua_pop(L, 1);
+            }
+            return;
+        }
+        case LUA_TUSERDATA:
+            if ((v = getvec2(L, i)) != NULL)
+            {
+                putbyte(e, T_VEC2);
+                putfloats(e, v, 2);
+                return;
+            }
+            if ((v = getvec3(L, i)) != NULL)
+            {
+                putbyte(e, T_VEC3);
+                putfloats(e, v, 3);
+                return;
+            }
+            if ((v = getvec4(L, i)) != NULL)
+            {
+                putbyte(e, T_VEC4);
+                putfloats(e, v, 4);
+                return;
+            }
+            if ((c = getcolor(L, i)) != NULL)
+            {
+                lua_Number rgba[4] = { c->r, c->g, c->b, c->a };
+                putbyte(e, T_COLOR);
+                putfloats(e, rgba, 4);
+                return;
+            }
+            if ((v = getmatrix44(L, i)) != NULL)
+            {
+                putbyte(e, T_MATRIX);
+                putfloats(e, v, 16);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    
+    luaL_error(L, "cannot serialize a %s", luaL_typename(L, i));
+}
+
+void serialize_encode(lua_State *L, int i, strbuf_type *b)
+{
+    encoder e;
+    char header[3] = { 'C', 'S', SERIALIZE_VERSION };
+    
+    if (i < 0 && i > LUA_REGISTRYINDEX) i = lua_gettop(L) + i + 1;
+    strbuf_append(L, b, header, 3);
+    
+    e.L = L;
+    e.b = b;
+    lua_newtable(L);
+    e.refs = lua_gettop(L);
+    e.nrefs = 0;
+    encodevalue(&e, i, 0);
+    lua_pop(L, 1);
+}
+
+static void corrupt(decoder *d)
+{
+    luaL_error(d->L, "corrupt or truncated serialized data");
+}
+
+static const unsigned char *getbytes(decoder *d, size_t n)
+{
+    const char *p = d->p;
+    if ((size_t)(d->end - p) < n)
+        corrupt(d);
+    d->p += n;
+    return (const unsigned char*)p;
+}
+
+static uint32_t getvarint(decoder *d)
+{
+    uint32_t v = 0;
+    int shift;
+    for (shift = 0; shift < 35; shift += 7)
+    {
+        unsigned char c = *getbytes(d, 1);
+        v |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return v;
+    }
+    corrupt(d);
+    return 0;
+}
+
+static void getfloats(decoder *d, lua_Number *v, int n)
+{
+    const unsigned char *p = getbytes(d, n * 4);
+    int i;
+    for (i = 0; i < n; i++, p += 4)
+    {
+        uint32_t u = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        float f;
+        memcpy(&f, &u, 4);
+        v[i] = f;
+    }
+}
+
+static void addref(decoder *d)
+{
+    lua_pushvalue(d->L, -1);
+    lua_rawseti(d->L, d->refs, ++d->nrefs);
+}
+
+static void decodevalue(decoder *d, int depth)
+{
+    lua_State *L = d->L;
+    lua_Number v[16];
+    
+    if (depth >= SERIALIZE_MAXDEPTH)
+        corrupt(d);
+    luaL_checkstack(L, 3, "serialized data is nested too deeply");
+    
+    switch (*getbytes(d, 1))
+    {
+        case T_NIL:     lua_pushnil(L); break;
+        case T_FALSE:   lua_pushboolean(L, 0); break;
+        case T_TRUE:    lua_pushboolean(L, 1); break;
+        case T_INT:
+        {
+            uint32_t u = getvarint(d);
+            lua_pushnumber(L, (lua_Number)(int32_t)((u >> 1) ^ (0u - (u & 1))));
+            break;
+        }
+        case T_FLOAT:
+            getfloats(d, v, 1);
+            lua_pushnumber(L, v[0]);
+            break;
+        case T_DOUBLE:
+        {
+            const unsigned char *p = getbytes(d, 8);
+            uint64_t u = 0;
+            double x;
+            int j;
+            for (j = 7; j >= 0; j--)
+                u = (u << 8) | p[j];
+            memcpy(&x, &u, 8);
+            lua_pushnumber(L, (lua_Number)x);
+            break;
+        }
+        case T_STRING:
+        {
+            size_t len = getvarint(d);
+            lua_pushlstring(L, (const char*)getbytes(d, len), len);
+            if (len >= SERIALIZE_MINREF)
+                addref(d);
+            break;
+        }
+        case T_TABLE:
+        {
+            uint32_t n = getvarint(d);
+            uint32_t nhash = getvarint(d);
+            uint32_t k;
+            //Every value takes at least a byte, so bogus counts fail before allocating
+            if (n > (size_t)(d->end - d->p) || nhash > (size_t)(d->end - d->p) / 2)
+                corrupt(d);
+            lua_createtable(L, (int)n, (int)nhash);
+            addref(d);
+            for (k = 1; k <= n; k++)
+            {
+                decodevalue(d, depth + 1);
+                if (lua_isnil(L, -1))
+                    lua_pop(L, 1);
+                else
+                    lua_rawseti(L, -2, (int)k);
+            }
+            for (k = 0; k < nhash; k++)
+            {
+                decodevalue(d, depth + 1);
+                if (lua_isnil(L, -1) || (lua_isnumber(L, -1) && lua_tonumber(L, -1) != lua_tonumber(L, -1)))
+                    corrupt(d);
+                decodevalue(d, depth + 1);
+                lua_rawset(L, -3);
+            }
+            break;
+        }
+        case T_REF:
+        {
+            uint32_t ref = getvarint(d);
+            if (ref >= (uint32_t)d->nrefs)
+                corrupt(d);
+            lua_rawgeti(L, d->refs, (int)ref + 1);
+            break;
+        }
+        case T_VEC2:
+            getfloats(d, v, 2);
+            pushvec2(L, v[0], v[1]);
+            break;
+        case T_VEC3:
+            getfloats(d, v, 3);
+            pushvec3(L, v[0], v[1], v[2]);
+            break;
+        case T_VEC4:
+            getfloats(d, v, 4);
+            pushvec4(L, v[0], v[1], v[2], v[3]);
+            break;
+        case T_COLOR:
+            getfloats(d, v, 4);
+            pushcolor(L, v[0], v[1], v[2], v[3]);
+            break;
+        case T_MATRIX:
+            getfloats(d, v, 16);
+            pushmatrix44(L, v);
+            break;
+        default:
+            corrupt(d);
+    }
+}
+
+size_t serialize_decode(lua_State *L, const char *data, size_t len)
+{
+    decoder d;
+    const unsigned char *header;
+    
+    d.L = L;
+    d.p = data;
+    d.end = data + len;
+    header = getbytes(&d, 3);
+    if (header[0] != 'C' || header[1] != 'S')
+        luaL_error(L, "not serialized data");
+    if (header[2] != SERIALIZE_VERSION)
+        luaL_error(L, "unsupported serialize version %d", (int)header[2]);
+    
+    lua_newtable(L);
+    d.refs = lua_gettop(L);
+    d.nrefs = 0;
+    decodevalue(&d, 0);
+    lua_remove(L, d.refs);
+    return (size_t)(d.p - data);
+}
+
+static int Lencode(lua_State *L)    /** serialize.encode(value, [strbuf]) */
+{
+    strbuf_type *b;
+    luaL_checkany(L, 1);
+    
+    if (!lua_isnoneornil(L, 2))
+    {
+        //Append to the caller's buffer and hand it back
+        b = checkstrbuf(L, 2);
+        lua_settop(L, 2);
+        serialize_encode(L, 1, b);
+        return 1;
+    }
+    
+    lua_settop(L, 1);
+    b = pushstrbuf(L, 256);
+    serialize_encode(L, 1, b);
+    lua_pushlstring(L, b->len ? b->data : "", b->len);
+    return 1;
+}
+
+static int Ldecode(lua_State *L)    /** serialize.decode(string or strbuf, [pos]) -> value, nextpos */
+{
+    size_t len, used;
+    const char *data;
+    strbuf_type *b = getstrbuf(L, 1);
+    ptrdiff_t pos = luaL_optinteger(L, 2, 1) - 1;
+    
+    if (b)
+    {
+        data = b->data;
+        len = b->len;
+    }
+    else
+        data = luaL_checklstring(L, 1, &len);
+    
+    luaL_argcheck(L, pos >= 0 && (size_t)pos <= len, 2, "position out of range");
+    used = serialize_decode(L, data + pos, len - pos);
+    lua_pushinteger(L, (lua_Integer)(pos + used + 1));
+    return 2;
+}
+
+static const luaL_reg R[] =
+{
+    { "encode",     Lencode     },
+    { "decode",     Ldecode     },
+    { NULL,         NULL        }
+};
+
+LUALIB_API int luaopen_serialize(lua_State *L)
+{
+    luaL_register(L, CODIFY_SERIALIZELIBNAME, R);
+    lua_pushinteger(L, SERIALIZE_VERSION);
+    lua_setfield(L, -2, "version");
+    return 1;
+}
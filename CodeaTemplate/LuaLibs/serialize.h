@@ -0,0 +1,51 @@
+//
+//  serialize.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#ifndef Codify_serialize_h
+#define Codify_serialize_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "lua.h"
+#include "strbuf.h"
+
+#define CODIFY_SERIALIZELIBNAME "serialize"
+
+//Bumped whenever the encoding changes; decode rejects other versions
+#define SERIALIZE_VERSION   1
+
+LUALIB_API int (luaopen_serialize) (lua_State *L);
+
+//Appends the encoding of the value at index i to b. Raises a Lua error for values that cannot be encoded
+void serialize_encode(lua_State *L, int i, strbuf_type *b);
+
+//Pushes the value encoded at the start of data, reading strings straight from the buffer,
+//and returns the number of bytes it used. Raises a Lua error if the data is corrupt or truncated
+size_t serialize_decode(lua_State *L, const char *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
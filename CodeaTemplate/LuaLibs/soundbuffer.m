@@ -22,12 +22,16 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "soundbuffer.h"
+#include "codea_luaext.h"
 
 #import "ALBuffer.h"
 
 #define SOUNDBUFFERTYPE "codeasoundbuffer"
 #define SOUNDBUFFERSIZE sizeof(soundbuffer_type)
 
+enum { FIELD_FORMAT, FIELD_FREQUENCY, FIELD_CHANNELS, FIELD_DURATION };
+static const char *const fields[] = { "format", "frequency", "channels", "duration", NULL };
+
 static ALBuffer* newBuffer(const char* data, size_t len, ALenum format, ALsizei freq)
 {
     return [ALBuffer bufferWithName:nil data:(void*)data size:len format:format frequency:freq];
@@ -90,31 +94,15 @@ static int Lnew( lua_State *L )
 
 static int Lget( lua_State *L )
 {
-    soundbuffer_type *v=Pget(L,1);
-    const char* c = luaL_checkstring(L,2);
+    soundbuffer_type *v=checkfieldudata(L,1,SOUNDBUFFERTYPE);
     
-    if( strcmp(c, "format") == 0 )
-    {
-        lua_pushnumber(L, [v->buffer format]);
-    }
-    else if( strcmp(c, "frequency") == 0 )
-    {
-        lua_pushnumber(L, [v->buffer frequency]);        
-    }
-    else if( strcmp(c, "channels") == 0 )
+    switch( fieldindex(L,2) )
     {
-        lua_pushnumber(L, [v->buffer channels]);        
-    }
-    else if( strcmp(c, "duration") == 0 )
-    {
-        lua_pushnumber(L, [v->buffer duration]);        
-    }
-    else
-    {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, SOUNDBUFFERTYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);
+        case FIELD_FORMAT:    lua_pushnumber(L, [v->buffer format]); break;
+        case FIELD_FREQUENCY: lua_pushnumber(L, [v->buffer frequency]); break;
+        case FIELD_CHANNELS:  lua_pushnumber(L, [v->buffer channels]); break;
+        case FIELD_DURATION:  lua_pushnumber(L, [v->buffer duration]); break;
+        default: break;     //The method (or nil) for key is on the stack
     }
     
     return 1;
@@ -136,7 +124,6 @@ static int Ltostring(lua_State *L)
 
 static const luaL_reg R[] =
 {
-    { "__index", Lget },
     //{ "__newindex",	Lset		},
     { "__tostring", Ltostring },
     { "__gc", Lgc },
@@ -147,11 +134,8 @@ LUALIB_API int luaopen_soundbuffer(lua_State *L)
 {
     luaL_newmetatable(L,SOUNDBUFFERTYPE);
     
-    lua_pushstring(L, "__index");
-    lua_pushvalue(L, -2);   // pushes the metatable
-    lua_settable(L, -3);    // metatable.__index = metatable
-    
     luaL_register(L, NULL, R);
+    setfieldhandlers(L, Lget, NULL, fields);
     
     lua_register(L,"soundbuffer",Lnew);
     
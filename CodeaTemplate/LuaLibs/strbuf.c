@@ -0,0 +1,315 @@
+//
+//  strbuf.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strbuf.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "codea_luaext.h"
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "color.h"
+
+#define STRBUFTYPE      "strbuf"
+#define STRBUFMINSIZE   64
+
+static void pushmetatable(lua_State *L);
+
+strbuf_type *getstrbuf(lua_State *L, int i)
+{
+    if( lua_isuserdata(L, i) )
+    {
+        return testudata(L, i, STRBUFTYPE);
+    }
+    
+    return NULL;
+}
+
+strbuf_type *checkstrbuf(lua_State *L, int i)
+{
+    strbuf_type *b = getstrbuf(L, i);
+    if (b == NULL) luaL_typerror(L, i, STRBUFTYPE);
+    return b;
+}
+
+static void reserve(lua_State *L, strbuf_type *b, size_t extra)
+{
+    size_t size;
+    char *data;
+    
+    if (b->size - b->len >= extra)
+        return;
+    
+    if (extra > ((size_t)-1) / 2 - b->len)
+        luaL_error(L, "strbuf too large");
+    
+    //Double so a run of appends costs amortised O(1) per byte
+    size = b->size < STRBUFMINSIZE ? STRBUFMINSIZE : b->size;
+    while (size - b->len < extra) size *= 2;
+    
+    data = realloc(b->data, size);
+    if (data == NULL)
+        luaL_error(L, "not enough memory");
+    b->data = data;
+    b->size = size;
+}
+
+strbuf_type *pushstrbuf(lua_State *L, size_t size)
+{
+    strbuf_type *b = lua_newuserdata(L, sizeof(strbuf_type));
+    b->data = NULL;
+    b->len = 0;
+    b->size = 0;
+    pushmetatable(L);
+    lua_setmetatable(L, -2);
+    if (size > 0) reserve(L, b, size);
+    return b;
+}
+
+void strbuf_append(lua_State *L, strbuf_type *b, const char *s, size_t len)
+{
+    reserve(L, b, len);
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+}
+
+void strbuf_appendvalue(lua_State *L, strbuf_type *b, int i)
+{
+    char s[FORMATNUMBERS_SIZE(4)];
+    size_t len;
+    const char *str;
+    lua_Number *v;
+    color_type *c;
+    strbuf_type *other;
+    
+    switch (lua_type(L, i))
+    {
+        case LUA_TSTRING:
+            str = lua_tolstring(L, i, &len);
+            strbuf_append(L, b, str, len);
+            return;
+        case LUA_TNUMBER:
+            len = lua_number2str(s, lua_tonumber(L, i));
+            strbuf_append(L, b, s, len);
+            return;
+        case LUA_TBOOLEAN:
+            if (lua_toboolean(L, i)) strbuf_append(L, b, "true", 4);
+            else strbuf_append(L, b, "false", 5);
+            return;
+        case LUA_TNIL:
+            strbuf_append(L, b, "nil", 3);
+            return;
+        case LUA_TUSERDATA:
+            //Format the common value types in place, matching their __tostring
+            if ((v = getvec2(L, i)) != NULL)
+                len = formatnumbers(s, v, 2);
+            else if ((v = getvec3(L, i)) != NULL)
+                len = formatnumbers(s, v, 3);
+            else if ((v = getvec4(L, i)) != NULL)
+                len = formatnumbers(s, v, 4);
+            else if ((c = getcolor(L, i)) != NULL)
+            {
+                lua_Number cv[4] = { c->r, c->g, c->b, c->a };
+                len = formatnumbers(s, cv, 4);
+            }
+            else if ((other = getstrbuf(L, i)) != NULL)
+            {
+                //Reserve first, other may be b itself
+                reserve(L, b, other->len);
+                memcpy(b->data + b->len, other->data, other->len);
+                b->len += other->len;
+                return;
+            }
+            else
+                break;
+            strbuf_append(L, b, s, len);
+            return;
+        default:
+            break;
+    }
+    
+    if (luaL_callmeta(L, i, "__tostring"))
+    {
+        if (!lua_isstring(L, -1))
+            luaL_error(L, "'__tostring' must return a string");
+        str = lua_tolstring(L, -1, &len);
+        strbuf_append(L, b, str, len);
+        lua_pop(L, 1);
+        return;
+    }
+    
+    len = sprintf(s, "%s: %p", luaL_typename(L, i), lua_topointer(L, i));
+    strbuf_append(L, b, s, len);
+}
+
+static int Lnew(lua_State *L)     /** strbuf([capacity or string]) */
+{
+    if (lua_type(L, 1) == LUA_TNUMBER)
+    {
+        lua_Number n = lua_tonumber(L, 1);
+        luaL_argcheck(L, n >= 0, 1, "capacity must not be negative");
+        pushstrbuf(L, (size_t)n);
+    }
+    else if (lua_isnoneornil(L, 1))
+        pushstrbuf(L, 0);
+    else
+    {
+        size_t len;
+        const char *s = luaL_checklstring(L, 1, &len);
+        strbuf_type *b = pushstrbuf(L, len);
+        strbuf_append(L, b, s, len);
+    }
+    return 1;
+}
+
+static int Lappend(lua_State *L)  /** sb:append(...) */
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    int i, n = lua_gettop(L);
+    for (i = 2; i <= n; i++)
+        strbuf_appendvalue(L, b, i);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int formatwriter(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    strbuf_append(L, (strbuf_type*)ud, (const char*)p, sz);
+    return 0;
+}
+
+static int Lformat(lua_State *L)  /** sb:format(fmt, ...) */
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    luaL_writeformat(L, 2, formatwriter, b);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lconcat(lua_State *L)  /** sb:concat(t, [sep], [i], [j]) */
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    size_t lsep;
+    const char *sep = luaL_optlstring(L, 3, "", &lsep);
+    int i, last;
+    luaL_checktype(L, 2, LUA_TTABLE);
+    i = luaL_optint(L, 4, 1);
+    last = luaL_opt(L, luaL_checkint, 5, luaL_getn(L, 2));
+    
+    for (; i <= last; i++)
+    {
+        lua_rawgeti(L, 2, i);
+        if (!lua_isstring(L, -1) && getstrbuf(L, -1) == NULL)
+            return luaL_error(L, "invalid value (at index %d) in table for 'concat'", i);
+        strbuf_appendvalue(L, b, -1);
+        lua_pop(L, 1);
+        if (i < last) strbuf_append(L, b, sep, lsep);
+    }
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lreserve(lua_State *L) /** sb:reserve(n) */
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "size must not be negative");
+    reserve(L, b, (size_t)n);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lclear(lua_State *L)   /** sb:clear() keeps the allocation for reuse */
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    b->len = 0;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Llen(lua_State *L)
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    lua_pushinteger(L, (lua_Integer)b->len);
+    return 1;
+}
+
+static int Lcapacity(lua_State *L)
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    lua_pushinteger(L, (lua_Integer)b->size);
+    return 1;
+}
+
+static int Ltostring(lua_State *L)
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    lua_pushlstring(L, b->len ? b->data : "", b->len);
+    return 1;
+}
+
+static int Lgc(lua_State *L)
+{
+    strbuf_type *b = checkstrbuf(L, 1);
+    free(b->data);
+    b->data = NULL;
+    b->len = b->size = 0;
+    return 0;
+}
+
+static const luaL_reg R[] =
+{
+    { "append",     Lappend     },
+    { "format",     Lformat     },
+    { "concat",     Lconcat     },
+    { "reserve",    Lreserve    },
+    { "clear",      Lclear      },
+    { "len",        Llen        },
+    { "capacity",   Lcapacity   },
+    { "tostring",   Ltostring   },
+    { "__tostring", Ltostring   },
+    { "__len",      Llen        },
+    { "__gc",       Lgc         },
+    { NULL,         NULL        }
+};
+
+//Created on first use too, so C code can make strbufs in states that never opened the library
+static void pushmetatable(lua_State *L)
+{
+    if (luaL_newmetatable(L,STRBUFTYPE))
+    {
+        luaL_openlib(L,NULL,R,0);
+        lua_pushvalue(L,-1);
+        lua_setfield(L,-2,"__index");
+    }
+}
+
+LUALIB_API int luaopen_strbuf(lua_State *L)
+{
+    pushmetatable(L);
+    lua_register(L,"strbuf",Lnew);
+    return 1;
+}
@@ -0,0 +1,50 @@
+//
+//  strbuf.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#ifndef Codify_strbuf_h
+#define Codify_strbuf_h
+
+#include <stddef.h>
+
+#include "lua.h"
+
+#define CODIFY_STRBUFLIBNAME "strbuf"
+
+typedef struct strbuf_type_t
+{
+    char *data;
+    size_t len;
+    size_t size;
+} strbuf_type;
+
+LUALIB_API int (luaopen_strbuf) (lua_State *L);
+strbuf_type *getstrbuf(lua_State *L, int i);
+strbuf_type *checkstrbuf(lua_State *L, int i);
+
+//Creates an empty strbuf on the stack with room for size bytes
+strbuf_type *pushstrbuf(lua_State *L, size_t size);
+
+//Appends bytes, growing the buffer geometrically. Raises a Lua error when out of memory
+void strbuf_append(lua_State *L, strbuf_type *b, const char *s, size_t len);
+
+//Appends the value at index i the way tostring would format it
+void strbuf_appendvalue(lua_State *L, strbuf_type *b, int i);
+
+#endif
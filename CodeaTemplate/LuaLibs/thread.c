@@ -0,0 +1,629 @@
+//
+//  thread.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "thread.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "strbuf.h"
+#include "serialize.h"
+
+#define THREAD_MAXWORKERS   4
+#define THREAD_QUEUESIZE    256     /* per worker and direction, power of two */
+#define THREAD_CHECKCOUNT   1000    /* instructions between shutdown checks in jobs */
+#define THREAD_CHUNKCACHE   64      /* compiled job chunks kept per worker */
+
+#define THREADPOOL          "codeathreadpool"
+#define THREADWORKER        "codeathreadworker"
+#define THREADENV           "codeathreadenv"
+#define THREADCHUNKS        "codeathreadchunks"
+
+enum { MSG_JOB, MSG_RESULT, MSG_ERROR, MSG_POST };
+
+typedef struct thread_message
+{
+    int kind;
+    int job;
+    size_t len;
+    char data[1];
+} thread_message;
+
+//Lock-free single producer, single consumer ring
+typedef struct thread_queue
+{
+    atomic_size_t head;     /* next slot to read, advanced by the consumer */
+    atomic_size_t tail;     /* next slot to write, advanced by the producer */
+    thread_message *slot[THREAD_QUEUESIZE];
+} thread_queue;
+
+struct thread_pool;
+
+typedef struct thread_worker
+{
+    struct thread_pool *pool;
+    pthread_t thread;
+    thread_queue jobs;          /* main -> worker */
+    thread_queue results;       /* worker -> main */
+    pthread_mutex_t lock;       /* only used to sleep while there are no jobs */
+    pthread_cond_t wake;
+    int pending;                /* jobs without a result yet, main thread only */
+    int current;                /* job being run, worker thread only */
+    int nchunks;                /* entries in the chunk cache, worker thread only */
+} thread_worker;
+
+typedef struct thread_pool
+{
+    atomic_int quit;
+    int nworkers;
+    int nextjob;
+    thread_worker worker[THREAD_MAXWORKERS];
+} thread_pool;
+
+static lua_CFunction openworkerlibs = NULL;
+
+void thread_setopenlibs(lua_CFunction openlibs)
+{
+    openworkerlibs = openlibs;
+}
+
+static int queue_push(thread_queue *q, thread_message *m)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&q->head, memory_order_acquire) == THREAD_QUEUESIZE)
+        return 0;
+    q->slot[tail & (THREAD_QUEUESIZE - 1)] = m;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static thread_message *queue_pop(thread_queue *q)
+{
+    thread_message *m;
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+        return NULL;
+    m = q->slot[head & (THREAD_QUEUESIZE - 1)];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return m;
+}
+
+static int queue_empty(thread_queue *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) == atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+//Messages are a sequence of values in the serialize format
+
+typedef struct thread_reader
+{
+    const char *p;
+    const char *end;
+} thread_reader;
+
+//Pushes the next value of a message
+static void decodevalue(lua_State *L, thread_reader *r)
+{
+    r->p += serialize_decode(L, r->p, (size_t)(r->end - r->p));
+}
+
+//Encodes the values first..last into a new message
+static thread_message *newmessage(lua_State *L, int kind, int job, int first, int last)
+{
+    thread_message *m;
+    strbuf_type *b;
+    int i;
+    
+    if (first < 0) first = lua_gettop(L) + first + 1;
+    if (last < 0) last = lua_gettop(L) + last + 1;
+    b = pushstrbuf(L, 64);
+    for (i = first; i <= last; i++)
+        serialize_encode(L, i, b);
+    
+    m = malloc(sizeof(thread_message) + b->len);
+    if (m == NULL)
+        luaL_error(L, "not enough memory");
+    m->kind = kind;
+    m->job = job;
+    m->len = b->len;
+    if (b->len) memcpy(m->data, b->data, b->len);
+    lua_pop(L, 1);
+    return m;
+}
+
+//Worker side
+
+static thread_worker *getworker(lua_State *L)
+{
+    thread_worker *w;
+    lua_getfield(L, LUA_REGISTRYINDEX, THREADWORKER);
+    w = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return w;
+}
+
+static void post(thread_worker *w, thread_message *m)
+{
+    //The main thread drains results every frame; wait for room if it falls behind
+    while (!queue_push(&w->results, m))
+    {
+        if (atomic_load(&w->pool->quit))
+        {
+            free(m);
+            return;
+        }
+        usleep(1000);
+    }
+}
+
+static void shutdownhook(lua_State *L, lua_Debug *ar)
+{
+    thread_worker *w = getworker(L);
+    (void)ar;
+    if (w && atomic_load(&w->pool->quit))
+        luaL_error(L, "thread pool was shut down");
+}
+
+static int Wsend(lua_State *L)      /** thread.send(value) inside a job */
+{
+    thread_worker *w = getworker(L);
+    lua_settop(L, 1);
+    post(w, newmessage(L, MSG_POST, w->current, 1, 1));
+    return 0;
+}
+
+static const luaL_reg W[] =
+{
+    { "send",   Wsend   },
+    { NULL,     NULL    }
+};
+
+static int Wopen(lua_State *L)
+{
+    thread_worker *w = lua_touserdata(L, 1);
+    
+    if (openworkerlibs)
+        openworkerlibs(L);
+    else
+    {
+        lua_pushcfunction(L, luaopen_base); lua_call(L, 0, 0);
+        lua_pushcfunction(L, luaopen_table); lua_call(L, 0, 0);
+        lua_pushcfunction(L, luaopen_string); lua_call(L, 0, 0);
+        lua_pushcfunction(L, luaopen_math); lua_call(L, 0, 0);
+    }
+    luaL_register(L, CODIFY_THREADLIBNAME, W);
+    
+    lua_pushlightuserdata(L, w);
+    lua_setfield(L, LUA_REGISTRYINDEX, THREADWORKER);
+    
+    //Every job gets its own globals, falling back to the libraries
+    lua_newtable(L);
+    lua_pushvalue(L, LUA_GLOBALSINDEX);
+    lua_setfield(L, -2, "__index");
+    lua_setfield(L, LUA_REGISTRYINDEX, THREADENV);
+    
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, THREADCHUNKS);
+    
+    lua_sethook(L, shutdownhook, LUA_MASKCOUNT, THREAD_CHECKCOUNT);
+    return 0;
+}
+
+static int Wrun(lua_State *L)
+{
+    thread_message *m = lua_touserdata(L, 1);
+    thread_worker *w = getworker(L);
+    thread_reader r;
+    int base;
+    
+    r.p = m->data;
+    r.end = m->data + m->len;
+    decodevalue(L, &r);     /* 2: chunk */
+    
+    //Compiled chunks are cached by their source or bytecode
+    lua_getfield(L, LUA_REGISTRYINDEX, THREADCHUNKS);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    if (lua_isnil(L, -1))
+    {
+        size_t len;
+        const char *code = lua_tolstring(L, 2, &len);
+        lua_pop(L, 1);
+        if (luaL_loadbuffer(L, code, len, "=thread"))
+            lua_error(L);
+        if (w->nchunks++ == THREAD_CHUNKCACHE)
+        {
+            lua_newtable(L);
+            lua_replace(L, 3);
+            lua_pushvalue(L, 3);
+            lua_setfield(L, LUA_REGISTRYINDEX, THREADCHUNKS);
+            w->nchunks = 1;
+        }
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, 3);
+    }
+    
+    lua_newtable(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, THREADENV);
+    lua_setmetatable(L, -2);
+    lua_setfenv(L, -2);
+    
+    base = lua_gettop(L);
+    while (r.p < r.end)
+        decodevalue(L, &r);
+    
+    w->current = m->job;
+    lua_call(L, lua_gettop(L) - base, 1);
+    post(w, newmessage(L, MSG_RESULT, m->job, -1, -1));
+    return 0;
+}
+
+static void *workermain(void *ud)
+{
+    thread_worker *w = ud;
+    thread_pool *pool = w->pool;
+    lua_State *L = luaL_newstate();
+    
+    if (L && lua_cpcall(L, Wopen, w) != 0)
+    {
+        lua_close(L);
+        L = NULL;
+    }
+    
+    for (;;)
+    {
+        thread_message *m = queue_pop(&w->jobs);
+        if (m == NULL)
+        {
+            pthread_mutex_lock(&w->lock);
+            while (!atomic_load(&pool->quit) && queue_empty(&w->jobs))
+                pthread_cond_wait(&w->wake, &w->lock);
+            pthread_mutex_unlock(&w->lock);
+            if (atomic_load(&pool->quit))
+                break;
+            continue;
+        }
+        
+        if (L == NULL)
+        {
+            static const char err[] = "could not create a Lua state for the thread";
+            thread_message *e = malloc(sizeof(thread_message) + sizeof(err));
+            if (e)
+            {
+                e->kind = MSG_ERROR;
+                e->job = m->job;
+                e->len = sizeof(err) - 1;
+                memcpy(e->data, err, sizeof(err));
+                post(w, e);
+            }
+        }
+        else if (lua_cpcall(L, Wrun, m) != 0)
+        {
+            size_t len;
+            const char *err = lua_tolstring(L, -1, &len);
+            thread_message *e;
+            if (err == NULL) { err = "error in thread"; len = strlen(err); }
+            e = malloc(sizeof(thread_message) + len);
+            if (e)
+            {
+                e->kind = MSG_ERROR;
+                e->job = m->job;
+                e->len = len;
+                memcpy(e->data, err, len);
+                post(w, e);
+            }
+            lua_settop(L, 0);
+        }
+        free(m);
+    }
+    
+    if (L) lua_close(L);
+    return NULL;
+}
+
+//Main thread side
+
+static int Lgc(lua_State *L)
+{
+    thread_pool *pool = lua_touserdata(L, 1);
+    thread_message *m;
+    int i;
+    
+    atomic_store(&pool->quit, 1);
+    for (i = 0; i < pool->nworkers; i++)
+    {
+        pthread_mutex_lock(&pool->worker[i].lock);
+        pthread_cond_signal(&pool->worker[i].wake);
+        pthread_mutex_unlock(&pool->worker[i].lock);
+    }
+    for (i = 0; i < pool->nworkers; i++)
+    {
+        thread_worker *w = &pool->worker[i];
+        pthread_join(w->thread, NULL);
+        while ((m = queue_pop(&w->jobs)) != NULL) free(m);
+        while ((m = queue_pop(&w->results)) != NULL) free(m);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->wake);
+    }
+    pool->nworkers = 0;
+    return 0;
+}
+
+//Pushes the pool (or nil), starting the workers when create is set
+static thread_pool *getpool(lua_State *L, int create)
+{
+    thread_pool *pool;
+    long ncpu;
+    int i, n;
+    
+    lua_getfield(L, LUA_REGISTRYINDEX, THREADPOOL);
+    pool = lua_touserdata(L, -1);
+    if (pool || !create)
+        return pool;
+    lua_pop(L, 1);
+    
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    n = ncpu > 1 ? (int)ncpu - 1 : 1;   /* leave a core for rendering */
+    if (n > THREAD_MAXWORKERS) n = THREAD_MAXWORKERS;
+    
+    pool = lua_newuserdata(L, sizeof(thread_pool));
+    memset(pool, 0, sizeof(thread_pool));
+    atomic_init(&pool->quit, 0);
+    
+    lua_newtable(L);
+    lua_pushcfunction(L, Lgc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    
+    //Callbacks by job id
+    lua_newtable(L);
+    lua_setfenv(L, -2);
+    
+    for (i = 0; i < n; i++)
+    {
+        thread_worker *w = &pool->worker[i];
+        w->pool = pool;
+        atomic_init(&w->jobs.head, 0);
+        atomic_init(&w->jobs.tail, 0);
+        atomic_init(&w->results.head, 0);
+        atomic_init(&w->results.tail, 0);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->wake, NULL);
+        if (pthread_create(&w->thread, NULL, workermain, w) != 0)
+        {
+            pthread_mutex_destroy(&w->lock);
+            pthread_cond_destroy(&w->wake);
+            break;
+        }
+        pool->nworkers++;
+    }
+    
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, THREADPOOL);
+    
+    if (pool->nworkers == 0)
+        luaL_error(L, "could not start worker threads");
+    return pool;
+}
+
+static int dumpwriter(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    strbuf_append(L, (strbuf_type*)ud, (const char*)p, sz);
+    return 0;
+}
+
+//Pushes the code for a job: a Lua function (as bytecode), the name of a global Lua function, or source
+static void pushjobchunk(lua_State *L, int i)
+{
+    strbuf_type *b;
+    
+    if (lua_type(L, i) == LUA_TSTRING)
+    {
+        lua_getglobal(L, lua_tostring(L, i));
+        if (!lua_isfunction(L, -1) || lua_iscfunction(L, -1))
+        {
+            lua_pop(L, 1);
+            lua_pushvalue(L, i);
+            return;
+        }
+        lua_replace(L, i);
+    }
+    
+    luaL_argcheck(L, lua_isfunction(L, i) && !lua_iscfunction(L, i), i, "Lua function, function name or source expected");
+    if (lua_getupvalue(L, i, 1) != NULL)
+        luaL_argerror(L, i, "job function cannot use upvalues (locals from an enclosing scope)");
+    
+    b = pushstrbuf(L, 1024);
+    lua_pushvalue(L, i);
+    if (lua_dump(L, dumpwriter, b) != 0)
+        luaL_error(L, "unable to dump job function");
+    lua_pop(L, 1);
+    lua_pushlstring(L, b->data, b->len);
+    lua_remove(L, -2);
+}
+
+static int Lspawn(lua_State *L)     /** thread.spawn(job, [arg], [ondone], [onmessage]) */
+{
+    thread_pool *pool;
+    thread_worker *w;
+    thread_message *m;
+    int i, id;
+    
+    luaL_checkany(L, 1);
+    if (!lua_isnoneornil(L, 3)) luaL_checktype(L, 3, LUA_TFUNCTION);
+    if (!lua_isnoneornil(L, 4)) luaL_checktype(L, 4, LUA_TFUNCTION);
+    lua_settop(L, 4);
+    
+    pool = getpool(L, 1);                       /* 5 */
+    
+    //Least busy worker
+    w = &pool->worker[0];
+    for (i = 1; i < pool->nworkers; i++)
+        if (pool->worker[i].pending < w->pending)
+            w = &pool->worker[i];
+    
+    pushjobchunk(L, 1);                         /* 6 */
+    lua_pushvalue(L, 2);                        /* 7 */
+    id = ++pool->nextjob;
+    m = newmessage(L, MSG_JOB, id, 6, 7);
+    
+    if (!queue_push(&w->jobs, m))
+    {
+        free(m);
+        return luaL_error(L, "too many pending thread jobs");
+    }
+    w->pending++;
+    
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    
+    //Callbacks by job id
+    lua_getfenv(L, 5);
+    lua_createtable(L, 2, 0);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, 4);
+    lua_rawseti(L, -2, 2);
+    lua_rawseti(L, -2, id);
+    
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+static int Ldeliver(lua_State *L)
+{
+    thread_message *m = lua_touserdata(L, 1);
+    thread_reader r;
+    
+    lua_getfield(L, LUA_REGISTRYINDEX, THREADPOOL);
+    lua_getfenv(L, -1);                         /* 3: callbacks */
+    lua_rawgeti(L, 3, m->job);                  /* 4 */
+    if (!lua_istable(L, 4))
+        return 0;
+    
+    if (m->kind != MSG_POST)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, 3, m->job);
+    }
+    
+    lua_rawgeti(L, 4, m->kind == MSG_POST ? 2 : 1);
+    if (lua_isnil(L, -1))
+    {
+        //Nobody is listening; unhandled job errors still get reported
+        if (m->kind == MSG_ERROR)
+        {
+            lua_pushlstring(L, m->data, m->len);
+            lua_error(L);
+        }
+        return 0;
+    }
+    
+    if (m->kind == MSG_ERROR)
+    {
+        lua_pushnil(L);
+        lua_pushlstring(L, m->data, m->len);
+        lua_call(L, 2, 0);
+    }
+    else
+    {
+        r.p = m->data;
+        r.end = m->data + m->len;
+        decodevalue(L, &r);
+        lua_call(L, 1, 0);
+    }
+    return 0;
+}
+
+int thread_poll(lua_State *L)
+{
+    thread_pool *pool = getpool(L, 0);
+    int i;
+    
+    lua_pop(L, 1);
+    if (pool == NULL)
+        return 0;
+    
+    for (i = 0; i < pool->nworkers; i++)
+    {
+        thread_worker *w = &pool->worker[i];
+        thread_message *m;
+        while ((m = queue_pop(&w->results)) != NULL)
+        {
+            int status;
+            if (m->kind != MSG_POST)
+                w->pending--;
+            lua_pushcfunction(L, Ldeliver);
+            lua_pushlightuserdata(L, m);
+            status = lua_pcall(L, 1, 0, 0);
+            free(m);
+            if (status != 0)
+                return status;  /* the rest is delivered on the next poll */
+        }
+    }
+    return 0;
+}
+
+static int Lpoll(lua_State *L)
+{
+    if (thread_poll(L) != 0)
+        lua_error(L);
+    return 0;
+}
+
+static int Lpending(lua_State *L)
+{
+    thread_pool *pool = getpool(L, 0);
+    int i, n = 0;
+    if (pool)
+        for (i = 0; i < pool->nworkers; i++)
+            n += pool->worker[i].pending;
+    lua_pushinteger(L, n);
+    return 1;
+}
+
+static int Lworkers(lua_State *L)
+{
+    thread_pool *pool = getpool(L, 1);
+    lua_pushinteger(L, pool->nworkers);
+    return 1;
+}
+
+static const luaL_reg R[] =
+{
+    { "spawn",      Lspawn      },
+    { "poll",       Lpoll       },
+    { "pending",    Lpending    },
+    { "workers",    Lworkers    },
+    { NULL,         NULL        }
+};
+
+LUALIB_API int luaopen_thread(lua_State *L)
+{
+    luaL_register(L, CODIFY_THREADLIBNAME, R);
+    return 1;
+}
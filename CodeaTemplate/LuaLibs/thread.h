@@ -0,0 +1,45 @@
+//
+//  thread.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#ifndef Codify_thread_h
+#define Codify_thread_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+
+#define CODIFY_THREADLIBNAME "thread"
+
+LUALIB_API int (luaopen_thread) (lua_State *L);
+
+//Opens the libraries available to jobs in a fresh worker state. Must be set before the first spawn
+void thread_setopenlibs(lua_CFunction openlibs);
+
+//Delivers finished results and messages to their callbacks; call once per frame on the main thread.
+//Returns a lua_pcall status, with the error message on the stack when non-zero
+int thread_poll(lua_State *L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+//
+//  tilegrid.cpp
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#include "tilegrid.h"
+
+#include <algorithm>
+
+TileGrid::TileGrid(float tileWidth, float tileHeight)
+    : width_(0), height_(0), chunksWide_(0), tileWidth_(tileWidth), tileHeight_(tileHeight),
+      columns_(0), rows_(0), cellS_(0), cellT_(0), rebuilds_(0)
+{
+}
+
+void TileGrid::resize(int width, int height)
+{
+    //Both vectors are allocated before anything changes, so a failed resize keeps the old grid
+    std::vector<tile_id> tiles((size_t)width * height, 0);
+    int newChunksWide = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<Chunk> chunks((size_t)newChunksWide * ((height + CHUNK_SIZE - 1) / CHUNK_SIZE));
+    int w = std::min(width, width_), h = std::min(height, height_);
+    
+    for (int y = 0; y < h; y++)
+    {
+        std::copy(tiles_.begin() + (size_t)y * width_, tiles_.begin() + (size_t)y * width_ + w, tiles.begin() + (size_t)y * width);
+    }
+    
+    width_ = width;
+    height_ = height;
+    chunksWide_ = newChunksWide;
+    tiles_.swap(tiles);
+    
+    //Every chunk starts over, counting the tiles that were kept
+    chunks_.swap(chunks);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            if (get(x, y))
+            {
+                chunks_[(y / CHUNK_SIZE) * chunksWide_ + x / CHUNK_SIZE].tiles++;
+            }
+        }
+    }
+}
+
+void TileGrid::set(int x, int y, tile_id tile)
+{
+    tile_id &t = tiles_[(size_t)y * width_ + x];
+    
+    if (t != tile)
+    {
+        Chunk &c = chunks_[(y / CHUNK_SIZE) * chunksWide_ + x / CHUNK_SIZE];
+        
+        c.tiles += (tile != 0) - (t != 0);
+        c.dirty = true;
+        t = tile;
+    }
+}
+
+void TileGrid::fill(int x, int y, int w, int h, tile_id tile)
+{
+    int x1 = std::min(x + w, width_), y1 = std::min(y + h, height_);
+    
+    for (int j = std::max(y, 0); j < y1; j++)
+    {
+        for (int i = std::max(x, 0); i < x1; i++)
+        {
+            set(i, j, tile);
+        }
+    }
+}
+
+void TileGrid::setAtlas(float contentWidth, float contentHeight, float textureWidth, float textureHeight)
+{
+    columns_ = (int)(contentWidth / tileWidth_);
+    rows_ = (int)(contentHeight / tileHeight_);
+    cellS_ = tileWidth_ / textureWidth;
+    cellT_ = tileHeight_ / textureHeight;
+    
+    for (size_t i = 0; i < chunks_.size(); i++)
+    {
+        chunks_[i].dirty = true;
+    }
+}
+
+void TileGrid::visibleChunks(const float* clip, std::vector<int>& visible) const
+{
+    float cw = CHUNK_SIZE * tileWidth_, ch = CHUNK_SIZE * tileHeight_;
+    
+    visible.clear();
+    for (int i = 0; i < (int)chunks_.size(); i++)
+    {
+        if (chunks_[i].tiles == 0)
+        {
+            continue;
+        }
+        
+        //The chunk is culled when all four corners are outside the same clip plane
+        float x0 = (i % chunksWide_) * cw, y0 = (i / chunksWide_) * ch;
+        int outside = 0xf;
+        
+        for (int k = 0; k < 4 && outside; k++)
+        {
+            float x = x0 + (k & 1) * cw, y = y0 + (k >> 1) * ch;
+            float px = clip[0] * x + clip[4] * y + clip[12];
+            float py = clip[1] * x + clip[5] * y + clip[13];
+            float pw = clip[3] * x + clip[7] * y + clip[15];
+            
+            outside &= (px < -pw) | (px > pw) << 1 | (py < -pw) << 2 | (py > pw) << 3;
+        }
+        
+        if (!outside)
+        {
+            visible.push_back(i);
+        }
+    }
+}
+
+const TileGrid::Chunk& TileGrid::chunk(int i)
+{
+    if (chunks_[i].dirty)
+    {
+        build(i);
+    }
+    return chunks_[i];
+}
+
+void TileGrid::build(int i)
+{
+    Chunk &c = chunks_[i];
+    int x0 = (i % chunksWide_) * CHUNK_SIZE, y0 = (i / chunksWide_) * CHUNK_SIZE;
+    int x1 = std::min(x0 + CHUNK_SIZE, width_), y1 = std::min(y0 + CHUNK_SIZE, height_);
+    int cells = columns_ * rows_;
+    
+    c.vertices.clear();
+    c.texCoords.clear();
+    c.vertices.reserve(c.tiles * 12);
+    c.texCoords.reserve(c.tiles * 12);
+    
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            int tile = get(x, y);
+            
+            //Ids past the end of the atlas draw nothing, like empty tiles
+            if (tile == 0 || tile > cells)
+            {
+                continue;
+            }
+            
+            float l = x * tileWidth_, b = y * tileHeight_, r = l + tileWidth_, t = b + tileHeight_;
+            float s0 = ((tile - 1) % columns_) * cellS_, s1 = s0 + cellS_;
+            float t1 = 1 - ((tile - 1) / columns_) * cellT_, t0 = t1 - cellT_;
+            const float v[12] = { l, b, r, b, r, t, l, b, r, t, l, t };
+            const float tc[12] = { s0, t0, s1, t0, s1, t1, s0, t0, s1, t1, s0, t1 };
+            
+            c.vertices.insert(c.vertices.end(), v, v + 12);
+            c.texCoords.insert(c.texCoords.end(), tc, tc + 12);
+        }
+    }
+    
+    c.dirty = false;
+    rebuilds_++;
+}
@@ -0,0 +1,98 @@
+//
+//  tilegrid.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#ifndef Codify_tilegrid_h
+#define Codify_tilegrid_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//Tiles are 1-based atlas cells counted left to right from the top left; 0 is an empty tile
+typedef uint16_t tile_id;
+
+//A dense grid of tile ids split into chunks of CHUNK_SIZE x CHUNK_SIZE tiles, each with its own
+//triangles. A chunk's geometry is only rebuilt when it is asked for after one of its tiles changed.
+//Tile x, y covers x * tileWidth, y * tileHeight to the next tile, with 0, 0 at the bottom left.
+//Plain C++ with no Lua or GL, so it can be built and run anywhere
+struct TileGrid
+{
+public:
+    static const int CHUNK_SIZE = 16;
+    
+    struct Chunk
+    {
+        std::vector<float> vertices;    //x, y per vertex, two triangles per tile
+        std::vector<float> texCoords;   //s, t per vertex, with t = 1 at the top of the atlas
+        int tiles;                      //Non-empty tiles
+        bool dirty;
+        
+        Chunk() : tiles(0), dirty(true) {}
+        int vertexCount() const { return (int)(vertices.size() / 2); }
+    };
+    
+    TileGrid(float tileWidth, float tileHeight);
+    
+    //Keeps the tiles that are inside both sizes, the rest are empty. Throws std::bad_alloc
+    //and leaves the grid as it was if the new one can't be allocated
+    void resize(int width, int height);
+    
+    int width() const { return width_; }
+    int height() const { return height_; }
+    float tileWidth() const { return tileWidth_; }
+    float tileHeight() const { return tileHeight_; }
+    
+    //x, y must be inside the grid
+    tile_id get(int x, int y) const { return tiles_[(size_t)y * width_ + x]; }
+    void set(int x, int y, tile_id tile);
+    
+    //Clipped to the grid
+    void fill(int x, int y, int w, int h, tile_id tile);
+    
+    //The atlas has contentWidth x contentHeight of cells at the top left of a
+    //textureWidth x textureHeight texture, in the same units as the tiles
+    void setAtlas(float contentWidth, float contentHeight, float textureWidth, float textureHeight);
+    
+    int chunkCount() const { return (int)chunks_.size(); }
+    
+    //Indices of the non-empty chunks whose bounds may be inside clip space after transforming
+    //by clip (a column major 4x4 matrix, like a model view projection)
+    void visibleChunks(const float* clip, std::vector<int>& visible) const;
+    
+    //Chunk i's geometry, rebuilt first if any of its tiles changed
+    const Chunk& chunk(int i);
+    
+    //Chunk geometry builds so far
+    unsigned rebuilds() const { return rebuilds_; }
+    
+private:
+    void build(int i);
+    
+    int width_, height_;
+    int chunksWide_;
+    float tileWidth_, tileHeight_;
+    int columns_, rows_;        //Atlas cells
+    float cellS_, cellT_;       //A cell's size in texture coordinates
+    std::vector<tile_id> tiles_;
+    std::vector<Chunk> chunks_;
+    unsigned rebuilds_;
+};
+
+#endif
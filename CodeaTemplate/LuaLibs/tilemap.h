@@ -0,0 +1,57 @@
+//
+//  tilemap.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#ifndef Codify_tilemap_h
+#define Codify_tilemap_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+    
+#include "lua.h"
+#import "CCTexture2D.h"
+#import "image.h"
+
+#define CODIFY_TILEMAPLIBNAME "tilemap"
+
+struct TileGrid;
+typedef struct TileGrid TileGrid;
+
+typedef struct tilemap_type_t
+{
+    TileGrid* grid;
+    
+    //The atlas, a sprite or an image like a mesh texture
+    NSString* spriteName;
+    CCTexture2D* texture;
+    image_type* image;
+    int imageRef;
+    
+    int drawnChunks;    //By the last draw, after culling
+} tilemap_type;
+
+LUALIB_API int (luaopen_tilemap) (lua_State *L);
+tilemap_type *checkTilemap(lua_State *L, int i);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif
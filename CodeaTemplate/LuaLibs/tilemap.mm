@@ -0,0 +1,336 @@
+//
+//  tilemap.mm
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+#include <stdio.h>
+#include <math.h>
+#include <limits.h>
+#include <new>
+
+#include "tilemap.h"
+#include "tilegrid.h"
+
+extern "C"
+{
+#include "lauxlib.h"
+#include "codea_luaext.h"
+}
+
+#import "RenderCommands.h"
+#import "SpriteManager.h"
+
+#define TILEMAP_TYPE    "tilemap"
+#define TILEMAP_SIZE    sizeof(tilemap_type)
+#define TILEMAP_MAXSIZE 16777216    /* largest width or height, exact as a lua_Number */
+
+enum { FIELD_WIDTH, FIELD_HEIGHT, FIELD_TILEWIDTH, FIELD_TILEHEIGHT, FIELD_ATLAS, FIELD_CHUNKS, FIELD_DRAWNCHUNKS, FIELD_REBUILDS };
+static const char *const fields[] = { "width", "height", "tileWidth", "tileHeight", "atlas", "chunks", "drawnChunks", "rebuilds", NULL };
+
+static tilemap_type *Pget(lua_State *L, int i)
+{
+    if (luaL_checkudata(L, i, TILEMAP_TYPE) == NULL) luaL_typerror(L, i, TILEMAP_TYPE);
+    return (tilemap_type*)lua_touserdata(L, i);
+}
+
+tilemap_type *checkTilemap(lua_State *L, int i)
+{
+    return Pget(L, i);
+}
+
+//Tells the grid where the atlas cells are, in points like the tiles
+static void applyAtlas(tilemap_type* map)
+{
+    if (map->texture)
+    {
+        //Sprites sit at the top left of a POT texture
+        CCTexture2D* texture = map->texture;
+        CGFloat scale = texture.scale;
+        
+        map->grid->setAtlas(texture.contentSizeInPixels.width / scale, texture.contentSizeInPixels.height / scale, 
+                            texture.pixelsWide / scale, texture.pixelsHigh / scale);
+    }
+    else if (map->image)
+    {
+        map->grid->setAtlas(map->image->scaledWidth, map->image->scaledHeight, map->image->scaledWidth, map->image->scaledHeight);
+    }
+}
+
+static void clearAtlas(lua_State *L, tilemap_type* map)
+{
+    if (map->texture)
+    {
+        [map->texture release];
+        map->texture = nil;
+        [map->spriteName release];
+        map->spriteName = nil;
+    }
+    else if (map->image)
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, map->imageRef);
+        map->image = NULL;
+    }
+}
+
+//The atlas at index i: a sprite name, an image or nil
+static void setAtlas(lua_State *L, tilemap_type* map, int i)
+{
+    if (lua_isnil(L, i) || lua_isnone(L, i))
+    {
+        clearAtlas(L, map);
+    }
+    else if (lua_isstring(L, i))
+    {
+        NSString* spriteName = [[NSString alloc] initWithUTF8String:lua_tostring(L, i)];
+        
+        clearAtlas(L, map);
+        map->texture = [[[SpriteManager sharedInstance] spriteTextureFromString:spriteName] retain];
+        if (map->texture)
+        {
+            map->spriteName = spriteName;
+        }
+        else
+        {
+            [spriteName release];
+        }
+    }
+    else
+    {
+        image_type* image = checkimage(L, i);
+        
+        clearAtlas(L, map);
+        map->image = image;
+        lua_pushvalue(L, i);
+        map->imageRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    
+    applyAtlas(map);
+}
+
+static tile_id checktile(lua_State *L, int i)
+{
+    lua_Integer tile = luaL_checkinteger(L, i);
+    
+    luaL_argcheck(L, tile >= 0 && tile <= 65535, i, "tile id must be 0 to 65535");
+    return (tile_id)tile;
+}
+
+//Tile coordinates are 1-based from the bottom left like image pixels
+static void checktilexy(lua_State *L, tilemap_type* map, int i, int *x, int *y)
+{
+    *x = (int)luaL_checkinteger(L, i) - 1;
+    *y = (int)luaL_checkinteger(L, i+1) - 1;
+    
+    if (*x < 0 || *y < 0 || *x >= map->grid->width() || *y >= map->grid->height())
+    {
+        luaL_error(L, "tile out of bounds of tilemap, %d, %d -> given %d, %d", map->grid->width(), map->grid->height(), *x+1, *y+1);
+    }
+}
+
+//Checked as numbers so huge values never reach an int; fractions are dropped as before
+static void checkmapsize(lua_State *L, int i, lua_Number w, lua_Number h, int *width, int *height)
+{
+    w = floor(w);
+    h = floor(h);
+    
+    luaL_argcheck(L, w >= 0 && w <= TILEMAP_MAXSIZE, i, "width must be 0 to 16777216");
+    luaL_argcheck(L, h >= 0 && h <= TILEMAP_MAXSIZE, i+1, "height must be 0 to 16777216");
+    luaL_argcheck(L, (double)w * h <= INT_MAX, i, "tilemap has too many tiles");
+    
+    *width = (int)w;
+    *height = (int)h;
+}
+
+//Allocation failures become Lua errors instead of unwinding through Lua
+static void resizegrid(lua_State *L, tilemap_type* map, int width, int height)
+{
+    bool failed = false;
+    
+    try
+    {
+        map->grid->resize(width, height);
+    }
+    catch (const std::bad_alloc&)
+    {
+        failed = true;
+    }
+    
+    if (failed)
+    {
+        luaL_error(L, "not enough memory for a %d x %d tilemap", width, height);
+    }
+}
+
+static int Lnew(lua_State *L)           /** tilemap(tileWidth, tileHeight, atlas, [width, height]) */
+{
+    lua_Number tileWidth = luaL_checknumber(L, 1);
+    lua_Number tileHeight = luaL_checknumber(L, 2);
+    int width, height;
+    
+    luaL_argcheck(L, tileWidth > 0, 1, "tile width must be > 0");
+    luaL_argcheck(L, tileHeight > 0, 2, "tile height must be > 0");
+    checkmapsize(L, 4, luaL_optnumber(L, 4, 0), luaL_optnumber(L, 5, 0), &width, &height);
+    
+    tilemap_type *map = (tilemap_type*)lua_newuserdata(L, TILEMAP_SIZE);
+    map->grid = new TileGrid(tileWidth, tileHeight);
+    map->spriteName = nil;
+    map->texture = nil;
+    map->image = NULL;
+    map->drawnChunks = 0;
+    luaL_getmetatable(L, TILEMAP_TYPE);
+    lua_setmetatable(L, -2);
+    
+    resizegrid(L, map, width, height);
+    setAtlas(L, map, 3);
+    
+    return 1;
+}
+
+static int Lget(lua_State *L)
+{
+    tilemap_type *map = (tilemap_type*)checkfieldudata(L, 1, TILEMAP_TYPE);
+    
+    switch( fieldindex(L,2) )
+    {
+        case FIELD_WIDTH:       lua_pushinteger(L, map->grid->width()); break;
+        case FIELD_HEIGHT:      lua_pushinteger(L, map->grid->height()); break;
+        case FIELD_TILEWIDTH:   lua_pushnumber(L, map->grid->tileWidth()); break;
+        case FIELD_TILEHEIGHT:  lua_pushnumber(L, map->grid->tileHeight()); break;
+        case FIELD_ATLAS:
+        {
+            if (map->texture)
+            {
+                lua_pushstring(L, [map->spriteName UTF8String]);
+            }
+            else if (map->image)
+            {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, map->imageRef);
+            }
+            else
+            {
+                lua_pushnil(L);
+            }
+        } break;
+        case FIELD_CHUNKS:      lua_pushinteger(L, map->grid->chunkCount()); break;
+        case FIELD_DRAWNCHUNKS: lua_pushinteger(L, map->drawnChunks); break;
+        case FIELD_REBUILDS:    lua_pushinteger(L, map->grid->rebuilds()); break;
+        default: break;     //The method (or nil) for key is on the stack
+    }
+    
+    return 1;
+}
+
+static int Lset(lua_State *L)
+{
+    tilemap_type *map = (tilemap_type*)checkfieldudata(L, 1, TILEMAP_TYPE);
+    
+    switch( fieldindex(L,2) )
+    {
+        case FIELD_ATLAS:       setAtlas(L, map, 3); break;
+        default: break;
+    }
+    return 0;
+}
+
+static int LgetTile(lua_State *L)       /** tilemap:get(x, y) */
+{
+    tilemap_type *map = Pget(L, 1);
+    int x, y;
+    
+    checktilexy(L, map, 2, &x, &y);
+    lua_pushinteger(L, map->grid->get(x, y));
+    return 1;
+}
+
+static int LsetTile(lua_State *L)       /** tilemap:set(x, y, id) */
+{
+    tilemap_type *map = Pget(L, 1);
+    int x, y;
+    
+    checktilexy(L, map, 2, &x, &y);
+    map->grid->set(x, y, checktile(L, 4));
+    return 0;
+}
+
+static int Lfill(lua_State *L)          /** tilemap:fill(id, [x, y, w, h]), clipped to the map */
+{
+    tilemap_type *map = Pget(L, 1);
+    tile_id tile = checktile(L, 2);
+    int x = (int)luaL_optinteger(L, 3, 1) - 1;
+    int y = (int)luaL_optinteger(L, 4, 1) - 1;
+    int w = (int)luaL_optinteger(L, 5, map->grid->width() - x);
+    int h = (int)luaL_optinteger(L, 6, map->grid->height() - y);
+    
+    map->grid->fill(x, y, w, h, tile);
+    return 0;
+}
+
+static int Lresize(lua_State *L)        /** tilemap:resize(width, height) */
+{
+    tilemap_type *map = Pget(L, 1);
+    int width, height;
+    
+    checkmapsize(L, 2, luaL_checknumber(L, 2), luaL_checknumber(L, 3), &width, &height);
+    resizegrid(L, map, width, height);
+    return 0;
+}
+
+static int Ldraw(lua_State *L)
+{
+    return drawTilemap(L);
+}
+
+static int Lgc(lua_State *L)
+{
+    tilemap_type *map = Pget(L, 1);
+    
+    clearAtlas(L, map);
+    delete map->grid;
+    
+    return 0;
+}
+
+static int Ltostring(lua_State *L)
+{
+    tilemap_type *map = Pget(L, 1);
+    char s[128];
+    sprintf(s, "tilemap: %p (%d x %d)", map, map->grid->width(), map->grid->height());
+    lua_pushstring(L, s);
+    return 1;
+}
+
+static const luaL_reg R[] =
+{
+    { "__gc",         Lgc           },
+    { "__tostring",   Ltostring     },
+    { "get",          LgetTile      },
+    { "set",          LsetTile      },
+    { "fill",         Lfill         },
+    { "resize",       Lresize       },
+    { "draw",         Ldraw         },
+    { NULL,           NULL          }
+};
+
+LUALIB_API int luaopen_tilemap(lua_State *L)
+{
+    luaL_newmetatable(L, TILEMAP_TYPE);
+    luaL_openlib(L, NULL, R, 0);
+    setfieldhandlers(L, Lget, Lset, fields);
+    lua_register(L, "tilemap", Lnew);
+    return 1;
+}
@@ -24,10 +24,14 @@
 
 #include "touch.h"
 #include "lauxlib.h"
+#include "codea_luaext.h"
 
 #define TOUCHTYPE		"touch"
 #define TOUCHSIZE      sizeof(touch_type)
 
+enum { FIELD_X, FIELD_Y, FIELD_PREVX, FIELD_PREVY, FIELD_DELTAX, FIELD_DELTAY, FIELD_ID, FIELD_STATE, FIELD_TAPCOUNT };
+static const char *const fields[] = { "x", "y", "prevX", "prevY", "deltaX", "deltaY", "id", "state", "tapCount", NULL };
+
 void setupEmptyTouch(touch_type* t)
 {
     t->x = 0;
@@ -57,51 +61,20 @@ static touch_type* Pnew( lua_State *L )
 
 static int Lget( lua_State *L )
 {
-    touch_type *v=Pget(L,1);
-    const char* c = luaL_checkstring(L,2);
+    touch_type *v=checkfieldudata(L,1,TOUCHTYPE);
 
-    if( strcmp(c, "x") == 0 )
-    {
-        lua_pushnumber(L, v->x);
-    }
-    else if( strcmp(c, "y") == 0 )
-    {
-        lua_pushnumber(L, v->y);        
-    }
-    else if( strcmp(c, "prevX") == 0 )
-    {
-        lua_pushnumber(L, v->prevX);        
-    }
-    else if( strcmp(c, "prevY") == 0 )
-    {
-        lua_pushnumber(L, v->prevY);        
-    }    
-    else if( strcmp(c, "deltaX") == 0 )
-    {
-        lua_pushnumber(L, v->deltaX);        
-    }            
-    else if( strcmp(c, "deltaY") == 0 )
-    {
-        lua_pushnumber(L, v->deltaY);        
-    }            
-    else if( strcmp(c, "id") == 0 )
-    {
-        lua_pushnumber(L, v->ID);        
-    }    
-    else if( strcmp(c, "state") == 0 )
-    {
-        lua_pushnumber(L, v->state);        
-    }    
-    else if( strcmp(c, "tapCount") == 0 )
-    {
-        lua_pushnumber(L, v->tapCount);        
-    }    
-    else
+    switch( fieldindex(L,2) )
     {
-        //Load the metatable and value for key
-        luaL_getmetatable(L, TOUCHTYPE);
-        lua_pushstring(L, c);
-        lua_gettable(L, -2);
+        case FIELD_X:           lua_pushnumber(L, v->x); break;
+        case FIELD_Y:           lua_pushnumber(L, v->y); break;
+        case FIELD_PREVX:       lua_pushnumber(L, v->prevX); break;
+        case FIELD_PREVY:       lua_pushnumber(L, v->prevY); break;
+        case FIELD_DELTAX:      lua_pushnumber(L, v->deltaX); break;
+        case FIELD_DELTAY:      lua_pushnumber(L, v->deltaY); break;
+        case FIELD_ID:          lua_pushnumber(L, v->ID); break;
+        case FIELD_STATE:       lua_pushnumber(L, v->state); break;
+        case FIELD_TAPCOUNT:    lua_pushnumber(L, v->tapCount); break;
+        default: break;         //The method (or nil) for key is on the stack
     }
     
     return 1;
@@ -119,7 +92,6 @@ static int Ltostring(lua_State *L)
 
 static const luaL_reg R[] =
 {
-    { "__index", Lget },
     { "__tostring", Ltostring },
     { NULL, NULL }
 };
@@ -128,5 +100,6 @@ LUALIB_API int luaopen_touch(lua_State *L)
 {
     luaL_newmetatable(L,TOUCHTYPE);
     luaL_openlib(L,NULL,R,0);
+    setfieldhandlers(L,Lget,NULL,fields);
     return 1;
 }
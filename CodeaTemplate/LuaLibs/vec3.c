@@ -29,6 +29,9 @@
 
 #define VEC3TYPE    "vec3"
 #define VEC3DIM     3
+#define VEC3_RGB    6   /* index of the first set-only field */
+
+static const char *const fields[] = { "x", "y", "z", "1", "2", "3", "r", "g", "b", NULL };
 
 #define MATHF(c)    c##f
 
@@ -70,6 +73,17 @@ static lua_Number *Pnew(lua_State *L)
     return v;
 }
 
+//The result vector for methods that take an optional out argument at index i: out itself, or a new vector
+static lua_Number *Pout(lua_State *L, int i)
+{
+    lua_Number *v;
+    if (lua_isnoneornil(L, i))
+        return Pnew(L);
+    v = Pget(L, i);
+    lua_pushvalue(L, i);
+    return v;
+}
+
 void pushvec3(lua_State *L, lua_Number x, lua_Number y, lua_Number z)
 {
     lua_Number *v=Pnew(L);
@@ -92,43 +106,31 @@ static int Lnew(lua_State *L)			/** vec3(x, y, z) */
 
 static int Lget(lua_State *L)
 {
-    lua_Number *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
-    switch (*i) {		/* lazy! */
-        case '1': case 'x': /*case 'r':*/ lua_pushnumber(L,v[0]); break;
-        case '2': case 'y': /*case 'g':*/ lua_pushnumber(L,v[1]); break;
-        case '3': case 'z': /*case 'b':*/ lua_pushnumber(L,v[2]); break;
-        default: 
-        {
-            //Load the metatable and value for key
-            luaL_getmetatable(L, VEC3TYPE);
-            lua_pushstring(L, i);
-            lua_gettable(L, -2);
-        } break;
-    }
+    lua_Number *v=checkfieldudata(L,1,VEC3TYPE);
+    int i=fieldindex(L,2);
+    if( i >= VEC3_RGB )
+        lua_pushnil(L);     /* r, g, b can only be set */
+    else if( i >= 0 )
+        lua_pushnumber(L,v[i%VEC3DIM]);
+    //else the method (or nil) for key is on the stack
     return 1;
 }
 
 static int Lset(lua_State *L) 
 {
-    lua_Number *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
+    lua_Number *v=checkfieldudata(L,1,VEC3TYPE);
+    int i=fieldindex(L,2);
     lua_Number t=luaL_checknumber(L,3);
-    switch (*i) {		/* lazy! */
-        case '1': case 'x': case 'r': v[0]=t; break;
-        case '2': case 'y': case 'g': v[1]=t; break;
-        case '3': case 'z': case 'b': v[2]=t; break;
-        default: break;
-    }
+    if( i >= 0 )
+        v[i%VEC3DIM]=t;
     return 1;
 }
 
 static int Ltostring(lua_State *L)
 {
     lua_Number *v=Pget(L,1);
-    char s[64];
-    sprintf(s,"(%f, %f, %f)",v[0],v[1],v[2]);
-    lua_pushstring(L,s);
+    char s[FORMATNUMBERS_SIZE(3)];
+    lua_pushlstring(L,s,formatnumbers(s,v,3));
     return 1;
 }
 
@@ -279,23 +281,23 @@ static int LlenSqr(lua_State *L)
     return 0;
 }
 
-static int Lnormalize(lua_State *L)
+static void normalize(lua_Number *r, const lua_Number *o1)
 {
-    lua_Number *o1 = checkvec3(L, -1);
+    lua_Number len = MATHF(sqrt)(o1[0]*o1[0] + o1[1]*o1[1] + o1[2]*o1[2]);
     
-    if( o1 )
-    {    
-        lua_Number len = MATHF(sqrt)(o1[0]*o1[0] + o1[1]*o1[1] + o1[2]*o1[2]);
-        
-        lua_Number *r = Pnew(L);
-        r[0] = o1[0] / len;
-        r[1] = o1[1] / len;  
-        r[2] = o1[2] / len;
-        
-        return 1;        
-    }
+    r[0] = o1[0] / len;
+    r[1] = o1[1] / len;
+    r[2] = o1[2] / len;
+}
+
+static int Lnormalize(lua_State *L)     /** v:normalize([out]) */
+{
+    lua_Number *o1 = Pget(L, 1);
+    lua_Number *r = Pout(L, 2);
     
-    return 0;
+    normalize(r, o1);
+    
+    return 1;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -351,24 +353,23 @@ static int Ldot(lua_State *L)
     return 0;
 }
 
-static int Lcross(lua_State *L)
+static int Lcross(lua_State *L)        /** v:cross(o, [out]) */
 {
-    lua_Number *o1 = checkvec3(L, 1);
-    lua_Number *o2 = checkvec3(L, 2);
+    lua_Number *o1 = Pget(L, 1);
+    lua_Number *o2 = Pget(L, 2);
+    lua_Number *r = Pout(L, 3);
+    lua_Number c[3];
     
-    if( o1 && o2 )
-    {
-        lua_Number *r = Pnew(L);
-        
-        // y1*z2 - y2*z1 , z1*x2 - z2*x1 , x1*y2 - x2*y1        
-        r[0] = o1[1]*o2[2] - o1[2]*o2[1];
-        r[1] = o1[2]*o2[0] - o1[0]*o2[2];
-        r[2] = o1[0]*o2[1] - o1[1]*o2[0];        
-        
-        return 1;        
-    }
+    // y1*z2 - y2*z1 , z1*x2 - z2*x1 , x1*y2 - x2*y1        
+    c[0] = o1[1]*o2[2] - o1[2]*o2[1];
+    c[1] = o1[2]*o2[0] - o1[0]*o2[2];
+    c[2] = o1[0]*o2[1] - o1[1]*o2[0];        
     
-    return 0;
+    r[0] = c[0];
+    r[1] = c[1];
+    r[2] = c[2];
+    
+    return 1;
 }
 
 static int Ldist(lua_State *L)
@@ -400,10 +401,127 @@ static int LdistSqr(lua_State *L)
     return 0;
 }
 
+//In-place arithmetic: these overwrite v and return it, using the same float operations as the operators
+
+static int LsetFrom(lua_State *L)           /** v:setFrom(o) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    v[0] = o[0];
+    v[1] = o[1];
+    v[2] = o[2];
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LaddInPlace(lua_State *L)        /** v:addInPlace(o) is v = v + o */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    v[0] = v[0] + o[0];
+    v[1] = v[1] + o[1];
+    v[2] = v[2] + o[2];
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LsubInPlace(lua_State *L)        /** v:subInPlace(o) is v = v - o */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    v[0] = v[0] - o[0];
+    v[1] = v[1] - o[1];
+    v[2] = v[2] - o[2];
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LscaleInPlace(lua_State *L)      /** v:scaleInPlace(s) is v = v * s */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    v[0] = v[0] * n;
+    v[1] = v[1] * n;
+    v[2] = v[2] * n;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LdivInPlace(lua_State *L)        /** v:divInPlace(s) is v = v / s */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    v[0] = v[0] / n;
+    v[1] = v[1] / n;
+    v[2] = v[2] / n;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lfma(lua_State *L)               /** v:fma(o, s) is v = v + o * s */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    lua_Number n = luaL_checknumber(L, 3);
+    volatile lua_Number p;
+    
+    //Rounded after the multiply like the two operators: the product goes
+    //through a volatile so the compiler can't contract it into an fma
+    p = o[0] * n;
+    v[0] = v[0] + p;
+    p = o[1] * n;
+    v[1] = v[1] + p;
+    p = o[2] * n;
+    v[2] = v[2] + p;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LnormalizeInPlace(lua_State *L)  /** v:normalizeInPlace() */
+{
+    lua_Number *v = Pget(L, 1);
+    normalize(v, v);
+    lua_settop(L, 1);
+    return 1;
+}
+
+//Results written into an optional out vector (which may be v or o) instead of a new one
+
+static int LaddOut(lua_State *L)            /** v:add(o, [out]) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    lua_Number *r = Pout(L, 3);
+    r[0] = v[0] + o[0];
+    r[1] = v[1] + o[1];
+    r[2] = v[2] + o[2];
+    return 1;
+}
+
+static int LsubOut(lua_State *L)            /** v:sub(o, [out]) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    lua_Number *r = Pout(L, 3);
+    r[0] = v[0] - o[0];
+    r[1] = v[1] - o[1];
+    r[2] = v[2] - o[2];
+    return 1;
+}
+
+static int LscaleOut(lua_State *L)          /** v:scale(s, [out]) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    lua_Number *r = Pout(L, 3);
+    r[0] = v[0] * n;
+    r[1] = v[1] * n;
+    r[2] = v[2] * n;
+    return 1;
+}
+
 static const luaL_reg R[] =
 {
-	{ "__index",	Lget		},
-	{ "__newindex",	Lset		},
 	{ "__tostring",	Ltostring	},
     { "__add",      Ladd        },
     { "__sub",      Lsub        },        
@@ -420,6 +538,16 @@ static const luaL_reg R[] =
     { "len",        Llen        },       
     { "lenSqr",     LlenSqr     },     
     { "cross",      Lcross      },               
+    { "setFrom",    LsetFrom    },
+    { "addInPlace", LaddInPlace },
+    { "subInPlace", LsubInPlace },
+    { "scaleInPlace", LscaleInPlace },
+    { "divInPlace", LdivInPlace },
+    { "fma",        Lfma        },
+    { "normalizeInPlace", LnormalizeInPlace },
+    { "add",        LaddOut     },
+    { "sub",        LsubOut     },
+    { "scale",      LscaleOut   },
 	{ NULL,		NULL		}
 };
 
@@ -427,12 +555,9 @@ LUALIB_API int luaopen_vec3(lua_State *L)
 {
     luaL_newmetatable(L,VEC3TYPE);
     
-    lua_pushstring(L, "__index");
-    lua_pushvalue(L, -2);
-    lua_settable(L, -3);
-    
     //luaL_openlib(L,NULL,R,0);
     luaL_register(L, NULL, R);
+    setfieldhandlers(L, Lget, Lset, fields);
     lua_register(L,"vec3",Lnew);
     
     return 1;
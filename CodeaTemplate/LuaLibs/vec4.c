@@ -31,6 +31,8 @@
 #define VEC4TYPE    "vec4"
 #define VEC4DIM     4
 
+static const char *const fields[] = { "x", "y", "z", "w", "r", "g", "b", "a", "1", "2", "3", "4", NULL };
+
 #define MATHF(c)    c##f
 
 lua_Number *getvec4(lua_State *L, int i)
@@ -71,6 +73,17 @@ static lua_Number *Pnew(lua_State *L)
     return v;
 }
 
+//The result vector for methods that take an optional out argument at index i: out itself, or a new vector
+static lua_Number *Pout(lua_State *L, int i)
+{
+    lua_Number *v;
+    if (lua_isnoneornil(L, i))
+        return Pnew(L);
+    v = Pget(L, i);
+    lua_pushvalue(L, i);
+    return v;
+}
+
 void pushvec4(lua_State *L, lua_Number x, lua_Number y, lua_Number z, lua_Number w)
 {
     lua_Number *v=Pnew(L);
@@ -95,45 +108,29 @@ static int Lnew(lua_State *L)			/** vec3(x, y, z, w) */
 
 static int Lget(lua_State *L)
 {
-    lua_Number *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
-    switch (*i) {		/* lazy! */
-        case '1': case 'x': case 'r': lua_pushnumber(L,v[0]); break;
-        case '2': case 'y': case 'g': lua_pushnumber(L,v[1]); break;
-        case '3': case 'z': case 'b': lua_pushnumber(L,v[2]); break;
-        case '4': case 'w': case 'a': lua_pushnumber(L,v[3]); break;            
-        default: 
-        {
-            //Load the metatable and value for key
-            luaL_getmetatable(L, VEC4TYPE);
-            lua_pushstring(L, i);
-            lua_gettable(L, -2);
-        } break;
-    }
+    lua_Number *v=checkfieldudata(L,1,VEC4TYPE);
+    int i=fieldindex(L,2);
+    if( i >= 0 )
+        lua_pushnumber(L,v[i%VEC4DIM]);
+    //else the method (or nil) for key is on the stack
     return 1;
 }
 
 static int Lset(lua_State *L) 
 {
-    lua_Number *v=Pget(L,1);
-    const char* i=luaL_checkstring(L,2);
+    lua_Number *v=checkfieldudata(L,1,VEC4TYPE);
+    int i=fieldindex(L,2);
     lua_Number t=luaL_checknumber(L,3);
-    switch (*i) {		/* lazy! */
-        case '1': case 'x': case 'r': v[0]=t; break;
-        case '2': case 'y': case 'g': v[1]=t; break;
-        case '3': case 'z': case 'b': v[2]=t; break;
-        case '4': case 'w': case 'a': v[3]=t; break;            
-        default: break;
-    }
+    if( i >= 0 )
+        v[i%VEC4DIM]=t;
     return 1;
 }
 
 static int Ltostring(lua_State *L)
 {
     lua_Number *v=Pget(L,1);
-    char s[64];
-    sprintf(s,"(%f, %f, %f, %f)",v[0],v[1],v[2],v[3]);
-    lua_pushstring(L,s);
+    char s[FORMATNUMBERS_SIZE(4)];
+    lua_pushlstring(L,s,formatnumbers(s,v,4));
     return 1;
 }
 
@@ -290,24 +287,24 @@ static int LlenSqr(lua_State *L)
     return 0;
 }
 
-static int Lnormalize(lua_State *L)
+static void normalize(lua_Number *r, const lua_Number *o1)
 {
-    lua_Number *o1 = checkvec4(L, -1);
+    lua_Number len = MATHF(sqrt)(o1[0]*o1[0] + o1[1]*o1[1] + o1[2]*o1[2] + o1[3]*o1[3]);
     
-    if( o1 )
-    {    
-        lua_Number len = MATHF(sqrt)(o1[0]*o1[0] + o1[1]*o1[1] + o1[2]*o1[2] + o1[3]*o1[3]);
-        
-        lua_Number *r = Pnew(L);
-        r[0] = o1[0] / len;
-        r[1] = o1[1] / len;  
-        r[2] = o1[2] / len;
-        r[3] = o1[3] / len;
-        
-        return 1;        
-    }
+    r[0] = o1[0] / len;
+    r[1] = o1[1] / len;
+    r[2] = o1[2] / len;
+    r[3] = o1[3] / len;
+}
+
+static int Lnormalize(lua_State *L)     /** v:normalize([out]) */
+{
+    lua_Number *o1 = Pget(L, 1);
+    lua_Number *r = Pout(L, 2);
     
-    return 0;
+    normalize(r, o1);
+    
+    return 1;
 }
 
 static int Ldot(lua_State *L)
@@ -375,10 +372,137 @@ static int LdistSqr(lua_State *L)
     return 0;
 }
 
+//In-place arithmetic: these overwrite v and return it, using the same float operations as the operators
+
+static int LsetFrom(lua_State *L)           /** v:setFrom(o) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    v[0] = o[0];
+    v[1] = o[1];
+    v[2] = o[2];
+    v[3] = o[3];
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LaddInPlace(lua_State *L)        /** v:addInPlace(o) is v = v + o */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    v[0] = v[0] + o[0];
+    v[1] = v[1] + o[1];
+    v[2] = v[2] + o[2];
+    v[3] = v[3] + o[3];
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LsubInPlace(lua_State *L)        /** v:subInPlace(o) is v = v - o */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    v[0] = v[0] - o[0];
+    v[1] = v[1] - o[1];
+    v[2] = v[2] - o[2];
+    v[3] = v[3] - o[3];
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LscaleInPlace(lua_State *L)      /** v:scaleInPlace(s) is v = v * s */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    v[0] = v[0] * n;
+    v[1] = v[1] * n;
+    v[2] = v[2] * n;
+    v[3] = v[3] * n;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LdivInPlace(lua_State *L)        /** v:divInPlace(s) is v = v / s */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    v[0] = v[0] / n;
+    v[1] = v[1] / n;
+    v[2] = v[2] / n;
+    v[3] = v[3] / n;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lfma(lua_State *L)               /** v:fma(o, s) is v = v + o * s */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    lua_Number n = luaL_checknumber(L, 3);
+    volatile lua_Number p;
+    
+    //Rounded after the multiply like the two operators: the product goes
+    //through a volatile so the compiler can't contract it into an fma
+    p = o[0] * n;
+    v[0] = v[0] + p;
+    p = o[1] * n;
+    v[1] = v[1] + p;
+    p = o[2] * n;
+    v[2] = v[2] + p;
+    p = o[3] * n;
+    v[3] = v[3] + p;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int LnormalizeInPlace(lua_State *L)  /** v:normalizeInPlace() */
+{
+    lua_Number *v = Pget(L, 1);
+    normalize(v, v);
+    lua_settop(L, 1);
+    return 1;
+}
+
+//Results written into an optional out vector (which may be v or o) instead of a new one
+
+static int LaddOut(lua_State *L)            /** v:add(o, [out]) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    lua_Number *r = Pout(L, 3);
+    r[0] = v[0] + o[0];
+    r[1] = v[1] + o[1];
+    r[2] = v[2] + o[2];
+    r[3] = v[3] + o[3];
+    return 1;
+}
+
+static int LsubOut(lua_State *L)            /** v:sub(o, [out]) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number *o = Pget(L, 2);
+    lua_Number *r = Pout(L, 3);
+    r[0] = v[0] - o[0];
+    r[1] = v[1] - o[1];
+    r[2] = v[2] - o[2];
+    r[3] = v[3] - o[3];
+    return 1;
+}
+
+static int LscaleOut(lua_State *L)          /** v:scale(s, [out]) */
+{
+    lua_Number *v = Pget(L, 1);
+    lua_Number n = luaL_checknumber(L, 2);
+    lua_Number *r = Pout(L, 3);
+    r[0] = v[0] * n;
+    r[1] = v[1] * n;
+    r[2] = v[2] * n;
+    r[3] = v[3] * n;
+    return 1;
+}
+
 static const luaL_reg R[] =
 {
-	{ "__index",	Lget		},
-	{ "__newindex",	Lset		},
 	{ "__tostring",	Ltostring	},
     { "__add",      Ladd        },
     { "__sub",      Lsub        },        
@@ -393,6 +517,16 @@ static const luaL_reg R[] =
     { "len",        Llen        },       
     { "lenSqr",     LlenSqr     },     
     { "cross",      Lcross      },               
+    { "setFrom",    LsetFrom    },
+    { "addInPlace", LaddInPlace },
+    { "subInPlace", LsubInPlace },
+    { "scaleInPlace", LscaleInPlace },
+    { "divInPlace", LdivInPlace },
+    { "fma",        Lfma        },
+    { "normalizeInPlace", LnormalizeInPlace },
+    { "add",        LaddOut     },
+    { "sub",        LsubOut     },
+    { "scale",      LscaleOut   },
 	{ NULL,		NULL		}
 };
 
@@ -400,12 +534,9 @@ LUALIB_API int luaopen_vec4(lua_State *L)
 {
     luaL_newmetatable(L,VEC4TYPE);
     
-    lua_pushstring(L, "__index");
-    lua_pushvalue(L, -2);
-    lua_settable(L, -3);
-    
     //luaL_openlib(L,NULL,R,0);
     luaL_register(L, NULL, R);
+    setfieldhandlers(L, Lget, Lset, fields);
     
     lua_register(L,"vec4",Lnew);
     return 1;
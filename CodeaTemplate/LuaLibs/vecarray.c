@@ -0,0 +1,636 @@
+//
+//  vecarray.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vecarray.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "codea_luaext.h"
+#include "buffer.h"
+#include "points.h"
+#include "vec2.h"
+#include "vec3.h"
+
+#define VEC2ARRAYTYPE   "vec2array"
+#define VEC3ARRAYTYPE   "vec3array"
+#define VECVIEWTYPE     "vecview"
+#define VECARRAYALIGN   16
+
+static const char *const fields[] = { NULL };   //Only numeric indices and methods
+
+enum { FIELD_X, FIELD_Y, FIELD_Z };
+static const char *const viewfields[] = { "x", "y", "z", NULL };
+
+//Four elements of one plane at a time with the GCC/Clang vector extension (SSE on the simulator,
+//NEON on devices). Planes are aligned and padded, so every load and store is a whole vector
+typedef float vecarray_vec __attribute__((vector_size(16)));
+
+//One element of an array, seen through a[i]. Views share their array's environment table, which
+//holds the array, so a view keeps its array alive without an allocation of its own
+typedef struct vecview_type_t
+{
+    vecarray_type *a;
+    size_t i;
+} vecview_type;
+
+//The right hand side of an operation: another array of the same size, or one vector for every element
+typedef struct vecarray_operand
+{
+    const float *planes[3];
+    float value[3];
+    int repeat;
+} vecarray_operand;
+
+static void pushmetatable(lua_State *L, int dim);
+static void pushviewmetatable(lua_State *L);
+
+vecarray_type *getvecarray(lua_State *L, int i)
+{
+    vecarray_type *a = NULL;
+    
+    if( lua_isuserdata(L, i) )
+    {
+        if ((a = testudata(L, i, VEC2ARRAYTYPE)) == NULL)
+            a = testudata(L, i, VEC3ARRAYTYPE);
+    }
+    
+    return a;
+}
+
+vecarray_type *checkvecarray(lua_State *L, int i)
+{
+    vecarray_type *a = getvecarray(L, i);
+    if (a == NULL) luaL_typerror(L, i, "vec2array or vec3array");
+    return a;
+}
+
+vecarray_type *pushvecarray(lua_State *L, size_t count, int dim)
+{
+    vecarray_type *a = lua_newuserdata(L, sizeof(vecarray_type));
+    size_t stride, size;
+    int k;
+    
+    memset(a, 0, sizeof(vecarray_type));
+    a->dim = dim;
+    pushmetatable(L, dim);
+    lua_setmetatable(L, -2);
+    
+    //The environment that views of this array share
+    lua_createtable(L, 1, 0);
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, -2, 1);
+    lua_setfenv(L, -2);
+    
+    if (count > ((size_t)-1) / sizeof(float) / 4 - 1)
+        luaL_error(L, "vecarray too large");
+    
+    stride = (count + 3) & ~(size_t)3;
+    size = stride * dim * sizeof(float);
+    if (size > 0)
+    {
+        if (posix_memalign((void**)&a->storage, VECARRAYALIGN, size) != 0)
+            luaL_error(L, "not enough memory");
+        memset(a->storage, 0, size);
+        for (k = 0; k < dim; k++)
+            a->planes[k] = a->storage + k * stride;
+    }
+    a->count = count;
+    return a;
+}
+
+static size_t padded(const vecarray_type *a)
+{
+    return (a->count + 3) & ~(size_t)3;
+}
+
+static const char *vectorname(int dim)
+{
+    return dim == 2 ? "vec2" : "vec3";
+}
+
+//Kernels
+
+static inline vecarray_vec vload(const float *p)
+{
+    return *(const vecarray_vec*)p;
+}
+
+static inline void vstore(float *p, vecarray_vec v)
+{
+    *(vecarray_vec*)p = v;
+}
+
+static inline vecarray_vec splat(float x)
+{
+    vecarray_vec v = { x, x, x, x };
+    return v;
+}
+
+//Lane by lane; compilers turn this into one vector square root
+static inline vecarray_vec vsqrt(vecarray_vec v)
+{
+    vecarray_vec r;
+    int k;
+    for (k = 0; k < 4; k++)
+        r[k] = sqrtf(v[k]);
+    return r;
+}
+
+static inline vecarray_vec operand(const vecarray_operand *o, int k, size_t j)
+{
+    return o->repeat ? splat(o->value[k]) : vload(o->planes[k] + j);
+}
+
+static inline vecarray_vec lensqr(const vecarray_type *a, size_t j)
+{
+    vecarray_vec x = vload(a->planes[0] + j), y = vload(a->planes[1] + j);
+    vecarray_vec r = x*x + y*y;
+    if (a->dim > 2)
+    {
+        vecarray_vec z = vload(a->planes[2] + j);
+        r += z*z;
+    }
+    return r;
+}
+
+//Operands
+
+//A vector of dim components at index i, either a vec2/vec3 or a view of another array
+static int getvector(lua_State *L, int i, int dim, float *v)
+{
+    lua_Number *p = dim == 2 ? getvec2(L, i) : getvec3(L, i);
+    vecview_type *w;
+    int k;
+    
+    if (p != NULL)
+    {
+        for (k = 0; k < dim; k++)
+            v[k] = p[k];
+        return 1;
+    }
+    
+    if (lua_isuserdata(L, i) && (w = testudata(L, i, VECVIEWTYPE)) != NULL && w->a->dim == dim)
+    {
+        for (k = 0; k < dim; k++)
+            v[k] = w->a->planes[k][w->i];
+        return 1;
+    }
+    
+    return 0;
+}
+
+static void getoperand(lua_State *L, int i, vecarray_type *a, vecarray_operand *o)
+{
+    vecarray_type *b = getvecarray(L, i);
+    int k;
+    
+    o->repeat = b == NULL;
+    if (b != NULL)
+    {
+        luaL_argcheck(L, b->dim == a->dim && b->count == a->count, i, "arrays differ in type or size");
+        for (k = 0; k < a->dim; k++)
+            o->planes[k] = b->planes[k];
+    }
+    else if (!getvector(L, i, a->dim, o->value))
+    {
+        luaL_typerror(L, i, a->dim == 2 ? "vec2 or vec2array" : "vec3 or vec3array");
+    }
+}
+
+//The buffer of one number per element at index i, or a new one, left on the stack
+static float *results(lua_State *L, int i, vecarray_type *a)
+{
+    buffer_type *b;
+    
+    if (lua_isnoneornil(L, i))
+        return pushbuffer(L, a->count, 1)->data;
+    
+    b = checkbuffer(L, i);
+    luaL_argcheck(L, b->components == 1 && b->count == a->count, i, "buffer of one number per element expected");
+    lua_pushvalue(L, i);
+    return b->data;
+}
+
+//Buffers may be unaligned slices, and only hold count numbers
+static inline void storeresults(float *r, size_t j, size_t count, vecarray_vec v)
+{
+    size_t n = count - j < 4 ? count - j : 4;
+    memcpy(r + j, &v, n * sizeof(float));
+}
+
+//Elements
+
+static size_t checkindex(lua_State *L, vecarray_type *a, int i)
+{
+    lua_Number n = luaL_checknumber(L, i);
+    if (!(n >= 1 && n <= (lua_Number)a->count))
+        luaL_error(L, "vecarray index %f out of range (1 to %d)", (double)n, (int)a->count);
+    return (size_t)n - 1;
+}
+
+static void pushview(lua_State *L, int i, vecarray_type *a, size_t j)
+{
+    vecview_type *w = lua_newuserdata(L, sizeof(vecview_type));
+    w->a = a;
+    w->i = j;
+    pushviewmetatable(L);
+    lua_setmetatable(L, -2);
+    lua_getfenv(L, i);
+    lua_setfenv(L, -2);
+}
+
+static void setelement(lua_State *L, vecarray_type *a, size_t j, int v)
+{
+    float e[3];
+    int k;
+    
+    if (!getvector(L, v, a->dim, e))
+        luaL_typerror(L, v, vectorname(a->dim));
+    for (k = 0; k < a->dim; k++)
+        a->planes[k][j] = e[k];
+}
+
+static int newarray(lua_State *L, int dim)
+{
+    if (lua_type(L, 1) == LUA_TNUMBER)
+    {
+        lua_Number n = lua_tonumber(L, 1);
+        luaL_argcheck(L, n >= 0, 1, "count must not be negative");
+        pushvecarray(L, (size_t)n, dim);
+    }
+    else
+    {
+        //Any points: a table of vectors, a buffer, a mesh's vertices or a string of packed floats
+        points_type p;
+        vecarray_type *a;
+        size_t j;
+        int k;
+        
+        checkpoints(L, 1, &p, luaL_optint(L, 2, dim));
+        a = pushvecarray(L, p.count, dim);
+        for (j = 0; j < p.count; j++)
+        {
+            for (k = 0; k < dim; k++)
+                a->planes[k][j] = k < p.components ? p.data[j * p.stride + k] : 0;
+        }
+    }
+    return 1;
+}
+
+static int Lnew2(lua_State *L)      /** vec2array(count or points) */
+{
+    return newarray(L, 2);
+}
+
+static int Lnew3(lua_State *L)      /** vec3array(count or points) */
+{
+    return newarray(L, 3);
+}
+
+static int Lget(lua_State *L)
+{
+    vecarray_type *a = checkfieldudata(L, 1, "vecarray");
+    
+    if (lua_type(L, 2) == LUA_TNUMBER)
+    {
+        pushview(L, 1, a, checkindex(L, a, 2));
+        return 1;
+    }
+    
+    fieldindex(L, 2);   //The method (or nil) for key is on the stack
+    return 1;
+}
+
+static int Lset(lua_State *L)
+{
+    vecarray_type *a = checkfieldudata(L, 1, "vecarray");
+    
+    if (lua_type(L, 2) == LUA_TNUMBER)
+        setelement(L, a, checkindex(L, a, 2), 3);
+    else
+        luaL_error(L, "vecarray elements are set by number");
+    return 0;
+}
+
+//Bulk operations, in place unless they return numbers
+
+static int Lassign(lua_State *L)    /** a:set(x) copies an array or repeats a vector */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    vecarray_operand o;
+    size_t j, n = padded(a);
+    int k;
+    
+    getoperand(L, 2, a, &o);
+    for (k = 0; k < a->dim; k++)
+        for (j = 0; j < n; j += 4)
+            vstore(a->planes[k] + j, operand(&o, k, j));
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Ladd(lua_State *L)       /** a:add(x) */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    vecarray_operand o;
+    size_t j, n = padded(a);
+    int k;
+    
+    getoperand(L, 2, a, &o);
+    for (k = 0; k < a->dim; k++)
+        for (j = 0; j < n; j += 4)
+            vstore(a->planes[k] + j, vload(a->planes[k] + j) + operand(&o, k, j));
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lsub(lua_State *L)       /** a:sub(x) */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    vecarray_operand o;
+    size_t j, n = padded(a);
+    int k;
+    
+    getoperand(L, 2, a, &o);
+    for (k = 0; k < a->dim; k++)
+        for (j = 0; j < n; j += 4)
+            vstore(a->planes[k] + j, vload(a->planes[k] + j) - operand(&o, k, j));
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lscale(lua_State *L)     /** a:scale(x) by a number, or per component by a vector or array */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    vecarray_operand o;
+    size_t j, n = padded(a);
+    int k;
+    
+    if (lua_type(L, 2) == LUA_TNUMBER)
+    {
+        o.repeat = 1;
+        o.value[0] = o.value[1] = o.value[2] = (float)lua_tonumber(L, 2);
+    }
+    else
+    {
+        getoperand(L, 2, a, &o);
+    }
+    
+    for (k = 0; k < a->dim; k++)
+        for (j = 0; j < n; j += 4)
+            vstore(a->planes[k] + j, vload(a->planes[k] + j) * operand(&o, k, j));
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lrotate(lua_State *L)    /** a:rotate(angle) for vec2arrays, a:rotate(angle, axis) for vec3arrays */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    lua_Number angle = luaL_checknumber(L, 2);
+    vecarray_vec c = splat(cosf(angle)), s = splat(sinf(angle));
+    size_t j, n = padded(a);
+    
+    if (a->dim == 2)
+    {
+        float *px = a->planes[0], *py = a->planes[1];
+        for (j = 0; j < n; j += 4)
+        {
+            vecarray_vec x = vload(px + j), y = vload(py + j);
+            vstore(px + j, c*x - s*y);
+            vstore(py + j, s*x + c*y);
+        }
+    }
+    else
+    {
+        //Rodrigues' rotation about a unit axis: v c + (k x v) s + k (k . v)(1 - c)
+        float *px = a->planes[0], *py = a->planes[1], *pz = a->planes[2];
+        float axis[3], len;
+        vecarray_vec kx, ky, kz, t = splat(1 - cosf(angle));
+        
+        if (!getvector(L, 3, 3, axis))
+            luaL_typerror(L, 3, "vec3");
+        len = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+        kx = splat(axis[0] / len);
+        ky = splat(axis[1] / len);
+        kz = splat(axis[2] / len);
+        
+        for (j = 0; j < n; j += 4)
+        {
+            vecarray_vec x = vload(px + j), y = vload(py + j), z = vload(pz + j);
+            vecarray_vec d = (kx*x + ky*y + kz*z) * t;
+            vstore(px + j, x*c + (ky*z - kz*y)*s + kx*d);
+            vstore(py + j, y*c + (kz*x - kx*z)*s + ky*d);
+            vstore(pz + j, z*c + (kx*y - ky*x)*s + kz*d);
+        }
+    }
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Lnormalize(lua_State *L) /** a:normalize() */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    size_t j, n = padded(a);
+    int k;
+    
+    for (j = 0; j < n; j += 4)
+    {
+        vecarray_vec len = vsqrt(lensqr(a, j));
+        for (k = 0; k < a->dim; k++)
+            vstore(a->planes[k] + j, vload(a->planes[k] + j) / len);
+    }
+    
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int Llength(lua_State *L)    /** a:length([out]) returns a buffer of lengths */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    float *r = results(L, 2, a);
+    size_t j, n = padded(a);
+    
+    for (j = 0; j < n; j += 4)
+        storeresults(r, j, a->count, vsqrt(lensqr(a, j)));
+    
+    return 1;
+}
+
+static int Ldistance(lua_State *L)  /** a:distance(point, [out]) returns a buffer of distances */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    float p[3];
+    float *r;
+    size_t j, n = padded(a);
+    int k;
+    
+    if (!getvector(L, 2, a->dim, p))
+        luaL_typerror(L, 2, vectorname(a->dim));
+    r = results(L, 3, a);
+    
+    for (j = 0; j < n; j += 4)
+    {
+        vecarray_vec d2 = splat(0);
+        for (k = 0; k < a->dim; k++)
+        {
+            vecarray_vec d = vload(a->planes[k] + j) - splat(p[k]);
+            d2 += d*d;
+        }
+        storeresults(r, j, a->count, vsqrt(d2));
+    }
+    
+    return 1;
+}
+
+static int Lclone(lua_State *L)     /** a:clone() */
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    vecarray_type *c = pushvecarray(L, a->count, a->dim);
+    if (a->storage) memcpy(c->storage, a->storage, padded(a) * a->dim * sizeof(float));
+    return 1;
+}
+
+static int Llen(lua_State *L)
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    lua_pushinteger(L, (lua_Integer)a->count);
+    return 1;
+}
+
+static int Ltostring(lua_State *L)
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    char s[64];
+    sprintf(s, "%sarray: %d", vectorname(a->dim), (int)a->count);
+    lua_pushstring(L, s);
+    return 1;
+}
+
+static int Lgc(lua_State *L)
+{
+    vecarray_type *a = checkvecarray(L, 1);
+    free(a->storage);
+    memset(a->planes, 0, sizeof(a->planes));
+    a->storage = NULL;
+    a->count = 0;
+    return 0;
+}
+
+//Views
+
+static int Lviewget(lua_State *L)
+{
+    vecview_type *w = checkfieldudata(L, 1, VECVIEWTYPE);
+    int k = fieldindex(L, 2);
+    
+    if (k >= FIELD_X && k < w->a->dim)
+        lua_pushnumber(L, w->a->planes[k][w->i]);
+    else if (k >= FIELD_X)
+        lua_pushnil(L);     //z of a vec2 view
+    //Otherwise the method (or nil) for key is on the stack
+    return 1;
+}
+
+static int Lviewset(lua_State *L)
+{
+    vecview_type *w = checkfieldudata(L, 1, VECVIEWTYPE);
+    int k = fieldindex(L, 2);
+    
+    if (!(k >= FIELD_X && k < w->a->dim))
+        luaL_error(L, "invalid field for %s view", vectorname(w->a->dim));
+    w->a->planes[k][w->i] = (float)luaL_checknumber(L, 3);
+    return 0;
+}
+
+static int Lviewtostring(lua_State *L)
+{
+    vecview_type *w = luaL_checkudata(L, 1, VECVIEWTYPE);
+    lua_Number v[3];
+    char s[FORMATNUMBERS_SIZE(3)];
+    int k;
+    
+    for (k = 0; k < w->a->dim; k++)
+        v[k] = w->a->planes[k][w->i];
+    lua_pushlstring(L, s, formatnumbers(s, v, w->a->dim));
+    return 1;
+}
+
+static const luaL_reg R[] =
+{
+    { "set",        Lassign     },
+    { "add",        Ladd        },
+    { "sub",        Lsub        },
+    { "scale",      Lscale      },
+    { "rotate",     Lrotate     },
+    { "normalize",  Lnormalize  },
+    { "length",     Llength     },
+    { "distance",   Ldistance   },
+    { "clone",      Lclone      },
+    { "__tostring", Ltostring   },
+    { "__len",      Llen        },
+    { "__gc",       Lgc         },
+    { NULL,         NULL        }
+};
+
+static const luaL_reg viewR[] =
+{
+    { "__tostring", Lviewtostring },
+    { NULL,         NULL          }
+};
+
+//Created on first use too, so C code can make arrays in states that never opened the library
+static void pushmetatable(lua_State *L, int dim)
+{
+    if (luaL_newmetatable(L, dim == 2 ? VEC2ARRAYTYPE : VEC3ARRAYTYPE))
+    {
+        luaL_openlib(L,NULL,R,0);
+        setfieldhandlers(L,Lget,Lset,fields);
+    }
+}
+
+static void pushviewmetatable(lua_State *L)
+{
+    if (luaL_newmetatable(L, VECVIEWTYPE))
+    {
+        luaL_openlib(L,NULL,viewR,0);
+        setfieldhandlers(L,Lviewget,Lviewset,viewfields);
+    }
+}
+
+LUALIB_API int luaopen_vecarray(lua_State *L)
+{
+    pushmetatable(L, 2);
+    pushmetatable(L, 3);
+    pushviewmetatable(L);
+    lua_register(L,"vec2array",Lnew2);
+    lua_register(L,"vec3array",Lnew3);
+    lua_pop(L, 2);
+    return 1;
+}
@@ -0,0 +1,56 @@
+//
+//  vecarray.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+
+
+#ifndef Codify_vecarray_h
+#define Codify_vecarray_h
+
+#include <stddef.h>
+
+#include "lua.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CODIFY_VECARRAYLIBNAME "vecarray"
+
+//count vec2s or vec3s stored as structure of arrays: one plane of floats per component, each
+//16 byte aligned and zero padded to a multiple of four elements
+typedef struct vecarray_type_t
+{
+    float *planes[3];   //x, y and z; z is NULL for vec2arrays
+    size_t count;
+    int dim;
+    float *storage;
+} vecarray_type;
+
+LUALIB_API int (luaopen_vecarray) (lua_State *L);
+vecarray_type *getvecarray(lua_State *L, int i);
+vecarray_type *checkvecarray(lua_State *L, int i);
+
+//Creates a zero-filled vec2array (dim 2) or vec3array (dim 3) on the stack
+vecarray_type *pushvecarray(lua_State *L, size_t count, int dim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,187 @@
+//
+//  watchdog.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "watchdog.h"
+#include "lua.h"
+#include "lauxlib.h"
+
+typedef struct watchdog_state
+{
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    double limit;
+    
+    pthread_t thread;
+    int started;
+    
+    lua_State *L;           /* watched main state while an entry is timed, NULL otherwise */
+    int depth;              /* nested watchdog_enter calls */
+    struct timespec deadline;
+    volatile sig_atomic_t fired;
+    
+    /* hook the watched state had when the deadline passed */
+    lua_Hook savedhook;
+    int savedmask;
+    int savedcount;
+} watchdog_state;
+
+static watchdog_state W = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .limit = WATCHDOG_DEFAULTLIMIT,
+};
+
+static struct timespec timefromnow(double seconds)
+{
+    struct timeval tv;
+    struct timespec ts;
+    long long us;
+    
+    gettimeofday(&tv, NULL);
+    us = (long long)tv.tv_sec * 1000000 + tv.tv_usec + (long long)(seconds * 1000000.0);
+    ts.tv_sec = (time_t)(us / 1000000);
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    return ts;
+}
+
+static int pastdeadline(void)
+{
+    struct timespec now = timefromnow(0);
+    return now.tv_sec > W.deadline.tv_sec || (now.tv_sec == W.deadline.tv_sec && now.tv_nsec >= W.deadline.tv_nsec);
+}
+
+
+//Runs on the main thread, and on coroutines it creates once the hook is armed
+static void watchdoghook(lua_State *L, lua_Debug *ar)
+{
+    (void)ar;
+    
+    //Raises on every instruction until the entry returns, so a pcall in a
+    //loop cannot carry on
+    if (W.fired)
+    {
+        luaL_where(L, 0);   /* level 0 is the function being interrupted */
+        lua_pushfstring(L, "Lua program has exceeded its time limit of %f seconds", (lua_Number)W.limit);
+        lua_concat(L, 2);
+        lua_error(L);
+    }
+    
+    //A coroutine created while the hook was armed, resumed after the entry
+    //returned: it never had a hook of its own
+    lua_sethook(L, NULL, 0, 0);
+}
+
+//Called by the watchdog thread with the lock held. Only the main state is
+//hooked: it lives as long as the entry, which can't return while the lock
+//is held, and lua_sethook is the one call Lua allows from a signal handler
+//(the hook fields are only read between instructions). A coroutine looping
+//without yielding is not interrupted; one that yields or returns is stopped
+//as soon as the main state runs again
+static void fire(void)
+{
+    W.savedhook = lua_gethook(W.L);
+    W.savedmask = lua_gethookmask(W.L);
+    W.savedcount = lua_gethookcount(W.L);
+    W.fired = 1;
+    lua_sethook(W.L, watchdoghook, LUA_MASKCOUNT, 1);
+}
+
+static void *watchdogmain(void *ud)
+{
+    (void)ud;
+    
+    pthread_mutex_lock(&W.lock);
+    for (;;)
+    {
+        if (W.L == NULL || W.fired)
+            pthread_cond_wait(&W.wake, &W.lock);
+        else
+        {
+            pthread_cond_timedwait(&W.wake, &W.lock, &W.deadline);
+            
+            //Woken early when the entry returns or the limit changes
+            if (W.L != NULL && !W.fired && pastdeadline())
+                fire();
+        }
+    }
+    
+    return NULL;
+}
+
+
+void watchdog_enter(lua_State *L)
+{
+    pthread_mutex_lock(&W.lock);
+    if (W.depth++ == 0 && W.limit > 0)
+    {
+        if (!W.started && pthread_create(&W.thread, NULL, watchdogmain, NULL) == 0)
+        {
+            pthread_detach(W.thread);
+            W.started = 1;
+        }
+        
+        if (W.started)
+        {
+            W.L = L;
+            W.deadline = timefromnow(W.limit);
+            pthread_cond_signal(&W.wake);
+        }
+    }
+    pthread_mutex_unlock(&W.lock);
+}
+
+void watchdog_leave(lua_State *L)
+{
+    pthread_mutex_lock(&W.lock);
+    if (W.depth > 0 && --W.depth == 0)
+    {
+        //Left alone if the script replaced it since (profiler, setInstructionLimit)
+        if (W.fired && W.L == L && lua_gethook(L) == watchdoghook)
+            lua_sethook(L, W.savedhook, W.savedmask, W.savedcount);
+        
+        W.fired = 0;
+        W.L = NULL;
+        pthread_cond_signal(&W.wake);
+    }
+    pthread_mutex_unlock(&W.lock);
+}
+
+void watchdog_setlimit(double seconds)
+{
+    pthread_mutex_lock(&W.lock);
+    W.limit = seconds > 0 ? seconds : 0;
+    if (W.L != NULL && !W.fired)
+    {
+        if (W.limit > 0)
+            W.deadline = timefromnow(W.limit);
+        else
+            W.L = NULL;
+        pthread_cond_signal(&W.wake);
+    }
+    pthread_mutex_unlock(&W.lock);
+}
+
+double watchdog_getlimit(void)
+{
+    return W.limit;
+}
@@ -0,0 +1,50 @@
+//
+//  watchdog.h
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+#ifndef Codify_watchdog_h
+#define Codify_watchdog_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+
+#define WATCHDOG_DEFAULTLIMIT   10.0    /* seconds allowed per entry into Lua */
+
+//Wall clock limit on host entries into Lua (setup, draw, touched...). A
+//background thread waits for the deadline and only then hooks the main
+//state to raise an error, so scripts normally run with no hook installed.
+//The hook the state had before (profiler, setInstructionLimit) is put back
+//when the entry returns.
+//Entries nest: only the outermost enter/leave pair arms and disarms.
+//Only one lua_State (the one on the main thread) can be watched at a time.
+void watchdog_enter(lua_State *L);
+void watchdog_leave(lua_State *L);
+
+//Seconds allowed per entry, 0 for no limit. Also restarts the clock of
+//an armed entry in progress
+void watchdog_setlimit(double seconds);
+double watchdog_getlimit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
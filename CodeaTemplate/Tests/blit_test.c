@@ -0,0 +1,220 @@
+//
+//  blit_test.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+//  Standalone checks for the blit_row compositing kernels, with timings in
+//  MPix/s against a plain per-pixel loop:
+//
+//  cc -O2 -I../LuaLibs blit_test.c ../LuaLibs/blit.c -lm -o blit_test && ./blit_test
+//
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blit.h"
+
+static void pixel(uint8_t *p, int r, int g, int b, int a)
+{
+    p[0] = r; p[1] = g; p[2] = b; p[3] = a;
+}
+
+static int same(const uint8_t *p, int r, int g, int b, int a)
+{
+    return p[0] == r && p[1] == g && p[2] == b && p[3] == a;
+}
+
+static int near(const uint8_t *p, const uint8_t *q, int tolerance)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        if (abs(p[c] - q[c]) > tolerance) return 0;
+    }
+    return 1;
+}
+
+static void testStraightDestination()
+{
+    uint8_t src[12], dst[12];
+    
+    //Half transparent red onto a transparent straight image stays full red
+    for (int i = 0; i < 3; i++)
+    {
+        pixel(src + i * 4, 255, 0, 0, 128);
+        pixel(dst + i * 4, 0, 0, 0, 0);
+    }
+    blit_row(dst, src, 3, BLIT_NORMAL, 0, 0);
+    for (int i = 0; i < 3; i++)
+    {
+        assert(same(dst + i * 4, 255, 0, 0, 128));
+    }
+    
+    //And is halved onto a premultiplied one
+    memset(dst, 0, sizeof(dst));
+    blit_row(dst, src, 3, BLIT_NORMAL, 0, 1);
+    assert(same(dst, 128, 0, 0, 128) && same(dst + 8, 128, 0, 0, 128));
+    
+    //Half red over half blue, straight: alpha 128 + 128 * 127 / 255, colours weighted by coverage
+    pixel(dst, 0, 0, 255, 128);
+    blit_row(dst, src, 1, BLIT_NORMAL, 0, 0);
+    assert(same(dst, 170, 0, 85, 192));
+    
+    //Opaque destinations come out the same either way
+    pixel(dst, 10, 200, 30, 255);
+    pixel(dst + 4, 10, 200, 30, 255);
+    blit_row(dst, src, 1, BLIT_NORMAL, 0, 0);
+    blit_row(dst + 4, src, 1, BLIT_NORMAL, 0, 1);
+    assert(same(dst, dst[4], dst[5], dst[6], 255));
+    
+    //Adding to a transparent straight pixel gives the source
+    pixel(dst, 0, 0, 0, 0);
+    blit_row(dst, src, 1, BLIT_ADD, 0, 0);
+    assert(same(dst, 255, 0, 0, 128));
+}
+
+static void testCopy()
+{
+    uint8_t src[4], dst[4];
+    
+    pixel(src, 255, 64, 0, 128);
+    blit_row(dst, src, 1, BLIT_COPY, 0, 0);
+    assert(same(dst, 255, 64, 0, 128));
+    blit_row(dst, src, 1, BLIT_COPY, 0, 1);
+    assert(same(dst, 128, 32, 0, 128));
+    
+    pixel(src, 128, 32, 0, 128);
+    blit_row(dst, src, 1, BLIT_COPY, 1, 0);
+    assert(same(dst, 255, 64, 0, 128));
+    
+    //Fully transparent premultiplied pixels have no colour to recover
+    pixel(src, 0, 0, 0, 0);
+    blit_row(dst, src, 1, BLIT_COPY, 1, 0);
+    assert(same(dst, 0, 0, 0, 0));
+}
+
+//Straight source over a destination of either form, one pixel at a time in floats
+static void reference(uint8_t *d, const uint8_t *s, size_t n, int dstpremultiplied)
+{
+    for (size_t i = 0; i < n; i++, d += 4, s += 4)
+    {
+        float sa = s[3] / 255.f, da = d[3] / 255.f, a = sa + da * (1 - sa);
+        
+        for (int c = 0; c < 3; c++)
+        {
+            float dc = dstpremultiplied ? d[c] / 255.f : d[c] / 255.f * da;
+            float out = s[c] / 255.f * sa + dc * (1 - sa);
+            if (!dstpremultiplied) out = a > 0 ? out / a : 0;
+            d[c] = (uint8_t)(out * 255 + 0.5f);
+        }
+        d[3] = (uint8_t)(a * 255 + 0.5f);
+    }
+}
+
+static void testAgainstReference()
+{
+    enum { N = 4099 };
+    uint8_t *src = malloc(N * 4), *dst = malloc(N * 4), *want = malloc(N * 4);
+    
+    srand(1);
+    for (int dstpremultiplied = 0; dstpremultiplied < 2; dstpremultiplied++)
+    {
+        for (size_t i = 0; i < N * 4; i++)
+        {
+            src[i] = rand();
+            dst[i] = rand();
+        }
+        //Every other run of destination pixels is opaque, the rest anything
+        for (size_t i = 0; i < N; i++)
+        {
+            if ((i / 100) & 1) dst[i * 4 + 3] = 255;
+            if (dstpremultiplied)
+            {
+                for (int c = 0; c < 3; c++) dst[i * 4 + c] = dst[i * 4 + c] * dst[i * 4 + 3] / 255;
+            }
+        }
+        memcpy(want, dst, N * 4);
+        reference(want, src, N, dstpremultiplied);
+        blit_row(dst, src, N, BLIT_NORMAL, 0, dstpremultiplied);
+        for (size_t i = 0; i < N; i++)
+        {
+            //Straight results are blended as 8 bit premultiplied colours, and each rounding of
+            //those grows by 255 / alpha when they are turned back
+            int tolerance = dstpremultiplied ? 1 : 1 + 2 * 255 / (want[i * 4 + 3] | 1);
+            assert(near(dst + i * 4, want + i * 4, tolerance));
+        }
+    }
+    free(src);
+    free(dst);
+    free(want);
+}
+
+static double seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark()
+{
+    enum { N = 1024 * 1024, REPS = 50 };
+    static const char *const names[] = { "normal", "add", "multiply", "copy" };
+    uint8_t *src = malloc(N * 4), *dst = malloc(N * 4), *opaque = malloc(N * 4);
+    double t;
+    
+    for (size_t i = 0; i < N * 4; i++)
+    {
+        src[i] = rand();
+        opaque[i] = (i & 3) == 3 ? 255 : rand();
+    }
+    
+    memcpy(dst, opaque, N * 4);
+    t = seconds();
+    for (int r = 0; r < REPS; r++) reference(dst, src, N, 1);
+    printf("  per-pixel floats      %7.1f MPix/s\n", REPS * (double)N / (seconds() - t) / 1e6);
+    
+    for (int mode = BLIT_NORMAL; mode <= BLIT_COPY; mode++)
+    {
+        for (int form = 0; form < 3; form++)
+        {
+            //Premultiplied, straight and opaque, straight and translucent destinations
+            memcpy(dst, form == 2 ? src : opaque, N * 4);
+            t = seconds();
+            for (int r = 0; r < REPS; r++) blit_row(dst, src, N, mode, 0, form == 0);
+            printf("  %-9s %-12s %7.1f MPix/s\n", names[mode], form == 0 ? "premult" : form == 1 ? "straight" : "translucent",
+                   REPS * (double)N / (seconds() - t) / 1e6);
+        }
+    }
+    free(src);
+    free(dst);
+    free(opaque);
+}
+
+int main()
+{
+    testStraightDestination();
+    testCopy();
+    testAgainstReference();
+    
+    printf("blit: ok\n");
+    benchmark();
+    return 0;
+}
@@ -0,0 +1,91 @@
+--
+--  buffer_bench.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Bulk buffer operations against the Lua loops they replace, on 100k
+--  floats and on 25k vec4 elements (particle positions and velocities).
+--  Each pair is checked to give the same result:
+--
+--  sh build.sh && build/luahost buffer_bench.lua
+--
+
+local N = 100000
+local RUNS = 20
+
+local function time(f)
+    local best = math.huge
+    for run = 1, 3 do
+        local start = now()
+        for r = 1, RUNS do f() end
+        best = math.min(best, (now() - start) / RUNS)
+    end
+    return best
+end
+
+local function compare(name, lua, buf)
+    local tl, tb = time(lua), time(buf)
+    print(string.format("%-8s lua %8.3f ms  buffer %7.3f ms  %6.1fx", name, tl * 1000, tb * 1000, tl / tb))
+end
+
+local xs, ys = {}, {}
+for i = 1, N do
+    xs[i] = (i % 100) / 10
+    ys[i] = (i % 7) / 7
+end
+local bx, by = buffer(xs), buffer(ys)
+
+local function near(a, b) return math.abs(a - b) <= 1e-3 * math.max(1, math.abs(a)) end
+
+--Results first, on copies, so the timed runs can keep rewriting them
+do
+    local t = {}
+    for i = 1, N do t[i] = xs[i] + ys[i] * 0.5 end
+    local b = bx:clone():fma(by, 0.5)
+    for i = 1, N, 997 do assert(near(b[i], t[i])) end
+    local s = 0
+    for i = 1, N do s = s + xs[i] * ys[i] end
+    assert(near(bx:dot(by), s))
+end
+
+local lt = {}
+for i = 1, N do lt[i] = xs[i] end
+local bt = bx:clone()
+
+compare("add", function() for i = 1, N do lt[i] = lt[i] + ys[i] end end, function() bt:add(by) end)
+compare("mul", function() for i = 1, N do lt[i] = lt[i] * 0.999 end end, function() bt:mul(0.999) end)
+compare("fma", function() for i = 1, N do lt[i] = lt[i] + xs[i] * ys[i] end end, function() bt:fma(bx, by) end)
+compare("lerp", function() for i = 1, N do lt[i] = lt[i] + (xs[i] - lt[i]) * 0.1 end end, function() bt:lerp(bx, 0.1) end)
+compare("clamp", function()
+    for i = 1, N do
+        local x = lt[i]
+        lt[i] = x < 0 and 0 or x > 5 and 5 or x
+    end
+end, function() bt:clamp(0, 5) end)
+compare("dot", function() local s = 0 for i = 1, N do s = s + xs[i] * ys[i] end return s end, function() return bx:dot(by) end)
+compare("sum", function() local s = 0 for i = 1, N do s = s + xs[i] end return s end, function() return bx:sum() end)
+
+--Particles: position += velocity * dt on vec4 elements
+local M = N / 4
+local pos, vel = {}, {}
+for i = 1, M do
+    pos[i] = vec4(i, 0, 0, 1)
+    vel[i] = vec4(1, 2, 3, 0)
+end
+local bpos, bvel = buffer(M, 4), buffer(M, 4)
+bvel:set(vec4(1, 2, 3, 0))
+compare("vec4 fma", function() for i = 1, M do pos[i] = pos[i] + vel[i] * 0.016 end end, function() bpos:fma(bvel, 0.016) end)
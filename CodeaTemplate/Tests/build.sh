@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+#  build.sh
+#  Codea
+#
+#  Copyright 2012 Two Lives Left Pty. Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+
+
+#  Builds the standalone test programs into build/:
+#
+#  luahost         Lua core and the UIKit-free LuaLibs, see luahost.c
+#  luahost_switch  the same with switch dispatch instead of computed goto
+#  tilegrid_test   see tilegrid_test.cpp
+#  blit_test       see blit_test.c
+#  numconv_test    see numconv_test.c
+#  matrix_bench    see matrix_bench.cpp
+#
+#  sh build.sh && build/luahost watchdog_bench.lua
+#  CFLAGS="-O1 -g -fsanitize=thread" sh build.sh   for a sanitizer build
+#
+
+set -e
+cd "$(dirname "$0")"
+
+CC=${CC:-cc}
+CXX=${CXX:-c++}
+CFLAGS=${CFLAGS:--O2}
+OUT=${OUT:-build}
+
+LIBS="vec2 vec3 vec4 color strbuf serialize buffer vecarray points profiler scheduler watchdog codea_luaext object_reg"
+
+host()
+{
+    name=$1; shift
+    mkdir -p $OUT/$name.o
+    for f in ../Lua/*.c; do
+        [ "$(basename $f)" = print.c ] && continue
+        $CC $CFLAGS "$@" -DLUA_USE_POSIX -I../Lua -c $f -o $OUT/$name.o/$(basename $f .c).o
+    done
+    for f in $LIBS; do
+        $CC $CFLAGS "$@" -I../Lua -I../LuaLibs -c ../LuaLibs/$f.c -o $OUT/$name.o/l_$f.o
+    done
+    $CXX $CFLAGS "$@" -std=gnu++11 -I../Lua -I../LuaLibs -I../GLM -c ../LuaLibs/matrix44.cpp -o $OUT/$name.o/l_matrix44.o
+    $CC $CFLAGS "$@" -I../Lua -I../LuaLibs -c luahost.c -o $OUT/$name.o/luahost.o
+    $CXX $CFLAGS "$@" $OUT/$name.o/*.o -o $OUT/$name -lm -lpthread
+}
+
+host luahost
+host luahost_switch -DLUA_NO_COMPUTED_GOTO
+$CXX $CFLAGS -I../LuaLibs tilegrid_test.cpp ../LuaLibs/tilegrid.cpp -o $OUT/tilegrid_test
+$CC $CFLAGS -I../LuaLibs blit_test.c ../LuaLibs/blit.c -lm -o $OUT/blit_test
+$CC $CFLAGS -I../Lua -c numconv_test.c -o $OUT/numconv_test.o
+$CC $CFLAGS $OUT/numconv_test.o $(ls $OUT/luahost.o/*.o | grep -v '/l_[^/]*$\|/luahost\.o$') -o $OUT/numconv_test -lm
+$CXX $CFLAGS -std=gnu++11 -I../Lua -I../LuaLibs -I../GLM -c matrix_bench.cpp -o $OUT/matrix_bench.o
+$CXX $CFLAGS $OUT/matrix_bench.o $(ls $OUT/luahost.o/*.o | grep -v '/l_matrix44\.o$\|/luahost\.o$') -o $OUT/matrix_bench -lm
@@ -0,0 +1,102 @@
+--
+--  gc_bench.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Allocation heavy workloads run as frames under each collector mode,
+--  printing throughput and the frame time spread. Collector work happens
+--  inside the frames, so the gap between the median frame and the slowest
+--  ones is the pause it adds:
+--
+--  particles:  short lived tables and vec2s, a few hundred kept per frame
+--  world:      a large long lived table graph with a slice rewritten per frame
+--  strings:    concatenation and string keys, most of them garbage at once
+--
+--  sh build.sh && build/luahost gc_bench.lua [frames]
+--
+
+local FRAMES = tonumber((...)) or 600
+
+local workloads = {}
+
+function workloads.particles()
+    local live = {}
+    return function(frame)
+        for i = 1, 2000 do
+            local p = { pos = vec2(i, frame), vel = vec2(1, -1), life = i % 60 }
+            p.pos = p.pos + p.vel
+            if p.life == 0 then live[#live + 1] = p end
+        end
+        if #live > 20000 then live = {} end
+    end
+end
+
+function workloads.world()
+    local world = {}
+    for i = 1, 50000 do
+        world[i] = { id = i, name = "entity" .. i, links = {}, pos = vec3(i, 0, 0) }
+    end
+    for i = 1, 50000 do
+        world[i].links[1] = world[(i * 7) % 50000 + 1]
+    end
+    return function(frame)
+        local base = (frame * 500) % 50000
+        for i = base + 1, base + 500 do
+            world[i].pos = vec3(i, frame, 0)
+            world[i].links[1] = world[(i * frame) % 50000 + 1]
+            world[i].tags = { frame, i }
+        end
+    end
+end
+
+function workloads.strings()
+    local names = {}
+    return function(frame)
+        local parts = {}
+        for i = 1, 1000 do
+            parts[i] = "item" .. i .. ":" .. frame
+        end
+        names[frame % 64] = table.concat(parts, ",")
+        local index = {}
+        for i = 1, 1000 do index[parts[i]] = i end
+    end
+end
+
+local function run(name, mode)
+    collectgarbage(mode)
+    collectgarbage("collect")
+    local step = workloads[name]()
+    local times, peak = {}, 0
+    local start = now()
+    for frame = 1, FRAMES do
+        local t = now()
+        step(frame)
+        times[frame] = now() - t
+        peak = math.max(peak, collectgarbage("count"))
+    end
+    local total = now() - start
+    table.sort(times)
+    local function at(q) return times[math.max(1, math.floor(FRAMES * q))] * 1000 end
+    print(string.format("%-10s %-13s %7.1f frames/s  median %6.2f ms  p99 %6.2f ms  max %6.2f ms  peak %7.0f KB",
+        name, mode, FRAMES / total, at(0.5), at(0.99), at(1), peak))
+end
+
+for _, name in ipairs({ "particles", "world", "strings" }) do
+    run(name, "incremental")
+    run(name, "generational")
+end
+collectgarbage("incremental")
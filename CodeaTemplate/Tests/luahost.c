@@ -0,0 +1,184 @@
+//
+//  luahost.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+//  Runs the Lua scripts in this directory outside the app: the Lua core and
+//  the LuaLibs that need no UIKit or GL, with a few host functions for
+//  timing and for standing in for the frame loop:
+//
+//  now()               monotonic wall clock seconds since startup
+//  lap()               seconds since the last call to lap, for timing
+//                      single steps at full float precision
+//  tick(time)          runs scheduler_tick, returns true or false, message
+//  watched(f, limit)   calls f under watchdog_enter/leave with a limit in
+//                      seconds, returns true or false, message
+//  counthook(count)    installs an always-on count hook that does nothing,
+//                      to measure what the hook alone costs; 0 removes it
+//
+//  Built by build.sh; run as luahost script.lua [args]
+//
+
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "color.h"
+#include "strbuf.h"
+#include "serialize.h"
+#include "buffer.h"
+#include "vecarray.h"
+#include "matrix44.h"
+#include "points.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "watchdog.h"
+
+static const luaL_Reg hostlibs[] =
+{
+    {CODIFY_COLORLIBNAME, luaopen_color},
+    {CODIFY_VEC2LIBNAME, luaopen_vec2},
+    {CODIFY_VEC3LIBNAME, luaopen_vec3},
+    {CODIFY_VEC4LIBNAME, luaopen_vec4},
+    {CODIFY_STRBUFLIBNAME, luaopen_strbuf},
+    {CODIFY_SERIALIZELIBNAME, luaopen_serialize},
+    {CODIFY_BUFFERLIBNAME, luaopen_buffer},
+    {CODIFY_VECARRAYLIBNAME, luaopen_vecarray},
+    {CODIFY_MATRIX44LIBNAME, luaopen_matrix44},
+    {CODIFY_PROFILERLIBNAME, luaopen_profiler},
+    {CODIFY_SCHEDULERLIBNAME, luaopen_scheduler},
+    {NULL, NULL}
+};
+
+//There are no meshes outside the app
+float *getmeshvertices(lua_State *L, int i, size_t *count, int *stride)
+{
+    (void)L; (void)i; (void)count; (void)stride;
+    return NULL;
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//lua_Number is a float, so times are kept small by counting from startup
+static double start;
+
+static int now(lua_State *L)
+{
+    lua_pushnumber(L, (lua_Number)(seconds() - start));
+    return 1;
+}
+
+static int lap(lua_State *L)
+{
+    static double last;
+    double t = seconds();
+    lua_pushnumber(L, (lua_Number)(t - last));
+    last = t;
+    return 1;
+}
+
+static int tick(lua_State *L)
+{
+    if (scheduler_tick(L, luaL_checknumber(L, 1)) != 0)
+    {
+        lua_pushboolean(L, 0);
+        lua_insert(L, -2);
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int watched(lua_State *L)
+{
+    int status;
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    watchdog_setlimit(luaL_checknumber(L, 2));
+    lua_settop(L, 1);
+    watchdog_enter(L);
+    status = lua_pcall(L, 0, 0, 0);
+    watchdog_leave(L);
+    lua_pushboolean(L, status == 0);
+    lua_insert(L, -2 + (status == 0));
+    return status == 0 ? 1 : 2;
+}
+
+static void countnothing(lua_State *L, lua_Debug *ar)
+{
+    (void)L; (void)ar;
+}
+
+static int counthook(lua_State *L)
+{
+    int count = luaL_checkint(L, 1);
+    if (count > 0)
+        lua_sethook(L, countnothing, LUA_MASKCOUNT, count);
+    else
+        lua_sethook(L, NULL, 0, 0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    lua_State *L = luaL_newstate();
+    const luaL_Reg *lib;
+    int i, status;
+    
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s script.lua [args]\n", argv[0]);
+        return 2;
+    }
+    
+    start = seconds();
+    luaL_openlibs(L);
+    for (lib = hostlibs; lib->func; lib++)
+    {
+        lua_pushcfunction(L, lib->func);
+        lua_pushstring(L, lib->name);
+        lua_call(L, 1, 0);
+    }
+    lua_register(L, "now", now);
+    lua_register(L, "lap", lap);
+    lua_register(L, "tick", tick);
+    lua_register(L, "watched", watched);
+    lua_register(L, "counthook", counthook);
+    
+    status = luaL_loadfile(L, argv[1]);
+    if (status == 0)
+    {
+        for (i = 2; i < argc; i++) lua_pushstring(L, argv[i]);
+        status = lua_pcall(L, argc - 2, 0, 0);
+    }
+    if (status != 0)
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    
+    lua_close(L);
+    return status != 0;
+}
@@ -0,0 +1,141 @@
+//
+//  matrix_bench.cpp
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+//  Times the matrix44 kernels against the GLM code they replaced, and
+//  checks they agree. matrix44.cpp is included whole to reach its static
+//  kernels, so this links against the Lua core like luahost does:
+//
+//  sh build.sh && build/matrix_bench
+//  CFLAGS=-Os sh build.sh && build/matrix_bench    at other optimisation levels
+//
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../LuaLibs/matrix44.cpp"
+
+//There are no meshes outside the app
+extern "C" float *getmeshvertices(lua_State *, int, size_t *, int *)
+{
+    return NULL;
+}
+
+static double seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void randomMatrix(float *m)
+{
+    for (int i = 0; i < 16; i++) m[i] = (float)rand() / RAND_MAX * 2 - 1;
+    for (int i = 0; i < 4; i++) m[i * 5] += 4;     //Keep it well conditioned
+}
+
+static bool near(const float *a, const float *b, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (fabsf(a[i] - b[i]) > 1e-5f * (1 + fabsf(b[i]))) return false;
+    }
+    return true;
+}
+
+static void testAgreement()
+{
+    float a[16], b[16], r[16], v[4];
+    
+    for (int k = 0; k < 2000; k++)
+    {
+        randomMatrix(a);
+        randomMatrix(b);
+        glm::mat4 ga = glm::make_mat4(a), gb = glm::make_mat4(b);
+        
+        mat4_mul(r, a, b);
+        assert(near(r, glm::value_ptr(ga * gb), 16));
+        mat4_inverse(r, a);
+        assert(near(r, glm::value_ptr(glm::inverse(ga)), 16));
+        mat4_transform(v, a, 1, 2, 3, 1);
+        glm::vec4 gv = ga * glm::vec4(1, 2, 3, 1);
+        assert(near(v, glm::value_ptr(gv), 4));
+        
+        //In place, as the methods use them
+        mat4_mul(a, a, b);
+        assert(near(a, glm::value_ptr(ga * gb), 16));
+    }
+    printf("matrix: ok\n");
+}
+
+//The noinline wrappers keep each call a real call, as it is from Lua
+__attribute__((noinline)) static void kernelMul(float *r, const float *a, const float *b) { mat4_mul(r, a, b); }
+__attribute__((noinline)) static void glmMul(float *r, const float *a, const float *b)
+{
+    *(glm::mat4 *)r = glm::make_mat4(a) * glm::make_mat4(b);
+}
+__attribute__((noinline)) static void kernelInverse(float *r, const float *a, const float *) { mat4_inverse(r, a); }
+__attribute__((noinline)) static void glmInverse(float *r, const float *a, const float *)
+{
+    *(glm::mat4 *)r = glm::inverse(glm::make_mat4(a));
+}
+__attribute__((noinline)) static void kernelTransform(float *r, const float *a, const float *b) { mat4_transform(r, a, b[0], b[1], b[2], 1); }
+__attribute__((noinline)) static void glmTransform(float *r, const float *a, const float *b)
+{
+    *(glm::vec4 *)r = glm::make_mat4(a) * glm::vec4(b[0], b[1], b[2], 1);
+}
+
+static double timeOf(void (*f)(float *, const float *, const float *))
+{
+    enum { N = 5000000 };
+    float a[16], b[16], r[16];
+    double best = 1e9;
+    
+    randomMatrix(a);
+    randomMatrix(b);
+    for (int run = 0; run < 3; run++)
+    {
+        double t = seconds();
+        for (int i = 0; i < N; i++)
+        {
+            f(r, a, b);
+            b[0] += r[1] * 1e-9f;   //Each call depends on the last
+        }
+        t = (seconds() - t) / N * 1e9;
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+static void benchmark()
+{
+    printf("  mul        kernel %6.1f ns  glm %6.1f ns\n", timeOf(kernelMul), timeOf(glmMul));
+    printf("  inverse    kernel %6.1f ns  glm %6.1f ns\n", timeOf(kernelInverse), timeOf(glmInverse));
+    printf("  transform  kernel %6.1f ns  glm %6.1f ns\n", timeOf(kernelTransform), timeOf(glmTransform));
+}
+
+int main()
+{
+    testAgreement();
+    benchmark();
+    return 0;
+}
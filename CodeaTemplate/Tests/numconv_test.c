@@ -0,0 +1,126 @@
+//
+//  numconv_test.c
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+//  Checks lua_num2str and lua_str2num against the C library and times them
+//  against the "%.14g" sprintf and strtod they replaced. Every step'th float
+//  is printed, read back by both strtof and lua_str2num, and compared; a
+//  step of 1 sweeps all four billion:
+//
+//  sh build.sh && build/numconv_test [step]
+//
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+static double seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int identical(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void testRoundTrip(unsigned step)
+{
+    char s[64];
+    unsigned long long checked = 0;
+    
+    for (unsigned long long u = 0; u <= 0xFFFFFFFFull; u += step)
+    {
+        unsigned bits = (unsigned)u;
+        float f;
+        char *end;
+        
+        memcpy(&f, &bits, sizeof(f));
+        if (isnan(f)) continue;
+        
+        lua_num2str(s, f);
+        assert(identical(strtof(s, &end), f) && *end == '\0');
+        assert(identical(lua_str2num(s, &end), f) && *end == '\0');
+        checked++;
+    }
+    printf("numconv: %llu floats round trip\n", checked);
+}
+
+static void testFormat()
+{
+    static const struct { float f; const char *s; } cases[] = {
+        { 0.0f, "0" }, { 1.0f, "1" }, { -2.5f, "-2.5" }, { 16777216.0f, "16777216" },
+        { 0.1f, "0.1" }, { 1.0f / 3, "0.33333334" }, { 1e20f, "1e+20" }, { 0.0001f, "0.0001" },
+    };
+    char s[64];
+    
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        lua_num2str(s, cases[i].f);
+        assert(strcmp(s, cases[i].s) == 0);
+    }
+}
+
+static void benchmark()
+{
+    enum { N = 1000000 };
+    static char text[N][32];
+    float *values = malloc(N * sizeof(float));
+    volatile float sink = 0;
+    double t;
+    char s[64];
+    
+    srand(1);
+    for (int i = 0; i < N; i++)
+    {
+        values[i] = (i & 1) ? (float)(rand() % 100000) / 8 : (float)rand() / RAND_MAX * 1000;
+        lua_num2str(text[i], values[i]);
+    }
+    
+    t = seconds();
+    for (int i = 0; i < N; i++) sink += lua_num2str(s, values[i]);
+    printf("  lua_num2str     %6.0f ns\n", (seconds() - t) / N * 1e9);
+    t = seconds();
+    for (int i = 0; i < N; i++) sink += snprintf(s, sizeof(s), "%.14g", values[i]);
+    printf("  sprintf %%.14g   %6.0f ns\n", (seconds() - t) / N * 1e9);
+    
+    t = seconds();
+    for (int i = 0; i < N; i++) sink += lua_str2num(text[i], NULL);
+    printf("  lua_str2num     %6.0f ns\n", (seconds() - t) / N * 1e9);
+    t = seconds();
+    for (int i = 0; i < N; i++) sink += strtod(text[i], NULL);
+    printf("  strtod          %6.0f ns\n", (seconds() - t) / N * 1e9);
+    
+    free(values);
+}
+
+int main(int argc, char **argv)
+{
+    testFormat();
+    testRoundTrip(argc > 1 ? (unsigned)atoi(argv[1]) : 997);
+    benchmark();
+    return 0;
+}
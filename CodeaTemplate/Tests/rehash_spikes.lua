@@ -0,0 +1,70 @@
+--
+--  rehash_spikes.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Frame spikes from growing hash tables. Prints the worst single insert
+--  and the worst frame of 1000 inserts while growing:
+--
+--  table:    a Lua table to 1M string keys
+--  strings:  the string table, with 1M new strings of which few are kept
+--
+--  A rehash done all at once shows as one insert costing milliseconds;
+--  incremental rehashing spreads it over the following inserts. Run it on
+--  builds from before and after to compare:
+--
+--  sh build.sh && build/luahost rehash_spikes.lua [keys]
+--
+
+local N = tonumber((...)) or 1000000
+local FRAME = 1000
+
+--Runs insert(i) for i = 1, N, timing each one
+local function measure(name, insert)
+    local worstInsert, worstFrame, frame, total = 0, 0, 0, 0
+    lap()
+    for i = 1, N do
+        insert(i)
+        local t = lap()
+        worstInsert = math.max(worstInsert, t)
+        frame = frame + t
+        if i % FRAME == 0 then
+            worstFrame = math.max(worstFrame, frame)
+            total = total + frame
+            frame = 0
+        end
+    end
+    print(string.format("%-8s worst insert %8.1f us  worst frame %8.1f us  total %7.1f ms",
+        name, worstInsert * 1e6, worstFrame * 1e6, total * 1000))
+end
+
+--The collector would add pauses of its own
+collectgarbage("collect")
+collectgarbage("stop")
+
+local keys = {}
+for i = 1, N do keys[i] = "key" .. i end
+local t = {}
+measure("table", function(i) t[keys[i]] = i end)
+t, keys = nil, nil
+collectgarbage("collect")
+collectgarbage("stop")
+
+local keep = {}
+measure("strings", function(i) keep[i % FRAME + 1] = "s" .. i end)
+
+collectgarbage("restart")
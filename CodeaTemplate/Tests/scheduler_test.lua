@@ -0,0 +1,120 @@
+--
+--  scheduler_test.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Checks for the tasks scheduler, stepping frames by hand with tick():
+--
+--  sh build.sh && build/luahost scheduler_test.lua
+--
+--  Build with CFLAGS="-O1 -g -DLUA_USE_APICHECK" to have stack misuse
+--  asserted rather than silently read.
+--
+
+local time, frame = 0, 0
+
+local function step(frames)
+    for i = 1, frames or 1 do
+        frame = frame + 1
+        time = time + 1 / 60
+        assert(tick(time))
+    end
+end
+
+--Waits that fail inside a pcall leave the task running
+local function testFailedWaits()
+    local t = tasks.spawn(function() assert(not pcall(tasks.wait, 0.05)) end)
+    local u = tasks.spawn(function() assert(not pcall(tasks.waitFrames, 3)) end)
+    local v = tasks.spawn(function() assert(not pcall(tasks.waitFor, "e")) end)
+    step()
+    assert(t.status == "dead" and u.status == "dead" and v.status == "dead")
+    assert(tasks.signal("e") == 0)
+end
+
+--A plain yield after a failed wait waits one frame, not for what the failed wait asked
+local function testYieldAfterFailedWait()
+    local resumed
+    local t = tasks.spawn(function()
+        assert(not pcall(tasks.waitFor, "ev"))
+        coroutine.yield()
+        resumed = frame
+    end)
+    local start = frame
+    step()
+    assert(t.status == "sleeping")
+    step()
+    assert(t.status == "dead" and resumed == start + 2)
+    assert(tasks.signal("ev") == 0)
+
+    resumed = nil
+    t = tasks.spawn(function()
+        assert(not pcall(tasks.wait, 5))
+        coroutine.yield()
+        resumed = frame
+    end)
+    start = frame
+    step(2)
+    assert(t.status == "dead" and resumed == start + 2)
+
+    resumed = nil
+    t = tasks.spawn(function()
+        assert(not pcall(tasks.waitFrames, 100))
+        coroutine.yield("anything")
+        resumed = frame
+    end)
+    start = frame
+    step(2)
+    assert(t.status == "dead" and resumed == start + 2)
+end
+
+local function testWaits()
+    local got
+    local t = tasks.spawn(function()
+        tasks.waitFrames(3)
+        got = { tasks.waitFor("go") }
+        tasks.wait(0.1)
+    end)
+    step(3)
+    assert(t.status == "sleeping")
+    step()
+    assert(t.status == "waiting")
+    assert(tasks.signal("go", 1, "two") == 1)
+    step()
+    assert(got[1] == 1 and got[2] == "two" and t.status == "sleeping")
+    step(7)
+    assert(t.status == "dead")
+end
+
+local function testCancel()
+    local a = tasks.spawn(function() tasks.wait(5) end)
+    local b = tasks.spawn(function() tasks.waitFor("g") end)
+    local c = tasks.spawn(function() end)
+    c:cancel()
+    step()
+    a:cancel()
+    b:cancel()
+    assert(tasks.signal("g") == 0)
+    step()
+    assert(select(3, tasks.stats()) == 0)
+end
+
+testFailedWaits()
+testYieldAfterFailedWait()
+testWaits()
+testCancel()
+
+print("scheduler: ok")
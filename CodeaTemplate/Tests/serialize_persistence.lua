@@ -0,0 +1,138 @@
+--
+--  serialize_persistence.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+--  Saves a save-game sized table through project data two ways and
+--  prints the times and sizes:
+--
+--  plist:     one saveProjectData key per value, the way projects store
+--             tables today (vectors as "x,y" strings)
+--  serialize: one serialize.encode blob under a single key, kept as
+--             NSData by the persistence layer
+--
+--  Paste into the Main tab of a project and run it. Both paths are read
+--  back and compared with the original table.
+--
+
+local ENTITIES = 500
+local RUNS = 5
+
+local function makeSave()
+    local save = { version = 3, player = "Sam", level = 12, score = 48210, entities = {} }
+    for i = 1, ENTITIES do
+        save.entities[i] = {
+            kind = (i % 3 == 0) and "enemy" or "pickup",
+            pos = vec2(i * 16, (i * 7) % 768),
+            hp = i % 100,
+            alive = (i % 5 ~= 0),
+            tags = { "t" .. (i % 4), "zone" .. (i % 10) },
+        }
+    end
+    return save
+end
+
+--plist path: every leaf becomes its own key, like "entities.3.pos"
+local function flatten(t, prefix, out)
+    for k, v in pairs(t) do
+        local key = prefix .. tostring(k)
+        local kind = type(v)
+        if kind == "table" then
+            flatten(v, key .. ".", out)
+        elseif kind == "userdata" then
+            out[key] = "vec2:" .. v.x .. "," .. v.y
+        else
+            out[key] = v
+        end
+    end
+    return out
+end
+
+local function unflatten(keys, read)
+    local save = {}
+    for _, key in ipairs(keys) do
+        local value = read(key)
+        if type(value) == "string" and value:sub(1, 5) == "vec2:" then
+            local x, y = value:match("vec2:([^,]+),(.+)")
+            value = vec2(tonumber(x), tonumber(y))
+        end
+        local t, last = save, nil
+        for part in key:gmatch("[^.]+") do
+            if last ~= nil then
+                local k = tonumber(last) or last
+                t[k] = t[k] or {}
+                t = t[k]
+            end
+            last = part
+        end
+        t[tonumber(last) or last] = value
+    end
+    return save
+end
+
+local function same(a, b)
+    if type(a) ~= type(b) then return false end
+    if type(a) == "userdata" then return a.x == b.x and a.y == b.y end
+    if type(a) ~= "table" then return a == b end
+    for k, v in pairs(a) do if not same(v, b[k]) then return false end end
+    for k in pairs(b) do if a[k] == nil then return false end end
+    return true
+end
+
+local function best(f)
+    local t = math.huge
+    for run = 1, RUNS do
+        local start = os.clock()
+        f()
+        t = math.min(t, os.clock() - start)
+    end
+    return t * 1000
+end
+
+function setup()
+    local save = makeSave()
+    local keys, loaded, bytes
+
+    clearProjectData()
+    local plistSave = best(function()
+        local values = flatten(save, "", {})
+        keys, bytes = {}, 0
+        for key, value in pairs(values) do
+            saveProjectData(key, value)
+            keys[#keys + 1] = key
+            bytes = bytes + #key + #tostring(value)
+        end
+    end)
+    local plistRead = best(function() loaded = unflatten(keys, readProjectData) end)
+    print(string.format("plist:     save %.2f ms, read %.2f ms, %d keys, %d bytes, %s",
+        plistSave, plistRead, #keys, bytes, same(save, loaded) and "ok" or "MISMATCH"))
+
+    clearProjectData()
+    local blob
+    local serialSave = best(function()
+        blob = serialize.encode(save)
+        saveProjectData("save", blob)
+    end)
+    local serialRead = best(function() loaded = serialize.decode(readProjectData("save")) end)
+    print(string.format("serialize: save %.2f ms, read %.2f ms, 1 key, %d bytes, %s",
+        serialSave, serialRead, #blob, same(save, loaded) and "ok" or "MISMATCH"))
+
+    clearProjectData()
+end
+
+function draw()
+    background(0)
+end
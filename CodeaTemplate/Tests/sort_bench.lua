@@ -0,0 +1,79 @@
+--
+--  sort_bench.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Times table.sort and table.sortby on 1k to 100k elements. Each size runs
+--  on random, sorted and reversed numbers, random strings, and records
+--  sorted by a numeric field. A comparator function forces the sort that
+--  calls into Lua for every comparison, which is how every sort ran before
+--  the C key paths. Results are checked to be in order:
+--
+--  sh build.sh && build/luahost sort_bench.lua
+--
+
+local SIZES = { 1000, 10000, 100000 }
+local RUNS = 3
+
+local inputs = {
+    random = function(n) local t = {} for i = 1, n do t[i] = math.random() end return t end,
+    sorted = function(n) local t = {} for i = 1, n do t[i] = i end return t end,
+    reversed = function(n) local t = {} for i = 1, n do t[i] = n - i end return t end,
+    strings = function(n) local t = {} for i = 1, n do t[i] = "s" .. math.random(n * 10) end return t end,
+    records = function(n) local t = {} for i = 1, n do t[i] = { depth = math.random(100), id = i } end return t end,
+}
+
+local function less(a, b) return a < b end
+local function byDepth(a, b) return a.depth < b.depth end
+
+local sorts = {
+    { "sort", function(t) table.sort(t) end, "values" },
+    { "sort(less)", function(t) table.sort(t, less) end, "values" },
+    { "sortby", function(t) table.sortby(t, "depth") end, "records" },
+    { "sort(byDepth)", function(t) table.sort(t, byDepth) end, "records" },
+}
+
+local function ordered(t, key)
+    for i = 2, #t do
+        local a, b = t[i - 1], t[i]
+        if key then a, b = a[key], b[key] end
+        if b < a then return false end
+    end
+    return true
+end
+
+local function copy(t) local c = {} for i = 1, #t do c[i] = t[i] end return c end
+
+math.randomseed(1)
+for _, n in ipairs(SIZES) do
+    for _, input in ipairs({ "random", "sorted", "reversed", "strings", "records" }) do
+        local data = inputs[input](n)
+        for _, s in ipairs(sorts) do
+            if (input == "records") == (s[3] == "records") then
+                local best = math.huge
+                for run = 1, RUNS do
+                    local t = copy(data)
+                    local start = now()
+                    s[2](t)
+                    best = math.min(best, now() - start)
+                    assert(ordered(t, s[3] == "records" and "depth"))
+                end
+                print(string.format("%6d %-9s %-14s %9.2f ms", n, input, s[1], best * 1000))
+            end
+        end
+    end
+end
@@ -0,0 +1,146 @@
+//
+//  tilegrid_test.cpp
+//  Codea
+//  
+//  Copyright 2012 Two Lives Left Pty. Ltd.
+//  
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//  
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//  
+
+//  Standalone checks for TileGrid, which has no Lua or GL dependencies:
+//
+//  c++ -I../LuaLibs tilegrid_test.cpp ../LuaLibs/tilegrid.cpp -o tilegrid_test && ./tilegrid_test
+//
+
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "tilegrid.h"
+
+//Maps 0..1024 x 0..768 to clip space, like an ortho() projection
+static const float screen[16] = { 2/1024.f, 0, 0, 0,  0, 2/768.f, 0, 0,  0, 0, 1, 0,  -1, -1, 0, 1 };
+static const float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+static void testStorage()
+{
+    TileGrid grid(32, 32);
+    
+    grid.resize(100, 70);
+    assert(grid.width() == 100 && grid.height() == 70);
+    assert(grid.chunkCount() == 7 * 5);
+    
+    grid.set(0, 0, 1);
+    grid.set(99, 69, 8);
+    assert(grid.get(0, 0) == 1 && grid.get(99, 69) == 8 && grid.get(50, 50) == 0);
+    
+    //Clipped to the grid
+    grid.fill(-5, -5, 200, 200, 3);
+    assert(grid.get(0, 0) == 3 && grid.get(99, 69) == 3);
+    grid.fill(-5, -5, 200, 200, 0);
+    assert(grid.get(0, 0) == 0 && grid.get(99, 69) == 0);
+}
+
+static void testResize()
+{
+    TileGrid grid(32, 32);
+    
+    grid.resize(64, 64);
+    grid.fill(10, 10, 30, 30, 3);
+    grid.resize(20, 20);
+    assert(grid.get(19, 19) == 3 && grid.get(5, 5) == 0);
+    assert(grid.chunkCount() == 4);
+    
+    //Kept tiles are counted again in their new chunks
+    grid.setAtlas(128, 128, 128, 128);
+    assert(grid.chunk(0).vertexCount() == 6 * 36);
+    assert(grid.chunk(3).vertexCount() == 6 * 16);
+    
+    grid.resize(0, 0);
+    assert(grid.chunkCount() == 0);
+}
+
+static void testDirty()
+{
+    TileGrid grid(32, 32);
+    
+    grid.resize(32, 32);
+    grid.setAtlas(128, 128, 128, 128);
+    grid.set(1, 1, 2);
+    grid.chunk(0);
+    
+    unsigned rebuilds = grid.rebuilds();
+    grid.chunk(0);
+    assert(grid.rebuilds() == rebuilds);
+    
+    grid.set(1, 1, 3);
+    grid.chunk(0);
+    assert(grid.rebuilds() == rebuilds + 1);
+    
+    //Setting a tile to the id it already has doesn't dirty its chunk
+    grid.set(1, 1, 3);
+    grid.chunk(0);
+    assert(grid.rebuilds() == rebuilds + 1);
+}
+
+static void testCulling()
+{
+    TileGrid grid(32, 32);
+    std::vector<int> visible;
+    
+    grid.resize(100, 70);
+    grid.set(0, 0, 1);
+    grid.set(99, 69, 1);
+    
+    //Only non-empty chunks inside the view
+    grid.visibleChunks(screen, visible);
+    assert(visible.size() == 1 && visible[0] == 0);
+    
+    grid.fill(0, 0, 100, 70, 0);
+    grid.visibleChunks(identity, visible);
+    assert(visible.empty());
+}
+
+static void testTexCoords()
+{
+    TileGrid grid(32, 32);
+    
+    //4 x 2 cells in the top half of the texture
+    grid.resize(100, 70);
+    grid.setAtlas(128, 64, 128, 128);
+    grid.set(0, 0, 1);
+    grid.set(5, 5, 9);      //Past the last cell, not drawn
+    grid.set(99, 69, 8);
+    
+    const TileGrid::Chunk& first = grid.chunk(0);
+    assert(first.vertexCount() == 6);
+    assert(first.texCoords[0] == 0 && first.texCoords[1] == 0.75f);
+    assert(first.texCoords[4] == 0.25f && first.texCoords[5] == 1.f);
+    
+    const TileGrid::Chunk& last = grid.chunk(34);
+    assert(last.vertexCount() == 6);
+    assert(last.texCoords[0] == 0.75f && last.texCoords[1] == 0.5f);
+    assert(last.vertices[0] == 99 * 32 && last.vertices[1] == 69 * 32);
+}
+
+int main()
+{
+    testStorage();
+    testResize();
+    testDirty();
+    testCulling();
+    testTexCoords();
+    
+    printf("tilegrid: ok\n");
+    return 0;
+}
@@ -0,0 +1,64 @@
+--
+--  vm_bench.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Interpreter dispatch benchmark, run with no hook installed so the fused
+--  opcodes are in play. Compare the computed goto build with the switch
+--  build:
+--
+--  sh build.sh && build/luahost vm_bench.lua && build/luahost_switch vm_bench.lua
+--
+
+local RUNS = 5
+
+local Obj = {}
+Obj.__index = Obj
+function Obj.new() return setmetatable({ pos = { x = 1, y = 2 }, vel = { x = 0.5, y = 0.25 }, n = 0 }, Obj) end
+function Obj:step(dt)
+    self.pos.x = self.pos.x + self.vel.x * dt
+    self.pos.y = self.pos.y + self.vel.y * dt
+    self.n = self.n + 1
+end
+function Obj:get() return self.pos.x + self.pos.y end
+
+local objs = {}
+for i = 1, 1000 do objs[i] = Obj.new() end
+
+local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end
+
+local benchmarks = {
+    { "method calls", function() for f = 1, 1000 do for i = 1, #objs do objs[i]:step(0.016) end end end },
+    { "field chains", function() local s = 0 for f = 1, 1000 do for i = 1, #objs do s = s + objs[i].pos.x + objs[i].vel.y end end end },
+    { "for loop", function() local x = 0 for i = 1, 5000000 do x = x + i end end },
+    { "recursion", function() fib(25) end },
+    { "strings", function() local t = {} for i = 1, 100000 do t[#t + 1] = ("%d"):format(i):rep(2) end end },
+}
+
+assert(debug.gethook() == nil)
+local total = 0
+for _, b in ipairs(benchmarks) do
+    local best = math.huge
+    for run = 1, RUNS do
+        local start = now()
+        b[2]()
+        best = math.min(best, now() - start)
+    end
+    total = total + best
+    print(string.format("%-14s %8.1f ms", b[1], best * 1000))
+end
+print(string.format("%-14s %8.1f ms", "total", total * 1000))
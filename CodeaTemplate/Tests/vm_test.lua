@@ -0,0 +1,154 @@
+--
+--  vm_test.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+
+--  Checks for the VM's fused opcodes: GETTABLE2 (a.b.c chains), SELFCALL
+--  (o:m() calls) and FORLOOPINC (for loops with a positive constant step).
+--  Covers hooks seeing every instruction of a fused pair, the names in
+--  error messages, for loop edge cases and string.dump round trips. Run it
+--  on both dispatch builds:
+--
+--  sh build.sh && build/luahost vm_test.lua && build/luahost_switch vm_test.lua
+--
+
+local O = { v = 3, a = { b = { c = 7 } } }
+function O:get(x) return self.v + (x or 0) end
+function O:tail() return self:get(1) end
+
+local function errorOf(f)
+    local ok, e = pcall(f)
+    assert(not ok)
+    return (e:gsub("^[^:]*:%d+: ", ""))
+end
+
+local function testFused()
+    assert(O:get() == 3 and O:tail() == 4)
+    assert(O.a.b.c == 7 and O.a.b == O.a.b)
+
+    --Metamethods run inside either half of a pair
+    local m = setmetatable({}, { __index = function(t, k) return k .. "!" end })
+    local n = setmetatable({}, { __index = function(t, k) return m end })
+    assert(m.x == "x!" and n.q.r == "r!")
+
+    --A method call that yields
+    local C = {}
+    function C:y(v) return coroutine.yield(v) end
+    local co = coroutine.wrap(function()
+        local a = C:y(1)
+        local b = C:y(a + 1)
+        return a + b
+    end)
+    assert(co() == 1 and co(10) == 11 and co(20) == 30)
+
+    --The call half keeps its name
+    local function namer() return debug.getinfo(1, "n").name end
+    local N = { namer = namer }
+    assert(N:namer() == "namer" and N.namer() == "namer")
+end
+
+local function testErrorNames()
+    assert(errorOf(function() local t = {} return t.a.b end) == "attempt to index field 'a' (a nil value)")
+    assert(errorOf(function() local t = { a = {} } return t.a.b.c end) == "attempt to index field 'b' (a nil value)")
+    assert(errorOf(function() local t = {} return t:nomethod() end) == "attempt to call method 'nomethod' (a nil value)")
+    assert(errorOf(function() return O.a.x:foo() end) == "attempt to index field 'x' (a nil value)")
+    assert(errorOf(function() return O.a:foo() end) == "attempt to call method 'foo' (a nil value)")
+    assert(errorOf(function() for i = 1, "x" do end end) == "'for' limit must be a number")
+    assert(errorOf(function() for i = 1, 2, {} do end end) == "'for' step must be a number")
+end
+
+local function collect(a, b, c)
+    local out = {}
+    if c then
+        for i = a, b, c do out[#out + 1] = i end
+    else
+        for i = a, b do out[#out + 1] = i end
+    end
+    return table.concat(out, ",")
+end
+
+local function testForLoops()
+    assert(collect(1, 3) == "1,2,3")
+    assert(collect(3, 3) == "3")
+    assert(collect(1, 0) == "")
+    assert(collect(10, 1, -3) == "10,7,4,1")
+    assert(collect(1, 3, -1) == "")
+    assert(collect(0, 1, 0.25) == "0,0.25,0.5,0.75,1")
+    assert(collect(1, 5, 2) == "1,3,5")
+
+    --Constant steps take FORLOOPINC, the same loops with variable steps do not
+    local out = {}
+    for i = 1, 5, 2 do out[#out + 1] = i end
+    for i = 0, 1, 0.5 do out[#out + 1] = i end
+    for i = 5, 1, -2 do out[#out + 1] = i end
+    assert(table.concat(out, ",") == "1,3,5,0,0.5,1,5,3,1")
+
+    --The loop variable is a copy
+    local n = 0
+    for i = 1, 3 do i = i * 10 n = n + i end
+    assert(n == 60)
+end
+
+local function testHooks()
+    --A line hook sees both lines, and the one inside get
+    local lines = {}
+    debug.sethook(function(e, l) lines[#lines + 1] = l end, "l")
+    local z = O.a.b.c
+    local w = O:get()
+    debug.sethook()
+    assert(#lines == 4)
+
+    --A count hook of 1 sees each half of a fused pair. The plain version runs the same
+    --instructions, apart from GETTABLE and GETUPVAL where SELF gets the method
+    local function counted(f)
+        local count = 0
+        debug.sethook(function() count = count + 1 end, "", 1)
+        f()
+        debug.sethook()
+        return count
+    end
+    local fused = counted(function() local x = O.a.b.c + O:get() end)
+    local plain = counted(function() local a = O.a local b = a.b local x = b.c + O.get(O) end)
+    assert(fused > 0 and fused == plain - 1)
+end
+
+local function testDump()
+    local function f(o)
+        local s = 0
+        for i = 1, 10 do s = s + o.a.b.c end
+        return s, o:get(2)
+    end
+    local g = loadstring(string.dump(f))
+    local s, v = g(O)
+    assert(s == 70 and v == 5)
+
+    --A constructor long enough for SETLIST's extra word, ahead of a chain
+    local src = { "local t = {" }
+    for i = 1, 30000 do src[#src + 1] = i .. "," end
+    src[#src + 1] = "} local q = { r = { s = 1 } } return #t, t[30000], q.r.s"
+    local h = loadstring(table.concat(src))
+    local a, b, c = loadstring(string.dump(h))()
+    assert(a == 30000 and b == 30000 and c == 1)
+end
+
+testFused()
+testErrorNames()
+testForLoops()
+testHooks()
+testDump()
+
+print("vm: ok")
@@ -0,0 +1,81 @@
+--
+--  watchdog_bench.lua
+--  Codea
+--
+--  Copyright 2012 Two Lives Left Pty. Ltd.
+--
+--  Licensed under the Apache License, Version 2.0 (the "License");
+--  you may not use this file except in compliance with the License.
+--  You may obtain a copy of the License at
+--
+--  http://www.apache.org/licenses/LICENSE-2.0
+--
+--  Unless required by applicable law or agreed to in writing, software
+--  distributed under the License is distributed on an "AS IS" BASIS,
+--  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+--  See the License for the specific language governing permissions and
+--  limitations under the License.
+--
+--  Throughput of host entries under each way of bounding them, using the
+--  same mix of method calls, table updates, a numeric loop and recursion:
+--
+--  no hook:     nothing installed, the ceiling
+--  count 30M:   the old setInstructionLimit hook (kMaxLineCount)
+--  count 1000:  a short always-on count hook, what a polling watchdog costs
+--  watchdog:    watchdog_enter/leave, hooked only once the deadline passes
+--
+--  The count hooks also turn off the fused GETTABLE2/SELFCALL opcodes, which
+--  fall back to the plain instructions whenever a count hook is set.
+--
+--  sh build.sh && build/luahost watchdog_bench.lua
+--
+
+local RUNS = 7
+
+local function work()
+    local Obj = {}
+    Obj.__index = Obj
+    function Obj.new()
+        return setmetatable({ pos = { x = 1, y = 2 }, vel = { x = 0.5, y = 0.25 }, n = 0 }, Obj)
+    end
+    function Obj:step(dt)
+        self.pos.x = self.pos.x + self.vel.x * dt
+        self.pos.y = self.pos.y + self.vel.y * dt
+        self.n = self.n + 1
+    end
+    function Obj:get() return self.pos.x + self.pos.y end
+
+    local objs = {}
+    for i = 1, 1000 do objs[i] = Obj.new() end
+    for frame = 1, 2000 do
+        for i = 1, #objs do objs[i]:step(0.016) end
+    end
+    local s = 0
+    for frame = 1, 500 do
+        for i = 1, #objs do s = s + objs[i]:get() end
+    end
+    local x = 0
+    for i = 1, 5000000 do x = x + i end
+    local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end
+    fib(27)
+end
+
+local modes = {
+    { "no hook", function() work() end },
+    { "count 30M", function() counthook(30000000) work() counthook(0) end },
+    { "count 1000", function() counthook(1000) work() counthook(0) end },
+    { "watchdog", function() assert(watched(work, 10)) end },
+}
+
+--modes take turns so drift in machine load hits them all alike
+local best = {}
+for run = 1, RUNS do
+    for i, mode in ipairs(modes) do
+        local start = now()
+        mode[2]()
+        best[i] = math.min(best[i] or math.huge, now() - start)
+    end
+end
+for i, mode in ipairs(modes) do
+    print(string.format("%-11s %8.1f ms  %+6.1f%%", mode[1], best[i] * 1000, (best[i] / best[1] - 1) * 100))
+end